@@ -0,0 +1,664 @@
+// core includes.
+#include "core/closest_point_query.h"
+#include "core/cpu_dispatch.h"
+#include "core/hausdorff.h"
+#include "core/memory.h"
+#include "core/mesh.h"
+#include "core/mesh_point_cloud.h"
+#include "core/query_engine.h"
+#include "core/scene_loader.h"
+#include "core/streaming_query.h"
+#include "core/trace.h"
+
+#include <glm/glm.hpp>
+
+// Standard includes.
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+//
+// Command line application.
+//
+// Load a mesh, build the closest point query objects, run queries
+// at random positions and print statistics. Doesn't need a display.
+//
+
+namespace
+{
+    struct Options
+    {
+        std::string     mesh_path = "resources/models/teapot.obj";
+        std::size_t     query_count = 1000;
+        float           max_distance = 10.0f;
+        core::QueryBackend backend = core::QueryBackend::KdTree;
+        core::BatchSchedule schedule = core::BatchSchedule::Sorted;
+        core::BvhBuildMethod bvh_build_method = core::BvhBuildMethod::Sah;
+        core::CpuIsa    isa = core::CpuIsa::Baseline;
+        bool            force_isa = false;  // use `isa` instead of the detected instruction set
+        bool            reorder_spatially = false;
+        bool            precompute_triangles = false;
+        bool            details = false;
+        std::size_t     k = 0;
+        float           contact_radius = 0.0f;
+        float           segment_length = 0.0f;
+        std::size_t     grid_size = 0;
+        std::string     compare_path;       // compare the mesh with this one instead of running queries
+        std::string     deviations_path;
+        std::string     trace_path;
+        std::string     split_path;         // split the mesh into this cluster file instead of running queries
+        std::string     clusters_path;      // run the queries on this cluster file instead of a mesh
+        std::size_t     cluster_size = core::default_cluster_size;
+        std::size_t     cache_size = 256;   // in MB
+        std::size_t     prefetch_distance = 0;
+
+        // Engine settings overriding the backend defaults, 0 when not set.
+        bool            double_precision = false;
+        std::size_t     index_bits = 0;
+        std::size_t     leaf_size = 0;
+        std::size_t     candidate_count = 0;
+    };
+
+    void print_usage()
+    {
+        std::cout
+            << "Usage: app.cli [options] [mesh file]\n"
+            << "Options:\n"
+            << "  --queries N     Number of random queries to run (default 1000)\n"
+            << "  --radius R      Maximum search distance (default 10)\n"
+            << "  --backend NAME  Acceleration structure: kdtree, bvh8, bvh16, wide4, wide8, heightfield, convex or auto (default kdtree)\n"
+            << "  --reorder       Sort triangles and vertices along a Morton curve on load\n"
+            << "  --precompute    Store per-triangle terms of the closest point computation\n"
+            << "  --double        Compute distances in double precision\n"
+            << "  --index-bits N  Width of the tree point indices: 32 or 64\n"
+            << "  --leaf-size N   Maximum number of points or triangles per leaf\n"
+            << "  --candidates N  Number of nearest points refined by the KDTree\n"
+            << "  --schedule NAME Batch schedule: sequential, sorted, packet or interleaved (default sorted)\n"
+            << "  --build NAME    BVH build: sah, lbvh or lbvh-treelets (default sah)\n"
+            << "  --isa NAME      Force the kernels: baseline, sse4.2, avx2 or avx512 (default detected)\n"
+            << "  --engines       List the available engine settings and exit\n"
+            << "  --details       Also get triangles, features and normals, and print feature counts\n"
+            << "  --k K           Also find the K closest triangles of each query\n"
+            << "  --contacts R    Also count the triangles within R of each query\n"
+            << "  --segments L    Also find the closest points to segments of length L from each query\n"
+            << "  --grid N        Also compute a N^3 distance volume, in a band of the search distance\n"
+            << "  --compare FILE  Compute the Hausdorff distances between the mesh and the one in FILE\n"
+            << "  --deviations F  With --compare, save the mesh vertex deviations in F (binary)\n"
+            << "  --trace FILE    Save a Chrome trace of all phases in FILE\n"
+            << "  --split FILE    Split the mesh into a cluster file for out-of-core queries and exit\n"
+            << "  --split-size N  With --split, triangles per cluster (default 4096)\n"
+            << "  --clusters F    Run the queries out of core on the cluster file F instead of a mesh\n"
+            << "  --cache MB      With --clusters, memory of the cluster cache (default 256)\n"
+            << "  --prefetch N    With --clusters, prefetch the clusters of the query N ahead (default 0, off)\n"
+            << "  --help          Show this message\n";
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const bool has_value = i + 1 < argc;
+
+            if (std::strcmp(argv[i], "--queries") == 0 && has_value)
+                options.query_count = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--radius") == 0 && has_value)
+                options.max_distance = std::strtof(argv[++i], nullptr);
+            else if (std::strcmp(argv[i], "--backend") == 0 && has_value)
+            {
+                if (!core::get_backend_from_name(argv[++i], options.backend))
+                    return false;
+            }
+            else if (std::strcmp(argv[i], "--schedule") == 0 && has_value)
+            {
+                if (!core::get_batch_schedule_from_name(argv[++i], options.schedule))
+                    return false;
+            }
+            else if (std::strcmp(argv[i], "--build") == 0 && has_value)
+            {
+                if (!core::get_bvh_build_method_from_name(argv[++i], options.bvh_build_method))
+                    return false;
+            }
+            else if (std::strcmp(argv[i], "--isa") == 0 && has_value)
+            {
+                if (!core::get_cpu_isa_from_name(argv[++i], options.isa))
+                    return false;
+
+                options.force_isa = true;
+            }
+            else if (std::strcmp(argv[i], "--reorder") == 0)
+                options.reorder_spatially = true;
+            else if (std::strcmp(argv[i], "--precompute") == 0)
+                options.precompute_triangles = true;
+            else if (std::strcmp(argv[i], "--double") == 0)
+                options.double_precision = true;
+            else if (std::strcmp(argv[i], "--index-bits") == 0 && has_value)
+                options.index_bits = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--leaf-size") == 0 && has_value)
+                options.leaf_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--candidates") == 0 && has_value)
+                options.candidate_count = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--details") == 0)
+                options.details = true;
+            else if (std::strcmp(argv[i], "--k") == 0 && has_value)
+                options.k = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--contacts") == 0 && has_value)
+                options.contact_radius = std::strtof(argv[++i], nullptr);
+            else if (std::strcmp(argv[i], "--segments") == 0 && has_value)
+                options.segment_length = std::strtof(argv[++i], nullptr);
+            else if (std::strcmp(argv[i], "--grid") == 0 && has_value)
+                options.grid_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--compare") == 0 && has_value)
+                options.compare_path = argv[++i];
+            else if (std::strcmp(argv[i], "--deviations") == 0 && has_value)
+                options.deviations_path = argv[++i];
+            else if (std::strcmp(argv[i], "--trace") == 0 && has_value)
+                options.trace_path = argv[++i];
+            else if (std::strcmp(argv[i], "--split") == 0 && has_value)
+                options.split_path = argv[++i];
+            else if (std::strcmp(argv[i], "--split-size") == 0 && has_value)
+                options.cluster_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--clusters") == 0 && has_value)
+                options.clusters_path = argv[++i];
+            else if (std::strcmp(argv[i], "--cache") == 0 && has_value)
+                options.cache_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--prefetch") == 0 && has_value)
+                options.prefetch_distance = std::strtoul(argv[++i], nullptr, 10);
+            else if (argv[i][0] != '-')
+                options.mesh_path = argv[i];
+            else
+                return false;
+        }
+
+        return options.max_distance > 0.0f && options.cluster_size > 0;
+    }
+
+    core::QueryEngineSettings get_engine_settings(const Options& options)
+    {
+        core::QueryEngineSettings settings = core::get_default_query_engine_settings(options.backend);
+        settings.precompute_triangles = options.precompute_triangles;
+        settings.bvh_build_method = options.bvh_build_method;
+
+        if (options.double_precision)
+            settings.scalar = core::ScalarType::Double;
+
+        if (options.index_bits > 0)
+            settings.index_bits = options.index_bits;
+
+        if (options.leaf_size > 0)
+            settings.leaf_size = options.leaf_size;
+
+        if (options.candidate_count > 0)
+            settings.candidate_count = options.candidate_count;
+
+        return settings;
+    }
+
+    void print_engine_settings(const core::QueryEngineSettings& settings)
+    {
+        std::cout << core::get_backend_name(settings.backend)
+            << " " << core::get_scalar_type_name(settings.scalar)
+            << ", " << settings.index_bits << "-bit indices"
+            << ", leaf size " << settings.leaf_size;
+
+        if (settings.backend == core::QueryBackend::KdTree)
+            std::cout << ", " << settings.candidate_count << " candidates";
+        else if (settings.backend != core::QueryBackend::Heightfield)
+            std::cout << ", " << core::get_bvh_build_method_name(settings.bvh_build_method) << " build";
+
+        std::cout << "\n";
+    }
+
+    void print_memory_usage(const char* title, const core::MemoryUsage& usage)
+    {
+        std::cout << "\t" << title << ": " << core::format_memory_size(usage.get_total_bytes()) << "\n";
+
+        for (const core::MemoryUsage::Component& component : usage.get_components())
+            std::cout << "\t\t" << component.name << ": " << core::format_memory_size(component.bytes)
+                << " (" << component.bytes << " bytes)\n";
+    }
+
+    void print_hausdorff_distance(const char* title, const core::HausdorffDistance& hausdorff, const core::Mesh& source)
+    {
+        std::cout << "\t" << title << ": " << hausdorff.distance
+            << " at vertex " << hausdorff.vertex
+            << " (" << hausdorff.query_count << " queries for " << source.get_vertices().size() << " vertices)\n";
+    }
+
+    /**
+     * @brief Compare two meshes: Hausdorff distances and deviations of the first one.
+     */
+    int run_comparison(
+        const Options&                  options,
+        const core::Mesh&               mesh,
+        const core::ClosestPointQuery&  closest_point_query)
+    {
+        const std::vector<core::Mesh> other_meshes = core::load_meshes_from_file(options.compare_path, options.reorder_spatially);
+
+        if (other_meshes.empty())
+        {
+            std::cerr << "No mesh in " << options.compare_path << ".\n";
+            return 2;
+        }
+
+        const core::Mesh& other_mesh = other_meshes[0];
+        const core::MeshPointCloud other_point_cloud(other_mesh);
+        const core::ClosestPointQuery other_query(other_point_cloud, get_engine_settings(options));
+
+        auto timer_start = std::chrono::high_resolution_clock::now();
+
+        const core::SymmetricHausdorffDistance hausdorff = core::compute_symmetric_hausdorff_distance(
+            mesh,
+            closest_point_query,
+            other_mesh,
+            other_query,
+            options.max_distance);
+
+        auto timer_stop = std::chrono::high_resolution_clock::now();
+        auto process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        std::cout << "Computed the Hausdorff distances in " << (process_time / 1000.0) << "ms.\n";
+        print_hausdorff_distance("Forward", hausdorff.forward, mesh);
+        print_hausdorff_distance("Backward", hausdorff.backward, other_mesh);
+        std::cout << "\tSymmetric: " << hausdorff.distance << "\n";
+
+        std::vector<float> deviations(mesh.get_vertices().size());
+
+        timer_start = std::chrono::high_resolution_clock::now();
+
+        const float max_deviation = core::compute_vertex_deviations(
+            mesh,
+            other_query,
+            options.max_distance,
+            deviations.data());
+
+        timer_stop = std::chrono::high_resolution_clock::now();
+        process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        double absolute_sum = 0.0;
+        for (const float deviation : deviations)
+            absolute_sum += std::abs(deviation);
+
+        std::cout << "Computed the vertex deviations in " << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tMaximum: " << max_deviation << "\n";
+        std::cout << "\tMean: " << (deviations.empty() ? 0.0 : absolute_sum / deviations.size()) << "\n";
+
+        if (!options.deviations_path.empty()
+            && core::write_vertex_deviations(options.deviations_path, deviations.data(), deviations.size()))
+        {
+            std::cout << "Saved the vertex deviations in " << options.deviations_path << ".\n";
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief Run the random queries out of core, on a cluster file.
+     */
+    int run_streaming_queries(const Options& options)
+    {
+        core::StreamingQuerySettings settings;
+        settings.cache_size = options.cache_size << 20;
+        settings.prefetch_distance = options.prefetch_distance;
+
+        const core::StreamingClosestPointQuery streaming_query(options.clusters_path, settings);
+
+        if (streaming_query.empty())
+            return 2;
+
+        // Same queries as in memory.
+        std::mt19937 random_engine(42);
+        std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+
+        std::vector<glm::vec3> query_points(options.query_count);
+        for (glm::vec3& query_point : query_points)
+            query_point = glm::vec3(distribution(random_engine), distribution(random_engine), distribution(random_engine));
+
+        std::vector<core::ClosestPointResult> results(options.query_count);
+        std::size_t found_count = 0;
+
+        auto timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("streaming queries");
+
+            found_count = streaming_query.get_closest_points(
+                query_points.data(),
+                query_points.size(),
+                options.max_distance,
+                results.data());
+        }
+
+        auto timer_stop = std::chrono::high_resolution_clock::now();
+        auto process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        const core::ClusterCacheStatistics statistics = streaming_query.get_cache_statistics();
+
+        std::cout << "Ran " << options.query_count << " queries (out of core) in " << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tFound: " << found_count << "\n";
+        std::cout << "Cluster cache (" << options.cache_size << " MB):\n";
+        std::cout << "\tHits: " << statistics.hits << "\n";
+        std::cout << "\tMisses: " << statistics.misses << "\n";
+        std::cout << "\tPrefetches: " << statistics.prefetches << " (" << statistics.prefetch_hits << " used)\n";
+        std::cout << "\tEvictions: " << statistics.evictions << "\n";
+        std::cout << "\tRead: " << core::format_memory_size(statistics.loaded_bytes) << "\n";
+        std::cout << "\tRead failures: " << statistics.read_failures << "\n";
+
+        std::cout << "Memory usage:\n";
+        print_memory_usage("Streaming query", streaming_query.get_memory_usage());
+
+        if (!options.trace_path.empty())
+            core::write_chrome_trace(options.trace_path);
+
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--engines") == 0)
+        {
+            for (const core::QueryEngineSettings& settings : core::get_query_engine_configurations())
+                print_engine_settings(settings);
+            return 0;
+        }
+    }
+
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage();
+        return 1;
+    }
+
+    core::set_tracing_enabled(!options.trace_path.empty());
+
+    // Before any engine is built: they keep their kernels.
+    if (options.force_isa)
+        core::force_cpu_isa(options.isa);
+
+    if (!options.clusters_path.empty())
+        return run_streaming_queries(options);
+
+    const std::vector<core::Mesh> meshes = core::load_meshes_from_file(options.mesh_path, options.reorder_spatially);
+
+    if (meshes.empty())
+    {
+        std::cerr << "No mesh in " << options.mesh_path << ".\n";
+        return 2;
+    }
+
+    const core::Mesh& mesh = meshes[0];
+
+    if (!options.split_path.empty())
+    {
+        const bool written = core::write_cluster_file(mesh, options.split_path, options.cluster_size);
+
+        if (!options.trace_path.empty())
+            core::write_chrome_trace(options.trace_path);
+
+        return written ? 0 : 2;
+    }
+
+    const core::MeshPointCloud mesh_point_cloud(mesh);
+    core::ClosestPointQuery closest_point_query(mesh_point_cloud, get_engine_settings(options));
+    closest_point_query.set_batch_schedule(options.schedule);
+
+    std::cout << "Query engine: ";
+    print_engine_settings(closest_point_query.get_settings());
+    std::cout << "Kernels: " << core::get_cpu_isa_name(core::get_cpu_isa())
+        << " (CPU supports " << core::get_cpu_isa_name(core::detect_cpu_isa()) << ")\n";
+
+    if (!options.compare_path.empty())
+    {
+        const int status = run_comparison(options, mesh, closest_point_query);
+
+        if (!options.trace_path.empty())
+            core::write_chrome_trace(options.trace_path);
+
+        return status;
+    }
+
+    // Run queries at random positions around the mesh (normalized in [-1, 1]).
+    std::mt19937 random_engine(42);
+    std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+
+    std::vector<glm::vec3> query_points(options.query_count);
+    for (glm::vec3& query_point : query_points)
+        query_point = glm::vec3(distribution(random_engine), distribution(random_engine), distribution(random_engine));
+
+    std::vector<glm::vec3> results;
+    std::vector<core::ClosestPointResult> detailed_results;
+    std::size_t found_count = 0;
+
+    if (options.details)
+        detailed_results.resize(options.query_count);
+    else
+        results.resize(options.query_count);
+
+    std::unique_ptr<bool[]> found_flags(new bool[options.query_count]);
+
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    {
+        CORE_TRACE_SCOPE("closest point queries");
+
+        if (options.details)
+        {
+            found_count = closest_point_query.get_closest_points(
+                query_points.data(),
+                query_points.size(),
+                options.max_distance,
+                detailed_results.data(),
+                found_flags.get());
+        }
+        else
+        {
+            found_count = closest_point_query.get_closest_points(
+                query_points.data(),
+                query_points.size(),
+                options.max_distance,
+                results.data());
+        }
+    }
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Ran " << options.query_count << " queries (" << core::get_batch_schedule_name(options.schedule)
+        << " batch) in " << (process_time / 1000.0) << "ms.\n";
+    std::cout << "\tFound: " << found_count << "\n";
+
+    if (options.details)
+    {
+        std::size_t feature_counts[3] = { 0, 0, 0 };
+
+        for (std::size_t i = 0; i < options.query_count; ++i)
+        {
+            if (found_flags[i])
+                ++feature_counts[static_cast<int>(detailed_results[i].feature)];
+        }
+
+        std::cout << "\tOn a vertex: " << feature_counts[0] << "\n";
+        std::cout << "\tOn an edge: " << feature_counts[1] << "\n";
+        std::cout << "\tInside a face: " << feature_counts[2] << "\n";
+    }
+
+    if (options.k > 0)
+    {
+        std::vector<core::ClosestPointResult> k_results(options.query_count * options.k);
+        std::size_t k_found_count = 0;
+
+        timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("k closest points queries");
+
+            k_found_count = closest_point_query.get_k_closest_points(
+                query_points.data(),
+                query_points.size(),
+                options.k,
+                options.max_distance,
+                k_results.data());
+        }
+
+        timer_stop = std::chrono::high_resolution_clock::now();
+        process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        std::cout << "Ran " << options.query_count << " " << options.k << "-closest queries in "
+            << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tFound: " << k_found_count << "\n";
+    }
+
+    if (options.contact_radius > 0.0f)
+    {
+        std::size_t contact_count = 0;
+        float distance2_sum = 0.0f;
+
+        timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("radius queries");
+
+            for (const glm::vec3& query_point : query_points)
+            {
+                contact_count += closest_point_query.for_each_triangle_in_radius(
+                    query_point,
+                    options.contact_radius,
+                    [&](const core::ClosestPointResult& result) { distance2_sum += result.distance2; });
+            }
+        }
+
+        timer_stop = std::chrono::high_resolution_clock::now();
+        process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        std::cout << "Ran " << options.query_count << " radius queries in " << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tTriangles: " << contact_count << "\n";
+
+        if (contact_count > 0)
+            std::cout << "\tMean distance: " << std::sqrt(distance2_sum / contact_count) << " (RMS)\n";
+    }
+
+    if (options.segment_length > 0.0f)
+    {
+        // Segments from each query point in a random direction.
+        std::vector<glm::vec3> segment_ends(options.query_count);
+        for (std::size_t i = 0; i < options.query_count; ++i)
+        {
+            glm::vec3 direction(distribution(random_engine), distribution(random_engine), distribution(random_engine));
+            if (glm::dot(direction, direction) == 0.0f)
+                direction = glm::vec3(1.0f, 0.0f, 0.0f);
+
+            segment_ends[i] = query_points[i] + glm::normalize(direction) * options.segment_length;
+        }
+
+        std::vector<core::SegmentClosestPointResult> segment_results(options.query_count);
+        std::size_t segment_found_count = 0;
+        std::size_t crossing_count = 0;
+
+        timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("segment queries");
+
+            segment_found_count = closest_point_query.get_closest_points_to_segments(
+                query_points.data(),
+                segment_ends.data(),
+                options.query_count,
+                options.max_distance,
+                segment_results.data(),
+                found_flags.get());
+        }
+
+        timer_stop = std::chrono::high_resolution_clock::now();
+        process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        for (std::size_t i = 0; i < options.query_count; ++i)
+        {
+            if (found_flags[i] && segment_results[i].mesh.distance2 == 0.0f)
+                ++crossing_count;
+        }
+
+        std::cout << "Ran " << options.query_count << " segment queries in " << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tFound: " << segment_found_count << "\n";
+        std::cout << "\tCrossing the mesh: " << crossing_count << "\n";
+    }
+
+    if (options.grid_size > 0)
+    {
+        // Same bounds as the random queries.
+        core::RegularGrid grid;
+        grid.origin = glm::vec3(-1.5f);
+        grid.spacing = glm::vec3(options.grid_size > 1 ? 3.0f / (options.grid_size - 1) : 0.0f);
+        grid.dimensions[0] = grid.dimensions[1] = grid.dimensions[2] = options.grid_size;
+        grid.band_width = options.max_distance;
+
+        const std::size_t voxel_count = options.grid_size * options.grid_size * options.grid_size;
+        std::vector<float> distances(voxel_count);
+        std::size_t in_band_count = 0;
+
+        timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("grid query");
+            in_band_count = closest_point_query.get_closest_points_on_grid(grid, distances.data());
+        }
+
+        timer_stop = std::chrono::high_resolution_clock::now();
+        process_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+        std::cout << "Computed a " << options.grid_size << "^3 grid in " << (process_time / 1000.0) << "ms.\n";
+        std::cout << "\tIn the band: " << in_band_count << " of " << voxel_count << "\n";
+
+        // Check the voxels against one query each, e.g. those on the faces
+        // of a mesh lying on grid planes.
+        std::vector<glm::vec3> voxel_points(voxel_count);
+        for (std::size_t z = 0, i = 0; z < options.grid_size; ++z)
+            for (std::size_t y = 0; y < options.grid_size; ++y)
+                for (std::size_t x = 0; x < options.grid_size; ++x, ++i)
+                    voxel_points[i] = grid.origin + grid.spacing * glm::vec3(x, y, z);
+
+        std::vector<core::ClosestPointResult> voxel_results(voxel_count);
+        std::unique_ptr<bool[]> voxel_found(new bool[voxel_count]);
+        closest_point_query.get_closest_points(
+            voxel_points.data(), voxel_count, grid.band_width, voxel_results.data(), voxel_found.get());
+
+        std::size_t mismatch_count = 0;
+        for (std::size_t i = 0; i < voxel_count; ++i)
+        {
+            if (voxel_found[i] != std::isfinite(distances[i])
+                || (voxel_found[i] && std::abs(std::sqrt(voxel_results[i].distance2) - distances[i]) > 1e-5f))
+                ++mismatch_count;
+        }
+
+        std::cout << "\tMismatches with single queries: " << mismatch_count << "\n";
+    }
+
+    std::cout << "Memory usage:\n";
+    print_memory_usage("Mesh", mesh.get_memory_usage());
+    print_memory_usage("Point cloud", mesh_point_cloud.get_memory_usage());
+    print_memory_usage("Query index", closest_point_query.get_memory_usage());
+
+    std::cout << "Allocated (all objects):\n";
+    for (std::size_t i = 0; i < static_cast<std::size_t>(core::MemoryCategory::Count); ++i)
+    {
+        const core::MemoryCategory category = static_cast<core::MemoryCategory>(i);
+        std::cout << "\t" << core::get_memory_category_name(category) << ": "
+            << core::format_memory_size(core::get_allocated_bytes(category))
+            << " (peak " << core::format_memory_size(core::get_peak_allocated_bytes(category)) << ")\n";
+    }
+
+    if (!options.trace_path.empty())
+        core::write_chrome_trace(options.trace_path);
+
+    return 0;
+}
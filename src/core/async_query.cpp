@@ -0,0 +1,153 @@
+#include "async_query.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace core
+{
+
+namespace
+{
+
+// Queries per worker task: large enough to amortize the task overhead,
+// small enough to spread a batch over all the workers.
+const std::size_t batch_chunk_size = 256;
+
+struct BatchState
+{
+    std::atomic<std::size_t>                    remaining_chunks;
+    std::atomic<std::size_t>                    found_count;
+    AsyncClosestPointQuery::BatchCallback       callback;
+};
+
+} // namespace
+
+AsyncClosestPointQuery::AsyncClosestPointQuery(
+    const ClosestPointQuery&    query,
+    const std::size_t           thread_count)
+  : m_query(query)
+  , m_pool(thread_count)
+{
+}
+
+AsyncClosestPointQuery::~AsyncClosestPointQuery()
+{
+    wait();
+}
+
+std::future<AsyncClosestPoint> AsyncClosestPointQuery::get_closest_point(
+    const glm::vec3&    query_point,
+    const float         max_distance)
+{
+    // std::function needs a copyable callable.
+    std::shared_ptr<std::promise<AsyncClosestPoint>> promise =
+        std::make_shared<std::promise<AsyncClosestPoint>>();
+
+    std::future<AsyncClosestPoint> future = promise->get_future();
+
+    get_closest_point(query_point, max_distance, [promise](const AsyncClosestPoint& closest_point)
+    {
+        promise->set_value(closest_point);
+    });
+
+    return future;
+}
+
+void AsyncClosestPointQuery::get_closest_point(
+    const glm::vec3&    query_point,
+    const float         max_distance,
+    Callback            callback)
+{
+    const ClosestPointQuery& query = m_query;
+
+    m_pool.submit([&query, query_point, max_distance, callback]()
+    {
+        CORE_TRACE_SCOPE("async closest point query");
+
+        AsyncClosestPoint closest_point;
+        closest_point.found = query.get_closest_point(query_point, max_distance, closest_point.result);
+        callback(closest_point);
+    });
+}
+
+std::future<std::size_t> AsyncClosestPointQuery::get_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance,
+    ClosestPointResult* results,
+    bool*               found)
+{
+    std::shared_ptr<std::promise<std::size_t>> promise =
+        std::make_shared<std::promise<std::size_t>>();
+
+    std::future<std::size_t> future = promise->get_future();
+
+    get_closest_points(query_points, count, max_distance, results, found, [promise](const std::size_t found_count)
+    {
+        promise->set_value(found_count);
+    });
+
+    return future;
+}
+
+void AsyncClosestPointQuery::get_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance,
+    ClosestPointResult* results,
+    bool*               found,
+    BatchCallback       callback)
+{
+    const std::size_t chunk_count = (count + batch_chunk_size - 1) / batch_chunk_size;
+
+    if (chunk_count == 0)
+    {
+        m_pool.submit([callback]() { callback(0); });
+        return;
+    }
+
+    std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+    state->remaining_chunks = chunk_count;
+    state->found_count = 0;
+    state->callback = std::move(callback);
+
+    const ClosestPointQuery& query = m_query;
+
+    for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        const std::size_t first = chunk * batch_chunk_size;
+        const std::size_t chunk_size = std::min(batch_chunk_size, count - first);
+
+        m_pool.submit([&query, state, query_points, results, found, first, chunk_size, max_distance]()
+        {
+            CORE_TRACE_SCOPE("async closest point queries");
+
+            state->found_count += query.get_closest_points(
+                query_points + first,
+                chunk_size,
+                max_distance,
+                results + first,
+                found ? found + first : nullptr);
+
+            // The last chunk to finish completes the batch.
+            if (--state->remaining_chunks == 0)
+                state->callback(state->found_count);
+        });
+    }
+}
+
+void AsyncClosestPointQuery::wait()
+{
+    m_pool.wait_idle();
+}
+
+const ClosestPointQuery& AsyncClosestPointQuery::get_query() const
+{
+    return m_query;
+}
+
+} // namespace core
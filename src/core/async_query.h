@@ -0,0 +1,90 @@
+#pragma once
+
+#include "closest_point_query.h"
+#include "parallel.h"
+#include "query_engine.h"
+#include "thread_pool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <future>
+
+namespace core
+{
+
+/**
+ * @brief Outcome of an asynchronous single query.
+ */
+struct AsyncClosestPoint
+{
+    bool                found = false;
+    ClosestPointResult  result;
+};
+
+/**
+ * @brief Run closest point queries on a persistent worker pool, without blocking the caller.
+ *
+ * Each call returns right away, with a future or a completion callback.
+ * Callbacks run on a worker thread. Batches are split across the workers.
+ *
+ * The query object must outlive this one, and batch buffers must stay
+ * valid until the batch completes. The destructor waits for the
+ * submitted queries.
+ */
+class AsyncClosestPointQuery
+{
+  public:
+    typedef std::function<void(const AsyncClosestPoint&)>   Callback;
+    typedef std::function<void(const std::size_t)>          BatchCallback; // number of points found
+
+    explicit AsyncClosestPointQuery(
+        const ClosestPointQuery&    query,
+        const std::size_t           thread_count = get_thread_count());
+
+    ~AsyncClosestPointQuery();
+
+    AsyncClosestPointQuery(const AsyncClosestPointQuery&) = delete;
+    AsyncClosestPointQuery& operator=(const AsyncClosestPointQuery&) = delete;
+
+    std::future<AsyncClosestPoint> get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance);
+
+    void get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        Callback            callback);
+
+    /**
+     * @brief Same as `ClosestPointQuery::get_closest_points`. The future gets the number of points found.
+     */
+    std::future<std::size_t> get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found);
+
+    void get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found,
+        BatchCallback       callback);
+
+    /**
+     * @brief Wait until all the submitted queries are done.
+     */
+    void wait();
+
+    const ClosestPointQuery& get_query() const;
+
+  private:
+    const ClosestPointQuery&    m_query;
+    ThreadPool                  m_pool;
+};
+
+} // namespace core
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+namespace core
+{
+
+/**
+ * @brief Keep the `capacity` smallest values pushed, in caller-provided storage.
+ *
+ * A max-heap: the largest kept value is on top, so a new value is compared
+ * to it only. Nothing is allocated, the storage can be a scratch buffer
+ * reused from one query to the next.
+ */
+template <typename T, typename Less>
+class BoundedPriorityQueue
+{
+  public:
+    BoundedPriorityQueue(
+        T*                  storage,
+        const std::size_t   capacity,
+        const Less&         less = Less())
+      : m_storage(storage)
+      , m_capacity(capacity)
+      , m_size(0)
+      , m_less(less)
+    {
+    }
+
+    /**
+     * @brief Add a value if it is smaller than the largest kept one,
+     * or if the queue is not full. Return true if it was added.
+     */
+    inline bool push(const T& value)
+    {
+        if (m_size < m_capacity)
+        {
+            m_storage[m_size++] = value;
+            std::push_heap(m_storage, m_storage + m_size, m_less);
+            return true;
+        }
+
+        if (m_capacity == 0 || !m_less(value, m_storage[0]))
+            return false;
+
+        std::pop_heap(m_storage, m_storage + m_size, m_less);
+        m_storage[m_size - 1] = value;
+        std::push_heap(m_storage, m_storage + m_size, m_less);
+        return true;
+    }
+
+    inline bool is_full() const
+    {
+        return m_size == m_capacity;
+    }
+
+    /**
+     * @brief Largest kept value.
+     */
+    inline const T& top() const
+    {
+        assert(m_size > 0);
+        return m_storage[0];
+    }
+
+    inline std::size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief Sort the kept values in increasing order, at the start of the storage.
+     *
+     * The queue must not be used anymore afterwards.
+     */
+    inline std::size_t sort()
+    {
+        std::sort_heap(m_storage, m_storage + m_size, m_less);
+        return m_size;
+    }
+
+  private:
+    T*                  m_storage;
+    const std::size_t   m_capacity;
+    std::size_t         m_size;
+    Less                m_less;
+};
+
+} // namespace core
@@ -0,0 +1,181 @@
+#include "bvh.h"
+
+#include "bvh_builder.h"
+#include "math.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    //
+    // Quantization, see bvh.h.
+    //
+
+    /**
+     * @brief Largest value that decodes to a position lower or equal to `position`.
+     */
+    template <typename Quantized>
+    Quantized quantize_down(const float box_min, const float scale, const float position)
+    {
+        if (scale == 0.0f)
+            return 0;
+
+        const float max_value = static_cast<float>(std::numeric_limits<Quantized>::max());
+        std::uint32_t value = static_cast<std::uint32_t>(
+            glm::clamp(std::floor((position - box_min) / scale), 0.0f, max_value));
+
+        while (value > 0 && dequantize(box_min, scale, value) > position)
+            --value;
+
+        assert(dequantize(box_min, scale, value) <= position);
+        return static_cast<Quantized>(value);
+    }
+
+    /**
+     * @brief Smallest value that decodes to a position greater or equal to `position`.
+     */
+    template <typename Quantized>
+    Quantized quantize_up(const float box_min, const float scale, const float position)
+    {
+        if (scale == 0.0f)
+            return 0;
+
+        const std::uint32_t max_value = std::numeric_limits<Quantized>::max();
+        std::uint32_t value = static_cast<std::uint32_t>(
+            glm::clamp(std::ceil((position - box_min) / scale), 0.0f, static_cast<float>(max_value)));
+
+        while (value < max_value && dequantize(box_min, scale, value) < position)
+            ++value;
+
+        assert(dequantize(box_min, scale, value) >= position);
+        return static_cast<Quantized>(value);
+    }
+
+    /**
+     * @brief Encode the build tree in compact nodes, depth first, siblings side by side.
+     */
+    template <typename Quantized, typename NodeArray>
+    void encode_node(
+        const std::vector<BuildNode>&   build_nodes,
+        const std::uint32_t             build_index,
+        const std::uint32_t             node_index,
+        const glm::vec3&                box_min,
+        const glm::vec3&                box_max,
+        NodeArray&                      nodes)
+    {
+        const BuildNode& build_node = build_nodes[build_index];
+
+        if (build_node.is_leaf)
+        {
+            nodes[node_index].first_child = 0;
+            nodes[node_index].leaf.first_primitive = build_node.first_primitive;
+            nodes[node_index].leaf.primitive_count = build_node.primitive_count;
+            return;
+        }
+
+        const std::uint32_t first_child = static_cast<std::uint32_t>(nodes.size());
+        nodes.resize(nodes.size() + 2);
+        nodes[node_index].first_child = first_child;
+
+        const glm::vec3 scale = get_quantization_scale<Quantized>(box_min, box_max);
+
+        for (std::size_t c = 0; c < 2; ++c)
+        {
+            const BuildBounds& child = build_nodes[build_node.children[c]].bounds;
+            Quantized* child_bounds = nodes[node_index].child_bounds[c];
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                child_bounds[axis] = quantize_down<Quantized>(box_min[axis], scale[axis], child.min[axis]);
+                child_bounds[axis + 3] = quantize_up<Quantized>(box_min[axis], scale[axis], child.max[axis]);
+            }
+
+            glm::vec3 child_min, child_max;
+            decode_child_bounds(child_bounds, box_min, scale, child_min, child_max);
+
+            encode_node<Quantized>(
+                build_nodes,
+                build_node.children[c],
+                first_child + static_cast<std::uint32_t>(c),
+                child_min,
+                child_max,
+                nodes);
+        }
+    }
+}
+
+template <typename Quantized>
+CompactBvh<Quantized>::CompactBvh(
+    const MeshPointCloud&   mesh_point_cloud,
+    const std::size_t       leaf_max_size,
+    const bool              precompute_triangles,
+    const BvhBuildMethod    build_method)
+  : m_mesh_point_cloud(mesh_point_cloud)
+{
+    CORE_TRACE_SCOPE("CompactBvh build");
+
+    // Start a timer to know how long it takes to build the hierarchy.
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    if (m_mesh_point_cloud.get_triangle_count() > 0)
+    {
+        const BvhBuilder builder(m_mesh_point_cloud, leaf_max_size, build_method);
+        const std::vector<BuildNode>& build_nodes = builder.get_nodes();
+
+        m_primitives.assign(builder.get_primitives().begin(), builder.get_primitives().end());
+
+        m_root_min = build_nodes[0].bounds.min;
+        m_root_max = build_nodes[0].bounds.max;
+
+        m_nodes.reserve(build_nodes.size());
+        m_nodes.resize(1);
+        encode_node<Quantized>(build_nodes, 0, 0, m_root_min, m_root_max, m_nodes);
+
+        if (precompute_triangles)
+            m_precomputed_triangles.reset(new PrecomputedTriangles(mesh_point_cloud, builder.get_primitives()));
+    }
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Generated mesh BVH (" << sizeof(Quantized) * 8 << "-bit nodes) in " << process_time << "ms.\n";
+    std::cout << "\tNode count: " << m_nodes.size() << "\n";
+}
+
+template <typename Quantized>
+std::size_t CompactBvh<Quantized>::get_node_count() const
+{
+    return m_nodes.size();
+}
+
+template <typename Quantized>
+MemoryUsage CompactBvh<Quantized>::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("bvh nodes", get_heap_bytes(m_nodes));
+    usage.add("bvh triangle indices", get_heap_bytes(m_primitives));
+
+    if (m_precomputed_triangles)
+        usage.add("precomputed triangles", m_precomputed_triangles->get_memory_usage().get_total_bytes());
+
+    return usage;
+}
+
+static_assert(bvh_max_build_depth + 2 <= CompactBvh8::max_stack_size, "traversal stack too small");
+
+// Supported quantizations.
+template class CompactBvh<std::uint8_t>;
+template class CompactBvh<std::uint16_t>;
+
+} // namespace core
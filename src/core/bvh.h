@@ -0,0 +1,644 @@
+#pragma once
+
+#include "bvh_builder.h"
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+#include "precomputed_triangles.h"
+
+#include <glm/glm.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace core
+{
+
+/**
+ * @brief Bounding volume hierarchy of the mesh triangles with compact nodes.
+ *
+ * Each node stores the bounds of its two children, quantized on 8 or 16 bits
+ * relative to its own bounds, and 32-bit offsets. Nodes are 16 bytes (8 bits)
+ * or 32 bytes (16 bits) so that they never straddle a cache line.
+ *
+ * Quantized bounds are rounded outwards at build time and decoded with the
+ * exact same operations during traversal, so the decoded boxes always contain
+ * the triangles: results are exact, only a few more boxes may be visited.
+ *
+ * Unlike the KDTree of `ClosestPointQuery`, the hierarchy is built on
+ * triangles, so it doesn't require a uniform mesh.
+ *
+ * Reference:
+ *  - Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs
+ *    Henri Ylitie, Tero Karras, Samuli Laine, HPG 2017
+ */
+template <typename Quantized>
+class CompactBvh
+{
+  public:
+    /**
+     * @brief Hierarchy node.
+     *
+     * The second child is always stored right after the first one.
+     * The root node is never a child, so `first_child == 0` marks leaves.
+     */
+    struct alignas(sizeof(Quantized) * 16) Node
+    {
+        union
+        {
+            // Children bounds: min x, y, z then max x, y, z.
+            Quantized child_bounds[2][6];
+
+            struct
+            {
+                std::uint32_t first_primitive;
+                std::uint32_t primitive_count;
+            } leaf;
+        };
+
+        std::uint32_t first_child;
+
+        inline bool is_leaf() const
+        {
+            return first_child == 0;
+        }
+    };
+
+    static_assert(sizeof(Node) == 16 || sizeof(Node) == 32, "BVH nodes must pack into cache lines");
+
+    // The build turns deeper nodes into leaves so that traversal fits in this stack.
+    static const std::size_t max_stack_size = 64;
+
+    /**
+     * @brief Build the hierarchy.
+     *
+     * With `precompute_triangles`, the terms of the closest point computation
+     * are stored for every triangle, in leaf order (see `PrecomputedTriangles`).
+     * `build_method` trades build time for query time, see `BvhBuilder`.
+     */
+    CompactBvh(
+        const MeshPointCloud&   mesh_point_cloud,
+        const std::size_t       leaf_max_size = 4,
+        const bool              precompute_triangles = false,
+        const BvhBuildMethod    build_method = BvhBuildMethod::Sah);
+
+    /**
+     * @brief Visit the leaves closer than `closest_distance2`, nearest first.
+     *
+     * `visit_leaf(first, count, closest_distance2)` is called for each visited
+     * leaf, with the range of its primitives (see `get_primitive`). It may
+     * lower `closest_distance2` to prune the remaining nodes.
+     *
+     * `Vec3` is `glm::vec3` or `glm::dvec3`. Boxes are always decoded in
+     * single precision, like at build time.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_nearest(
+        const Vec3&                     query_point,
+        typename Vec3::value_type&      closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Same as above, for any query shape.
+     *
+     * `box_distance2(min, max)` returns a lower bound of the squared distance
+     * between the query and the box, as a `Scalar`.
+     */
+    template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+    void traverse_closest(
+        const BoxDistance&              box_distance2,
+        Scalar&                         closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Visit the leaves needed by a packet of nearby queries, in one traversal.
+     *
+     * A node is visited while it is closer than `closest_distance2` for at
+     * least one lane, children nearest first for the lanes that need them.
+     * `visit_leaf(first, count, leaf_distance2, closest_distance2)` gets the
+     * squared distance of every lane to the leaf and may lower any lane of
+     * `closest_distance2`. Lanes with a bound of 0 never need a node.
+     */
+    template <typename Scalar, std::size_t Width, typename LeafVisitor>
+    void traverse_packet(
+        const PointPacket<Scalar, Width>&   packet,
+        Scalar                              (&closest_distance2)[Width],
+        LeafVisitor&                        visit_leaf) const;
+
+    /**
+     * @brief Suspended `traverse_nearest`, for traversals interleaved on one thread.
+     */
+    template <typename Scalar>
+    struct NearestTraversal
+    {
+        struct StackEntry
+        {
+            std::uint32_t   node;
+            Scalar          distance2;  // to the node bounds
+            glm::vec3       min;
+            glm::vec3       max;
+        };
+
+        StackEntry      stack[max_stack_size];
+        std::size_t     stack_size;
+    };
+
+    /**
+     * @brief Start a `traverse_nearest` that runs one node per `step_nearest` call.
+     */
+    template <typename Vec3>
+    void start_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal) const;
+
+    /**
+     * @brief Process the next node of the traversal, then prefetch the following one.
+     *
+     * Same visits as `traverse_nearest`, in the same order. Return false once
+     * the traversal is over. Between two calls, the caller is expected to work
+     * on other traversals while the prefetched node is loaded (AMAC).
+     *
+     * Reference:
+     *  - Asynchronous Memory Access Chaining
+     *    Onur Kocberber, Babak Falsafi, Boris Grot, VLDB 2015
+     */
+    template <typename Vec3, typename LeafVisitor>
+    bool step_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal,
+        typename Vec3::value_type&                                  closest_distance2,
+        LeafVisitor&                                                visit_leaf) const;
+
+    /**
+     * @brief Visit the leaves a ray enters before `max_t`, nearest entry first.
+     *
+     * `visit_leaf(first, count, max_t)` is called for each visited leaf and
+     * may lower `max_t`, e.g. to the nearest hit so far.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_ray(
+        const Vec3&                     origin,
+        const Vec3&                     direction,
+        typename Vec3::value_type&      max_t,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Triangle index of the primitive at `index`, in leaf order.
+     */
+    inline std::uint32_t get_primitive(const std::size_t index) const
+    {
+        return m_primitives[index];
+    }
+
+    /**
+     * @brief Precomputed triangles in leaf order, or nullptr.
+     */
+    inline const PrecomputedTriangles* get_precomputed_triangles() const
+    {
+        return m_precomputed_triangles.get();
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_mesh_point_cloud;
+    }
+
+    std::size_t get_node_count() const;
+
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    typedef TrackedVector<Node, MemoryCategory::QueryIndex> NodeArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryIndex> PrimitiveArray;
+
+    const MeshPointCloud&   m_mesh_point_cloud;
+    glm::vec3               m_root_min;
+    glm::vec3               m_root_max;
+    NodeArray               m_nodes;
+
+    // Triangle indices, in leaf order.
+    PrimitiveArray          m_primitives;
+
+    // Optional, in leaf order too.
+    std::unique_ptr<PrecomputedTriangles> m_precomputed_triangles;
+};
+
+typedef CompactBvh<std::uint8_t> CompactBvh8;
+typedef CompactBvh<std::uint16_t> CompactBvh16;
+
+//
+// Quantization.
+//
+// Children bounds are stored as integers `q` relative to the parent bounds:
+//   value = parent_min + q * scale
+// where `scale` is the smallest power of two such that `q_max * scale`
+// covers the parent extent. With a power of two, `q * scale` is exact and
+// the only rounding is in the addition, which is monotonic: the largest
+// `q` always decodes to a value >= parent_max. Build and traversal use
+// these same functions, so decoded bounds are bit-identical in both.
+//
+
+/**
+ * @brief Smallest power of two greater or equal to `value`.
+ */
+inline float round_up_to_power_of_two(const float value);
+
+/**
+ * @brief Per-axis scale of the children bounds of a node with the given bounds.
+ */
+template <typename Quantized>
+inline glm::vec3 get_quantization_scale(const glm::vec3& box_min, const glm::vec3& box_max);
+
+inline float dequantize(const float box_min, const float scale, const std::uint32_t value);
+
+template <typename Quantized>
+inline void decode_child_bounds(
+    const Quantized     child_bounds[6],
+    const glm::vec3&    box_min,
+    const glm::vec3&    scale,
+    glm::vec3&          child_min,
+    glm::vec3&          child_max);
+
+
+//
+// Implementation.
+//
+
+float round_up_to_power_of_two(const float value)
+{
+    assert(value >= 0.0f);
+
+    if (value == 0.0f)
+        return 0.0f;
+
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    // Non-zero mantissa: clear it and go to the next exponent.
+    if (bits & 0x007FFFFFu)
+        bits = (bits & 0xFF800000u) + 0x00800000u;
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return std::max(result, std::numeric_limits<float>::min());
+}
+
+template <typename Quantized>
+glm::vec3 get_quantization_scale(const glm::vec3& box_min, const glm::vec3& box_max)
+{
+    const float max_value = static_cast<float>(std::numeric_limits<Quantized>::max());
+    const glm::vec3 extent = box_max - box_min;
+
+    return glm::vec3(
+        round_up_to_power_of_two(extent.x / max_value),
+        round_up_to_power_of_two(extent.y / max_value),
+        round_up_to_power_of_two(extent.z / max_value));
+}
+
+float dequantize(const float box_min, const float scale, const std::uint32_t value)
+{
+    return box_min + static_cast<float>(value) * scale;
+}
+
+template <typename Quantized>
+void decode_child_bounds(
+    const Quantized     child_bounds[6],
+    const glm::vec3&    box_min,
+    const glm::vec3&    scale,
+    glm::vec3&          child_min,
+    glm::vec3&          child_max)
+{
+    child_min.x = dequantize(box_min.x, scale.x, child_bounds[0]);
+    child_min.y = dequantize(box_min.y, scale.y, child_bounds[1]);
+    child_min.z = dequantize(box_min.z, scale.z, child_bounds[2]);
+    child_max.x = dequantize(box_min.x, scale.x, child_bounds[3]);
+    child_max.y = dequantize(box_min.y, scale.y, child_bounds[4]);
+    child_max.z = dequantize(box_min.z, scale.z, child_bounds[5]);
+}
+
+template <typename Quantized>
+template <typename Vec3, typename LeafVisitor>
+void CompactBvh<Quantized>::traverse_nearest(
+    const Vec3&                     query_point,
+    typename Vec3::value_type&      closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    const auto box_distance2 = [&query_point](const glm::vec3& box_min, const glm::vec3& box_max)
+    {
+        return distance2_to_box(query_point, Vec3(box_min), Vec3(box_max));
+    };
+
+    traverse_closest(box_distance2, closest_distance2, visit_leaf);
+}
+
+template <typename Quantized>
+template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+void CompactBvh<Quantized>::traverse_closest(
+    const BoxDistance&              box_distance2,
+    Scalar&                         closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    struct StackEntry
+    {
+        std::uint32_t   node;
+        Scalar          distance2;  // to the node bounds
+        glm::vec3       min;
+        glm::vec3       max;
+    };
+
+    if (m_nodes.empty())
+        return;
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    stack[stack_size++] = {
+        0,
+        box_distance2(m_root_min, m_root_max),
+        m_root_min,
+        m_root_max };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer point was found since this node was pushed.
+        if (entry.distance2 >= closest_distance2)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+
+        if (node.is_leaf())
+        {
+            visit_leaf(node.leaf.first_primitive, node.leaf.primitive_count, closest_distance2);
+            continue;
+        }
+
+        const glm::vec3 scale = get_quantization_scale<Quantized>(entry.min, entry.max);
+
+        StackEntry children[2];
+
+        for (std::uint32_t c = 0; c < 2; ++c)
+        {
+            children[c].node = node.first_child + c;
+            decode_child_bounds(node.child_bounds[c], entry.min, scale, children[c].min, children[c].max);
+            children[c].distance2 = box_distance2(children[c].min, children[c].max);
+        }
+
+        // Visit the nearest child first: push it last.
+        const std::size_t nearest = children[1].distance2 < children[0].distance2 ? 1 : 0;
+        const std::size_t farthest = 1 - nearest;
+
+        assert(stack_size + 2 <= max_stack_size);
+
+        if (children[farthest].distance2 < closest_distance2)
+            stack[stack_size++] = children[farthest];
+
+        if (children[nearest].distance2 < closest_distance2)
+            stack[stack_size++] = children[nearest];
+    }
+}
+
+template <typename Quantized>
+template <typename Scalar, std::size_t Width, typename LeafVisitor>
+void CompactBvh<Quantized>::traverse_packet(
+    const PointPacket<Scalar, Width>&   packet,
+    Scalar                              (&closest_distance2)[Width],
+    LeafVisitor&                        visit_leaf) const
+{
+    struct StackEntry
+    {
+        std::uint32_t   node;
+        glm::vec3       min;
+        glm::vec3       max;
+        Scalar          distance2[Width];   // of every lane to the node bounds
+    };
+
+    if (m_nodes.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    StackEntry& root = stack[stack_size++];
+    root.node = 0;
+    root.min = m_root_min;
+    root.max = m_root_max;
+    distance2_to_box(packet, m_root_min, m_root_max, root.distance2);
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // Closer points were found for every lane since this node was pushed.
+        if (get_min_distance2_below(entry.distance2, closest_distance2) == infinity)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+
+        if (node.is_leaf())
+        {
+            visit_leaf(node.leaf.first_primitive, node.leaf.primitive_count, entry.distance2, closest_distance2);
+            continue;
+        }
+
+        const glm::vec3 scale = get_quantization_scale<Quantized>(entry.min, entry.max);
+
+        StackEntry children[2];
+        Scalar nearest_lane_distance2[2];
+
+        for (std::uint32_t c = 0; c < 2; ++c)
+        {
+            children[c].node = node.first_child + c;
+            decode_child_bounds(node.child_bounds[c], entry.min, scale, children[c].min, children[c].max);
+            distance2_to_box(packet, children[c].min, children[c].max, children[c].distance2);
+            nearest_lane_distance2[c] = get_min_distance2_below(children[c].distance2, closest_distance2);
+        }
+
+        // Visit the nearest child first: push it last.
+        const std::size_t nearest = nearest_lane_distance2[1] < nearest_lane_distance2[0] ? 1 : 0;
+        const std::size_t farthest = 1 - nearest;
+
+        assert(stack_size + 2 <= max_stack_size);
+
+        if (nearest_lane_distance2[farthest] < infinity)
+            stack[stack_size++] = children[farthest];
+
+        if (nearest_lane_distance2[nearest] < infinity)
+            stack[stack_size++] = children[nearest];
+    }
+}
+
+template <typename Quantized>
+template <typename Vec3>
+void CompactBvh<Quantized>::start_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal) const
+{
+    traversal.stack_size = 0;
+
+    if (m_nodes.empty())
+        return;
+
+    traversal.stack[traversal.stack_size++] = {
+        0,
+        distance2_to_box(query_point, Vec3(m_root_min), Vec3(m_root_max)),
+        m_root_min,
+        m_root_max };
+
+    prefetch(&m_nodes[0]);
+}
+
+template <typename Quantized>
+template <typename Vec3, typename LeafVisitor>
+bool CompactBvh<Quantized>::step_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal,
+    typename Vec3::value_type&                                  closest_distance2,
+    LeafVisitor&                                                visit_leaf) const
+{
+    typedef typename NearestTraversal<typename Vec3::value_type>::StackEntry StackEntry;
+
+    StackEntry* stack = traversal.stack;
+    std::size_t& stack_size = traversal.stack_size;
+
+    // Entries pruned since they were pushed: skipped without loading their node.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    const StackEntry entry = stack[--stack_size];
+    const Node& node = m_nodes[entry.node];
+
+    if (node.is_leaf())
+        visit_leaf(node.leaf.first_primitive, node.leaf.primitive_count, closest_distance2);
+    else
+    {
+        const glm::vec3 scale = get_quantization_scale<Quantized>(entry.min, entry.max);
+
+        StackEntry children[2];
+
+        for (std::uint32_t c = 0; c < 2; ++c)
+        {
+            children[c].node = node.first_child + c;
+            decode_child_bounds(node.child_bounds[c], entry.min, scale, children[c].min, children[c].max);
+            children[c].distance2 = distance2_to_box(query_point, Vec3(children[c].min), Vec3(children[c].max));
+        }
+
+        // Visit the nearest child first: push it last.
+        const std::size_t nearest = children[1].distance2 < children[0].distance2 ? 1 : 0;
+        const std::size_t farthest = 1 - nearest;
+
+        assert(stack_size + 2 <= max_stack_size);
+
+        if (children[farthest].distance2 < closest_distance2)
+            stack[stack_size++] = children[farthest];
+
+        if (children[nearest].distance2 < closest_distance2)
+            stack[stack_size++] = children[nearest];
+    }
+
+    // A leaf may have pruned the next entries.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    prefetch(&m_nodes[stack[stack_size - 1].node]);
+    return true;
+}
+
+template <typename Quantized>
+template <typename Vec3, typename LeafVisitor>
+void CompactBvh<Quantized>::traverse_ray(
+    const Vec3&                     origin,
+    const Vec3&                     direction,
+    typename Vec3::value_type&      max_t,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    struct StackEntry
+    {
+        std::uint32_t   node;
+        Scalar          t_entry;
+        glm::vec3       min;
+        glm::vec3       max;
+    };
+
+    if (m_nodes.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    const Vec3 inv_direction(
+        direction.x != Scalar(0) ? Scalar(1) / direction.x : infinity,
+        direction.y != Scalar(0) ? Scalar(1) / direction.y : infinity,
+        direction.z != Scalar(0) ? Scalar(1) / direction.z : infinity);
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    Scalar root_t_entry;
+    if (!intersect_ray_box(origin, inv_direction, Vec3(m_root_min), Vec3(m_root_max), max_t, root_t_entry))
+        return;
+
+    stack[stack_size++] = { 0, root_t_entry, m_root_min, m_root_max };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer hit was found since this node was pushed.
+        if (entry.t_entry > max_t)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+
+        if (node.is_leaf())
+        {
+            visit_leaf(node.leaf.first_primitive, node.leaf.primitive_count, max_t);
+            continue;
+        }
+
+        const glm::vec3 scale = get_quantization_scale<Quantized>(entry.min, entry.max);
+
+        StackEntry children[2];
+        bool hit[2];
+
+        for (std::uint32_t c = 0; c < 2; ++c)
+        {
+            children[c].node = node.first_child + c;
+            decode_child_bounds(node.child_bounds[c], entry.min, scale, children[c].min, children[c].max);
+            hit[c] = intersect_ray_box(
+                origin,
+                inv_direction,
+                Vec3(children[c].min),
+                Vec3(children[c].max),
+                max_t,
+                children[c].t_entry);
+        }
+
+        // Visit the nearest child first: push it last.
+        const std::size_t nearest = hit[1] && (!hit[0] || children[1].t_entry < children[0].t_entry) ? 1 : 0;
+        const std::size_t farthest = 1 - nearest;
+
+        assert(stack_size + 2 <= max_stack_size);
+
+        if (hit[farthest])
+            stack[stack_size++] = children[farthest];
+
+        if (hit[nearest])
+            stack[stack_size++] = children[nearest];
+    }
+}
+
+} // namespace core
@@ -0,0 +1,707 @@
+#include "bvh_builder.h"
+
+#include "cpu_dispatch.h"
+#include "morton.h"
+#include "parallel.h"
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace core
+{
+
+namespace
+{
+    // Number of bins used to evaluate the SAH.
+    const std::size_t bin_count = 16;
+
+    // Items per work item of the parallel loops of the build.
+    const std::size_t parallel_block_size = 4096;
+
+    // SAH costs of a node traversal and of a triangle test, for treelet restructuring.
+    const float inner_node_cost = 1.2f;
+    const float primitive_cost = 1.0f;
+
+    // Leaves of a restructured treelet: 2^7 subsets to evaluate.
+    const std::size_t treelet_leaf_count = 7;
+
+    // Bits of the Morton codes kept for the linear build, from the top: more
+    // bits only separate triangles that are already next to each other, and
+    // cost sort passes.
+    const std::size_t linear_code_bits = 30;
+
+    /**
+     * @brief Call `body(first, last)` on blocks of [0, count), on all threads.
+     */
+    template <typename Body>
+    void parallel_for_blocks(const std::size_t count, const Body& body)
+    {
+        const std::size_t block_count = (count + parallel_block_size - 1) / parallel_block_size;
+
+        parallel_for(block_count, [&](const std::size_t block)
+        {
+            body(block * parallel_block_size, std::min(count, (block + 1) * parallel_block_size));
+        });
+    }
+
+    /**
+     * @brief Number of leading zero bits. `value` must not be 0.
+     */
+    inline int count_leading_zeros(const std::uint64_t value)
+    {
+        assert(value != 0);
+
+    #if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - static_cast<int>(index);
+    #else
+        return __builtin_clzll(value);
+    #endif
+    }
+
+    /**
+     * @brief Binary radix tree of the Morton codes, one triangle per leaf.
+     *
+     * Inner nodes are [0, leaf_offset), the root first, and leaf `i` of the
+     * sorted order is node `leaf_offset + i`. Leaves only store their parent:
+     * the rest comes from their triangle.
+     */
+    struct RadixTree
+    {
+        struct Node
+        {
+            BuildBounds     bounds;
+            std::uint32_t   children[2];
+            std::uint32_t   parent;
+            std::uint32_t   primitive_count;
+            float           cost;       // SAH cost of the subtree
+        };
+
+        std::vector<Node>           nodes;
+        std::vector<std::uint32_t>  leaf_parents;
+        std::vector<std::uint32_t>  primitives;         // triangle of each leaf, sorted along the Morton curve
+        const BuildBounds*          primitive_bounds;   // by triangle
+        std::uint32_t               leaf_offset;
+
+        bool is_leaf(const std::uint32_t index) const
+        {
+            return index >= leaf_offset;
+        }
+
+        const BuildBounds& get_bounds(const std::uint32_t index) const
+        {
+            return is_leaf(index) ? primitive_bounds[primitives[index - leaf_offset]] : nodes[index].bounds;
+        }
+
+        std::uint32_t get_primitive_count(const std::uint32_t index) const
+        {
+            return is_leaf(index) ? 1 : nodes[index].primitive_count;
+        }
+
+        float get_cost(const std::uint32_t index) const
+        {
+            return is_leaf(index) ? primitive_cost * get_bounds(index).half_area() : nodes[index].cost;
+        }
+
+        void set_parent(const std::uint32_t index, const std::uint32_t parent)
+        {
+            if (is_leaf(index))
+                leaf_parents[index - leaf_offset] = parent;
+            else
+                nodes[index].parent = parent;
+        }
+    };
+
+    /**
+     * @brief Length of the common prefix of the sorted codes `i` and `j`, -1 if `j` is out of range.
+     *
+     * Equal codes are told apart by their index, as if it was appended to the code.
+     */
+    inline int get_common_prefix(
+        const std::vector<std::uint64_t>&   codes,
+        const std::int64_t                  i,
+        const std::int64_t                  j)
+    {
+        if (j < 0 || j >= static_cast<std::int64_t>(codes.size()))
+            return -1;
+
+        if (codes[i] != codes[j])
+            return count_leading_zeros(codes[i] ^ codes[j]);
+
+        return 64 + count_leading_zeros(static_cast<std::uint64_t>(i ^ j)) - 32;
+    }
+
+    /**
+     * @brief Find the range of keys covered by the inner node `i` and where it splits.
+     */
+    void emit_radix_node(
+        const std::vector<std::uint64_t>&   codes,
+        const std::int64_t                  i,
+        RadixTree&                          tree)
+    {
+        // Direction of the range: towards the neighbour with the longest common prefix.
+        const std::int64_t d = get_common_prefix(codes, i, i + 1) > get_common_prefix(codes, i, i - 1) ? 1 : -1;
+
+        // Find the other end with an exponential then a binary search.
+        const int min_prefix = get_common_prefix(codes, i, i - d);
+
+        std::int64_t max_length = 2;
+        while (get_common_prefix(codes, i, i + max_length * d) > min_prefix)
+            max_length *= 2;
+
+        std::int64_t length = 0;
+        for (std::int64_t t = max_length / 2; t >= 1; t /= 2)
+        {
+            if (get_common_prefix(codes, i, i + (length + t) * d) > min_prefix)
+                length += t;
+        }
+
+        const std::int64_t j = i + length * d;
+
+        // Split where the common prefix of the range ends, with a binary search.
+        const int node_prefix = get_common_prefix(codes, i, j);
+
+        std::int64_t split_length = 0;
+        std::int64_t t = length;
+
+        do
+        {
+            t = (t + 1) / 2;
+
+            if (get_common_prefix(codes, i, i + (split_length + t) * d) > node_prefix)
+                split_length += t;
+        }
+        while (t > 1);
+
+        const std::int64_t split = i + split_length * d + std::min<std::int64_t>(d, 0);
+
+        const std::uint32_t left = static_cast<std::uint32_t>(
+            std::min(i, j) == split ? tree.leaf_offset + split : split);
+        const std::uint32_t right = static_cast<std::uint32_t>(
+            std::max(i, j) == split + 1 ? tree.leaf_offset + split + 1 : split + 1);
+
+        RadixTree::Node& node = tree.nodes[i];
+        node.children[0] = left;
+        node.children[1] = right;
+        tree.set_parent(left, static_cast<std::uint32_t>(i));
+        tree.set_parent(right, static_cast<std::uint32_t>(i));
+    }
+
+    /**
+     * @brief Bounds, primitive count and cost of an inner node from its children.
+     */
+    void update_radix_node(RadixTree& tree, const std::uint32_t index)
+    {
+        RadixTree::Node& node = tree.nodes[index];
+
+        node.bounds = tree.get_bounds(node.children[0]);
+        node.bounds.extend(tree.get_bounds(node.children[1]));
+        node.primitive_count = tree.get_primitive_count(node.children[0]) + tree.get_primitive_count(node.children[1]);
+        node.cost = inner_node_cost * node.bounds.half_area()
+            + tree.get_cost(node.children[0])
+            + tree.get_cost(node.children[1]);
+    }
+
+    /**
+     * @brief Rearrange the treelet of `treelet_leaf_count` leaves under `root` into its lowest SAH cost topology.
+     *
+     * The treelet grows from the root by opening its largest leaf. Every
+     * subset of its leaves gets its optimal partition by dynamic programming,
+     * then the treelet inner nodes are reused for the new topology.
+     * The subtrees below the treelet leaves are left untouched.
+     */
+    void restructure_treelet(RadixTree& tree, const std::uint32_t root)
+    {
+        const std::size_t subset_count = std::size_t(1) << treelet_leaf_count;
+
+        std::uint32_t leaves[treelet_leaf_count];
+        std::uint32_t inner_nodes[treelet_leaf_count - 1];
+        std::size_t leaf_count = 0;
+        std::size_t inner_count = 0;
+
+        inner_nodes[inner_count++] = root;
+        leaves[leaf_count++] = tree.nodes[root].children[0];
+        leaves[leaf_count++] = tree.nodes[root].children[1];
+
+        while (leaf_count < treelet_leaf_count)
+        {
+            std::size_t largest = treelet_leaf_count;
+            float largest_area = -1.0f;
+
+            for (std::size_t i = 0; i < leaf_count; ++i)
+            {
+                if (tree.is_leaf(leaves[i]))
+                    continue;
+
+                const float area = tree.nodes[leaves[i]].bounds.half_area();
+
+                if (area > largest_area)
+                {
+                    largest = i;
+                    largest_area = area;
+                }
+            }
+
+            // Not enough triangles below the root.
+            if (largest == treelet_leaf_count)
+                return;
+
+            const RadixTree::Node& opened = tree.nodes[leaves[largest]];
+            inner_nodes[inner_count++] = leaves[largest];
+            leaves[largest] = opened.children[0];
+            leaves[leaf_count++] = opened.children[1];
+        }
+
+        // Bounds and lowest cost of every subset of leaves, smaller subsets first.
+        BuildBounds subset_bounds[subset_count];
+        std::uint32_t subset_primitive_count[subset_count] = {};
+        float subset_cost[subset_count];
+        std::uint8_t subset_partition[subset_count] = {};
+
+        for (std::size_t subset = 1; subset < subset_count; ++subset)
+        {
+            const std::size_t lowest = subset & (~subset + 1);
+            const std::size_t rest = subset ^ lowest;
+
+            std::size_t leaf = 0;
+            while ((std::size_t(1) << leaf) != lowest)
+                ++leaf;
+
+            subset_bounds[subset] = subset_bounds[rest];
+            subset_bounds[subset].extend(tree.get_bounds(leaves[leaf]));
+            subset_primitive_count[subset] = subset_primitive_count[rest] + tree.get_primitive_count(leaves[leaf]);
+
+            if (rest == 0)
+            {
+                subset_cost[subset] = tree.get_cost(leaves[leaf]);
+                continue;
+            }
+
+            // Each partition once: the side holding the lowest leaf, with any of the others.
+            float best_cost = std::numeric_limits<float>::max();
+
+            for (std::size_t others = rest & (rest - 1); ; others = (others - 1) & rest)
+            {
+                const std::size_t part = lowest | others;
+                const float cost = subset_cost[part] + subset_cost[subset ^ part];
+
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    subset_partition[subset] = static_cast<std::uint8_t>(part);
+                }
+
+                if (others == 0)
+                    break;
+            }
+
+            subset_cost[subset] = inner_node_cost * subset_bounds[subset].half_area() + best_cost;
+        }
+
+        // Rebuild top-down, the root keeping its index.
+        struct Pending
+        {
+            std::size_t     subset;
+            std::uint32_t   node;
+        };
+
+        Pending stack[treelet_leaf_count];
+        std::size_t stack_size = 0;
+        std::size_t next_inner = 1;
+
+        stack[stack_size++] = { subset_count - 1, root };
+
+        while (stack_size > 0)
+        {
+            const Pending pending = stack[--stack_size];
+            RadixTree::Node& node = tree.nodes[pending.node];
+
+            node.bounds = subset_bounds[pending.subset];
+            node.primitive_count = subset_primitive_count[pending.subset];
+            node.cost = subset_cost[pending.subset];
+
+            const std::size_t sides[2] = {
+                subset_partition[pending.subset],
+                pending.subset ^ subset_partition[pending.subset] };
+
+            for (std::size_t c = 0; c < 2; ++c)
+            {
+                std::uint32_t child;
+
+                // A single leaf: the subtree below it stays as is.
+                if ((sides[c] & (sides[c] - 1)) == 0)
+                {
+                    std::size_t leaf = 0;
+                    while ((std::size_t(1) << leaf) != sides[c])
+                        ++leaf;
+
+                    child = leaves[leaf];
+                }
+                else
+                {
+                    child = inner_nodes[next_inner++];
+                    stack[stack_size++] = { sides[c], child };
+                }
+
+                node.children[c] = child;
+                tree.set_parent(child, pending.node);
+            }
+        }
+
+        assert(next_inner == treelet_leaf_count - 1);
+    }
+
+    /**
+     * @brief Append the primitives below `index` to `primitives`, left to right.
+     */
+    void gather_primitives(
+        const RadixTree&                tree,
+        const std::uint32_t             index,
+        std::vector<std::uint32_t>&     primitives)
+    {
+        if (tree.is_leaf(index))
+        {
+            primitives.push_back(tree.primitives[index - tree.leaf_offset]);
+            return;
+        }
+
+        gather_primitives(tree, tree.nodes[index].children[0], primitives);
+        gather_primitives(tree, tree.nodes[index].children[1], primitives);
+    }
+
+    /**
+     * @brief Copy the radix tree into build nodes, depth first.
+     *
+     * Subtrees with few enough triangles, or at the maximum depth, become leaves.
+     */
+    std::uint32_t emit_build_node(
+        const RadixTree&                tree,
+        const std::uint32_t             index,
+        const std::size_t               depth,
+        const std::size_t               leaf_max_size,
+        std::vector<BuildNode>&         nodes,
+        std::vector<std::uint32_t>&     primitives)
+    {
+        const std::uint32_t node_index = static_cast<std::uint32_t>(nodes.size());
+        const std::uint32_t primitive_count = tree.get_primitive_count(index);
+
+        nodes.push_back(BuildNode());
+        nodes[node_index].bounds = tree.get_bounds(index);
+        nodes[node_index].first_primitive = static_cast<std::uint32_t>(primitives.size());
+        nodes[node_index].primitive_count = primitive_count;
+        nodes[node_index].is_leaf = true;
+
+        if (primitive_count <= leaf_max_size || depth >= bvh_max_build_depth || tree.is_leaf(index))
+        {
+            gather_primitives(tree, index, primitives);
+            return node_index;
+        }
+
+        const RadixTree::Node& radix_node = tree.nodes[index];
+        const std::uint32_t left = emit_build_node(
+            tree, radix_node.children[0], depth + 1, leaf_max_size, nodes, primitives);
+        const std::uint32_t right = emit_build_node(
+            tree, radix_node.children[1], depth + 1, leaf_max_size, nodes, primitives);
+
+        nodes[node_index].children[0] = left;
+        nodes[node_index].children[1] = right;
+        nodes[node_index].is_leaf = false;
+
+        return node_index;
+    }
+}
+
+BvhBuilder::BvhBuilder(
+    const MeshPointCloud&   mesh_point_cloud,
+    const std::size_t       leaf_max_size,
+    const BvhBuildMethod    method)
+  : m_leaf_max_size(std::max<std::size_t>(leaf_max_size, 1))
+{
+    const std::size_t triangle_count = mesh_point_cloud.get_triangle_count();
+    assert(triangle_count <= std::numeric_limits<std::uint32_t>::max());
+
+    m_primitive_bounds.resize(triangle_count);
+    m_primitive_centroids.resize(triangle_count);
+
+    parallel_for_blocks(triangle_count, [&](const std::size_t first, const std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
+        {
+            glm::vec3 v1, v2, v3;
+            mesh_point_cloud.get_triangle(i * 3, v1, v2, v3);
+
+            m_primitive_bounds[i].extend(v1);
+            m_primitive_bounds[i].extend(v2);
+            m_primitive_bounds[i].extend(v3);
+            m_primitive_centroids[i] = (v1 + v2 + v3) / 3.0f;
+        }
+    });
+
+    build_nodes(method);
+}
+
+BvhBuilder::BvhBuilder(
+    const std::vector<BuildBounds>& primitive_bounds,
+    const std::size_t               leaf_max_size,
+    const BvhBuildMethod            method)
+  : m_primitive_bounds(primitive_bounds)
+  , m_leaf_max_size(std::max<std::size_t>(leaf_max_size, 1))
+{
+    assert(primitive_bounds.size() <= std::numeric_limits<std::uint32_t>::max());
+
+    m_primitive_centroids.resize(primitive_bounds.size());
+
+    for (std::size_t i = 0; i < primitive_bounds.size(); ++i)
+        m_primitive_centroids[i] = (primitive_bounds[i].min + primitive_bounds[i].max) * 0.5f;
+
+    build_nodes(method);
+}
+
+void BvhBuilder::build_nodes(const BvhBuildMethod method)
+{
+    m_primitives.resize(m_primitive_bounds.size());
+    for (std::size_t i = 0; i < m_primitives.size(); ++i)
+        m_primitives[i] = static_cast<std::uint32_t>(i);
+
+    if (m_primitives.empty())
+        return;
+
+    m_nodes.reserve(2 * m_primitives.size() / m_leaf_max_size + 1);
+
+    if (method == BvhBuildMethod::Sah)
+        build(0, static_cast<std::uint32_t>(m_primitives.size()), 0);
+    else
+        build_linear(method == BvhBuildMethod::LinearTreelets);
+}
+
+std::uint32_t BvhBuilder::build(
+    const std::uint32_t first,
+    const std::uint32_t count,
+    const std::size_t   depth)
+{
+    const std::uint32_t node_index = static_cast<std::uint32_t>(m_nodes.size());
+    m_nodes.push_back(BuildNode());
+
+    BuildBounds bounds;
+    BuildBounds centroid_bounds;
+
+    for (std::uint32_t i = first; i < first + count; ++i)
+    {
+        bounds.extend(m_primitive_bounds[m_primitives[i]]);
+        centroid_bounds.extend(m_primitive_centroids[m_primitives[i]]);
+    }
+
+    m_nodes[node_index].bounds = bounds;
+    m_nodes[node_index].first_primitive = first;
+    m_nodes[node_index].primitive_count = count;
+    m_nodes[node_index].is_leaf = true;
+
+    if (count <= m_leaf_max_size || depth >= bvh_max_build_depth)
+        return node_index;
+
+    const std::uint32_t split = find_split(first, count, centroid_bounds);
+    const std::uint32_t left = build(first, split - first, depth + 1);
+    const std::uint32_t right = build(split, first + count - split, depth + 1);
+
+    m_nodes[node_index].children[0] = left;
+    m_nodes[node_index].children[1] = right;
+    m_nodes[node_index].is_leaf = false;
+
+    return node_index;
+}
+
+std::uint32_t BvhBuilder::find_split(
+    const std::uint32_t first,
+    const std::uint32_t count,
+    const BuildBounds&  centroid_bounds)
+{
+    const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    // All centroids are at the same position: split in the middle.
+    if (extent[axis] <= 0.0f)
+        return first + count / 2;
+
+    const float bin_scale = bin_count / extent[axis];
+    const float axis_min = centroid_bounds.min[axis];
+
+    auto get_bin = [&](const std::uint32_t primitive)
+    {
+        const std::size_t bin = static_cast<std::size_t>(
+            (m_primitive_centroids[primitive][axis] - axis_min) * bin_scale);
+        return std::min(bin, bin_count - 1);
+    };
+
+    BuildBounds bin_bounds[bin_count];
+    std::size_t bin_primitive_count[bin_count] = {};
+
+    for (std::uint32_t i = first; i < first + count; ++i)
+    {
+        const std::size_t bin = get_bin(m_primitives[i]);
+        bin_bounds[bin].extend(m_primitive_bounds[m_primitives[i]]);
+        bin_primitive_count[bin] += 1;
+    }
+
+    // Sweep from the right to know the cost of every right side.
+    float right_cost[bin_count];
+    BuildBounds right_bounds;
+    std::size_t right_count = 0;
+
+    for (std::size_t bin = bin_count - 1; bin > 0; --bin)
+    {
+        right_bounds.extend(bin_bounds[bin]);
+        right_count += bin_primitive_count[bin];
+        right_cost[bin] = right_count > 0 ? right_bounds.half_area() * right_count : 0.0f;
+    }
+
+    // Sweep from the left and keep the cheapest split.
+    BuildBounds left_bounds;
+    std::size_t left_count = 0;
+    std::size_t best_bin = 1;
+    float best_cost = std::numeric_limits<float>::max();
+
+    for (std::size_t bin = 1; bin < bin_count; ++bin)
+    {
+        left_bounds.extend(bin_bounds[bin - 1]);
+        left_count += bin_primitive_count[bin - 1];
+
+        const float left_cost = left_count > 0 ? left_bounds.half_area() * left_count : 0.0f;
+        const float cost = left_cost + right_cost[bin];
+
+        if (left_count > 0 && left_count < count && cost < best_cost)
+        {
+            best_cost = cost;
+            best_bin = bin;
+        }
+    }
+
+    std::uint32_t* split = std::partition(
+        m_primitives.data() + first,
+        m_primitives.data() + first + count,
+        [&](const std::uint32_t primitive) { return get_bin(primitive) < best_bin; });
+
+    const std::uint32_t split_index = static_cast<std::uint32_t>(split - m_primitives.data());
+
+    // Can only happen with degenerate floating point inputs.
+    if (split_index == first || split_index == first + count)
+        return first + count / 2;
+
+    return split_index;
+}
+
+void BvhBuilder::build_linear(const bool restructure_treelets)
+{
+    const std::size_t count = m_primitives.size();
+
+    // One triangle: the root is a leaf.
+    if (count == 1)
+    {
+        build(0, 1, 0);
+        return;
+    }
+
+    // Morton codes of the centroids, in their bounds.
+    const std::size_t block_count = (count + parallel_block_size - 1) / parallel_block_size;
+    std::vector<BuildBounds> block_centroid_bounds(block_count);
+
+    parallel_for_blocks(count, [&](const std::size_t first, const std::size_t last)
+    {
+        BuildBounds& bounds = block_centroid_bounds[first / parallel_block_size];
+
+        for (std::size_t i = first; i < last; ++i)
+            bounds.extend(m_primitive_centroids[i]);
+    });
+
+    BuildBounds centroid_bounds;
+    for (const BuildBounds& bounds : block_centroid_bounds)
+        centroid_bounds.extend(bounds);
+
+    const glm::vec3 inv_extent = get_morton_inv_extent(centroid_bounds.min, centroid_bounds.max);
+
+    RadixTree tree;
+    tree.primitives.resize(count);
+    tree.primitive_bounds = m_primitive_bounds.data();
+    tree.leaf_offset = static_cast<std::uint32_t>(count - 1);
+
+    std::vector<std::uint64_t> codes(count);
+    const SimdKernels* simd_kernels = get_simd_kernels();
+
+    parallel_for_blocks(count, [&](const std::size_t first, const std::size_t last)
+    {
+        if (simd_kernels)
+        {
+            simd_kernels->morton_codes(
+                &m_primitive_centroids[first], last - first, centroid_bounds.min, inv_extent, &codes[first]);
+        }
+        else
+        {
+            for (std::size_t i = first; i < last; ++i)
+                codes[i] = morton_code(m_primitive_centroids[i], centroid_bounds.min, inv_extent);
+        }
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            codes[i] >>= 63 - linear_code_bits;
+            tree.primitives[i] = static_cast<std::uint32_t>(i);
+        }
+    });
+
+    parallel_radix_sort(codes.data(), tree.primitives.data(), count, linear_code_bits);
+
+    // Every inner node independently.
+    tree.nodes.resize(count - 1);
+    tree.leaf_parents.resize(count);
+    tree.nodes[0].parent = 0;
+
+    parallel_for_blocks(count - 1, [&](const std::size_t first, const std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
+            emit_radix_node(codes, static_cast<std::int64_t>(i), tree);
+    });
+
+    // Bounds bottom-up: the second child to arrive at a node updates it, then
+    // goes on with its parent. Treelets are restructured on the way, once
+    // their subtrees are final.
+    std::unique_ptr<std::atomic<std::uint32_t>[]> arrivals(new std::atomic<std::uint32_t>[count - 1]);
+    for (std::size_t i = 0; i < count - 1; ++i)
+        arrivals[i].store(0, std::memory_order_relaxed);
+
+    parallel_for_blocks(count, [&](const std::size_t first, const std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
+        {
+            std::uint32_t node = tree.leaf_parents[i];
+
+            while (arrivals[node].fetch_add(1, std::memory_order_acq_rel) != 0)
+            {
+                update_radix_node(tree, node);
+
+                if (restructure_treelets && tree.nodes[node].primitive_count >= treelet_leaf_count)
+                    restructure_treelet(tree, node);
+
+                if (node == 0)
+                    break;
+
+                node = tree.nodes[node].parent;
+            }
+        }
+    });
+
+    m_primitives.clear();
+    emit_build_node(tree, 0, 0, m_leaf_max_size, m_nodes, m_primitives);
+
+    assert(m_primitives.size() == count);
+}
+
+} // namespace core
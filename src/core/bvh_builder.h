@@ -0,0 +1,153 @@
+#pragma once
+
+#include "mesh_point_cloud.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace core
+{
+
+// Deeper nodes are turned into leaves so that traversals can use a fixed-size stack.
+const std::size_t bvh_max_build_depth = 60;
+
+/**
+ * @brief How `BvhBuilder` builds the hierarchy: build speed against query speed.
+ */
+enum class BvhBuildMethod
+{
+    Sah,            // top-down binned SAH: slowest build, fastest queries
+    Linear,         // LBVH: Morton order of the triangle centroids, built in parallel
+    LinearTreelets  // LBVH, then treelets restructured for the SAH: in between
+};
+
+/**
+ * @brief Axis-aligned bounds, empty by default.
+ */
+struct BuildBounds
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void extend(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void extend(const BuildBounds& bounds)
+    {
+        min = glm::min(min, bounds.min);
+        max = glm::max(max, bounds.max);
+    }
+
+    float half_area() const
+    {
+        const glm::vec3 extent = max - min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+};
+
+/**
+ * @brief Node of an uncompressed binary hierarchy.
+ *
+ * Leaves hold a range of `BvhBuilder::get_primitives`.
+ */
+struct BuildNode
+{
+    BuildBounds     bounds;
+    std::uint32_t   first_primitive;
+    std::uint32_t   primitive_count;
+    std::uint32_t   children[2];
+    bool            is_leaf;
+};
+
+/**
+ * @brief Builder of a binary hierarchy of the mesh triangles.
+ *
+ * The result is then encoded by the hierarchies used for queries:
+ * `CompactBvh` quantizes it, `WideBvh` collapses it into wider nodes.
+ * The root is node 0, unless the mesh has no triangle.
+ *
+ * The SAH build splits nodes top-down where the surface area heuristic is
+ * the lowest. The linear build (LBVH) sorts the triangles along a Morton
+ * curve of their centroids with a parallel radix sort, then finds every
+ * inner node independently from the common prefixes of the sorted codes,
+ * in parallel. Its splits only follow the Morton grid, so queries visit
+ * more nodes. Treelet restructuring wins part of it back: small subtrees
+ * of 7 leaves are rearranged into their optimal SAH topology, bottom-up.
+ *
+ * References:
+ *  - Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees
+ *    Tero Karras, HPG 2012
+ *  - Fast Parallel Construction of High-Quality Bounding Volume Hierarchies
+ *    Tero Karras, Timo Aila, HPG 2013
+ */
+class BvhBuilder
+{
+  public:
+    BvhBuilder(
+        const MeshPointCloud&   mesh_point_cloud,
+        const std::size_t       leaf_max_size,
+        const BvhBuildMethod    method = BvhBuildMethod::Sah);
+
+    /**
+     * @brief Build over arbitrary primitives, e.g. the clusters of a mesh, from their bounds.
+     *
+     * Centroids are the centers of the bounds.
+     */
+    BvhBuilder(
+        const std::vector<BuildBounds>& primitive_bounds,
+        const std::size_t               leaf_max_size,
+        const BvhBuildMethod            method = BvhBuildMethod::Sah);
+
+    const std::vector<BuildNode>& get_nodes() const
+    {
+        return m_nodes;
+    }
+
+    /**
+     * @brief Primitive indices, i.e. triangles unless built from bounds, in leaf order.
+     */
+    const std::vector<std::uint32_t>& get_primitives() const
+    {
+        return m_primitives;
+    }
+
+  private:
+    std::vector<BuildBounds>        m_primitive_bounds;
+    std::vector<glm::vec3>          m_primitive_centroids;
+    const std::size_t               m_leaf_max_size;
+    std::vector<BuildNode>          m_nodes;
+    std::vector<std::uint32_t>      m_primitives;
+
+    /**
+     * @brief Build the nodes from the primitive bounds and centroids.
+     */
+    void build_nodes(const BvhBuildMethod method);
+
+    std::uint32_t build(
+        const std::uint32_t first,
+        const std::uint32_t count,
+        const std::size_t   depth);
+
+    /**
+     * @brief Partition primitives along the largest centroid axis and return
+     * the index of the first primitive of the right child.
+     */
+    std::uint32_t find_split(
+        const std::uint32_t first,
+        const std::uint32_t count,
+        const BuildBounds&  centroid_bounds);
+
+    /**
+     * @brief Build the nodes and reorder the primitives with the linear method.
+     */
+    void build_linear(const bool restructure_treelets);
+};
+
+} // namespace core
@@ -1,34 +1,42 @@
 #include "closest_point_query.h"
 
-#include "math.h"
-
-#include <glm/gtc/type_ptr.hpp>
-
-#include <chrono>
-#include <cstddef>
+#include <cassert>
 #include <iostream>
-#include <limits>
-#include <vector>
 
 namespace core
 {
 
-ClosestPointQuery::ClosestPointQuery(const MeshPointCloud& mesh_point_cloud)
-  : m_mesh_point_cloud(mesh_point_cloud)
-  , m_tree_index(
-    3,
-    mesh_point_cloud,
-    nanoflann::KDTreeSingleIndexAdaptorParams(10 /* tree leaf max size */))
+ClosestPointQuery::ClosestPointQuery(
+    const MeshPointCloud&   mesh_point_cloud,
+    const Backend           backend,
+    const bool              precompute_triangles)
 {
-    // Start a timer to know how long it takes to build the query object.
-    auto timer_start = std::chrono::high_resolution_clock::now();
+    QueryEngineSettings settings = get_default_query_engine_settings(backend);
+    settings.precompute_triangles = precompute_triangles;
+
+    m_engine = create_query_engine(mesh_point_cloud, settings);
+    assert(m_engine);
+}
 
-    m_tree_index.buildIndex();
+ClosestPointQuery::ClosestPointQuery(
+    const MeshPointCloud&       mesh_point_cloud,
+    const QueryEngineSettings&  settings)
+  : m_engine(create_query_engine(mesh_point_cloud, settings))
+{
+    if (!m_engine)
+    {
+        std::cerr << "No " << get_backend_name(settings.backend) << " query engine with "
+            << get_scalar_type_name(settings.scalar) << " scalars, "
+            << settings.index_bits << "-bit indices, leaf size " << settings.leaf_size
+            << " and " << settings.candidate_count << " candidates. Using the default settings.\n";
 
-    auto timer_stop = std::chrono::high_resolution_clock::now();
-    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+        QueryEngineSettings default_settings = get_default_query_engine_settings(settings.backend);
+        default_settings.precompute_triangles = settings.precompute_triangles;
+        default_settings.bvh_build_method = settings.bvh_build_method;
 
-    std::cout << "Generated mesh query tree in " << process_time << "ms.\n";
+        m_engine = create_query_engine(mesh_point_cloud, default_settings);
+        assert(m_engine);
+    }
 }
 
 bool ClosestPointQuery::get_closest_point(
@@ -36,60 +44,125 @@ bool ClosestPointQuery::get_closest_point(
     float               max_distance,
     glm::vec3&          result) const
 {
-    assert(max_distance > 0.0f);
-
-    // nanoflann (the KDTree library) use squared distance. We do the same.
-    const float max_distance2 = max_distance * max_distance;
-
-    // Define how many points we take from the tree to find the closest point on the mesh.
-    // A number that is too low will generate incorrect results when the mesh density is high.
-    // The points we process are the nearest points in the cloud to the query point.
-    const std::size_t point_to_process_max_count = 100;
-    std::vector<std::size_t> ret_index(point_to_process_max_count);
-    std::vector<float> out_dist_sqr(point_to_process_max_count);
-
-    // Use the KDTree to find the nearest points to the `query_point`.
-    const std::size_t num_results =
-        m_tree_index.knnSearch(
-            glm::value_ptr(query_point),
-            point_to_process_max_count,
-            &ret_index[0],
-            &out_dist_sqr[0]);
-
-    bool found = false;
-    float closest_distance2 = 0.0f;
-
-    // Find the closest point on the mesh using all points near to `query_point`.
-    // To do so, we use the triangle on which each point is and compute the closest
-    // point to query_point that is on the triangle.
-    // For all these "triangles points", we keep the closest one to the query point.
-    // FIXME: We analyse the same triangles multiple times.
-    for (std::size_t i = 0; i < num_results; ++i)
-    {
-        // Ask to the point cloud which triangle is this point on.
-        glm::vec3 v1, v2, v3;
-        m_mesh_point_cloud.get_triangle(ret_index[i], v1, v2, v3);
-
-        // Compute the closest point to `query_point` that is on the triangle.
-        glm::vec3 p = closest_point_in_triangle(
-            query_point,
-            v1,
-            v2,
-            v3);
-
-        // From all triangles, keep the closest one.
-        const float distance2_to_triangle = distance2(p, query_point);
-
-        if (distance2_to_triangle < max_distance2
-            && (!found || distance2_to_triangle < closest_distance2))
-        {
-            found = true;
-            result = p;
-            closest_distance2 = distance2_to_triangle;
-        }
-    }
+    return m_engine->get_closest_point(query_point, max_distance, result);
+}
+
+bool ClosestPointQuery::get_closest_point(
+    const glm::vec3&    query_point,
+    float               max_distance,
+    ClosestPointResult& result) const
+{
+    return m_engine->get_closest_point(query_point, max_distance, result);
+}
+
+std::size_t ClosestPointQuery::get_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance,
+    glm::vec3*          results,
+    bool*               found) const
+{
+    return m_engine->get_closest_points(query_points, count, max_distance, results, found);
+}
+
+std::size_t ClosestPointQuery::get_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance,
+    ClosestPointResult* results,
+    bool*               found) const
+{
+    return m_engine->get_closest_points(query_points, count, max_distance, results, found);
+}
+
+std::size_t ClosestPointQuery::get_k_closest_points(
+    const glm::vec3&    query_point,
+    const std::size_t   k,
+    const float         max_distance,
+    ClosestPointResult* results) const
+{
+    return m_engine->get_k_closest_points(query_point, k, max_distance, results);
+}
+
+std::size_t ClosestPointQuery::get_k_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const std::size_t   k,
+    const float         max_distance,
+    ClosestPointResult* results,
+    std::size_t*        result_counts) const
+{
+    return m_engine->get_k_closest_points(query_points, count, k, max_distance, results, result_counts);
+}
 
-    return found;
+std::size_t ClosestPointQuery::for_each_triangle_in_radius(
+    const glm::vec3&        query_point,
+    const float             radius,
+    const TriangleCallback& callback) const
+{
+    return m_engine->for_each_triangle_in_radius(query_point, radius, callback);
+}
+
+bool ClosestPointQuery::get_closest_point_to_segment(
+    const glm::vec3&            start,
+    const glm::vec3&            end,
+    const float                 max_distance,
+    SegmentClosestPointResult&  result) const
+{
+    return m_engine->get_closest_point_to_segment(start, end, max_distance, result);
+}
+
+std::size_t ClosestPointQuery::get_closest_points_to_segments(
+    const glm::vec3*            starts,
+    const glm::vec3*            ends,
+    const std::size_t           count,
+    const float                 max_distance,
+    SegmentClosestPointResult*  results,
+    bool*                       found) const
+{
+    return m_engine->get_closest_points_to_segments(starts, ends, count, max_distance, results, found);
+}
+
+std::size_t ClosestPointQuery::get_closest_points_on_grid(
+    const RegularGrid&  grid,
+    float*              distances,
+    glm::vec3*          closest_points) const
+{
+    return m_engine->get_closest_points_on_grid(grid, distances, closest_points);
+}
+
+bool ClosestPointQuery::intersect_ray(
+    const glm::vec3&    origin,
+    const glm::vec3&    direction,
+    const float         max_distance,
+    RayHit&             hit) const
+{
+    return m_engine->intersect_ray(origin, direction, max_distance, hit);
+}
+
+void ClosestPointQuery::set_batch_schedule(const BatchSchedule schedule)
+{
+    m_engine->set_batch_schedule(schedule);
+}
+
+BatchSchedule ClosestPointQuery::get_batch_schedule() const
+{
+    return m_engine->get_batch_schedule();
+}
+
+MemoryUsage ClosestPointQuery::get_memory_usage() const
+{
+    return m_engine->get_memory_usage();
+}
+
+ClosestPointQuery::Backend ClosestPointQuery::get_backend() const
+{
+    return m_engine->get_settings().backend;
+}
+
+const QueryEngineSettings& ClosestPointQuery::get_settings() const
+{
+    return m_engine->get_settings();
 }
 
 } // namespace core
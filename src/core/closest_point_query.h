@@ -1,11 +1,13 @@
 #pragma once
 
+#include "memory.h"
 #include "mesh_point_cloud.h"
+#include "query_engine.h"
 
-#include <nanoflann/nanoflann.hpp>
 #include <glm/glm.hpp>
 
-#include <vector>
+#include <cstddef>
+#include <memory>
 
 namespace core
 {
@@ -17,11 +19,36 @@ namespace core
  * `get_closest_point`.
  * 
  * This implementation require a point cloud and not a mesh.
+ *
+ * Queries run in a `QueryEngine` specialized at compile time on the
+ * settings, picked at runtime among the pre-instantiated ones.
  */
 class ClosestPointQuery
 {
   public:
-    ClosestPointQuery(const MeshPointCloud& mesh_point_cloud);
+    typedef QueryBackend Backend;
+
+    /**
+     * @brief Build the acceleration structure of the given backend, with its default settings.
+     *
+     * With `precompute_triangles`, the triangle terms of the closest point
+     * computation are stored once instead of being computed for each
+     * candidate triangle of each query. It costs 65 bytes per triangle.
+     */
+    ClosestPointQuery(
+        const MeshPointCloud&   mesh_point_cloud,
+        const Backend           backend = Backend::KdTree,
+        const bool              precompute_triangles = false);
+
+    /**
+     * @brief Build the engine matching the settings.
+     *
+     * Falls back to the backend default settings if the combination
+     * is not pre-instantiated.
+     */
+    ClosestPointQuery(
+        const MeshPointCloud&       mesh_point_cloud,
+        const QueryEngineSettings&  settings);
 
     /**
      * @brief Return the closest point on the mesh within the specified maximum search distance.
@@ -31,16 +58,151 @@ class ClosestPointQuery
         float               max_distance,
         glm::vec3&          result) const;
 
+    /**
+     * @brief Same as above, with the triangle, barycentric coordinates, feature and normal.
+     *
+     * They are all known at the end of the search: no second pass is needed.
+     */
+    bool get_closest_point(
+        const glm::vec3&    query_point,
+        float               max_distance,
+        ClosestPointResult& result) const;
+
+    /**
+     * @brief Run `count` queries at once. Return the number of points found.
+     *
+     * `found` is optional. `results[i]` is left untouched when no point is found.
+     */
+    std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        glm::vec3*          results,
+        bool*               found = nullptr) const;
+
+    std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found = nullptr) const;
+
+    /**
+     * @brief Find the `k` closest distinct triangles strictly within `max_distance`,
+     * sorted by distance. Return how many were found, at most `k`.
+     *
+     * With the KDTree, like `get_closest_point`, only the triangles of the
+     * nearest cloud points are considered.
+     */
+    std::size_t get_k_closest_points(
+        const glm::vec3&    query_point,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results) const;
+
+    /**
+     * @brief Batch version: `results` holds `k` entries per query.
+     * Return the total number of results. `result_counts` is optional.
+     *
+     * Scheduled like `get_closest_points`: `BatchSchedule::Sequential` runs
+     * the queries in order on the calling thread, the other schedules in
+     * sorted parallel chunks.
+     */
+    std::size_t get_k_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results,
+        std::size_t*        result_counts = nullptr) const;
+
+    /**
+     * @brief Call `callback` with the closest point of every triangle within
+     * `radius` (inclusive). Return the number of triangles. Exact with all backends.
+     */
+    std::size_t for_each_triangle_in_radius(
+        const glm::vec3&        query_point,
+        const float             radius,
+        const TriangleCallback& callback) const;
+
+    /**
+     * @brief Return the closest point on the mesh to a segment, within the specified maximum distance.
+     *
+     * Use it instead of sampling points along a tool move or a moving point: it is exact,
+     * and nodes are pruned by their distance to the whole segment.
+     */
+    bool get_closest_point_to_segment(
+        const glm::vec3&            start,
+        const glm::vec3&            end,
+        const float                 max_distance,
+        SegmentClosestPointResult&  result) const;
+
+    /**
+     * @brief Run `count` segment queries at once. Return the number of points found.
+     *
+     * Scheduled like `get_closest_points`, sorted on the segment midpoints:
+     * `BatchSchedule::Sequential` runs them in order on the calling thread,
+     * the other schedules in parallel chunks.
+     */
+    std::size_t get_closest_points_to_segments(
+        const glm::vec3*            starts,
+        const glm::vec3*            ends,
+        const std::size_t           count,
+        const float                 max_distance,
+        SegmentClosestPointResult*  results,
+        bool*                       found = nullptr) const;
+
+    /**
+     * @brief Closest point of every voxel of a grid, in caller buffers of one entry per voxel.
+     *
+     * `distances` is infinity outside the band, `closest_points` is optional.
+     * Tiles of voxels are processed in parallel. Return the number of voxels in the band.
+     */
+    std::size_t get_closest_points_on_grid(
+        const RegularGrid&  grid,
+        float*              distances,
+        glm::vec3*          closest_points = nullptr) const;
+
+    /**
+     * @brief Find the nearest triangle hit by the ray within `max_distance` of its origin.
+     *
+     * Uses the same acceleration structure as the closest point queries.
+     * `direction` doesn't need to be normalized. Triangles are hit from both sides.
+     */
+    bool intersect_ray(
+        const glm::vec3&    origin,
+        const glm::vec3&    direction,
+        const float         max_distance,
+        RayHit&             hit) const;
+
+    /**
+     * @brief Schedule of the closest point batches, `BatchSchedule::Sorted` by default.
+     *
+     * Sorted batches run in parallel, in an order that keeps the caches warm:
+     * large batches of randomly ordered queries are much faster. Packet
+     * batches also traverse the BVH with groups of nearby queries, for dense
+     * batches such as surface sampling. Interleaved batches hide the memory
+     * latency of BVH traversals on meshes much larger than the caches.
+     * Must not be changed while queries run.
+     */
+    void set_batch_schedule(const BatchSchedule schedule);
+
+    BatchSchedule get_batch_schedule() const;
+
+    /**
+     * @brief Heap bytes used by the tree nodes and the tree point indices.
+     */
+    MemoryUsage get_memory_usage() const;
+
+    Backend get_backend() const;
+
+    /**
+     * @brief Settings of the engine actually running the queries.
+     */
+    const QueryEngineSettings& get_settings() const;
+
   private:
-    const MeshPointCloud& m_mesh_point_cloud;
-
-    // nanoflann kdtree. Will be used to speed up look up time.
-    typedef nanoflann::KDTreeSingleIndexAdaptor<
-        nanoflann::L2_Simple_Adaptor<float, MeshPointCloud>,
-        MeshPointCloud,
-        3, /* Go 3D! */
-        size_t> TreeIndex;
-    TreeIndex m_tree_index;
+    std::unique_ptr<QueryEngine> m_engine;
 };
 
 } // namespace core
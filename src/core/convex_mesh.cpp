@@ -0,0 +1,408 @@
+#include "convex_mesh.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    /**
+     * @brief Adjacency found by `find_convex_adjacency`, with the notations of `ConvexMesh`.
+     */
+    struct ConvexAdjacency
+    {
+        std::vector<glm::vec3>      vertices;
+        std::vector<std::uint32_t>  triangle_vertices;
+        std::vector<std::uint32_t>  vertex_triangle_offsets;
+        std::vector<std::uint32_t>  vertex_triangles;
+        std::vector<std::uint32_t>  vertex_neighbor_offsets;
+        std::vector<std::uint32_t>  vertex_neighbors;
+        float                       orientation;
+    };
+
+    bool is_finite(const glm::vec3& v)
+    {
+        return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+    }
+
+    /**
+     * @brief Weld the vertices and link the triangles. Return false if the mesh is not convex.
+     *
+     * Each edge must be shared by two triangles running it in opposite
+     * directions, so the surface is closed, manifold and consistently
+     * oriented. It is a single
+     * sphere when it is connected and V - E + F = 2. Then every edge is
+     * convex when no vertex of the triangle across it is in front of the
+     * triangle's plane.
+     */
+    bool find_convex_adjacency(const MeshPointCloud& mesh_point_cloud, ConvexAdjacency& adjacency)
+    {
+        const std::size_t triangle_count = mesh_point_cloud.get_triangle_count();
+        const std::size_t corner_count = triangle_count * 3;
+
+        // A tetrahedron is the smallest closed mesh.
+        if (triangle_count < 4 || corner_count > std::numeric_limits<std::uint32_t>::max())
+            return false;
+
+        // Weld the mesh vertices sharing a position.
+        const Mesh::VertexArray& mesh_vertices = mesh_point_cloud.get_mesh().get_vertices();
+        const Mesh::IndexArray& mesh_triangles = mesh_point_cloud.get_mesh().get_triangles();
+
+        // Only the vertices of the triangles.
+        std::vector<bool> used(mesh_vertices.size(), false);
+
+        for (const unsigned int vertex : mesh_triangles)
+            used[vertex] = true;
+
+        std::vector<std::uint32_t> order;
+
+        for (std::size_t i = 0; i < mesh_vertices.size(); ++i)
+        {
+            if (!used[i])
+                continue;
+
+            if (!is_finite(mesh_vertices[i].pos))
+                return false;
+
+            order.push_back(static_cast<std::uint32_t>(i));
+        }
+
+        std::sort(
+            order.begin(),
+            order.end(),
+            [&](const std::uint32_t lhs, const std::uint32_t rhs)
+            {
+                const glm::vec3& a = mesh_vertices[lhs].pos;
+                const glm::vec3& b = mesh_vertices[rhs].pos;
+                return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+            });
+
+        std::vector<std::uint32_t> welded_vertices(mesh_vertices.size());
+        adjacency.vertices.clear();
+
+        for (const std::uint32_t i : order)
+        {
+            if (adjacency.vertices.empty() || adjacency.vertices.back() != mesh_vertices[i].pos)
+                adjacency.vertices.push_back(mesh_vertices[i].pos);
+
+            welded_vertices[i] = static_cast<std::uint32_t>(adjacency.vertices.size() - 1);
+        }
+
+        const std::size_t vertex_count = adjacency.vertices.size();
+
+        adjacency.triangle_vertices.resize(corner_count);
+
+        for (std::size_t i = 0; i < corner_count; ++i)
+            adjacency.triangle_vertices[i] = welded_vertices[mesh_triangles[i]];
+
+        // Edges from each corner to the next one, keyed by their vertices in increasing order.
+        typedef std::pair<std::uint64_t, std::uint32_t> Edge;
+        std::vector<Edge> edges(corner_count);
+
+        for (std::size_t triangle = 0; triangle < triangle_count; ++triangle)
+        {
+            const std::uint32_t* v = &adjacency.triangle_vertices[triangle * 3];
+
+            if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+                return false;
+
+            const glm::vec3& p0 = adjacency.vertices[v[0]];
+            const glm::vec3 normal = glm::cross(adjacency.vertices[v[1]] - p0, adjacency.vertices[v[2]] - p0);
+
+            if (!(glm::dot(normal, normal) > 0.0f))
+                return false;
+
+            for (std::size_t k = 0; k < 3; ++k)
+            {
+                const std::uint32_t v0 = v[k];
+                const std::uint32_t v1 = v[(k + 1) % 3];
+
+                edges[triangle * 3 + k] = Edge(
+                    std::uint64_t(glm::min(v0, v1)) << 32 | glm::max(v0, v1),
+                    static_cast<std::uint32_t>(triangle * 3 + k));
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        // Each edge twice, in opposite directions. Triangle across each edge of each triangle.
+        std::vector<std::uint32_t> across(corner_count);
+
+        for (std::size_t i = 0; i < corner_count; i += 2)
+        {
+            if (i + 1 == corner_count
+                || edges[i].first != edges[i + 1].first
+                || (i + 2 < corner_count && edges[i + 2].first == edges[i].first))
+                return false;
+
+            const std::uint32_t corner = edges[i].second;
+            const std::uint32_t other_corner = edges[i + 1].second;
+
+            if (adjacency.triangle_vertices[corner] == adjacency.triangle_vertices[other_corner])
+                return false;
+
+            across[corner] = other_corner / 3;
+            across[other_corner] = corner / 3;
+        }
+
+        // Euler characteristic of a sphere: V - E + F = 2, with E = 3F / 2.
+        if (2 * vertex_count != 4 + triangle_count)
+            return false;
+
+        // Connected.
+        std::vector<bool> reached(triangle_count, false);
+        std::vector<std::uint32_t> stack(1, 0);
+        std::size_t reached_count = 1;
+        reached[0] = true;
+
+        while (!stack.empty())
+        {
+            const std::uint32_t triangle = stack.back();
+            stack.pop_back();
+
+            for (std::size_t k = 0; k < 3; ++k)
+            {
+                const std::uint32_t neighbor = across[std::size_t(triangle) * 3 + k];
+
+                if (!reached[neighbor])
+                {
+                    reached[neighbor] = true;
+                    ++reached_count;
+                    stack.push_back(neighbor);
+                }
+            }
+        }
+
+        if (reached_count != triangle_count)
+            return false;
+
+        // Orientation from the sign of the enclosed volume.
+        glm::dvec3 center(0.0);
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+
+        for (const glm::vec3& vertex : adjacency.vertices)
+        {
+            center += glm::dvec3(vertex);
+            min = glm::min(min, vertex);
+            max = glm::max(max, vertex);
+        }
+
+        center /= double(vertex_count);
+
+        double volume = 0.0;
+
+        for (std::size_t triangle = 0; triangle < triangle_count; ++triangle)
+        {
+            const std::uint32_t* v = &adjacency.triangle_vertices[triangle * 3];
+            const glm::dvec3 p0 = glm::dvec3(adjacency.vertices[v[0]]) - center;
+            const glm::dvec3 p1 = glm::dvec3(adjacency.vertices[v[1]]) - center;
+            const glm::dvec3 p2 = glm::dvec3(adjacency.vertices[v[2]]) - center;
+            volume += glm::dot(p0, glm::cross(p1, p2));
+        }
+
+        if (volume == 0.0)
+            return false;
+
+        adjacency.orientation = volume > 0.0 ? 1.0f : -1.0f;
+
+        // No vertex across an edge in front of the triangle.
+        const double tolerance = 1e-5 * glm::length(glm::dvec3(max) - glm::dvec3(min));
+
+        for (std::size_t triangle = 0; triangle < triangle_count; ++triangle)
+        {
+            const std::uint32_t* v = &adjacency.triangle_vertices[triangle * 3];
+            const glm::dvec3 p0(adjacency.vertices[v[0]]);
+            const glm::dvec3 normal = double(adjacency.orientation) * glm::normalize(glm::cross(
+                glm::dvec3(adjacency.vertices[v[1]]) - p0,
+                glm::dvec3(adjacency.vertices[v[2]]) - p0));
+
+            for (std::size_t k = 0; k < 3; ++k)
+            {
+                const std::uint32_t* neighbor = &adjacency.triangle_vertices[std::size_t(across[triangle * 3 + k]) * 3];
+
+                for (std::size_t j = 0; j < 3; ++j)
+                {
+                    if (glm::dot(normal, glm::dvec3(adjacency.vertices[neighbor[j]]) - p0) > tolerance)
+                        return false;
+                }
+            }
+        }
+
+        // Triangles around each vertex.
+        adjacency.vertex_triangle_offsets.assign(vertex_count + 1, 0);
+
+        for (const std::uint32_t vertex : adjacency.triangle_vertices)
+            ++adjacency.vertex_triangle_offsets[vertex + 1];
+
+        for (std::size_t vertex = 0; vertex < vertex_count; ++vertex)
+            adjacency.vertex_triangle_offsets[vertex + 1] += adjacency.vertex_triangle_offsets[vertex];
+
+        adjacency.vertex_triangles.resize(corner_count);
+        std::vector<std::uint32_t> next(adjacency.vertex_triangle_offsets.begin(), adjacency.vertex_triangle_offsets.end() - 1);
+
+        for (std::size_t i = 0; i < corner_count; ++i)
+            adjacency.vertex_triangles[next[adjacency.triangle_vertices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+        // Neighbors of each vertex, from the edges.
+        adjacency.vertex_neighbor_offsets.assign(vertex_count + 1, 0);
+
+        for (std::size_t i = 0; i < corner_count; i += 2)
+        {
+            ++adjacency.vertex_neighbor_offsets[(edges[i].first >> 32) + 1];
+            ++adjacency.vertex_neighbor_offsets[(edges[i].first & 0xFFFFFFFFu) + 1];
+        }
+
+        for (std::size_t vertex = 0; vertex < vertex_count; ++vertex)
+            adjacency.vertex_neighbor_offsets[vertex + 1] += adjacency.vertex_neighbor_offsets[vertex];
+
+        adjacency.vertex_neighbors.resize(corner_count);
+        next.assign(adjacency.vertex_neighbor_offsets.begin(), adjacency.vertex_neighbor_offsets.end() - 1);
+
+        for (std::size_t i = 0; i < corner_count; i += 2)
+        {
+            const std::uint32_t v0 = static_cast<std::uint32_t>(edges[i].first >> 32);
+            const std::uint32_t v1 = static_cast<std::uint32_t>(edges[i].first & 0xFFFFFFFFu);
+            adjacency.vertex_neighbors[next[v0]++] = v1;
+            adjacency.vertex_neighbors[next[v1]++] = v0;
+        }
+
+        return true;
+    }
+}
+
+bool is_convex_mesh(const MeshPointCloud& mesh_point_cloud)
+{
+    ConvexAdjacency adjacency;
+    return find_convex_adjacency(mesh_point_cloud, adjacency);
+}
+
+ConvexMesh::ConvexMesh(const MeshPointCloud& mesh_point_cloud)
+  : m_mesh_point_cloud(mesh_point_cloud)
+  , m_center(0.0f)
+  , m_orientation(1.0f)
+{
+    CORE_TRACE_SCOPE("Convex mesh build");
+
+    // Start a timer to know how long it takes to link the triangles.
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    for (std::uint32_t& vertex : m_support_vertices)
+        vertex = 0;
+
+    ConvexAdjacency adjacency;
+
+    if (!find_convex_adjacency(mesh_point_cloud, adjacency))
+    {
+        std::cerr << "The mesh is not convex, the convex mesh is empty.\n";
+        return;
+    }
+
+    m_vertices.assign(adjacency.vertices.begin(), adjacency.vertices.end());
+    m_triangle_vertices.assign(adjacency.triangle_vertices.begin(), adjacency.triangle_vertices.end());
+    m_vertex_triangle_offsets.assign(adjacency.vertex_triangle_offsets.begin(), adjacency.vertex_triangle_offsets.end());
+    m_vertex_triangles.assign(adjacency.vertex_triangles.begin(), adjacency.vertex_triangles.end());
+    m_vertex_neighbor_offsets.assign(adjacency.vertex_neighbor_offsets.begin(), adjacency.vertex_neighbor_offsets.end());
+    m_vertex_neighbors.assign(adjacency.vertex_neighbors.begin(), adjacency.vertex_neighbors.end());
+    m_orientation = adjacency.orientation;
+
+    glm::dvec3 center(0.0);
+
+    for (const glm::vec3& vertex : m_vertices)
+        center += glm::dvec3(vertex);
+
+    m_center = glm::vec3(center / double(m_vertices.size()));
+
+    // Vertex furthest along the center of each cell, each climb starting from the previous cell's vertex.
+    std::uint32_t vertex = 0;
+
+    for (std::size_t face = 0; face < 6; ++face)
+    {
+        const int axis = static_cast<int>(face / 2);
+
+        for (std::size_t j = 0; j < support_map_size; ++j)
+        {
+            for (std::size_t i = 0; i < support_map_size; ++i)
+            {
+                glm::vec3 direction;
+                direction[axis] = face % 2 == 0 ? -1.0f : 1.0f;
+                direction[(axis + 1) % 3] = -1.0f + (2.0f * i + 1.0f) / support_map_size;
+                direction[(axis + 2) % 3] = -1.0f + (2.0f * j + 1.0f) / support_map_size;
+
+                vertex = climb_to_support_vertex(direction, vertex);
+                m_support_vertices[(face * support_map_size + j) * support_map_size + i] = vertex;
+            }
+        }
+    }
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Linked convex mesh (" << m_vertices.size() << " vertices) in " << process_time << "ms.\n";
+}
+
+MemoryUsage ConvexMesh::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("convex mesh vertices", get_heap_bytes(m_vertices) + get_heap_bytes(m_triangle_vertices));
+    usage.add("convex mesh adjacency",
+        get_heap_bytes(m_vertex_triangle_offsets) + get_heap_bytes(m_vertex_triangles)
+        + get_heap_bytes(m_vertex_neighbor_offsets) + get_heap_bytes(m_vertex_neighbors));
+    return usage;
+}
+
+std::size_t ConvexMesh::get_support_cell(const glm::vec3& direction)
+{
+    const glm::vec3 magnitude = glm::abs(direction);
+    const int axis = magnitude.x >= magnitude.y
+        ? (magnitude.x >= magnitude.z ? 0 : 2)
+        : (magnitude.y >= magnitude.z ? 1 : 2);
+
+    if (!(magnitude[axis] > 0.0f))
+        return 0;
+
+    const std::size_t face = 2 * static_cast<std::size_t>(axis) + (direction[axis] > 0.0f ? 1 : 0);
+
+    auto get_square = [&](const float coordinate)
+    {
+        const float square = (coordinate / magnitude[axis] + 1.0f) * 0.5f * support_map_size;
+        return glm::min(static_cast<std::size_t>(glm::max(square, 0.0f)), support_map_size - 1);
+    };
+
+    return (face * support_map_size + get_square(direction[(axis + 2) % 3])) * support_map_size
+        + get_square(direction[(axis + 1) % 3]);
+}
+
+std::uint32_t ConvexMesh::climb_to_support_vertex(const glm::vec3& direction, std::uint32_t vertex) const
+{
+    float support = glm::dot(direction, m_vertices[vertex]);
+
+    while (true)
+    {
+        const std::uint32_t previous_vertex = vertex;
+
+        for (std::uint32_t i = m_vertex_neighbor_offsets[previous_vertex]; i < m_vertex_neighbor_offsets[previous_vertex + 1]; ++i)
+        {
+            const float distance = glm::dot(direction, m_vertices[m_vertex_neighbors[i]]);
+
+            if (distance > support)
+            {
+                support = distance;
+                vertex = m_vertex_neighbors[i];
+            }
+        }
+
+        if (vertex == previous_vertex)
+            return vertex;
+    }
+}
+
+} // namespace core
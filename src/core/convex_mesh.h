@@ -0,0 +1,243 @@
+#pragma once
+
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace core
+{
+
+/**
+ * @brief Whether the mesh is the closed surface of a convex solid, e.g. a box or a collision hull.
+ *
+ * Vertices at the same position are welded. The triangles must then form
+ * one closed, consistently oriented surface of genus 0, without zero-area
+ * triangles, and no edge may fold inward by more than 1e-5 of the mesh
+ * size. O(n log n) in the triangle count.
+ */
+bool is_convex_mesh(const MeshPointCloud& mesh_point_cloud);
+
+/**
+ * @brief Adjacency of a convex mesh (see `is_convex_mesh`), to find closest points by walking on it.
+ *
+ * The distance from an outside point to the surface of a convex solid has
+ * no local minimum but the global one, so the closest point is found by
+ * walking from triangle to triangle. The walk starts around the vertex
+ * furthest towards the point (its support vertex), then moves to any
+ * triangle around the closest point that is closer, and stops at a local
+ * minimum: a handful of triangles per query, whatever the mesh size.
+ *
+ * Points inside the solid have local minima on every face, so a minimum
+ * is only accepted when the point is in front of its triangle: the walk
+ * reports the others, which are left to a full search.
+ */
+class ConvexMesh
+{
+  public:
+    /**
+     * @brief Build the adjacency. Empty if the mesh is not convex.
+     */
+    explicit ConvexMesh(const MeshPointCloud& mesh_point_cloud);
+
+    inline bool empty() const
+    {
+        return m_vertices.empty();
+    }
+
+    /**
+     * @brief Walk to the closest triangle point. Return false if the result is not certain.
+     *
+     * That is when the point is inside the solid, on the back of the
+     * triangle where the walk stopped, or when the mesh is empty. Points on
+     * the surface are found. Same closest point computation as the BVHs.
+     */
+    template <typename Vec3>
+    bool find_closest(
+        const Vec3&                 point,
+        std::uint32_t&              triangle,
+        Vec3&                       closest_point,
+        Vec3&                       barycentric,
+        typename Vec3::value_type&  closest_distance2) const;
+
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    typedef TrackedVector<glm::vec3, MemoryCategory::QueryIndex> VertexArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryIndex> IndexArray;
+
+    // Cells per side of each face of the cube map of support vertices.
+    static const std::size_t support_map_size = 16;
+
+    static const std::uint32_t no_vertex = std::numeric_limits<std::uint32_t>::max();
+
+    const MeshPointCloud&   m_mesh_point_cloud;
+
+    // Welded vertices.
+    VertexArray             m_vertices;
+
+    // Welded vertices of each triangle, in the mesh order.
+    IndexArray              m_triangle_vertices;
+
+    // Triangles and neighbors around vertex v: [offsets[v], offsets[v + 1]).
+    IndexArray              m_vertex_triangle_offsets;
+    IndexArray              m_vertex_triangles;
+    IndexArray              m_vertex_neighbor_offsets;
+    IndexArray              m_vertex_neighbors;
+
+    // Vertex furthest along the center direction of each cube map cell, where walks on the vertices start.
+    std::uint32_t           m_support_vertices[6 * support_map_size * support_map_size];
+
+    // Mean of the vertices, inside the solid.
+    glm::vec3               m_center;
+
+    // 1 if the triangles are counterclockwise seen from outside, -1 otherwise.
+    float                   m_orientation;
+
+    /**
+     * @brief Cube map cell of a direction: the face of its largest coordinate, then a square of that face.
+     */
+    static std::size_t get_support_cell(const glm::vec3& direction);
+
+    /**
+     * @brief Vertex furthest along `direction`, climbing along the edges from `vertex`.
+     *
+     * A convex surface has no local maximum along a direction, so the
+     * climb ends at the furthest vertex, or one as far.
+     */
+    std::uint32_t climb_to_support_vertex(const glm::vec3& direction, std::uint32_t vertex) const;
+
+    /**
+     * @brief Vertex of every triangle holding a closest point, or `no_vertex` if it's inside the triangle.
+     *
+     * A closest point on an edge or a vertex of the triangle is also on the
+     * triangles around its vertex of largest weight. Weights are compared
+     * with a margin, so a rounded point inside the triangle counts as on its
+     * border: it only costs a few more triangles.
+     */
+    template <typename Vec3>
+    std::uint32_t get_border_vertex(const std::uint32_t triangle, const Vec3& barycentric) const;
+
+    /**
+     * @brief Refine the triangles around `vertex`, except `skipped_triangle`, lowering `closest_distance2`.
+     */
+    template <typename Vec3>
+    void refine_vertex_triangles(
+        const Vec3&                 point,
+        const std::uint32_t         vertex,
+        const std::uint32_t         skipped_triangle,
+        std::uint32_t&              triangle,
+        Vec3&                       closest_point,
+        Vec3&                       barycentric,
+        typename Vec3::value_type&  closest_distance2) const;
+};
+
+template <typename Vec3>
+bool ConvexMesh::find_closest(
+    const Vec3&                 point,
+    std::uint32_t&              triangle,
+    Vec3&                       closest_point,
+    Vec3&                       barycentric,
+    typename Vec3::value_type&  closest_distance2) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    if (empty())
+        return false;
+
+    const glm::vec3 direction = glm::vec3(point) - m_center;
+    std::uint32_t vertex = climb_to_support_vertex(direction, m_support_vertices[get_support_cell(direction)]);
+
+    triangle = std::numeric_limits<std::uint32_t>::max();
+    closest_distance2 = std::numeric_limits<Scalar>::infinity();
+    refine_vertex_triangles(point, vertex, triangle, triangle, closest_point, barycentric, closest_distance2);
+
+    // Every triangle holding the closest point is around `vertex` once the
+    // border vertex stops changing: the closest point is a local minimum.
+    while (true)
+    {
+        const std::uint32_t border_vertex = get_border_vertex(triangle, barycentric);
+
+        if (border_vertex == no_vertex || border_vertex == vertex)
+            break;
+
+        const std::uint32_t previous_triangle = triangle;
+        vertex = border_vertex;
+        refine_vertex_triangles(point, vertex, previous_triangle, triangle, closest_point, barycentric, closest_distance2);
+
+        if (triangle == previous_triangle)
+            break;
+    }
+
+    // Outward normal of the triangle.
+    glm::vec3 v1, v2, v3;
+    m_mesh_point_cloud.get_triangle(std::size_t(triangle) * 3, v1, v2, v3);
+
+    const Vec3 normal = Scalar(m_orientation) * glm::cross(Vec3(v2) - Vec3(v1), Vec3(v3) - Vec3(v1));
+
+    return glm::dot(point - closest_point, normal) >= Scalar(0);
+}
+
+template <typename Vec3>
+std::uint32_t ConvexMesh::get_border_vertex(const std::uint32_t triangle, const Vec3& barycentric) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Scalar margin = Scalar(1e-4);
+
+    if (barycentric.x > margin && barycentric.y > margin && barycentric.z > margin)
+        return no_vertex;
+
+    std::size_t largest = 0;
+
+    if (barycentric.y > barycentric[static_cast<int>(largest)])
+        largest = 1;
+
+    if (barycentric.z > barycentric[static_cast<int>(largest)])
+        largest = 2;
+
+    return m_triangle_vertices[std::size_t(triangle) * 3 + largest];
+}
+
+template <typename Vec3>
+void ConvexMesh::refine_vertex_triangles(
+    const Vec3&                 point,
+    const std::uint32_t         vertex,
+    const std::uint32_t         skipped_triangle,
+    std::uint32_t&              triangle,
+    Vec3&                       closest_point,
+    Vec3&                       barycentric,
+    typename Vec3::value_type&  closest_distance2) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    for (std::uint32_t i = m_vertex_triangle_offsets[vertex]; i < m_vertex_triangle_offsets[vertex + 1]; ++i)
+    {
+        const std::uint32_t candidate = m_vertex_triangles[i];
+
+        if (candidate == skipped_triangle)
+            continue;
+
+        glm::vec3 v1, v2, v3;
+        m_mesh_point_cloud.get_triangle(std::size_t(candidate) * 3, v1, v2, v3);
+
+        Vec3 candidate_barycentric;
+        const Vec3 p = closest_point_in_triangle(point, Vec3(v1), Vec3(v2), Vec3(v3), candidate_barycentric);
+        const Scalar distance2_to_triangle = distance2(p, point);
+
+        if (distance2_to_triangle < closest_distance2)
+        {
+            triangle = candidate;
+            closest_point = p;
+            barycentric = candidate_barycentric;
+            closest_distance2 = distance2_to_triangle;
+        }
+    }
+}
+
+} // namespace core
@@ -0,0 +1,203 @@
+#include "cpu_dispatch.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CORE_CPU_X86
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CORE_CPU_X86
+#endif
+
+namespace core
+{
+
+// Defined in simd_kernels_*.cpp, each compiled for its instruction set.
+const SimdKernels& get_sse42_simd_kernels();
+const SimdKernels& get_avx2_simd_kernels();
+const SimdKernels& get_avx512_simd_kernels();
+
+namespace
+{
+    const char* const cpu_isa_names[] = { "baseline", "sse4.2", "avx2", "avx512" };
+    const std::size_t cpu_isa_count = sizeof(cpu_isa_names) / sizeof(cpu_isa_names[0]);
+
+    // Set by `force_cpu_isa`, -1 until then.
+    std::atomic<int> forced_cpu_isa(-1);
+
+#if defined(CORE_CPU_X86)
+    /**
+     * @brief EAX, EBX, ECX and EDX of the `leaf` and `subleaf` CPUID function, or zeros.
+     */
+    void get_cpuid(const unsigned int leaf, const unsigned int subleaf, unsigned int (&registers)[4])
+    {
+        registers[0] = registers[1] = registers[2] = registers[3] = 0;
+
+    #if defined(_MSC_VER)
+        int values[4];
+        __cpuid(values, 0);
+
+        if (static_cast<unsigned int>(values[0]) < leaf)
+            return;
+
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+        for (std::size_t i = 0; i < 4; ++i)
+            registers[i] = static_cast<unsigned int>(values[i]);
+    #else
+        if (__get_cpuid_max(0, nullptr) < leaf)
+            return;
+
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+    #endif
+    }
+
+    /**
+     * @brief Register states the OS saves on context switches (XCR0).
+     */
+    std::uint64_t get_enabled_register_states()
+    {
+    #if defined(_MSC_VER)
+        return _xgetbv(0);
+    #else
+        // `_xgetbv` needs -mxsave.
+        unsigned int eax, edx;
+        __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return eax | std::uint64_t(edx) << 32;
+    #endif
+    }
+#endif
+
+    CpuIsa get_supported_cpu_isa(const CpuIsa isa)
+    {
+        const CpuIsa detected = detect_cpu_isa();
+
+        if (isa <= detected)
+            return isa;
+
+        std::cerr << "The CPU doesn't support " << get_cpu_isa_name(isa)
+            << ", using " << get_cpu_isa_name(detected) << ".\n";
+
+        return detected;
+    }
+
+    CpuIsa get_startup_cpu_isa()
+    {
+        const char* name = std::getenv("CLOSEST_POINT_ISA");
+
+        if (!name)
+            return detect_cpu_isa();
+
+        CpuIsa isa;
+
+        if (!get_cpu_isa_from_name(name, isa))
+        {
+            std::cerr << "Unknown instruction set in CLOSEST_POINT_ISA: " << name << ".\n";
+            return detect_cpu_isa();
+        }
+
+        return get_supported_cpu_isa(isa);
+    }
+}
+
+CpuIsa detect_cpu_isa()
+{
+#if defined(CORE_CPU_X86)
+    static const CpuIsa detected = []()
+    {
+        unsigned int leaf1[4];
+        unsigned int leaf7[4];
+        get_cpuid(1, 0, leaf1);
+        get_cpuid(7, 0, leaf7);
+
+        auto has_bit = [](const unsigned int value, const unsigned int bit) { return (value >> bit & 1) != 0; };
+
+        if (!has_bit(leaf1[2], 20))
+            return CpuIsa::Baseline;
+
+        // AVX registers are only usable when the OS saves them.
+        const bool os_saves_ymm = has_bit(leaf1[2], 27)
+            && (get_enabled_register_states() & 0x6) == 0x6;
+        const bool os_saves_zmm = os_saves_ymm
+            && (get_enabled_register_states() & 0xE0) == 0xE0;
+
+        const bool avx2 = os_saves_ymm
+            && has_bit(leaf1[2], 28)    // AVX
+            && has_bit(leaf7[1], 5);    // AVX2
+
+        if (!avx2)
+            return CpuIsa::Sse42;
+
+        const bool avx512 = os_saves_zmm
+            && has_bit(leaf7[1], 16)    // F
+            && has_bit(leaf7[1], 17)    // DQ
+            && has_bit(leaf7[1], 30)    // BW
+            && has_bit(leaf7[1], 31);   // VL
+
+        return avx512 ? CpuIsa::Avx512 : CpuIsa::Avx2;
+    }();
+
+    return detected;
+#else
+    return CpuIsa::Baseline;
+#endif
+}
+
+CpuIsa get_cpu_isa()
+{
+    const int forced = forced_cpu_isa.load(std::memory_order_relaxed);
+
+    if (forced >= 0)
+        return static_cast<CpuIsa>(forced);
+
+    static const CpuIsa startup_isa = get_startup_cpu_isa();
+    return startup_isa;
+}
+
+void force_cpu_isa(const CpuIsa isa)
+{
+    forced_cpu_isa.store(static_cast<int>(get_supported_cpu_isa(isa)), std::memory_order_relaxed);
+}
+
+const char* get_cpu_isa_name(const CpuIsa isa)
+{
+    const std::size_t index = static_cast<std::size_t>(isa);
+    assert(index < cpu_isa_count);
+    return cpu_isa_names[index];
+}
+
+bool get_cpu_isa_from_name(const char* name, CpuIsa& isa)
+{
+    for (std::size_t i = 0; i < cpu_isa_count; ++i)
+    {
+        if (std::strcmp(name, cpu_isa_names[i]) == 0)
+        {
+            isa = static_cast<CpuIsa>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const SimdKernels* get_simd_kernels()
+{
+    switch (get_cpu_isa())
+    {
+      case CpuIsa::Sse42:
+        return &get_sse42_simd_kernels();
+      case CpuIsa::Avx2:
+        return &get_avx2_simd_kernels();
+      case CpuIsa::Avx512:
+        return &get_avx512_simd_kernels();
+      default:
+        return nullptr;
+    }
+}
+
+} // namespace core
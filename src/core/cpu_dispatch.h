@@ -0,0 +1,100 @@
+#pragma once
+
+#include "math.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace core
+{
+
+//
+// Runtime CPU dispatch.
+//
+// The hot kernels of math.h and morton.h are also compiled for several
+// x86 instruction sets (simd_kernels_*.cpp). The best set supported by the
+// CPU is picked once, the first time it is needed, so one binary runs the
+// widest code each machine has. The inline math.h code stays the baseline,
+// used on other CPUs and when forced.
+//
+
+/**
+ * @brief Instruction sets the kernels are compiled for, from the narrowest.
+ */
+enum class CpuIsa
+{
+    Baseline,   // inline math.h code, built with the compiler defaults
+    Sse42,
+    Avx2,
+    Avx512      // F, DQ, BW and VL
+};
+
+/**
+ * @brief Widest instruction set supported by the CPU and the OS.
+ */
+CpuIsa detect_cpu_isa();
+
+/**
+ * @brief Instruction set of the kernels returned by `get_simd_kernels`.
+ *
+ * The detected one, unless the CLOSEST_POINT_ISA environment variable or
+ * `force_cpu_isa` asks for another.
+ */
+CpuIsa get_cpu_isa();
+
+/**
+ * @brief Use the kernels of `isa` from now on, for testing.
+ *
+ * Instruction sets the CPU doesn't support are lowered to the detected one.
+ * Engines and hierarchies keep the kernels they were built with.
+ */
+void force_cpu_isa(const CpuIsa isa);
+
+/**
+ * @brief Instruction set name, e.g. "avx2".
+ */
+const char* get_cpu_isa_name(const CpuIsa isa);
+
+/**
+ * @brief Find an instruction set from its name. Return false if the name is unknown.
+ */
+bool get_cpu_isa_from_name(const char* name, CpuIsa& isa);
+
+/**
+ * @brief Kernels compiled for one instruction set.
+ *
+ * Each computes the same operations in the same order as its math.h or
+ * morton.h counterpart, without contracting them into FMAs, so results
+ * don't depend on the instruction set.
+ */
+struct SimdKernels
+{
+    CpuIsa isa;
+
+    // `distance2_to_boxes` of a point on the 4 or 8 boxes of a wide node:
+    // `bounds` are the min x, y, z then max x, y, z arrays, side by side.
+    void (*distance2_to_boxes4)(const glm::vec3& point, const float* bounds, float* distance2);
+    void (*distance2_to_boxes8)(const glm::vec3& point, const float* bounds, float* distance2);
+
+    // `distance2_to_triangle` of a packet of 8 points.
+    void (*distance2_to_triangle8)(const PointPacket<float, 8>& packet, const TriangleQueryData& triangle, float* distance2);
+
+    // `morton_code` of `count` points.
+    void (*morton_codes)(
+        const glm::vec3*    points,
+        const std::size_t   count,
+        const glm::vec3&    box_min,
+        const glm::vec3&    inv_extent,
+        std::uint64_t*      codes);
+};
+
+/**
+ * @brief Kernels of `get_cpu_isa`, or nullptr on the baseline.
+ *
+ * Callers keep the pointer and use the inline math.h code when it is null.
+ */
+const SimdKernels* get_simd_kernels();
+
+} // namespace core
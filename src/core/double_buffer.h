@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+namespace core
+{
+
+/**
+ * @brief Latest value published by a producer thread, read without waiting for the next one.
+ *
+ * The producer writes into the back buffer, then swaps it with the front
+ * buffer that readers copy. The lock is only held for the swap and the copy,
+ * never while the producer computes or writes. Single producer.
+ */
+template <typename T>
+class DoubleBuffer
+{
+  public:
+    DoubleBuffer()
+      : m_front(0)
+      , m_version(0)
+    {
+    }
+
+    /**
+     * @brief Publish a value. Called by the producer only.
+     */
+    void write(const T& value)
+    {
+        // Readers only access the front buffer, under the lock.
+        m_buffers[1 - m_front] = value;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_front = 1 - m_front;
+        ++m_version;
+    }
+
+    /**
+     * @brief Copy the latest value. Return false if nothing was published yet.
+     *
+     * `version` is incremented by each write, to detect new values.
+     */
+    bool read(T& value, std::uint64_t& version) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_version == 0)
+            return false;
+
+        value = m_buffers[m_front];
+        version = m_version;
+        return true;
+    }
+
+  private:
+    T                   m_buffers[2];
+    int                 m_front;
+    std::uint64_t       m_version;
+    mutable std::mutex  m_mutex;
+};
+
+} // namespace core
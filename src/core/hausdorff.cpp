@@ -0,0 +1,213 @@
+#include "hausdorff.h"
+
+#include "closest_point_query.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    // Vertices per parallel work item.
+    const std::size_t chunk_size = 1024;
+
+    /**
+     * @brief Raise `value` to `candidate` if it is larger.
+     */
+    void atomic_max(std::atomic<float>& value, const float candidate)
+    {
+        float current = value.load(std::memory_order_relaxed);
+
+        while (candidate > current
+            && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+HausdorffDistance compute_hausdorff_distance(
+    const Mesh&                 source,
+    const ClosestPointQuery&    target,
+    const float                 max_distance)
+{
+    CORE_TRACE_SCOPE("hausdorff distance");
+
+    const Mesh::VertexArray& vertices = source.get_vertices();
+    const std::size_t chunk_count = (vertices.size() + chunk_size - 1) / chunk_size;
+
+    // Largest distance found so far, shared by all chunks.
+    std::atomic<float> lower_bound(0.0f);
+    std::atomic<std::size_t> query_count(0);
+    std::vector<HausdorffDistance> chunk_results(chunk_count);
+
+    parallel_for(chunk_count, [&](const std::size_t chunk)
+    {
+        const std::size_t first = chunk * chunk_size;
+        const std::size_t last = std::min(first + chunk_size, vertices.size());
+
+        HausdorffDistance& result = chunk_results[chunk];
+        std::size_t chunk_query_count = 0;
+
+        // Last queried vertex and its distance.
+        bool has_previous = false;
+        glm::vec3 previous_position;
+        float previous_distance = 0.0f;
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            const glm::vec3& position = vertices[i].pos;
+            const float bound = lower_bound.load(std::memory_order_relaxed);
+
+            if (has_previous && previous_distance + glm::length(position - previous_position) <= bound)
+                continue;
+
+            ++chunk_query_count;
+
+            ClosestPointResult closest;
+            float distance = std::numeric_limits<float>::infinity();
+
+            if (bound > 0.0f && target.get_closest_point(position, std::min(bound, max_distance), closest))
+            {
+                distance = std::sqrt(closest.distance2);
+            }
+            else if (target.get_closest_point(position, max_distance, closest))
+            {
+                distance = std::sqrt(closest.distance2);
+
+                if (distance > result.distance)
+                {
+                    result.distance = distance;
+                    result.vertex = static_cast<std::uint32_t>(i);
+                    result.target_point = closest.point;
+                }
+            }
+            else if (result.distance < distance)
+            {
+                result.distance = distance;
+                result.vertex = static_cast<std::uint32_t>(i);
+            }
+
+            atomic_max(lower_bound, distance);
+
+            has_previous = true;
+            previous_position = position;
+            previous_distance = distance;
+        }
+
+        query_count += chunk_query_count;
+    });
+
+    HausdorffDistance hausdorff;
+
+    for (const HausdorffDistance& result : chunk_results)
+    {
+        if (result.distance > hausdorff.distance)
+            hausdorff = result;
+    }
+
+    hausdorff.query_count = query_count;
+    return hausdorff;
+}
+
+SymmetricHausdorffDistance compute_symmetric_hausdorff_distance(
+    const Mesh&                 first,
+    const ClosestPointQuery&    first_query,
+    const Mesh&                 second,
+    const ClosestPointQuery&    second_query,
+    const float                 max_distance)
+{
+    SymmetricHausdorffDistance hausdorff;
+    hausdorff.forward = compute_hausdorff_distance(first, second_query, max_distance);
+    hausdorff.backward = compute_hausdorff_distance(second, first_query, max_distance);
+    hausdorff.distance = std::max(hausdorff.forward.distance, hausdorff.backward.distance);
+    return hausdorff;
+}
+
+float compute_vertex_deviations(
+    const Mesh&                 source,
+    const ClosestPointQuery&    target,
+    const float                 max_distance,
+    float*                      deviations)
+{
+    CORE_TRACE_SCOPE("vertex deviations");
+
+    const Mesh::VertexArray& vertices = source.get_vertices();
+    const std::size_t chunk_count = (vertices.size() + chunk_size - 1) / chunk_size;
+
+    std::atomic<float> max_deviation(0.0f);
+
+    parallel_for(chunk_count, [&](const std::size_t chunk)
+    {
+        const std::size_t first = chunk * chunk_size;
+        const std::size_t count = std::min(chunk_size, vertices.size() - first);
+
+        // Batch buffers, reused by the chunks of a thread.
+        static thread_local std::vector<glm::vec3> positions;
+        static thread_local std::vector<ClosestPointResult> results;
+        static thread_local std::unique_ptr<bool[]> found(new bool[chunk_size]);
+
+        positions.resize(count);
+        results.resize(count);
+
+        for (std::size_t i = 0; i < count; ++i)
+            positions[i] = vertices[first + i].pos;
+
+        target.get_closest_points(positions.data(), count, max_distance, results.data(), found.get());
+
+        float chunk_max_deviation = 0.0f;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (!found[i])
+            {
+                deviations[first + i] = std::numeric_limits<float>::infinity();
+                chunk_max_deviation = deviations[first + i];
+                continue;
+            }
+
+            const float distance = std::sqrt(results[i].distance2);
+            const bool below = glm::dot(positions[i] - results[i].point, results[i].normal) < 0.0f;
+
+            deviations[first + i] = below ? -distance : distance;
+            chunk_max_deviation = std::max(chunk_max_deviation, distance);
+        }
+
+        atomic_max(max_deviation, chunk_max_deviation);
+    });
+
+    return max_deviation;
+}
+
+bool write_vertex_deviations(
+    const std::string&  file_path,
+    const float*        deviations,
+    const std::size_t   count)
+{
+    std::ofstream out(file_path, std::ios::binary);
+
+    if (!out)
+    {
+        std::cerr << "Unable to write deviation file " << file_path << "\n";
+        return false;
+    }
+
+    const std::uint32_t vertex_count = static_cast<std::uint32_t>(count);
+
+    out.write("DEV1", 4);
+    out.write(reinterpret_cast<const char*>(&vertex_count), sizeof(vertex_count));
+    out.write(reinterpret_cast<const char*>(deviations), count * sizeof(float));
+
+    return static_cast<bool>(out);
+}
+
+} // namespace core
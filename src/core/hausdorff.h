@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace core
+{
+
+class ClosestPointQuery;
+
+//
+// Mesh comparison.
+//
+// Distances are measured from the vertices of a source mesh to the
+// surface of a target mesh, searched with the target `ClosestPointQuery`.
+// Vertices farther than the maximum search distance are at infinity.
+// Vertices are processed in chunks, in parallel: keep meshes sorted
+// spatially (see mesh_reorder.h) for the best pruning.
+//
+
+/**
+ * @brief One-sided Hausdorff distance: largest distance of a source vertex to the target.
+ */
+struct HausdorffDistance
+{
+    float           distance = 0.0f;
+    std::uint32_t   vertex = 0;         // source vertex at `distance`
+    glm::vec3       target_point;       // its closest point on the target, if `distance` is finite
+
+    // Closest point queries run, the other vertices were pruned without a query.
+    std::size_t     query_count = 0;
+};
+
+/**
+ * @brief Both one-sided Hausdorff distances between two meshes.
+ */
+struct SymmetricHausdorffDistance
+{
+    float               distance = 0.0f;    // largest of both
+    HausdorffDistance   forward;            // from the first mesh to the second
+    HausdorffDistance   backward;           // from the second mesh to the first
+};
+
+/**
+ * @brief Hausdorff distance from the vertices of `source` to the `target` surface.
+ *
+ * Only the maximum is exact. With `h` the largest distance found so far:
+ *  - a query bounded by `h` that finds a point ends the vertex early,
+ *    it can't raise `h`: only the vertices that do get a full query;
+ *  - the distance is 1-Lipschitz: a vertex within h - d of the previous
+ *    queried vertex, at `d` from the target, is skipped without a query.
+ */
+HausdorffDistance compute_hausdorff_distance(
+    const Mesh&                 source,
+    const ClosestPointQuery&    target,
+    const float                 max_distance);
+
+SymmetricHausdorffDistance compute_symmetric_hausdorff_distance(
+    const Mesh&                 first,
+    const ClosestPointQuery&    first_query,
+    const Mesh&                 second,
+    const ClosestPointQuery&    second_query,
+    const float                 max_distance);
+
+/**
+ * @brief Signed distance of every source vertex to the target surface.
+ *
+ * `deviations` holds one entry per source vertex. The sign is positive on the
+ * side the target normals point to (interpolated at the closest point).
+ * Return the largest absolute deviation.
+ */
+float compute_vertex_deviations(
+    const Mesh&                 source,
+    const ClosestPointQuery&    target,
+    const float                 max_distance,
+    float*                      deviations);
+
+/**
+ * @brief Save per-vertex deviations in a binary file.
+ *
+ * Layout, in native byte order: the 4 characters "DEV1", the vertex count
+ * as a uint32, then one float32 per vertex, in source vertex order.
+ */
+bool write_vertex_deviations(
+    const std::string&  file_path,
+    const float*        deviations,
+    const std::size_t   count);
+
+} // namespace core
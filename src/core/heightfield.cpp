@@ -0,0 +1,344 @@
+#include "heightfield.h"
+
+#include "trace.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    const char* const axis_names[] = { "x", "y", "z" };
+
+    /**
+     * @brief Grid found by `find_height_grid`, with the notations of `Heightfield`.
+     */
+    struct HeightGrid
+    {
+        std::size_t                 axes[3];
+        float                       origin[2];
+        float                       spacing[2];
+        float                       margin[2];
+        std::uint32_t               column_count;
+        std::uint32_t               row_count;
+
+        // Two triangles per cell, in cell order.
+        std::vector<std::uint32_t>  primitives;
+    };
+
+    /**
+     * @brief Find the grid of the mesh projected along `height_axis`. Return false if it isn't one.
+     *
+     * The spacing is guessed from the first triangle, then every vertex is
+     * snapped to its grid node and every triangle must span one cell and
+     * three of its corners. Each cell must end up with two triangles missing
+     * opposite corners, i.e. split along a diagonal.
+     */
+    bool find_height_grid(
+        const MeshPointCloud&   mesh_point_cloud,
+        const std::size_t       height_axis,
+        HeightGrid&             grid)
+    {
+        const std::size_t triangle_count = mesh_point_cloud.get_triangle_count();
+        const std::size_t point_count = mesh_point_cloud.kdtree_get_point_count();
+
+        if (triangle_count < 2 || triangle_count % 2 != 0 || triangle_count > std::numeric_limits<std::uint32_t>::max())
+            return false;
+
+        grid.axes[0] = (height_axis + 1) % 3;
+        grid.axes[1] = (height_axis + 2) % 3;
+        grid.axes[2] = height_axis;
+
+        std::size_t cell_counts[2];
+
+        for (std::size_t axis = 0; axis < 2; ++axis)
+        {
+            const int component = static_cast<int>(grid.axes[axis]);
+
+            float min = std::numeric_limits<float>::infinity();
+            float max = -std::numeric_limits<float>::infinity();
+
+            for (std::size_t i = 0; i < point_count; ++i)
+            {
+                const float position = mesh_point_cloud.kdtree_get_pt(i)[component];
+                min = glm::min(min, position);
+                max = glm::max(max, position);
+            }
+
+            // Spacing of the first triangle.
+            float triangle_min = std::numeric_limits<float>::infinity();
+            float triangle_max = -std::numeric_limits<float>::infinity();
+
+            for (std::size_t i = 0; i < 3; ++i)
+            {
+                const float position = mesh_point_cloud.kdtree_get_pt(i)[component];
+                triangle_min = glm::min(triangle_min, position);
+                triangle_max = glm::max(triangle_max, position);
+            }
+
+            const double extent = double(max) - double(min);
+            const double triangle_extent = double(triangle_max) - double(triangle_min);
+
+            if (!(triangle_extent > 0.0) || !(extent / triangle_extent <= double(triangle_count)))
+                return false;
+
+            cell_counts[axis] = static_cast<std::size_t>(std::llround(extent / triangle_extent));
+
+            if (cell_counts[axis] == 0)
+                return false;
+
+            grid.origin[axis] = min;
+            grid.spacing[axis] = static_cast<float>(extent / double(cell_counts[axis]));
+        }
+
+        // As many triangles as two per cell.
+        if (cell_counts[0] > triangle_count / 2 / cell_counts[1]
+            || 2 * cell_counts[0] * cell_counts[1] != triangle_count)
+            return false;
+
+        grid.column_count = static_cast<std::uint32_t>(cell_counts[0]);
+        grid.row_count = static_cast<std::uint32_t>(cell_counts[1]);
+
+        // Snap the vertices to their node, one triangle at a time.
+        const std::uint32_t no_triangle = std::numeric_limits<std::uint32_t>::max();
+        grid.primitives.assign(triangle_count, no_triangle);
+        std::vector<std::uint8_t> missing_corners(triangle_count / 2);
+
+        double deviation[2] = { 0.0, 0.0 };
+
+        for (std::size_t triangle = 0; triangle < triangle_count; ++triangle)
+        {
+            std::size_t nodes[3][2];
+
+            for (std::size_t v = 0; v < 3; ++v)
+            {
+                const glm::vec3 point = mesh_point_cloud.kdtree_get_pt(3 * triangle + v);
+
+                for (std::size_t axis = 0; axis < 2; ++axis)
+                {
+                    const double position = point[static_cast<int>(grid.axes[axis])];
+                    const double node = std::round((position - grid.origin[axis]) / grid.spacing[axis]);
+
+                    if (!(node >= 0.0 && node <= double(cell_counts[axis])))
+                        return false;
+
+                    nodes[v][axis] = static_cast<std::size_t>(node);
+
+                    // Same operations as `Heightfield::get_block_bounds`.
+                    const float node_position = grid.origin[axis] + float(nodes[v][axis]) * grid.spacing[axis];
+                    const double node_deviation = std::fabs(position - double(node_position));
+
+                    if (node_deviation > 1e-3 * grid.spacing[axis])
+                        return false;
+
+                    deviation[axis] = glm::max(deviation[axis], node_deviation);
+                }
+            }
+
+            const std::size_t i = glm::min(nodes[0][0], glm::min(nodes[1][0], nodes[2][0]));
+            const std::size_t j = glm::min(nodes[0][1], glm::min(nodes[1][1], nodes[2][1]));
+
+            if (glm::max(nodes[0][0], glm::max(nodes[1][0], nodes[2][0])) != i + 1
+                || glm::max(nodes[0][1], glm::max(nodes[1][1], nodes[2][1])) != j + 1)
+                return false;
+
+            // Corners 0 to 3 of the cell, the column first.
+            unsigned int corners = 0;
+
+            for (std::size_t v = 0; v < 3; ++v)
+                corners |= 1u << ((nodes[v][0] - i) + 2 * (nodes[v][1] - j));
+
+            std::uint8_t missing_corner;
+
+            switch (corners)
+            {
+              case 0xE: missing_corner = 0; break;
+              case 0xD: missing_corner = 1; break;
+              case 0xB: missing_corner = 2; break;
+              case 0x7: missing_corner = 3; break;
+              default: return false;
+            }
+
+            const std::size_t cell = j * cell_counts[0] + i;
+
+            if (grid.primitives[2 * cell] == no_triangle)
+            {
+                grid.primitives[2 * cell] = static_cast<std::uint32_t>(triangle);
+                missing_corners[cell] = missing_corner;
+            }
+            else if (grid.primitives[2 * cell + 1] == no_triangle && (missing_corners[cell] ^ missing_corner) == 3)
+                grid.primitives[2 * cell + 1] = static_cast<std::uint32_t>(triangle);
+            else
+                return false;
+        }
+
+        // No triangle went to a full cell, so every cell has its two.
+        // The margin also covers the rounding of the block bounds.
+        for (std::size_t axis = 0; axis < 2; ++axis)
+        {
+            const double extent_max = glm::max(
+                std::fabs(double(grid.origin[axis])),
+                std::fabs(double(grid.origin[axis]) + double(cell_counts[axis]) * grid.spacing[axis]));
+
+            grid.margin[axis] = static_cast<float>(
+                deviation[axis] + 4.0 * std::numeric_limits<float>::epsilon() * extent_max);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Try the y axis, the usual up axis, then z and x.
+     */
+    bool find_height_grid(const MeshPointCloud& mesh_point_cloud, HeightGrid& grid)
+    {
+        const std::size_t height_axes[] = { 1, 2, 0 };
+
+        for (const std::size_t height_axis : height_axes)
+        {
+            if (find_height_grid(mesh_point_cloud, height_axis, grid))
+                return true;
+        }
+
+        return false;
+    }
+}
+
+bool is_height_grid(const MeshPointCloud& mesh_point_cloud)
+{
+    HeightGrid grid;
+    return find_height_grid(mesh_point_cloud, grid);
+}
+
+Heightfield::Heightfield(
+    const MeshPointCloud&   mesh_point_cloud,
+    const std::size_t,
+    const bool              precompute_triangles,
+    const BvhBuildMethod)
+  : m_mesh_point_cloud(mesh_point_cloud)
+  , m_level_count(0)
+{
+    CORE_TRACE_SCOPE("Heightfield build");
+
+    // Start a timer to know how long it takes to build the heightfield.
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    m_levels[0] = { 0, 0, 0 };
+
+    HeightGrid grid;
+
+    if (!find_height_grid(mesh_point_cloud, grid))
+    {
+        std::cerr << "The mesh is not a height grid, the heightfield is empty.\n";
+        return;
+    }
+
+    for (std::size_t axis = 0; axis < 3; ++axis)
+        m_axes[axis] = grid.axes[axis];
+
+    for (std::size_t axis = 0; axis < 2; ++axis)
+    {
+        m_origin[axis] = grid.origin[axis];
+        m_spacing[axis] = grid.spacing[axis];
+        m_margin[axis] = grid.margin[axis];
+    }
+
+    // Levels from the cells to a single block.
+    std::size_t mipmap_size = 0;
+    std::uint32_t column_count = grid.column_count;
+    std::uint32_t row_count = grid.row_count;
+
+    while (true)
+    {
+        assert(m_level_count < max_level_count);
+        m_levels[m_level_count++] = { column_count, row_count, mipmap_size };
+        mipmap_size += std::size_t(column_count) * row_count;
+
+        if (column_count == 1 && row_count == 1)
+            break;
+
+        column_count = (column_count + 1) / 2;
+        row_count = (row_count + 1) / 2;
+    }
+
+    m_mipmaps.resize(mipmap_size);
+
+    // Level 0: height range of the two triangles of each cell.
+    const int height_component = static_cast<int>(m_axes[2]);
+
+    for (std::size_t cell = 0; cell < grid.primitives.size() / 2; ++cell)
+    {
+        HeightRange& range = m_mipmaps[cell];
+        range.min = std::numeric_limits<float>::infinity();
+        range.max = -std::numeric_limits<float>::infinity();
+
+        for (std::size_t k = 0; k < 2; ++k)
+        {
+            glm::vec3 v[3];
+            mesh_point_cloud.get_triangle(std::size_t(grid.primitives[2 * cell + k]) * 3, v[0], v[1], v[2]);
+
+            for (const glm::vec3& vertex : v)
+            {
+                range.min = glm::min(range.min, vertex[height_component]);
+                range.max = glm::max(range.max, vertex[height_component]);
+            }
+        }
+    }
+
+    // Upper levels: range of each 2x2 block below.
+    for (std::size_t level = 1; level < m_level_count; ++level)
+    {
+        const Level& below = m_levels[level - 1];
+
+        for (std::uint32_t j = 0; j < m_levels[level].row_count; ++j)
+        {
+            for (std::uint32_t i = 0; i < m_levels[level].column_count; ++i)
+            {
+                HeightRange& range = m_mipmaps[m_levels[level].offset + std::size_t(j) * m_levels[level].column_count + i];
+                range = get_height_range(static_cast<std::uint32_t>(level - 1), 2 * i, 2 * j);
+
+                for (std::uint32_t sub_j = 2 * j; sub_j < glm::min(2 * j + 2, below.row_count); ++sub_j)
+                {
+                    for (std::uint32_t sub_i = 2 * i; sub_i < glm::min(2 * i + 2, below.column_count); ++sub_i)
+                    {
+                        const HeightRange& sub_range = get_height_range(static_cast<std::uint32_t>(level - 1), sub_i, sub_j);
+                        range.min = glm::min(range.min, sub_range.min);
+                        range.max = glm::max(range.max, sub_range.max);
+                    }
+                }
+            }
+        }
+    }
+
+    m_primitives.assign(grid.primitives.begin(), grid.primitives.end());
+
+    if (precompute_triangles)
+        m_precomputed_triangles.reset(new PrecomputedTriangles(mesh_point_cloud, grid.primitives));
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Generated mesh heightfield (" << grid.column_count << "x" << grid.row_count
+        << " cells, heights along " << axis_names[m_axes[2]] << ") in " << process_time << "ms.\n";
+    std::cout << "\tMipmap levels: " << m_level_count << "\n";
+}
+
+MemoryUsage Heightfield::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("heightfield mipmaps", get_heap_bytes(m_mipmaps));
+    usage.add("heightfield triangle indices", get_heap_bytes(m_primitives));
+
+    if (m_precomputed_triangles)
+        usage.add("precomputed triangles", m_precomputed_triangles->get_memory_usage().get_total_bytes());
+
+    return usage;
+}
+
+} // namespace core
@@ -0,0 +1,826 @@
+#pragma once
+
+#include "bvh_builder.h"
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+#include "precomputed_triangles.h"
+
+#include <glm/glm.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace core
+{
+
+/**
+ * @brief Whether the mesh is a regular grid projected on the x, y or z axis, e.g. a terrain.
+ *
+ * Every cell of the grid must hold two triangles splitting it along a
+ * diagonal, and every vertex must lie on a grid node, within a thousandth
+ * of the spacing. Linear in the triangle count.
+ */
+bool is_height_grid(const MeshPointCloud& mesh_point_cloud);
+
+/**
+ * @brief Heightfield of a grid mesh (see `is_height_grid`), with min/max height mipmaps.
+ *
+ * A triangle grid needs no hierarchy to be built: the cell under a point is
+ * found by a division, and the bounds of any block of cells are its grid
+ * rectangle with the height range of the block. Level 0 of the mipmaps
+ * holds the height range of each cell, and each level above the range of
+ * 2x2 blocks of the level below, up to a single block.
+ *
+ * A closest point query first refines the two triangles of the cell under
+ * the point. Only the cells of a window of twice that distance around the
+ * point may hold a closer triangle: the mipmaps are descended from the few
+ * blocks covering the window, nearest first, skipping the blocks farther
+ * than the closest point so far. Results are exact.
+ *
+ * The class has the interface of `WideBvh`, with the cells as leaves of two
+ * primitives, so `BvhQueryEngine` runs every query on it.
+ */
+class Heightfield
+{
+  public:
+    // Grids have less than 2^32 triangles, so less than 2^31 cells per side.
+    static const std::size_t max_level_count = 32;
+
+    // Along a path, each level leaves at most 3 blocks on the stack, plus the first cell.
+    static const std::size_t max_stack_size = 3 * max_level_count + 6;
+
+    // Level of the stack entry pushing the window of blocks around the first cell, see `push_window`.
+    static const std::uint32_t window_level = max_level_count;
+
+    /**
+     * @brief Build the heightfield. Empty if the mesh is not a grid.
+     *
+     * The leaf size and the build method don't apply: they are there for
+     * `BvhQueryEngine`. With `precompute_triangles`, the terms of the closest
+     * point computation are stored for every triangle, in cell order.
+     */
+    Heightfield(
+        const MeshPointCloud&   mesh_point_cloud,
+        const std::size_t       leaf_max_size = 2,
+        const bool              precompute_triangles = false,
+        const BvhBuildMethod    build_method = BvhBuildMethod::Sah);
+
+    /**
+     * @brief Visit the cells closer than `closest_distance2`, the cell under the point first.
+     *
+     * Same as `CompactBvh::traverse_nearest`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_nearest(
+        const Vec3&                     query_point,
+        typename Vec3::value_type&      closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Same as above, for any query shape. See `CompactBvh::traverse_closest`.
+     */
+    template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+    void traverse_closest(
+        const BoxDistance&              box_distance2,
+        Scalar&                         closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Visit the cells needed by a packet of nearby queries, in one traversal.
+     *
+     * Same as `CompactBvh::traverse_packet`.
+     */
+    template <typename Scalar, std::size_t PacketWidth, typename LeafVisitor>
+    void traverse_packet(
+        const PointPacket<Scalar, PacketWidth>& packet,
+        Scalar                                  (&closest_distance2)[PacketWidth],
+        LeafVisitor&                            visit_leaf) const;
+
+    /**
+     * @brief Suspended `traverse_nearest`, for traversals interleaved on one thread.
+     */
+    template <typename Scalar>
+    struct NearestTraversal
+    {
+        struct StackEntry
+        {
+            std::uint32_t   i;
+            std::uint32_t   j;
+            std::uint32_t   level;          // 0 for cells, or `window_level`
+            Scalar          distance2;      // to the block bounds
+        };
+
+        StackEntry      stack[max_stack_size];
+        std::size_t     stack_size;
+
+        // Cell under the query point, visited first, then skipped by the descent.
+        std::uint32_t   first_cell;
+    };
+
+    /**
+     * @brief Start a `traverse_nearest` that runs one block per `step_nearest` call.
+     */
+    template <typename Vec3>
+    void start_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal) const;
+
+    /**
+     * @brief Process the next block or cell of the traversal, then prefetch the following one.
+     *
+     * Same as `CompactBvh::step_nearest`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    bool step_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal,
+        typename Vec3::value_type&                                  closest_distance2,
+        LeafVisitor&                                                visit_leaf) const;
+
+    /**
+     * @brief Visit the cells a ray enters before `max_t`, nearest entry first.
+     *
+     * Same as `CompactBvh::traverse_ray`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_ray(
+        const Vec3&                     origin,
+        const Vec3&                     direction,
+        typename Vec3::value_type&      max_t,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Triangle index of the primitive at `index`: the two triangles of each cell, in cell order.
+     */
+    inline std::uint32_t get_primitive(const std::size_t index) const
+    {
+        return m_primitives[index];
+    }
+
+    /**
+     * @brief Precomputed triangles in cell order, or nullptr.
+     */
+    inline const PrecomputedTriangles* get_precomputed_triangles() const
+    {
+        return m_precomputed_triangles.get();
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_mesh_point_cloud;
+    }
+
+    /**
+     * @brief Number of cells along the two grid axes, 0 if the mesh is not a grid.
+     */
+    inline std::size_t get_column_count() const
+    {
+        return m_levels[0].column_count;
+    }
+
+    inline std::size_t get_row_count() const
+    {
+        return m_levels[0].row_count;
+    }
+
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    /**
+     * @brief Height range of a block of cells.
+     */
+    struct HeightRange
+    {
+        float min;
+        float max;
+    };
+
+    struct Level
+    {
+        std::uint32_t   column_count;
+        std::uint32_t   row_count;
+        std::size_t     offset;         // of the level in `m_mipmaps`
+    };
+
+    typedef TrackedVector<HeightRange, MemoryCategory::QueryIndex> MipmapArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryIndex> PrimitiveArray;
+
+    const MeshPointCloud&   m_mesh_point_cloud;
+
+    // Heights are along `m_axes[2]`, columns along `m_axes[0]` and rows along `m_axes[1]`.
+    std::size_t             m_axes[3];
+
+    // Grid node (i, j) is at `m_origin + (i, j) * m_spacing` on the column and row axes.
+    float                   m_origin[2];
+    float                   m_spacing[2];
+
+    // Largest distance between a vertex and its grid node, plus rounding, on the column and row axes.
+    float                   m_margin[2];
+
+    Level                   m_levels[max_level_count];
+    std::size_t             m_level_count;
+
+    // All the levels, from the cells to the single top block, rows after rows.
+    MipmapArray             m_mipmaps;
+
+    // Triangle indices, two per cell, in cell order.
+    PrimitiveArray          m_primitives;
+
+    // Optional, in cell order too.
+    std::unique_ptr<PrecomputedTriangles> m_precomputed_triangles;
+
+    inline std::uint32_t get_cell(const std::uint32_t i, const std::uint32_t j) const
+    {
+        return j * m_levels[0].column_count + i;
+    }
+
+    inline const HeightRange& get_height_range(
+        const std::uint32_t     level,
+        const std::uint32_t     i,
+        const std::uint32_t     j) const
+    {
+        return m_mipmaps[m_levels[level].offset + std::size_t(j) * m_levels[level].column_count + i];
+    }
+
+    /**
+     * @brief Bounds of the block (i, j) of `level`: its grid rectangle, widened by the margin, and its height range.
+     */
+    inline void get_block_bounds(
+        const std::uint32_t     level,
+        const std::uint32_t     i,
+        const std::uint32_t     j,
+        glm::vec3&              box_min,
+        glm::vec3&              box_max) const
+    {
+        const std::uint32_t first_column = i << level;
+        const std::uint32_t first_row = j << level;
+        const std::uint32_t end_column = glm::min((i + 1) << level, m_levels[0].column_count);
+        const std::uint32_t end_row = glm::min((j + 1) << level, m_levels[0].row_count);
+
+        const HeightRange& height = get_height_range(level, i, j);
+
+        box_min[m_axes[0]] = m_origin[0] + float(first_column) * m_spacing[0] - m_margin[0];
+        box_min[m_axes[1]] = m_origin[1] + float(first_row) * m_spacing[1] - m_margin[1];
+        box_min[m_axes[2]] = height.min;
+        box_max[m_axes[0]] = m_origin[0] + float(end_column) * m_spacing[0] + m_margin[0];
+        box_max[m_axes[1]] = m_origin[1] + float(end_row) * m_spacing[1] + m_margin[1];
+        box_max[m_axes[2]] = height.max;
+    }
+
+    /**
+     * @brief Cell whose column and row contain the projection of `point`, clamped to the grid.
+     */
+    template <typename Vec3>
+    inline std::uint32_t find_cell(const Vec3& point) const;
+
+    /**
+     * @brief Push the blocks of `level` in the given ranges closer than `closest_distance2`, nearest last.
+     *
+     * `skip_cell` is never pushed.
+     */
+    template <typename StackEntry, typename Scalar, typename BoxDistance>
+    inline void push_blocks(
+        const std::uint32_t             level,
+        const std::uint32_t             first_i,
+        const std::uint32_t             end_i,
+        const std::uint32_t             first_j,
+        const std::uint32_t             end_j,
+        const BoxDistance&              box_distance2,
+        const Scalar                    closest_distance2,
+        const std::uint32_t             skip_cell,
+        StackEntry*                     stack,
+        std::size_t&                    stack_size) const;
+
+    /**
+     * @brief Push the sub-blocks of `entry`, see `push_blocks`.
+     */
+    template <typename StackEntry, typename Scalar, typename BoxDistance>
+    inline void push_children(
+        const StackEntry&               entry,
+        const BoxDistance&              box_distance2,
+        const Scalar                    closest_distance2,
+        const std::uint32_t             skip_cell,
+        StackEntry*                     stack,
+        std::size_t&                    stack_size) const
+    {
+        assert(entry.level > 0);
+
+        const Level& below = m_levels[entry.level - 1];
+
+        push_blocks(
+            entry.level - 1,
+            2 * entry.i,
+            glm::min(2 * entry.i + 2, below.column_count),
+            2 * entry.j,
+            glm::min(2 * entry.j + 2, below.row_count),
+            box_distance2,
+            closest_distance2,
+            skip_cell,
+            stack,
+            stack_size);
+    }
+
+    /**
+     * @brief Push the blocks that may hold a point closer than `closest_distance2`, once the first cell is refined.
+     *
+     * These cells are in a square window of twice the distance around the
+     * point. The blocks covering the window are taken on the lowest level
+     * where there are at most 2x2 of them, so the descent starts there
+     * instead of at the top.
+     */
+    template <typename Vec3>
+    inline void push_window(
+        const Vec3&                                                 query_point,
+        const typename Vec3::value_type                             closest_distance2,
+        NearestTraversal<typename Vec3::value_type>&                traversal) const;
+
+    inline void prefetch_children(const std::uint32_t level, const std::uint32_t i, const std::uint32_t j) const
+    {
+        if (level == window_level)
+            return;
+
+        if (level == 0)
+            prefetch(&m_primitives[2 * std::size_t(get_cell(i, j))]);
+        else
+        {
+            // The sub-blocks are on two rows of the level below.
+            const Level& below = m_levels[level - 1];
+            prefetch(&get_height_range(level - 1, 2 * i, 2 * j));
+
+            if (2 * j + 1 < below.row_count)
+                prefetch(&get_height_range(level - 1, 2 * i, 2 * j + 1));
+        }
+    }
+};
+
+//
+// Implementation.
+//
+
+template <typename Vec3>
+std::uint32_t Heightfield::find_cell(const Vec3& point) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    std::uint32_t cell[2];
+
+    for (std::size_t axis = 0; axis < 2; ++axis)
+    {
+        const Scalar position = (point[m_axes[axis]] - Scalar(m_origin[axis])) / Scalar(m_spacing[axis]);
+        const std::uint32_t count = axis == 0 ? m_levels[0].column_count : m_levels[0].row_count;
+
+        // Written so that NaN goes to the first cell.
+        if (!(position > Scalar(0)))
+            cell[axis] = 0;
+        else if (position >= Scalar(count))
+            cell[axis] = count - 1;
+        else
+            cell[axis] = static_cast<std::uint32_t>(position);
+    }
+
+    return get_cell(cell[0], cell[1]);
+}
+
+template <typename StackEntry, typename Scalar, typename BoxDistance>
+void Heightfield::push_blocks(
+    const std::uint32_t             level,
+    const std::uint32_t             first_i,
+    const std::uint32_t             end_i,
+    const std::uint32_t             first_j,
+    const std::uint32_t             end_j,
+    const BoxDistance&              box_distance2,
+    const Scalar                    closest_distance2,
+    const std::uint32_t             skip_cell,
+    StackEntry*                     stack,
+    std::size_t&                    stack_size) const
+{
+    assert(end_i - first_i <= 2 && end_j - first_j <= 2);
+    assert(stack_size + 4 <= max_stack_size);
+
+    // Insertion sort of the visited blocks on the stack, farthest first.
+    const std::size_t first = stack_size;
+
+    for (std::uint32_t j = first_j; j < end_j; ++j)
+    {
+        for (std::uint32_t i = first_i; i < end_i; ++i)
+        {
+            if (level == 0 && get_cell(i, j) == skip_cell)
+                continue;
+
+            glm::vec3 box_min, box_max;
+            get_block_bounds(level, i, j, box_min, box_max);
+            const Scalar distance2 = box_distance2(box_min, box_max);
+
+            if (!(distance2 < closest_distance2))
+                continue;
+
+            std::size_t k = stack_size++;
+
+            while (k > first && stack[k - 1].distance2 < distance2)
+            {
+                stack[k] = stack[k - 1];
+                --k;
+            }
+
+            stack[k].i = i;
+            stack[k].j = j;
+            stack[k].level = level;
+            stack[k].distance2 = distance2;
+        }
+    }
+}
+
+template <typename Vec3>
+void Heightfield::push_window(
+    const Vec3&                                                 query_point,
+    const typename Vec3::value_type                             closest_distance2,
+    NearestTraversal<typename Vec3::value_type>&                traversal) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Scalar radius = std::sqrt(closest_distance2);
+
+    // Cells of the window, plus one on each side for the rounding. Infinities give the whole grid.
+    std::uint32_t first_cell[2];
+    std::uint32_t last_cell[2];
+
+    for (std::size_t axis = 0; axis < 2; ++axis)
+    {
+        const std::uint32_t count = axis == 0 ? m_levels[0].column_count : m_levels[0].row_count;
+        const Scalar position = query_point[m_axes[axis]] - Scalar(m_origin[axis]);
+        const Scalar low = (position - radius - Scalar(m_margin[axis])) / Scalar(m_spacing[axis]) - Scalar(1);
+        const Scalar high = (position + radius + Scalar(m_margin[axis])) / Scalar(m_spacing[axis]) + Scalar(1);
+
+        first_cell[axis] = !(low > Scalar(0)) ? 0 : low >= Scalar(count) ? count - 1 : static_cast<std::uint32_t>(low);
+        last_cell[axis] = !(high < Scalar(count)) ? count - 1 : high <= Scalar(0) ? 0 : static_cast<std::uint32_t>(high);
+    }
+
+    std::uint32_t level = 0;
+
+    while ((first_cell[0] >> level) + 1 < (last_cell[0] >> level)
+        || (first_cell[1] >> level) + 1 < (last_cell[1] >> level))
+        ++level;
+
+    assert(level < m_level_count);
+
+    const auto box_distance2 = [&](const glm::vec3& box_min, const glm::vec3& box_max)
+    {
+        return distance2_to_box(query_point, Vec3(box_min), Vec3(box_max));
+    };
+
+    push_blocks(
+        level,
+        first_cell[0] >> level,
+        (last_cell[0] >> level) + 1,
+        first_cell[1] >> level,
+        (last_cell[1] >> level) + 1,
+        box_distance2,
+        closest_distance2,
+        traversal.first_cell,
+        traversal.stack,
+        traversal.stack_size);
+}
+
+template <typename Vec3, typename LeafVisitor>
+void Heightfield::traverse_nearest(
+    const Vec3&                     query_point,
+    typename Vec3::value_type&      closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    NearestTraversal<Scalar> traversal;
+    start_nearest(query_point, traversal);
+
+    const auto box_distance2 = [&](const glm::vec3& box_min, const glm::vec3& box_max)
+    {
+        return distance2_to_box(query_point, Vec3(box_min), Vec3(box_max));
+    };
+
+    while (traversal.stack_size > 0)
+    {
+        const auto entry = traversal.stack[--traversal.stack_size];
+
+        // A closer point was found since this block was pushed.
+        if (entry.distance2 >= closest_distance2)
+            continue;
+
+        if (entry.level == 0)
+            visit_leaf(2 * get_cell(entry.i, entry.j), 2, closest_distance2);
+        else if (entry.level == window_level)
+            push_window(query_point, closest_distance2, traversal);
+        else
+            push_children(entry, box_distance2, closest_distance2, traversal.first_cell, traversal.stack, traversal.stack_size);
+    }
+}
+
+template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+void Heightfield::traverse_closest(
+    const BoxDistance&              box_distance2,
+    Scalar&                         closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename NearestTraversal<Scalar>::StackEntry StackEntry;
+
+    if (m_primitives.empty())
+        return;
+
+    const std::uint32_t top = static_cast<std::uint32_t>(m_level_count - 1);
+
+    glm::vec3 root_min, root_max;
+    get_block_bounds(top, 0, 0, root_min, root_max);
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    stack[stack_size++] = { 0, 0, top, box_distance2(root_min, root_max) };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer point was found since this block was pushed.
+        if (entry.distance2 >= closest_distance2)
+            continue;
+
+        if (entry.level == 0)
+        {
+            visit_leaf(2 * get_cell(entry.i, entry.j), 2, closest_distance2);
+            continue;
+        }
+
+        push_children(entry, box_distance2, closest_distance2, std::numeric_limits<std::uint32_t>::max(), stack, stack_size);
+    }
+}
+
+template <typename Scalar, std::size_t PacketWidth, typename LeafVisitor>
+void Heightfield::traverse_packet(
+    const PointPacket<Scalar, PacketWidth>& packet,
+    Scalar                                  (&closest_distance2)[PacketWidth],
+    LeafVisitor&                            visit_leaf) const
+{
+    struct StackEntry
+    {
+        std::uint32_t   i;
+        std::uint32_t   j;
+        std::uint32_t   level;                  // 0 for cells
+        Scalar          distance2[PacketWidth]; // of every lane to the block bounds
+        Scalar          nearest_distance2;      // of the lanes that need the block
+    };
+
+    if (m_primitives.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    const std::uint32_t top = static_cast<std::uint32_t>(m_level_count - 1);
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    StackEntry& root = stack[stack_size++];
+    root.i = 0;
+    root.j = 0;
+    root.level = top;
+
+    glm::vec3 root_min, root_max;
+    get_block_bounds(top, 0, 0, root_min, root_max);
+    distance2_to_box(packet, root_min, root_max, root.distance2);
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // Closer points were found for every lane since this block was pushed.
+        if (get_min_distance2_below(entry.distance2, closest_distance2) == infinity)
+            continue;
+
+        if (entry.level == 0)
+        {
+            visit_leaf(2 * get_cell(entry.i, entry.j), 2, entry.distance2, closest_distance2);
+            continue;
+        }
+
+        assert(stack_size + 4 <= max_stack_size);
+
+        const std::uint32_t level = entry.level - 1;
+        const std::uint32_t end_i = glm::min(2 * entry.i + 2, m_levels[level].column_count);
+        const std::uint32_t end_j = glm::min(2 * entry.j + 2, m_levels[level].row_count);
+
+        // Insertion sort of the needed sub-blocks on the stack, farthest first.
+        const std::size_t first = stack_size;
+
+        for (std::uint32_t j = 2 * entry.j; j < end_j; ++j)
+        {
+            for (std::uint32_t i = 2 * entry.i; i < end_i; ++i)
+            {
+                StackEntry child;
+                child.i = i;
+                child.j = j;
+                child.level = level;
+
+                glm::vec3 box_min, box_max;
+                get_block_bounds(level, i, j, box_min, box_max);
+                distance2_to_box(packet, box_min, box_max, child.distance2);
+                child.nearest_distance2 = get_min_distance2_below(child.distance2, closest_distance2);
+
+                if (child.nearest_distance2 == infinity)
+                    continue;
+
+                std::size_t k = stack_size++;
+
+                while (k > first && stack[k - 1].nearest_distance2 < child.nearest_distance2)
+                {
+                    stack[k] = stack[k - 1];
+                    --k;
+                }
+
+                stack[k] = child;
+            }
+        }
+    }
+}
+
+template <typename Vec3>
+void Heightfield::start_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal) const
+{
+    traversal.stack_size = 0;
+    traversal.first_cell = std::numeric_limits<std::uint32_t>::max();
+
+    if (m_primitives.empty())
+        return;
+
+    const std::uint32_t top = static_cast<std::uint32_t>(m_level_count - 1);
+
+    glm::vec3 box_min, box_max;
+
+    // The window around the first cell, pruned with the whole grid bounds. A grid of one cell has none.
+    if (top > 0)
+    {
+        get_block_bounds(top, 0, 0, box_min, box_max);
+        traversal.stack[traversal.stack_size++] = {
+            0,
+            0,
+            window_level,
+            distance2_to_box(query_point, Vec3(box_min), Vec3(box_max)) };
+    }
+
+    // The cell under the point goes on top: its triangles most often bound the search to a few cells.
+    traversal.first_cell = find_cell(query_point);
+
+    const std::uint32_t i = traversal.first_cell % m_levels[0].column_count;
+    const std::uint32_t j = traversal.first_cell / m_levels[0].column_count;
+
+    get_block_bounds(0, i, j, box_min, box_max);
+    traversal.stack[traversal.stack_size++] = {
+        i,
+        j,
+        0,
+        distance2_to_box(query_point, Vec3(box_min), Vec3(box_max)) };
+
+    prefetch_children(0, i, j);
+}
+
+template <typename Vec3, typename LeafVisitor>
+bool Heightfield::step_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal,
+    typename Vec3::value_type&                                  closest_distance2,
+    LeafVisitor&                                                visit_leaf) const
+{
+    typedef typename NearestTraversal<typename Vec3::value_type>::StackEntry StackEntry;
+
+    StackEntry* stack = traversal.stack;
+    std::size_t& stack_size = traversal.stack_size;
+
+    // Entries pruned since they were pushed: skipped without loading their block.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    const StackEntry entry = stack[--stack_size];
+
+    if (entry.level == 0)
+        visit_leaf(2 * get_cell(entry.i, entry.j), 2, closest_distance2);
+    else if (entry.level == window_level)
+        push_window(query_point, closest_distance2, traversal);
+    else
+    {
+        const auto box_distance2 = [&](const glm::vec3& box_min, const glm::vec3& box_max)
+        {
+            return distance2_to_box(query_point, Vec3(box_min), Vec3(box_max));
+        };
+
+        push_children(entry, box_distance2, closest_distance2, traversal.first_cell, stack, stack_size);
+    }
+
+    // A cell may have pruned the next entries.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    prefetch_children(stack[stack_size - 1].level, stack[stack_size - 1].i, stack[stack_size - 1].j);
+
+    return true;
+}
+
+template <typename Vec3, typename LeafVisitor>
+void Heightfield::traverse_ray(
+    const Vec3&                     origin,
+    const Vec3&                     direction,
+    typename Vec3::value_type&      max_t,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    struct StackEntry
+    {
+        std::uint32_t   i;
+        std::uint32_t   j;
+        std::uint32_t   level;              // 0 for cells
+        Scalar          t_entry;
+    };
+
+    if (m_primitives.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    const Vec3 inv_direction(
+        direction.x != Scalar(0) ? Scalar(1) / direction.x : infinity,
+        direction.y != Scalar(0) ? Scalar(1) / direction.y : infinity,
+        direction.z != Scalar(0) ? Scalar(1) / direction.z : infinity);
+
+    const std::uint32_t top = static_cast<std::uint32_t>(m_level_count - 1);
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    glm::vec3 root_min, root_max;
+    get_block_bounds(top, 0, 0, root_min, root_max);
+
+    Scalar root_t_entry;
+    if (!intersect_ray_box(origin, inv_direction, Vec3(root_min), Vec3(root_max), max_t, root_t_entry))
+        return;
+
+    stack[stack_size++] = { 0, 0, top, root_t_entry };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer hit was found since this block was pushed.
+        if (entry.t_entry > max_t)
+            continue;
+
+        if (entry.level == 0)
+        {
+            visit_leaf(2 * get_cell(entry.i, entry.j), 2, max_t);
+            continue;
+        }
+
+        assert(stack_size + 4 <= max_stack_size);
+
+        const std::uint32_t level = entry.level - 1;
+        const std::uint32_t end_i = glm::min(2 * entry.i + 2, m_levels[level].column_count);
+        const std::uint32_t end_j = glm::min(2 * entry.j + 2, m_levels[level].row_count);
+
+        // Insertion sort of the hit sub-blocks on the stack, farthest entry first.
+        const std::size_t first = stack_size;
+
+        for (std::uint32_t j = 2 * entry.j; j < end_j; ++j)
+        {
+            for (std::uint32_t i = 2 * entry.i; i < end_i; ++i)
+            {
+                glm::vec3 box_min, box_max;
+                get_block_bounds(level, i, j, box_min, box_max);
+
+                Scalar t_entry;
+
+                if (!intersect_ray_box(origin, inv_direction, Vec3(box_min), Vec3(box_max), max_t, t_entry))
+                    continue;
+
+                std::size_t k = stack_size++;
+
+                while (k > first && stack[k - 1].t_entry < t_entry)
+                {
+                    stack[k] = stack[k - 1];
+                    --k;
+                }
+
+                stack[k] = { i, j, level, t_entry };
+            }
+        }
+    }
+}
+
+} // namespace core
@@ -2,6 +2,16 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace core
 {
 
@@ -9,10 +19,26 @@ namespace core
 // Math utilities.
 //
 
+// Functions taking a `Vec3` template work both in single precision
+// (`glm::vec3`) and double precision (`glm::dvec3`).
+//
+
 /**
  * @brief Squared distance between two points.
  */
-inline float distance2(const glm::vec3& lhs, const glm::vec3& rhs);
+template <typename Vec3>
+inline typename Vec3::value_type distance2(const Vec3& lhs, const Vec3& rhs);
+
+/**
+ * @brief Squared distance between a point and an axis-aligned box.
+ *
+ * Zero when the point is inside the box.
+ */
+template <typename Vec3>
+inline typename Vec3::value_type distance2_to_box(
+    const Vec3&         p,
+    const Vec3&         box_min,
+    const Vec3&         box_max);
 
 /**
  * @brief Closest point to a given point on a triangle.
@@ -22,56 +48,307 @@ inline float distance2(const glm::vec3& lhs, const glm::vec3& rhs);
  *    David Eberly, Geometric Tools, Redmond WA 98052
  *    https://www.geometrictools.com/Documentation/DistancePoint3Triangle3.pdf
  */
-inline glm::vec3 closest_point_in_triangle(
-    const glm::vec3&    p,
+template <typename Vec3>
+inline Vec3 closest_point_in_triangle(
+    const Vec3&         p,
+    const Vec3&         vertex0,
+    const Vec3&         vertex1,
+    const Vec3&         vertex2);
+
+/**
+ * @brief Same as above, also returning the barycentric coordinates
+ * (weights of vertex0, vertex1 and vertex2) of the closest point.
+ *
+ * Coordinates of the vertices that don't contribute are exactly 0.
+ */
+template <typename Vec3>
+inline Vec3 closest_point_in_triangle(
+    const Vec3&         p,
+    const Vec3&         vertex0,
+    const Vec3&         vertex1,
+    const Vec3&         vertex2,
+    Vec3&               barycentric);
+
+/**
+ * @brief Intersection of a ray and a triangle, seen from both sides.
+ *
+ * On a hit at a ray parameter in [0, max_t), return true with the
+ * parameter `t` (in units of `direction`) and the barycentric coordinates.
+ *
+ * Reference:
+ *  - Fast, Minimum Storage Ray/Triangle Intersection
+ *    Tomas Moller, Ben Trumbore, Journal of Graphics Tools, 1997
+ */
+template <typename Vec3>
+inline bool intersect_ray_triangle(
+    const Vec3&                 origin,
+    const Vec3&                 direction,
+    const Vec3&                 vertex0,
+    const Vec3&                 vertex1,
+    const Vec3&                 vertex2,
+    typename Vec3::value_type   max_t,
+    typename Vec3::value_type&  t,
+    Vec3&                       barycentric);
+
+/**
+ * @brief Ray parameter where a ray enters an axis-aligned box (slab test).
+ *
+ * `inv_direction` is `1 / direction`, infinite on axes the ray is parallel to.
+ * Return false if the ray misses the box or enters it at a parameter
+ * greater than `max_t`. A ray starting inside the box enters at 0.
+ */
+template <typename Vec3>
+inline bool intersect_ray_box(
+    const Vec3&                 origin,
+    const Vec3&                 inv_direction,
+    const Vec3&                 box_min,
+    const Vec3&                 box_max,
+    typename Vec3::value_type   max_t,
+    typename Vec3::value_type&  t_entry);
+
+/**
+ * @brief Squared distance between a segment and an axis-aligned box. Exact.
+ *
+ * The slab planes split the segment in at most 7 pieces, on each of
+ * which the squared distance is a quadratic of the segment parameter.
+ */
+template <typename Vec3>
+inline typename Vec3::value_type distance2_segment_to_box(
+    const Vec3&         start,
+    const Vec3&         end,
+    const Vec3&         box_min,
+    const Vec3&         box_max);
+
+/**
+ * @brief Closest points of two segments, `p0 + s * (p1 - p0)` and `q0 + t * (q1 - q0)`.
+ *
+ * Return the squared distance between them. Degenerate segments are points.
+ *
+ * Reference:
+ *  - Real-Time Collision Detection, 5.1.9
+ *    Christer Ericson, 2005
+ */
+template <typename Vec3>
+inline typename Vec3::value_type closest_points_on_segments(
+    const Vec3&                 p0,
+    const Vec3&                 p1,
+    const Vec3&                 q0,
+    const Vec3&                 q1,
+    typename Vec3::value_type&  s,
+    typename Vec3::value_type&  t);
+
+/**
+ * @brief Closest points of a segment and a triangle. Exact.
+ *
+ * Return the squared distance, with the closest point on the segment
+ * as `start + segment_t * (end - start)`, and the closest point on the
+ * triangle with its barycentric coordinates. When the segment crosses
+ * the triangle, both points are the first crossing.
+ */
+template <typename Vec3>
+inline typename Vec3::value_type closest_points_segment_triangle(
+    const Vec3&                 start,
+    const Vec3&                 end,
+    const Vec3&                 vertex0,
+    const Vec3&                 vertex1,
+    const Vec3&                 vertex2,
+    typename Vec3::value_type&  segment_t,
+    Vec3&                       triangle_point,
+    Vec3&                       barycentric);
+
+/**
+ * @brief Part of a triangle a closest point lies on.
+ */
+enum class SurfaceFeature
+{
+    Vertex,
+    Edge,
+    Face
+};
+
+/**
+ * @brief Feature of a closest point, from its barycentric coordinates.
+ */
+template <typename Vec3>
+inline SurfaceFeature get_surface_feature(const Vec3& barycentric);
+
+/**
+ * @brief Terms of `closest_point_in_triangle` that only depend on the triangle.
+ *
+ * Degenerate triangles (zero area) are detected when the terms are computed
+ * and stored as their longest edge: [origin, origin + edge0].
+ */
+struct TriangleQueryData
+{
+    glm::vec3   origin;         // vertex0
+    glm::vec3   edge0;          // vertex1 - vertex0
+    glm::vec3   edge1;          // vertex2 - vertex0
+    float       a00;            // dot(edge0, edge0)
+    float       a01;            // dot(edge0, edge1)
+    float       a11;            // dot(edge1, edge1)
+    float       inv_det;        // 1 / (a00 * a11 - a01 * a01)
+    float       inv_a00;
+    float       inv_a11;
+    float       inv_a_12;       // 1 / (a00 - 2 * a01 + a11), i.e. 1 / squared length of vertex2 - vertex1
+    bool        degenerate;
+    std::uint8_t segment;       // degenerate only: 0 = vertex0-vertex1, 1 = vertex0-vertex2, 2 = vertex1-vertex2
+};
+
+inline TriangleQueryData make_triangle_query_data(
     const glm::vec3&    vertex0,
     const glm::vec3&    vertex1,
     const glm::vec3&    vertex2);
 
+/**
+ * @brief Closest point to a given point on a triangle, using precomputed terms.
+ *
+ * Same algorithm as `closest_point_in_triangle` with divisions replaced by
+ * precomputed reciprocals. Never produces NaNs, even on degenerate triangles.
+ */
+inline glm::vec3 closest_point_in_triangle(
+    const glm::vec3&            p,
+    const TriangleQueryData&    triangle);
+
+/**
+ * @brief Same as above, also returning the barycentric coordinates of the closest point.
+ */
+inline glm::vec3 closest_point_in_triangle(
+    const glm::vec3&            p,
+    const TriangleQueryData&    triangle,
+    glm::vec3&                  barycentric);
+
+/**
+ * @brief `Width` query points in SoA layout, processed together.
+ */
+template <typename Scalar, std::size_t Width>
+struct PointPacket
+{
+    Scalar  x[Width];
+    Scalar  y[Width];
+    Scalar  z[Width];
+};
+
+/**
+ * @brief Squared distances between every point of a packet and an axis-aligned box.
+ *
+ * Same operations as `distance2_to_box`, lane by lane.
+ */
+template <typename Scalar, std::size_t Width>
+inline void distance2_to_box(
+    const PointPacket<Scalar, Width>&   packet,
+    const glm::vec3&                    box_min,
+    const glm::vec3&                    box_max,
+    Scalar                              (&distance2)[Width]);
+
+/**
+ * @brief Squared distances between a point and `Width` boxes in SoA layout, e.g. the children of a wide node.
+ *
+ * Same operations as `distance2_to_box`, box by box, in one vectorized loop.
+ * Empty boxes (min +infinity, max -infinity) are at infinity.
+ */
+template <typename Vec3, std::size_t Width>
+inline void distance2_to_boxes(
+    const Vec3&                         p,
+    const float                         (&min_x)[Width],
+    const float                         (&min_y)[Width],
+    const float                         (&min_z)[Width],
+    const float                         (&max_x)[Width],
+    const float                         (&max_y)[Width],
+    const float                         (&max_z)[Width],
+    typename Vec3::value_type           (&distance2)[Width]);
+
+/**
+ * @brief Smallest of the `distance2` lanes strictly below their `bound`, or infinity.
+ */
+template <typename Scalar, std::size_t Width>
+inline Scalar get_min_distance2_below(
+    const Scalar                        (&distance2)[Width],
+    const Scalar                        (&bound)[Width]);
+
+/**
+ * @brief Squared distances between every point of a packet and its closest point on a triangle.
+ *
+ * Batched `closest_point_in_triangle(p, triangle)`: the triangle terms are
+ * loaded once and the regions are picked with selects instead of branches,
+ * so the loop over the lanes vectorizes. The operations are the same, and
+ * so are the distances.
+ */
+template <std::size_t Width>
+inline void distance2_to_triangle(
+    const PointPacket<float, Width>&    packet,
+    const TriangleQueryData&            triangle,
+    float                               (&distance2)[Width]);
+
 
 //
 // Implementaiton.
 //
 
-float distance2(const glm::vec3& lhs, const glm::vec3& rhs)
+template <typename Vec3>
+typename Vec3::value_type distance2(const Vec3& lhs, const Vec3& rhs)
 {
-    const glm::vec3 diff = lhs - rhs;
+    const Vec3 diff = lhs - rhs;
     return glm::dot(diff, diff);
 }
 
-glm::vec3 closest_point_in_triangle(
-    const glm::vec3&    p,
-    const glm::vec3&    vertex0,
-    const glm::vec3&    vertex1,
-    const glm::vec3&    vertex2)
+template <typename Vec3>
+typename Vec3::value_type distance2_to_box(
+    const Vec3&         p,
+    const Vec3&         box_min,
+    const Vec3&         box_max)
 {
-    const glm::vec3 vertex0_p = p - vertex0;
-    const glm::vec3 edge0 = vertex1 - vertex0;
-    const glm::vec3 edge1 = vertex2- vertex0;
-    const float a00 = glm::dot(edge0, edge0);
-    const float a01 = glm::dot(edge0, edge1);
-    const float a11 = glm::dot(edge1, edge1);
-    const float b0 = -glm::dot(vertex0_p, edge0);
-    const float b1 = -glm::dot(vertex0_p, edge1);
+    const Vec3 clamped = glm::clamp(p, box_min, box_max);
+    return distance2(p, clamped);
+}
 
-    const float det = a00 * a11 - a01 * a01;
-    float t0 = a01 * b1 - a11 * b0;
-    float t1 = a01 * b0 - a00 * b1;
+template <typename Vec3>
+Vec3 closest_point_in_triangle(
+    const Vec3&         p,
+    const Vec3&         vertex0,
+    const Vec3&         vertex1,
+    const Vec3&         vertex2)
+{
+    Vec3 barycentric;
+    return closest_point_in_triangle(p, vertex0, vertex1, vertex2, barycentric);
+}
+
+template <typename Vec3>
+Vec3 closest_point_in_triangle(
+    const Vec3&         p,
+    const Vec3&         vertex0,
+    const Vec3&         vertex1,
+    const Vec3&         vertex2,
+    Vec3&               barycentric)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Vec3 vertex0_p = p - vertex0;
+    const Vec3 edge0 = vertex1 - vertex0;
+    const Vec3 edge1 = vertex2- vertex0;
+    const Scalar a00 = glm::dot(edge0, edge0);
+    const Scalar a01 = glm::dot(edge0, edge1);
+    const Scalar a11 = glm::dot(edge1, edge1);
+    const Scalar b0 = -glm::dot(vertex0_p, edge0);
+    const Scalar b1 = -glm::dot(vertex0_p, edge1);
+
+    const Scalar det = a00 * a11 - a01 * a01;
+    Scalar t0 = a01 * b1 - a11 * b0;
+    Scalar t1 = a01 * b0 - a00 * b1;
 
     // FIXME: Make this code easy to read.
     // Right now, it's copy-pasted from the paper.
     if (t0 + t1 <= det)
     {
-        if (t0 < 0.0f)
+        if (t0 < Scalar(0))
         {
-            if (t1 < 0.0f)  // region 4
+            if (t1 < Scalar(0))  // region 4
             {
-                if (b0 < 0.0f)
+                if (b0 < Scalar(0))
                 {
-                    t1 = 0.0f;
+                    t1 = Scalar(0);
                     if (-b0 >= a00)  // V1
                     {
-                        t0 = 1.0f;
+                        t0 = Scalar(1);
                     }
                     else  // E01
                     {
@@ -80,14 +357,14 @@ glm::vec3 closest_point_in_triangle(
                 }
                 else
                 {
-                    t0 = 0.0f;
-                    if (b1 >= 0.0f)  // V0
+                    t0 = Scalar(0);
+                    if (b1 >= Scalar(0))  // V0
                     {
-                        t1 = 0.0f;
+                        t1 = Scalar(0);
                     }
                     else if (-b1 >= a11)  // V2
                     {
-                        t1 = 1.0f;
+                        t1 = Scalar(1);
                     }
                     else  // E20
                     {
@@ -97,14 +374,14 @@ glm::vec3 closest_point_in_triangle(
             }
             else  // region 3
             {
-                t0 = 0.0f;
-                if (b1 >= 0.0f)  // V0
+                t0 = Scalar(0);
+                if (b1 >= Scalar(0))  // V0
                 {
-                    t1 = 0.0f;
+                    t1 = Scalar(0);
                 }
                 else if (-b1 >= a11)  // V2
                 {
-                    t1 = 1.0f;
+                    t1 = Scalar(1);
                 }
                 else  // E20
                 {
@@ -112,16 +389,16 @@ glm::vec3 closest_point_in_triangle(
                 }
             }
         }
-        else if (t1 < 0.0f)  // region 5
+        else if (t1 < Scalar(0))  // region 5
         {
-            t1 = 0.0f;
-            if (b0 >= 0.0f)  // V0
+            t1 = Scalar(0);
+            if (b0 >= Scalar(0))  // V0
             {
-                t0 = 0.0f;
+                t0 = Scalar(0);
             }
             else if (-b0 >= a00)  // V1
             {
-                t0 = 1.0f;
+                t0 = Scalar(1);
             }
             else  // E01
             {
@@ -130,44 +407,44 @@ glm::vec3 closest_point_in_triangle(
         }
         else  // region 0, interior
         {
-            const float invDet = 1.0f / det;
+            const Scalar invDet = Scalar(1) / det;
             t0 *= invDet;
             t1 *= invDet;
         }
     }
     else
     {
-        float tmp0, tmp1, numer, denom;
+        Scalar tmp0, tmp1, numer, denom;
 
-        if (t0 < 0.0f)  // region 2
+        if (t0 < Scalar(0))  // region 2
         {
             tmp0 = a01 + b0;
             tmp1 = a11 + b1;
             if (tmp1 > tmp0)
             {
                 numer = tmp1 - tmp0;
-                denom = a00 - 2.0 * a01 + a11;
+                denom = a00 - Scalar(2) * a01 + a11;
                 if (numer >= denom)  // V1
                 {
-                    t0 = 1.0f;
-                    t1 = 0.0f;
+                    t0 = Scalar(1);
+                    t1 = Scalar(0);
                 }
                 else  // E12
                 {
                     t0 = numer / denom;
-                    t1 = 1.0f - t0;
+                    t1 = Scalar(1) - t0;
                 }
             }
             else
             {
-                t0 = 0.0f;
-                if (tmp1 <= 0.0f)  // V2
+                t0 = Scalar(0);
+                if (tmp1 <= Scalar(0))  // V2
                 {
-                    t1 = 1.0f;
+                    t1 = Scalar(1);
                 }
-                else if (b1 >= 0.0f)  // V0
+                else if (b1 >= Scalar(0))  // V0
                 {
-                    t1 = 0.0f;
+                    t1 = Scalar(0);
                 }
                 else  // E20
                 {
@@ -175,35 +452,35 @@ glm::vec3 closest_point_in_triangle(
                 }
             }
         }
-        else if (t1 < 0.0f)  // region 6
+        else if (t1 < Scalar(0))  // region 6
         {
             tmp0 = a01 + b1;
             tmp1 = a00 + b0;
             if (tmp1 > tmp0)
             {
                 numer = tmp1 - tmp0;
-                denom = a00 - 2.0 * a01 + a11;
+                denom = a00 - Scalar(2) * a01 + a11;
                 if (numer >= denom)  // V2
                 {
-                    t1 = 1.0f;
-                    t0 = 0.0f;
+                    t1 = Scalar(1);
+                    t0 = Scalar(0);
                 }
                 else  // E12
                 {
                     t1 = numer / denom;
-                    t0 = 1.0f - t1;
+                    t0 = Scalar(1) - t1;
                 }
             }
             else
             {
-                t1 = 0.0f;
-                if (tmp1 <= 0.0f)  // V1
+                t1 = Scalar(0);
+                if (tmp1 <= Scalar(0))  // V1
                 {
-                    t0 = 1.0f;
+                    t0 = Scalar(1);
                 }
-                else if (b0 >= 0.0f)  // V0
+                else if (b0 >= Scalar(0))  // V0
                 {
-                    t0 = 0.0f;
+                    t0 = Scalar(0);
                 }
                 else  // E01
                 {
@@ -214,29 +491,725 @@ glm::vec3 closest_point_in_triangle(
         else  // region 1
         {
             numer = a11 + b1 - a01 - b0;
-            if (numer <= 0.0f)  // V2
+            if (numer <= Scalar(0))  // V2
             {
-                t0 = 0.0f;
-                t1 = 1.0f;
+                t0 = Scalar(0);
+                t1 = Scalar(1);
             }
             else
             {
-                denom = a00 - 2.0 * a01 + a11;
+                denom = a00 - Scalar(2) * a01 + a11;
                 if (numer >= denom)  // V1
                 {
-                    t0 = 1.0f;
-                    t1 = 0.0f;
+                    t0 = Scalar(1);
+                    t1 = Scalar(0);
                 }
                 else  // 12
                 {
                     t0 = numer / denom;
-                    t1 = 1.0f - t0;
+                    t1 = Scalar(1) - t0;
                 }
             }
         }
     }
 
+    barycentric = Vec3(Scalar(1) - t0 - t1, t0, t1);
     return vertex0 + t0 * edge0 + t1 * edge1;
 }
 
+template <typename Vec3>
+bool intersect_ray_triangle(
+    const Vec3&                 origin,
+    const Vec3&                 direction,
+    const Vec3&                 vertex0,
+    const Vec3&                 vertex1,
+    const Vec3&                 vertex2,
+    typename Vec3::value_type   max_t,
+    typename Vec3::value_type&  t,
+    Vec3&                       barycentric)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Vec3 edge0 = vertex1 - vertex0;
+    const Vec3 edge1 = vertex2 - vertex0;
+    const Vec3 p = glm::cross(direction, edge1);
+    const Scalar det = glm::dot(edge0, p);
+
+    // Parallel to the triangle plane, or degenerate triangle.
+    if (det == Scalar(0))
+        return false;
+
+    const Scalar inv_det = Scalar(1) / det;
+    const Vec3 vertex0_origin = origin - vertex0;
+    const Scalar u = glm::dot(vertex0_origin, p) * inv_det;
+
+    if (u < Scalar(0) || u > Scalar(1))
+        return false;
+
+    const Vec3 q = glm::cross(vertex0_origin, edge0);
+    const Scalar v = glm::dot(direction, q) * inv_det;
+
+    if (v < Scalar(0) || u + v > Scalar(1))
+        return false;
+
+    const Scalar hit_t = glm::dot(edge1, q) * inv_det;
+
+    if (!(hit_t >= Scalar(0) && hit_t < max_t))
+        return false;
+
+    t = hit_t;
+    barycentric = Vec3(Scalar(1) - u - v, u, v);
+    return true;
+}
+
+template <typename Vec3>
+bool intersect_ray_box(
+    const Vec3&                 origin,
+    const Vec3&                 inv_direction,
+    const Vec3&                 box_min,
+    const Vec3&                 box_max,
+    typename Vec3::value_type   max_t,
+    typename Vec3::value_type&  t_entry)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    Scalar t_min = Scalar(0);
+    Scalar t_max = max_t;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        Scalar t0 = (box_min[axis] - origin[axis]) * inv_direction[axis];
+        Scalar t1 = (box_max[axis] - origin[axis]) * inv_direction[axis];
+
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        // Written so that NaNs (0 * infinity, on a slab plane) don't reject the box.
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+
+        if (t_min > t_max)
+            return false;
+    }
+
+    t_entry = t_min;
+    return true;
+}
+
+template <typename Vec3>
+typename Vec3::value_type distance2_segment_to_box(
+    const Vec3&         start,
+    const Vec3&         end,
+    const Vec3&         box_min,
+    const Vec3&         box_max)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Vec3 direction = end - start;
+
+    // Segment parameters where the segment crosses a slab plane.
+    Scalar splits[8];
+    std::size_t split_count = 0;
+    splits[split_count++] = Scalar(0);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (direction[axis] == Scalar(0))
+            continue;
+
+        const Scalar t0 = (box_min[axis] - start[axis]) / direction[axis];
+        const Scalar t1 = (box_max[axis] - start[axis]) / direction[axis];
+
+        if (t0 > Scalar(0) && t0 < Scalar(1))
+            splits[split_count++] = t0;
+        if (t1 > Scalar(0) && t1 < Scalar(1))
+            splits[split_count++] = t1;
+    }
+
+    splits[split_count++] = Scalar(1);
+    std::sort(splits + 1, splits + split_count - 1);
+
+    Scalar closest_distance2 = std::numeric_limits<Scalar>::max();
+
+    for (std::size_t i = 0; i + 1 < split_count; ++i)
+    {
+        // On the piece, each axis is below, inside or above the box:
+        // the distance is the sum of (start + t * direction - bound)^2
+        // over the axes outside, minimal at t = -b / a.
+        const Scalar middle = (splits[i] + splits[i + 1]) * Scalar(0.5);
+        Scalar a = Scalar(0);
+        Scalar b = Scalar(0);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const Scalar value = start[axis] + middle * direction[axis];
+            const Scalar bound =
+                value < box_min[axis] ? box_min[axis] :
+                value > box_max[axis] ? box_max[axis] : value;
+
+            if (bound == value)
+                continue;
+
+            a += direction[axis] * direction[axis];
+            b += direction[axis] * (start[axis] - bound);
+        }
+
+        const Scalar t = a > Scalar(0)
+            ? std::min(std::max(-b / a, splits[i]), splits[i + 1])
+            : splits[i];
+
+        closest_distance2 = std::min(closest_distance2, distance2_to_box(Vec3(start + t * direction), box_min, box_max));
+
+        if (closest_distance2 == Scalar(0))
+            break;
+    }
+
+    return closest_distance2;
+}
+
+template <typename Vec3>
+typename Vec3::value_type closest_points_on_segments(
+    const Vec3&                 p0,
+    const Vec3&                 p1,
+    const Vec3&                 q0,
+    const Vec3&                 q1,
+    typename Vec3::value_type&  s,
+    typename Vec3::value_type&  t)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Vec3 d1 = p1 - p0;
+    const Vec3 d2 = q1 - q0;
+    const Vec3 r = p0 - q0;
+    const Scalar a = glm::dot(d1, d1);
+    const Scalar e = glm::dot(d2, d2);
+    const Scalar f = glm::dot(d2, r);
+
+    const auto clamp01 = [](const Scalar value)
+    {
+        return std::min(std::max(value, Scalar(0)), Scalar(1));
+    };
+
+    if (a == Scalar(0) && e == Scalar(0))
+    {
+        s = t = Scalar(0);
+    }
+    else if (a == Scalar(0))
+    {
+        s = Scalar(0);
+        t = clamp01(f / e);
+    }
+    else
+    {
+        const Scalar c = glm::dot(d1, r);
+
+        if (e == Scalar(0))
+        {
+            t = Scalar(0);
+            s = clamp01(-c / a);
+        }
+        else
+        {
+            const Scalar b = glm::dot(d1, d2);
+            const Scalar denom = a * e - b * b;
+
+            // Parallel segments: any s works, take the start.
+            s = denom > Scalar(0) ? clamp01((b * f - c * e) / denom) : Scalar(0);
+            t = (b * s + f) / e;
+
+            if (t < Scalar(0))
+            {
+                t = Scalar(0);
+                s = clamp01(-c / a);
+            }
+            else if (t > Scalar(1))
+            {
+                t = Scalar(1);
+                s = clamp01((b - c) / a);
+            }
+        }
+    }
+
+    return distance2(Vec3(p0 + s * d1), Vec3(q0 + t * d2));
+}
+
+template <typename Vec3>
+typename Vec3::value_type closest_points_segment_triangle(
+    const Vec3&                 start,
+    const Vec3&                 end,
+    const Vec3&                 vertex0,
+    const Vec3&                 vertex1,
+    const Vec3&                 vertex2,
+    typename Vec3::value_type&  segment_t,
+    Vec3&                       triangle_point,
+    Vec3&                       barycentric)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Vec3 direction = end - start;
+
+    // The segment crosses the triangle.
+    Scalar t;
+    if (intersect_ray_triangle(start, direction, vertex0, vertex1, vertex2, Scalar(1), t, barycentric))
+    {
+        segment_t = t;
+        triangle_point = start + t * direction;
+        return Scalar(0);
+    }
+
+    // Otherwise the closest points are on the boundary of one of them:
+    // an end of the segment, or an edge of the triangle.
+    Vec3 end_barycentric;
+    triangle_point = closest_point_in_triangle(start, vertex0, vertex1, vertex2, barycentric);
+    segment_t = Scalar(0);
+    Scalar closest_distance2 = distance2(start, triangle_point);
+
+    const Vec3 end_point = closest_point_in_triangle(end, vertex0, vertex1, vertex2, end_barycentric);
+    const Scalar end_distance2 = distance2(end, end_point);
+
+    if (end_distance2 < closest_distance2)
+    {
+        closest_distance2 = end_distance2;
+        segment_t = Scalar(1);
+        triangle_point = end_point;
+        barycentric = end_barycentric;
+    }
+
+    const Vec3* vertices[3] = { &vertex0, &vertex1, &vertex2 };
+
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        const int first = edge;
+        const int second = (edge + 1) % 3;
+
+        Scalar s, u;
+        const Scalar edge_distance2 = closest_points_on_segments(start, end, *vertices[first], *vertices[second], s, u);
+
+        if (edge_distance2 < closest_distance2)
+        {
+            closest_distance2 = edge_distance2;
+            segment_t = s;
+            triangle_point = *vertices[first] + u * (*vertices[second] - *vertices[first]);
+            barycentric = Vec3(Scalar(0));
+            barycentric[first] = Scalar(1) - u;
+            barycentric[second] = u;
+        }
+    }
+
+    return closest_distance2;
+}
+
+template <typename Vec3>
+SurfaceFeature get_surface_feature(const Vec3& barycentric)
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const int zero_count =
+        (barycentric.x == Scalar(0) ? 1 : 0)
+        + (barycentric.y == Scalar(0) ? 1 : 0)
+        + (barycentric.z == Scalar(0) ? 1 : 0);
+
+    if (zero_count >= 2)
+        return SurfaceFeature::Vertex;
+
+    return zero_count == 1 ? SurfaceFeature::Edge : SurfaceFeature::Face;
+}
+
+TriangleQueryData make_triangle_query_data(
+    const glm::vec3&    vertex0,
+    const glm::vec3&    vertex1,
+    const glm::vec3&    vertex2)
+{
+    TriangleQueryData triangle;
+    triangle.origin = vertex0;
+    triangle.edge0 = vertex1 - vertex0;
+    triangle.edge1 = vertex2 - vertex0;
+    triangle.a00 = glm::dot(triangle.edge0, triangle.edge0);
+    triangle.a01 = glm::dot(triangle.edge0, triangle.edge1);
+    triangle.a11 = glm::dot(triangle.edge1, triangle.edge1);
+
+    const float det = triangle.a00 * triangle.a11 - triangle.a01 * triangle.a01;
+    const float a_12 = triangle.a00 - 2.0f * triangle.a01 + triangle.a11;
+
+    // The determinant is the squared area (times 4): compare it to the
+    // squared edge lengths to get a scale independent test.
+    triangle.degenerate =
+        !(det > std::numeric_limits<float>::epsilon() * triangle.a00 * triangle.a11)
+        || !(a_12 > 0.0f);
+    triangle.segment = 0;
+
+    if (triangle.degenerate)
+    {
+        // All vertices are aligned: the triangle is its longest edge.
+        const glm::vec3 edge2 = vertex2 - vertex1;
+        const float a22 = glm::dot(edge2, edge2);
+
+        if (triangle.a11 > triangle.a00 && triangle.a11 >= a22)
+        {
+            triangle.edge0 = triangle.edge1;
+            triangle.a00 = triangle.a11;
+            triangle.segment = 1;
+        }
+        else if (a22 > triangle.a00)
+        {
+            triangle.origin = vertex1;
+            triangle.edge0 = edge2;
+            triangle.a00 = a22;
+            triangle.segment = 2;
+        }
+
+        triangle.edge1 = glm::vec3(0.0f);
+        triangle.a01 = 0.0f;
+        triangle.a11 = 0.0f;
+        triangle.inv_det = 0.0f;
+        triangle.inv_a00 = triangle.a00 > 0.0f ? 1.0f / triangle.a00 : 0.0f;
+        triangle.inv_a11 = 0.0f;
+        triangle.inv_a_12 = 0.0f;
+        return triangle;
+    }
+
+    triangle.inv_det = 1.0f / det;
+    triangle.inv_a00 = 1.0f / triangle.a00;
+    triangle.inv_a11 = 1.0f / triangle.a11;
+    triangle.inv_a_12 = 1.0f / a_12;
+    return triangle;
+}
+
+glm::vec3 closest_point_in_triangle(
+    const glm::vec3&            p,
+    const TriangleQueryData&    triangle)
+{
+    glm::vec3 barycentric;
+    return closest_point_in_triangle(p, triangle, barycentric);
+}
+
+glm::vec3 closest_point_in_triangle(
+    const glm::vec3&            p,
+    const TriangleQueryData&    triangle,
+    glm::vec3&                  barycentric)
+{
+    const glm::vec3 vertex0_p = p - triangle.origin;
+
+    if (triangle.degenerate)
+    {
+        const float t = glm::clamp(glm::dot(vertex0_p, triangle.edge0) * triangle.inv_a00, 0.0f, 1.0f);
+
+        if (triangle.segment == 0)
+            barycentric = glm::vec3(1.0f - t, t, 0.0f);
+        else if (triangle.segment == 1)
+            barycentric = glm::vec3(1.0f - t, 0.0f, t);
+        else
+            barycentric = glm::vec3(0.0f, 1.0f - t, t);
+
+        return triangle.origin + t * triangle.edge0;
+    }
+
+    const float a00 = triangle.a00;
+    const float a01 = triangle.a01;
+    const float a11 = triangle.a11;
+    const float b0 = -glm::dot(vertex0_p, triangle.edge0);
+    const float b1 = -glm::dot(vertex0_p, triangle.edge1);
+
+    const float det = a00 * a11 - a01 * a01;
+    float t0 = a01 * b1 - a11 * b0;
+    float t1 = a01 * b0 - a00 * b1;
+
+    // Same regions as `closest_point_in_triangle`.
+    if (t0 + t1 <= det)
+    {
+        if (t0 < 0.0f)
+        {
+            if (t1 < 0.0f)  // region 4
+            {
+                if (b0 < 0.0f)
+                {
+                    t1 = 0.0f;
+                    t0 = -b0 >= a00 ? 1.0f : -b0 * triangle.inv_a00;  // V1 or E01
+                }
+                else
+                {
+                    t0 = 0.0f;
+                    if (b1 >= 0.0f)  // V0
+                        t1 = 0.0f;
+                    else  // V2 or E20
+                        t1 = -b1 >= a11 ? 1.0f : -b1 * triangle.inv_a11;
+                }
+            }
+            else  // region 3
+            {
+                t0 = 0.0f;
+                if (b1 >= 0.0f)  // V0
+                    t1 = 0.0f;
+                else  // V2 or E20
+                    t1 = -b1 >= a11 ? 1.0f : -b1 * triangle.inv_a11;
+            }
+        }
+        else if (t1 < 0.0f)  // region 5
+        {
+            t1 = 0.0f;
+            if (b0 >= 0.0f)  // V0
+                t0 = 0.0f;
+            else  // V1 or E01
+                t0 = -b0 >= a00 ? 1.0f : -b0 * triangle.inv_a00;
+        }
+        else  // region 0, interior
+        {
+            t0 *= triangle.inv_det;
+            t1 *= triangle.inv_det;
+        }
+    }
+    else
+    {
+        if (t0 < 0.0f)  // region 2
+        {
+            const float tmp0 = a01 + b0;
+            const float tmp1 = a11 + b1;
+            if (tmp1 > tmp0)
+            {
+                const float numer = tmp1 - tmp0;
+                t0 = std::min(numer * triangle.inv_a_12, 1.0f);  // V1 or E12
+                t1 = 1.0f - t0;
+            }
+            else
+            {
+                t0 = 0.0f;
+                if (tmp1 <= 0.0f)  // V2
+                    t1 = 1.0f;
+                else if (b1 >= 0.0f)  // V0
+                    t1 = 0.0f;
+                else  // E20
+                    t1 = -b1 * triangle.inv_a11;
+            }
+        }
+        else if (t1 < 0.0f)  // region 6
+        {
+            const float tmp0 = a01 + b1;
+            const float tmp1 = a00 + b0;
+            if (tmp1 > tmp0)
+            {
+                const float numer = tmp1 - tmp0;
+                t1 = std::min(numer * triangle.inv_a_12, 1.0f);  // V2 or E12
+                t0 = 1.0f - t1;
+            }
+            else
+            {
+                t1 = 0.0f;
+                if (tmp1 <= 0.0f)  // V1
+                    t0 = 1.0f;
+                else if (b0 >= 0.0f)  // V0
+                    t0 = 0.0f;
+                else  // E01
+                    t0 = -b0 * triangle.inv_a00;
+            }
+        }
+        else  // region 1
+        {
+            const float numer = a11 + b1 - a01 - b0;
+            if (numer <= 0.0f)  // V2
+            {
+                t0 = 0.0f;
+                t1 = 1.0f;
+            }
+            else  // V1 or E12
+            {
+                t0 = std::min(numer * triangle.inv_a_12, 1.0f);
+                t1 = 1.0f - t0;
+            }
+        }
+    }
+
+    barycentric = glm::vec3(1.0f - t0 - t1, t0, t1);
+    return triangle.origin + t0 * triangle.edge0 + t1 * triangle.edge1;
+}
+
+template <typename Scalar, std::size_t Width>
+void distance2_to_box(
+    const PointPacket<Scalar, Width>&   packet,
+    const glm::vec3&                    box_min,
+    const glm::vec3&                    box_max,
+    Scalar                              (&distance2)[Width])
+{
+    const Scalar min_x = Scalar(box_min.x), min_y = Scalar(box_min.y), min_z = Scalar(box_min.z);
+    const Scalar max_x = Scalar(box_max.x), max_y = Scalar(box_max.y), max_z = Scalar(box_max.z);
+
+    for (std::size_t i = 0; i < Width; ++i)
+    {
+        // Clamp like `glm::clamp`, with selects on values.
+        const Scalar x = packet.x[i] < min_x ? min_x : packet.x[i];
+        const Scalar y = packet.y[i] < min_y ? min_y : packet.y[i];
+        const Scalar z = packet.z[i] < min_z ? min_z : packet.z[i];
+        const Scalar dx = packet.x[i] - (max_x < x ? max_x : x);
+        const Scalar dy = packet.y[i] - (max_y < y ? max_y : y);
+        const Scalar dz = packet.z[i] - (max_z < z ? max_z : z);
+        distance2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+template <typename Vec3, std::size_t Width>
+void distance2_to_boxes(
+    const Vec3&                         p,
+    const float                         (&min_x)[Width],
+    const float                         (&min_y)[Width],
+    const float                         (&min_z)[Width],
+    const float                         (&max_x)[Width],
+    const float                         (&max_y)[Width],
+    const float                         (&max_z)[Width],
+    typename Vec3::value_type           (&distance2)[Width])
+{
+    typedef typename Vec3::value_type Scalar;
+
+    const Scalar px = p.x, py = p.y, pz = p.z;
+
+    for (std::size_t i = 0; i < Width; ++i)
+    {
+        // Clamp like `glm::clamp`, with selects on values.
+        const Scalar x = px < Scalar(min_x[i]) ? Scalar(min_x[i]) : px;
+        const Scalar y = py < Scalar(min_y[i]) ? Scalar(min_y[i]) : py;
+        const Scalar z = pz < Scalar(min_z[i]) ? Scalar(min_z[i]) : pz;
+        const Scalar dx = px - (Scalar(max_x[i]) < x ? Scalar(max_x[i]) : x);
+        const Scalar dy = py - (Scalar(max_y[i]) < y ? Scalar(max_y[i]) : y);
+        const Scalar dz = pz - (Scalar(max_z[i]) < z ? Scalar(max_z[i]) : z);
+        distance2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+template <typename Scalar, std::size_t Width>
+Scalar get_min_distance2_below(
+    const Scalar                        (&distance2)[Width],
+    const Scalar                        (&bound)[Width])
+{
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    Scalar result = infinity;
+
+    for (std::size_t i = 0; i < Width; ++i)
+    {
+        const Scalar lane = distance2[i] < bound[i] ? distance2[i] : infinity;
+        result = lane < result ? lane : result;
+    }
+
+    return result;
+}
+
+template <std::size_t Width>
+void distance2_to_triangle(
+    const PointPacket<float, Width>&    packet,
+    const TriangleQueryData&            triangle,
+    float                               (&distance2)[Width])
+{
+    const float ox = triangle.origin.x, oy = triangle.origin.y, oz = triangle.origin.z;
+    const float e0x = triangle.edge0.x, e0y = triangle.edge0.y, e0z = triangle.edge0.z;
+
+    if (triangle.degenerate)
+    {
+        for (std::size_t i = 0; i < Width; ++i)
+        {
+            const float vx = packet.x[i] - ox, vy = packet.y[i] - oy, vz = packet.z[i] - oz;
+            const float projection = (vx * e0x + vy * e0y + vz * e0z) * triangle.inv_a00;
+            const float clamped = projection < 0.0f ? 0.0f : projection;
+            const float t = 1.0f < clamped ? 1.0f : clamped;
+
+            const float dx = ox + t * e0x - packet.x[i];
+            const float dy = oy + t * e0y - packet.y[i];
+            const float dz = oz + t * e0z - packet.z[i];
+            distance2[i] = dx * dx + dy * dy + dz * dz;
+        }
+
+        return;
+    }
+
+    const float e1x = triangle.edge1.x, e1y = triangle.edge1.y, e1z = triangle.edge1.z;
+    const float a00 = triangle.a00;
+    const float a01 = triangle.a01;
+    const float a11 = triangle.a11;
+    const float det = a00 * a11 - a01 * a01;
+
+    for (std::size_t i = 0; i < Width; ++i)
+    {
+        const float vx = packet.x[i] - ox, vy = packet.y[i] - oy, vz = packet.z[i] - oz;
+        const float b0 = -(vx * e0x + vy * e0y + vz * e0z);
+        const float b1 = -(vx * e1x + vy * e1y + vz * e1z);
+        const float t0 = a01 * b1 - a11 * b0;
+        const float t1 = a01 * b0 - a00 * b1;
+
+        // Every candidate is computed, then selected: no branches, no
+        // conditional arithmetic, so the compiler can if-convert the loop.
+        const float e01 = -b0 * triangle.inv_a00;
+        const float e20 = -b1 * triangle.inv_a11;
+        const float e01_or_v1 = -b0 >= a00 ? 1.0f : e01;
+        const float e20_or_v2 = -b1 >= a11 ? 1.0f : e20;
+
+        // Regions 3, 4 and 5: V0, V1 or E01, V0, V2 or E20.
+        const float on_e01 = b0 >= 0.0f ? 0.0f : e01_or_v1;
+        const float on_e20 = b1 >= 0.0f ? 0.0f : e20_or_v2;
+
+        // Region 0, interior.
+        const float interior_s0 = t0 * triangle.inv_det;
+        const float interior_s1 = t1 * triangle.inv_det;
+
+        // Region 2: V1 or E12, V2, V0 or E20.
+        const float r2_tmp0 = a01 + b0;
+        const float r2_tmp1 = a11 + b1;
+        const float r2_numer = (r2_tmp1 - r2_tmp0) * triangle.inv_a_12;
+        const float r2_t0 = 1.0f < r2_numer ? 1.0f : r2_numer;
+        const float r2_1_t0 = 1.0f - r2_t0;
+        const float r2_e20 = r2_tmp1 <= 0.0f ? 1.0f : (b1 >= 0.0f ? 0.0f : e20);
+        const bool r2_on_e12 = r2_tmp1 > r2_tmp0;
+
+        // Region 6: V2 or E12, V1, V0 or E01.
+        const float r6_tmp0 = a01 + b1;
+        const float r6_tmp1 = a00 + b0;
+        const float r6_numer = (r6_tmp1 - r6_tmp0) * triangle.inv_a_12;
+        const float r6_t1 = 1.0f < r6_numer ? 1.0f : r6_numer;
+        const float r6_1_t1 = 1.0f - r6_t1;
+        const float r6_e01 = r6_tmp1 <= 0.0f ? 1.0f : (b0 >= 0.0f ? 0.0f : e01);
+        const bool r6_on_e12 = r6_tmp1 > r6_tmp0;
+
+        // Region 1: V2, V1 or E12.
+        const float r1_numer = a11 + b1 - a01 - b0;
+        const float r1_scaled = r1_numer * triangle.inv_a_12;
+        const float r1_t0 = r1_numer <= 0.0f ? 0.0f : (1.0f < r1_scaled ? 1.0f : r1_scaled);
+        const float r1_1_t0 = 1.0f - r1_t0;
+        const float r1_t1 = r1_numer <= 0.0f ? 1.0f : r1_1_t0;
+
+        // Bitwise operators: `&&` would be a branch.
+        const bool region_e20 = (t0 < 0.0f) & !((t1 < 0.0f) & (b0 < 0.0f));
+        const bool region_e01 = !region_e20 & (t1 < 0.0f);
+        const float inside_s0 = region_e20 ? 0.0f : (region_e01 ? on_e01 : interior_s0);
+        const float inside_s1 = region_e20 ? on_e20 : (region_e01 ? 0.0f : interior_s1);
+
+        const float r2_s0 = r2_on_e12 ? r2_t0 : 0.0f;
+        const float r2_s1 = r2_on_e12 ? r2_1_t0 : r2_e20;
+        const float r6_s0 = r6_on_e12 ? r6_1_t1 : r6_e01;
+        const float r6_s1 = r6_on_e12 ? r6_t1 : 0.0f;
+        const float outside_s0 = t0 < 0.0f ? r2_s0 : (t1 < 0.0f ? r6_s0 : r1_t0);
+        const float outside_s1 = t0 < 0.0f ? r2_s1 : (t1 < 0.0f ? r6_s1 : r1_t1);
+
+        const bool inside = t0 + t1 <= det;
+        const float s0 = inside ? inside_s0 : outside_s0;
+        const float s1 = inside ? inside_s1 : outside_s1;
+
+        const float dx = ox + s0 * e0x + s1 * e1x - packet.x[i];
+        const float dy = oy + s0 * e0y + s1 * e1y - packet.y[i];
+        const float dz = oz + s0 * e0z + s1 * e1z - packet.z[i];
+        distance2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+/**
+ * @brief Hint the CPU to start loading the cache line of `address`, without waiting for it.
+ *
+ * Traversals interleaving several queries (see `BatchSchedule::Interleaved`)
+ * prefetch the next node of a query, then work on another one during the load.
+ */
+inline void prefetch(const void* address)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    (void)address;
+#endif
+}
+
 } // namespace core
@@ -0,0 +1,103 @@
+#include "memory.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+
+namespace core
+{
+
+namespace
+{
+    const std::size_t category_count = static_cast<std::size_t>(MemoryCategory::Count);
+
+    std::atomic<std::size_t> g_allocated_bytes[category_count];
+    std::atomic<std::size_t> g_peak_allocated_bytes[category_count];
+
+    std::size_t to_index(const MemoryCategory category)
+    {
+        const std::size_t index = static_cast<std::size_t>(category);
+        assert(index < category_count);
+        return index;
+    }
+}
+
+const char* get_memory_category_name(const MemoryCategory category)
+{
+    switch (category)
+    {
+      case MemoryCategory::MeshVertices:    return "Mesh vertices";
+      case MemoryCategory::MeshIndices:     return "Mesh indices";
+      case MemoryCategory::PointCloud:      return "Point cloud";
+      case MemoryCategory::QueryIndex:      return "Query index";
+      case MemoryCategory::QueryCache:      return "Query cache";
+      default:                              return "Unknown";
+    }
+}
+
+std::size_t get_allocated_bytes(const MemoryCategory category)
+{
+    return g_allocated_bytes[to_index(category)].load(std::memory_order_relaxed);
+}
+
+std::size_t get_peak_allocated_bytes(const MemoryCategory category)
+{
+    return g_peak_allocated_bytes[to_index(category)].load(std::memory_order_relaxed);
+}
+
+std::string format_memory_size(const std::size_t bytes)
+{
+    const char* units[] = { "B", "KB", "MB", "GB" };
+
+    double size = static_cast<double>(bytes);
+    std::size_t unit = 0;
+
+    while (size >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0]))
+    {
+        size /= 1024.0;
+        ++unit;
+    }
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", size, units[unit]);
+    return buffer;
+}
+
+void record_allocation(const MemoryCategory category, const std::size_t bytes)
+{
+    const std::size_t index = to_index(category);
+    const std::size_t allocated =
+        g_allocated_bytes[index].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    // Keep track of the highest value.
+    std::size_t peak = g_peak_allocated_bytes[index].load(std::memory_order_relaxed);
+    while (allocated > peak
+        && !g_peak_allocated_bytes[index].compare_exchange_weak(peak, allocated, std::memory_order_relaxed))
+    {}
+}
+
+void record_deallocation(const MemoryCategory category, const std::size_t bytes)
+{
+    g_allocated_bytes[to_index(category)].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryUsage::add(const char* name, const std::size_t bytes)
+{
+    m_components.push_back({ name, bytes });
+}
+
+const std::vector<MemoryUsage::Component>& MemoryUsage::get_components() const
+{
+    return m_components;
+}
+
+std::size_t MemoryUsage::get_total_bytes() const
+{
+    std::size_t total = 0;
+    for (const Component& component : m_components)
+        total += component.bytes;
+    return total;
+}
+
+} // namespace core
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace core
+{
+
+//
+// Memory accounting.
+//
+// Containers of the core objects allocate through `TrackingAllocator`,
+// which counts the live heap bytes of each category for the whole process.
+// Each core object also reports the bytes it owns, component by component,
+// with a `MemoryUsage`.
+//
+
+enum class MemoryCategory
+{
+    MeshVertices,
+    MeshIndices,
+    PointCloud,
+    QueryIndex,
+    QueryCache,
+    Count
+};
+
+const char* get_memory_category_name(const MemoryCategory category);
+
+/**
+ * @brief Live heap bytes allocated through `TrackingAllocator` for a category.
+ */
+std::size_t get_allocated_bytes(const MemoryCategory category);
+
+/**
+ * @brief Highest value reached by `get_allocated_bytes` for a category.
+ */
+std::size_t get_peak_allocated_bytes(const MemoryCategory category);
+
+/**
+ * @brief Human readable size, e.g. "12.3 MB".
+ */
+std::string format_memory_size(const std::size_t bytes);
+
+void record_allocation(const MemoryCategory category, const std::size_t bytes);
+void record_deallocation(const MemoryCategory category, const std::size_t bytes);
+
+/**
+ * @brief Standard allocator that counts allocated bytes in a category.
+ *
+ * Over-aligned types (e.g. nodes aligned on cache lines) are honored,
+ * which `std::allocator` doesn't guarantee before C++17.
+ */
+template <typename T, MemoryCategory Category>
+class TrackingAllocator
+{
+  public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef TrackingAllocator<U, Category> other;
+    };
+
+    TrackingAllocator() = default;
+
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U, Category>&)
+    {}
+
+    T* allocate(const std::size_t count)
+    {
+        T* ptr = nullptr;
+
+        if (alignof(T) > alignof(std::max_align_t))
+        {
+#if defined(_MSC_VER)
+            void* memory = _aligned_malloc(count * sizeof(T), alignof(T));
+            if (memory == nullptr)
+                throw std::bad_alloc();
+#else
+            void* memory = nullptr;
+            if (posix_memalign(&memory, alignof(T), count * sizeof(T)) != 0)
+                throw std::bad_alloc();
+#endif
+            ptr = static_cast<T*>(memory);
+        }
+        else
+        {
+            ptr = std::allocator<T>().allocate(count);
+        }
+
+        record_allocation(Category, count * sizeof(T));
+        return ptr;
+    }
+
+    void deallocate(T* ptr, const std::size_t count)
+    {
+        record_deallocation(Category, count * sizeof(T));
+
+        if (alignof(T) > alignof(std::max_align_t))
+        {
+#if defined(_MSC_VER)
+            _aligned_free(ptr);
+#else
+            free(ptr);
+#endif
+        }
+        else
+            std::allocator<T>().deallocate(ptr, count);
+    }
+};
+
+template <typename T, typename U, MemoryCategory Category>
+bool operator==(const TrackingAllocator<T, Category>&, const TrackingAllocator<U, Category>&)
+{ return true; }
+
+template <typename T, typename U, MemoryCategory Category>
+bool operator!=(const TrackingAllocator<T, Category>&, const TrackingAllocator<U, Category>&)
+{ return false; }
+
+template <typename T, MemoryCategory Category>
+using TrackedVector = std::vector<T, TrackingAllocator<T, Category>>;
+
+/**
+ * @brief Heap bytes held by a vector: what its allocator handed out.
+ */
+template <typename T, typename Allocator>
+inline std::size_t get_heap_bytes(const std::vector<T, Allocator>& vector)
+{
+    return vector.capacity() * sizeof(T);
+}
+
+/**
+ * @brief Heap bytes owned by an object, broken down by component.
+ */
+class MemoryUsage
+{
+  public:
+    struct Component
+    {
+        const char* name;
+        std::size_t bytes;
+    };
+
+    void add(const char* name, const std::size_t bytes);
+
+    const std::vector<Component>& get_components() const;
+
+    std::size_t get_total_bytes() const;
+
+  private:
+    std::vector<Component> m_components;
+};
+
+} // namespace core
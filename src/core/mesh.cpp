@@ -6,18 +6,31 @@ namespace core
 Mesh::Mesh(
     const std::vector<Mesh::Vertex>&    vertices,
     const std::vector<unsigned int>&    triangles)
-  : m_vertices(vertices)
-  , m_triangles(triangles)
+  : m_vertices(vertices.begin(), vertices.end())
+  , m_triangles(triangles.begin(), triangles.end())
 { }
 
-const std::vector<Mesh::Vertex>& Mesh::get_vertices() const
+const Mesh::VertexArray& Mesh::get_vertices() const
 {
     return m_vertices;
 }
 
-const std::vector<unsigned int>& Mesh::get_triangles() const
+const Mesh::IndexArray& Mesh::get_triangles() const
 {
     return m_triangles;
 }
 
+MemoryUsage Mesh::get_memory_usage() const
+{
+    // Positions and normals are interleaved in the same buffer.
+    const std::size_t vertex_bytes = get_heap_bytes(m_vertices);
+    const std::size_t normal_bytes = m_vertices.capacity() * sizeof(glm::vec3);
+
+    MemoryUsage usage;
+    usage.add("vertices", vertex_bytes - normal_bytes);
+    usage.add("normals", normal_bytes);
+    usage.add("indices", get_heap_bytes(m_triangles));
+    return usage;
+}
+
 } // namespace core
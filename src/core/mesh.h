@@ -1,5 +1,7 @@
 #pragma once
 
+#include "memory.h"
+
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
@@ -23,16 +25,24 @@ class Mesh
       glm::vec3 normal;
     };
 
+    typedef TrackedVector<Vertex, MemoryCategory::MeshVertices> VertexArray;
+    typedef TrackedVector<unsigned int, MemoryCategory::MeshIndices> IndexArray;
+
     Mesh(
         const std::vector<Vertex>& vertices,
         const std::vector<unsigned int>& triangles);
 
-    const std::vector<Vertex>& get_vertices() const;
-    const std::vector<unsigned int>& get_triangles() const;
+    const VertexArray& get_vertices() const;
+    const IndexArray& get_triangles() const;
+
+    /**
+     * @brief Heap bytes used by vertex positions, normals and triangle indices.
+     */
+    MemoryUsage get_memory_usage() const;
 
   private:
-    const std::vector<Vertex> m_vertices;
-    const std::vector<unsigned int> m_triangles;
+    const VertexArray m_vertices;
+    const IndexArray m_triangles;
 };
 
 } // namespace core
@@ -1,5 +1,7 @@
 #include "mesh_point_cloud.h"
 
+#include "trace.h"
+
 #include <chrono>
 #include <iostream>
 
@@ -9,12 +11,14 @@ namespace core
 MeshPointCloud::MeshPointCloud(const Mesh& mesh)
   : m_mesh(mesh)
 {
+    CORE_TRACE_SCOPE("MeshPointCloud build");
+
     // Start a timer to know how long it takes to generate the point cloud.
     auto timer_start = std::chrono::high_resolution_clock::now();
 
     // Add all mesh vertices in the point cloud.
-    const std::vector<Mesh::Vertex>& vertices = m_mesh.get_vertices();
-    const std::vector<unsigned int>& triangles = m_mesh.get_triangles();
+    const Mesh::VertexArray& vertices = m_mesh.get_vertices();
+    const Mesh::IndexArray& triangles = m_mesh.get_triangles();
     const std::size_t index_count = triangles.size();
     assert(index_count % 3 == 0);
 
@@ -36,4 +40,11 @@ MeshPointCloud::MeshPointCloud(const Mesh& mesh)
     std::cout << "\tPoint count: " << m_points.size() << "\n";
 }
 
+MemoryUsage MeshPointCloud::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("points", get_heap_bytes(m_points));
+    return usage;
+}
+
 } // namespace core
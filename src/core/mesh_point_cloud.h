@@ -1,5 +1,6 @@
 #pragma once
 
+#include "memory.h"
 #include "mesh.h"
 
 #include <nanoflann/nanoflann.hpp>
@@ -63,6 +64,14 @@ class MeshPointCloud
         return m_points.size() / 3;
     }
 
+    /**
+     * @brief Mesh of the cloud. Cloud triangle `i` is triangle `i` of the mesh.
+     */
+    inline const Mesh& get_mesh() const
+    {
+        return m_mesh;
+    }
+
     // nanoflann compatibility implementaiton.
     inline std::size_t kdtree_get_point_count() const
     {
@@ -88,9 +97,18 @@ class MeshPointCloud
     bool kdtree_get_bbox(BBOX&) const
     { return false; }
 
+    /**
+     * @brief Heap bytes used by the cloud points.
+     *
+     * Each mesh vertex is stored once per triangle using it.
+     */
+    MemoryUsage get_memory_usage() const;
+
   private:
+    typedef TrackedVector<glm::vec3, MemoryCategory::PointCloud> PointArray;
+
     const Mesh&             m_mesh;
-    std::vector<glm::vec3>  m_points;
+    PointArray              m_points;
 };
 
 } // namespace core
@@ -0,0 +1,117 @@
+#include "mesh_projection.h"
+
+#include "closest_point_query.h"
+#include "morton.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    // Vertices per parallel batch.
+    const std::size_t batch_size = 1024;
+
+    void interpolate_attribute(
+        const VertexAttribute&      attribute,
+        const Mesh::IndexArray&     triangles,
+        const ClosestPointResult&   closest,
+        const std::size_t           vertex)
+    {
+        const std::size_t count = attribute.component_count;
+        const float* values[3] = {
+            attribute.target_values + std::size_t(triangles[std::size_t(closest.triangle) * 3]) * count,
+            attribute.target_values + std::size_t(triangles[std::size_t(closest.triangle) * 3 + 1]) * count,
+            attribute.target_values + std::size_t(triangles[std::size_t(closest.triangle) * 3 + 2]) * count };
+
+        float* projected = attribute.projected_values + vertex * count;
+
+        for (std::size_t c = 0; c < count; ++c)
+        {
+            projected[c] =
+                closest.barycentric.x * values[0][c]
+                + closest.barycentric.y * values[1][c]
+                + closest.barycentric.z * values[2][c];
+        }
+    }
+}
+
+std::size_t project_vertices(
+    const Mesh&                 source,
+    const Mesh&                 target,
+    const ClosestPointQuery&    target_query,
+    const float                 max_distance,
+    glm::vec3*                  positions,
+    glm::vec3*                  normals,
+    bool*                       found,
+    const VertexAttribute*      attributes,
+    const std::size_t           attribute_count)
+{
+    CORE_TRACE_SCOPE("project vertices");
+
+    const Mesh::VertexArray& vertices = source.get_vertices();
+    const Mesh::IndexArray& target_triangles = target.get_triangles();
+
+    // Source vertex indices sorted along a Morton curve.
+    const std::vector<std::uint32_t> order = get_morton_order(
+        vertices.size(),
+        [&vertices](const std::size_t i) { return vertices[i].pos; });
+    const std::size_t batch_count = (order.size() + batch_size - 1) / batch_size;
+
+    std::atomic<std::size_t> projected_count(0);
+
+    parallel_for(batch_count, [&](const std::size_t batch)
+    {
+        const std::size_t first = batch * batch_size;
+        const std::size_t count = std::min(batch_size, order.size() - first);
+
+        // Batch buffers, reused by the batches of a thread.
+        static thread_local std::vector<glm::vec3> query_points;
+        static thread_local std::vector<ClosestPointResult> results;
+        static thread_local std::unique_ptr<bool[]> batch_found(new bool[batch_size]);
+
+        query_points.resize(count);
+        results.resize(count);
+
+        for (std::size_t i = 0; i < count; ++i)
+            query_points[i] = vertices[order[first + i]].pos;
+
+        projected_count += target_query.get_closest_points(
+            query_points.data(),
+            count,
+            max_distance,
+            results.data(),
+            batch_found.get());
+
+        // Scatter back in source order.
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::size_t vertex = order[first + i];
+
+            if (found)
+                found[vertex] = batch_found[i];
+
+            if (!batch_found[i])
+                continue;
+
+            positions[vertex] = results[i].point;
+
+            if (normals)
+                normals[vertex] = results[i].normal;
+
+            for (std::size_t a = 0; a < attribute_count; ++a)
+                interpolate_attribute(attributes[a], target_triangles, results[i], vertex);
+        }
+    });
+
+    return projected_count;
+}
+
+} // namespace core
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace core
+{
+
+class ClosestPointQuery;
+
+/**
+ * @brief Per-vertex attribute carried from a target mesh to projected vertices, e.g. UVs or colours.
+ */
+struct VertexAttribute
+{
+    std::size_t     component_count;    // floats per vertex
+
+    // `component_count` floats per target vertex.
+    const float*    target_values;
+
+    // Output: `component_count` floats per source vertex, interpolated at its projection.
+    float*          projected_values;
+};
+
+/**
+ * @brief Snap the vertices of `source` onto the closest points of `target`.
+ *
+ * `target_query` must be built on `target`. All outputs have one entry per
+ * source vertex and are left untouched for the vertices farther than
+ * `max_distance`; only `positions` is required. `normals` gets the target
+ * normals and `attributes` their target values, interpolated with the
+ * barycentric coordinates of the projection.
+ *
+ * Vertices are processed in parallel batches, in Morton order so that the
+ * queries of a batch hit the same parts of the index. Nothing is allocated
+ * per vertex. Return the number of projected vertices.
+ */
+std::size_t project_vertices(
+    const Mesh&                 source,
+    const Mesh&                 target,
+    const ClosestPointQuery&    target_query,
+    const float                 max_distance,
+    glm::vec3*                  positions,
+    glm::vec3*                  normals = nullptr,
+    bool*                       found = nullptr,
+    const VertexAttribute*      attributes = nullptr,
+    const std::size_t           attribute_count = 0);
+
+} // namespace core
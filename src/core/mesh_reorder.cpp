@@ -0,0 +1,90 @@
+#include "mesh_reorder.h"
+
+#include "morton.h"
+#include "trace.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+
+void reorder_mesh_spatially(
+    std::vector<Mesh::Vertex>&  vertices,
+    std::vector<unsigned int>&  triangles)
+{
+    CORE_TRACE_SCOPE("reorder_mesh_spatially");
+
+    assert(triangles.size() % 3 == 0);
+    const std::size_t triangle_count = triangles.size() / 3;
+
+    if (triangle_count == 0)
+        return;
+
+    // Compute triangle centroids and their bounds.
+    std::vector<glm::vec3> centroids(triangle_count);
+    glm::vec3 centroid_min(std::numeric_limits<float>::max());
+    glm::vec3 centroid_max(-std::numeric_limits<float>::max());
+
+    for (std::size_t i = 0; i < triangle_count; ++i)
+    {
+        centroids[i] =
+            (vertices[triangles[i * 3]].pos
+            + vertices[triangles[i * 3 + 1]].pos
+            + vertices[triangles[i * 3 + 2]].pos) / 3.0f;
+
+        centroid_min = glm::min(centroid_min, centroids[i]);
+        centroid_max = glm::max(centroid_max, centroids[i]);
+    }
+
+    // Sort triangles by Morton code.
+    const glm::vec3 inv_extent = get_morton_inv_extent(centroid_min, centroid_max);
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(triangle_count);
+
+    for (std::size_t i = 0; i < triangle_count; ++i)
+        keys[i] = { morton_code(centroids[i], centroid_min, inv_extent), static_cast<std::uint32_t>(i) };
+
+    std::sort(keys.begin(), keys.end());
+
+    // Renumber vertices in order of first use.
+    const unsigned int unassigned = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> new_vertex_index(vertices.size(), unassigned);
+    std::vector<Mesh::Vertex> sorted_vertices;
+    std::vector<unsigned int> sorted_triangles;
+    sorted_vertices.reserve(vertices.size());
+    sorted_triangles.reserve(triangles.size());
+
+    for (const std::pair<std::uint64_t, std::uint32_t>& key : keys)
+    {
+        for (std::size_t j = 0; j < 3; ++j)
+        {
+            const unsigned int vertex = triangles[std::size_t(key.second) * 3 + j];
+
+            if (new_vertex_index[vertex] == unassigned)
+            {
+                new_vertex_index[vertex] = static_cast<unsigned int>(sorted_vertices.size());
+                sorted_vertices.push_back(vertices[vertex]);
+            }
+
+            sorted_triangles.push_back(new_vertex_index[vertex]);
+        }
+    }
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        if (new_vertex_index[i] == unassigned)
+            sorted_vertices.push_back(vertices[i]);
+    }
+
+    vertices.swap(sorted_vertices);
+    triangles.swap(sorted_triangles);
+}
+
+} // namespace core
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <vector>
+
+namespace core
+{
+
+/**
+ * @brief Sort triangles along a Morton curve and renumber vertices to match.
+ *
+ * Triangles are sorted by the Morton code of their centroid, so triangles
+ * that are close in space end up close in memory. Vertices are then renumbered
+ * in the order of their first use by the sorted triangles; unused vertices
+ * are kept at the end.
+ *
+ * Everything built from the mesh afterwards (point cloud, query index,
+ * OpenGL buffers) inherits this order.
+ */
+void reorder_mesh_spatially(
+    std::vector<Mesh::Vertex>&  vertices,
+    std::vector<unsigned int>&  triangles);
+
+} // namespace core
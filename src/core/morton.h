@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+
+//
+// Morton (Z-order) codes.
+//
+// Sorting points by Morton code puts points that are close in space
+// close in memory.
+//
+
+/**
+ * @brief Spread the 21 lowest bits of `value` so that there are 2 zero bits between each bit.
+ */
+inline std::uint64_t expand_bits_21(const std::uint32_t value);
+
+/**
+ * @brief 63-bit Morton code of a point, 21 bits per axis.
+ *
+ * The point is quantized in the box [box_min, box_min + 1 / inv_extent].
+ * Points outside of the box are clamped.
+ */
+inline std::uint64_t morton_code(
+    const glm::vec3&    point,
+    const glm::vec3&    box_min,
+    const glm::vec3&    inv_extent);
+
+/**
+ * @brief Inverse of the box extent, per axis. Flat axes get 0.
+ */
+inline glm::vec3 get_morton_inv_extent(
+    const glm::vec3&    box_min,
+    const glm::vec3&    box_max);
+
+/**
+ * @brief Indices of `count` points sorted along a Morton curve of their bounding box.
+ *
+ * `get_point(i)` returns the point `i`.
+ */
+template <typename GetPoint>
+std::vector<std::uint32_t> get_morton_order(
+    const std::size_t   count,
+    const GetPoint&     get_point);
+
+
+//
+// Implementation.
+//
+
+std::uint64_t expand_bits_21(const std::uint32_t value)
+{
+    std::uint64_t x = value & 0x1FFFFF;
+    x = (x | x << 32) & 0x001F00000000FFFFull;
+    x = (x | x << 16) & 0x001F0000FF0000FFull;
+    x = (x | x << 8)  & 0x100F00F00F00F00Full;
+    x = (x | x << 4)  & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+std::uint64_t morton_code(
+    const glm::vec3&    point,
+    const glm::vec3&    box_min,
+    const glm::vec3&    inv_extent)
+{
+    const float max_value = static_cast<float>((1 << 21) - 1);
+    const glm::vec3 normalized = glm::clamp((point - box_min) * inv_extent, 0.0f, 1.0f) * max_value;
+
+    return expand_bits_21(static_cast<std::uint32_t>(normalized.x)) << 2
+        | expand_bits_21(static_cast<std::uint32_t>(normalized.y)) << 1
+        | expand_bits_21(static_cast<std::uint32_t>(normalized.z));
+}
+
+glm::vec3 get_morton_inv_extent(
+    const glm::vec3&    box_min,
+    const glm::vec3&    box_max)
+{
+    const glm::vec3 extent = box_max - box_min;
+
+    return glm::vec3(
+        extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+        extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+}
+
+template <typename GetPoint>
+std::vector<std::uint32_t> get_morton_order(
+    const std::size_t   count,
+    const GetPoint&     get_point)
+{
+    assert(count <= std::numeric_limits<std::uint32_t>::max());
+
+    glm::vec3 box_min(std::numeric_limits<float>::max());
+    glm::vec3 box_max(-std::numeric_limits<float>::max());
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        box_min = glm::min(box_min, get_point(i));
+        box_max = glm::max(box_max, get_point(i));
+    }
+
+    const glm::vec3 inv_extent = get_morton_inv_extent(box_min, box_max);
+
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(count);
+    for (std::size_t i = 0; i < count; ++i)
+        keys[i] = std::make_pair(morton_code(get_point(i), box_min, inv_extent), static_cast<std::uint32_t>(i));
+
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<std::uint32_t> order(count);
+    for (std::size_t i = 0; i < count; ++i)
+        order[i] = keys[i].second;
+
+    return order;
+}
+
+} // namespace core
@@ -0,0 +1,187 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+
+// Item range [begin, end) of a thread, packed in one word so that its owner
+// and the thieves update it with a single compare-and-swap.
+struct ItemRange
+{
+    std::atomic<std::uint64_t>  range;
+    char                        padding[64 - sizeof(std::atomic<std::uint64_t>)]; // one range per cache line
+
+    static std::uint64_t pack(const std::uint64_t begin, const std::uint64_t end)
+    {
+        return begin | end << 32;
+    }
+
+    static std::uint64_t get_begin(const std::uint64_t range)
+    {
+        return range & 0xFFFFFFFF;
+    }
+
+    static std::uint64_t get_end(const std::uint64_t range)
+    {
+        return range >> 32;
+    }
+};
+
+// Take the first item of a range. Return false if it is empty.
+bool pop_front(ItemRange& item_range, std::size_t& index)
+{
+    std::uint64_t range = item_range.range.load();
+
+    while (ItemRange::get_begin(range) < ItemRange::get_end(range))
+    {
+        const std::uint64_t begin = ItemRange::get_begin(range);
+
+        if (item_range.range.compare_exchange_weak(range, ItemRange::pack(begin + 1, ItemRange::get_end(range))))
+        {
+            index = static_cast<std::size_t>(begin);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Take the second half of a range. Return false if it is empty.
+bool steal_back(ItemRange& item_range, std::uint64_t& begin, std::uint64_t& end)
+{
+    std::uint64_t range = item_range.range.load();
+
+    while (ItemRange::get_begin(range) < ItemRange::get_end(range))
+    {
+        const std::uint64_t victim_begin = ItemRange::get_begin(range);
+        end = ItemRange::get_end(range);
+        begin = victim_begin + (end - victim_begin) / 2;
+
+        if (item_range.range.compare_exchange_weak(range, ItemRange::pack(victim_begin, begin)))
+            return true;
+    }
+
+    return false;
+}
+
+} // namespace
+
+std::size_t get_thread_count()
+{
+    // May be 0 when unknown.
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+void parallel_for(
+    const std::size_t                               count,
+    const std::function<void(const std::size_t)>&   body)
+{
+    std::atomic<std::size_t> next_index(0);
+
+    auto work = [&]()
+    {
+        for (std::size_t index = next_index++; index < count; index = next_index++)
+            body(index);
+    };
+
+    const std::size_t thread_count = std::min(get_thread_count(), count);
+
+    if (thread_count <= 1)
+    {
+        work();
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+
+    for (std::size_t i = 1; i < thread_count; ++i)
+        threads.emplace_back(work);
+
+    work();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void parallel_for_stealing(
+    const std::size_t                               count,
+    const std::function<void(const std::size_t)>&   body)
+{
+    assert(count <= std::numeric_limits<std::uint32_t>::max());
+
+    const std::size_t thread_count = std::min(get_thread_count(), count);
+
+    if (thread_count <= 1)
+    {
+        for (std::size_t index = 0; index < count; ++index)
+            body(index);
+        return;
+    }
+
+    std::vector<ItemRange> ranges(thread_count);
+
+    for (std::size_t i = 0; i < thread_count; ++i)
+        ranges[i].range = ItemRange::pack(count * i / thread_count, count * (i + 1) / thread_count);
+
+    auto work = [&](const std::size_t thread_index)
+    {
+        ItemRange& own_range = ranges[thread_index];
+
+        while (true)
+        {
+            std::size_t index;
+
+            while (pop_front(own_range, index))
+                body(index);
+
+            // Steal from the thread with the most items left. Only the owner
+            // refills its range, once it is empty.
+            std::size_t victim = thread_count;
+            std::uint64_t victim_size = 0;
+
+            for (std::size_t i = 0; i < thread_count; ++i)
+            {
+                const std::uint64_t range = ranges[i].range.load();
+                const std::uint64_t size = ItemRange::get_end(range) - std::min(ItemRange::get_begin(range), ItemRange::get_end(range));
+
+                if (size > victim_size)
+                {
+                    victim = i;
+                    victim_size = size;
+                }
+            }
+
+            if (victim == thread_count)
+                return;
+
+            std::uint64_t begin, end;
+
+            if (steal_back(ranges[victim], begin, end))
+                own_range.range = ItemRange::pack(begin, end);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+
+    for (std::size_t i = 1; i < thread_count; ++i)
+        threads.emplace_back(work, i);
+
+    work(0);
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+} // namespace core
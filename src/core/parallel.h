@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace core
+{
+
+//
+// Parallel loops.
+//
+// Work items are handed out one at a time from a shared counter, so
+// items of uneven cost still keep all threads busy. The calling thread
+// takes part in the work. Items must not throw.
+//
+
+/**
+ * @brief Number of threads used by `parallel_for`, at least 1.
+ */
+std::size_t get_thread_count();
+
+/**
+ * @brief Call `body(index)` for each index in [0, count), on all threads.
+ *
+ * Return when all items are done.
+ */
+void parallel_for(
+    const std::size_t                               count,
+    const std::function<void(const std::size_t)>&   body);
+
+/**
+ * @brief Same as `parallel_for`, for items whose neighbours share data.
+ *
+ * Each thread starts with its own contiguous range of items and runs it in
+ * order. A thread that runs out steals the second half of the largest
+ * remaining range, so it also continues on neighbouring items.
+ */
+void parallel_for_stealing(
+    const std::size_t                               count,
+    const std::function<void(const std::size_t)>&   body);
+
+} // namespace core
@@ -0,0 +1,110 @@
+#include "precomputed_triangles.h"
+
+#include "trace.h"
+
+#include <cstddef>
+
+namespace core
+{
+
+PrecomputedTriangles::PrecomputedTriangles(const MeshPointCloud& mesh_point_cloud)
+  : m_degenerate_count(0)
+{
+    CORE_TRACE_SCOPE("PrecomputedTriangles build");
+
+    resize(mesh_point_cloud.get_triangle_count());
+
+    for (std::size_t i = 0; i < mesh_point_cloud.get_triangle_count(); ++i)
+    {
+        glm::vec3 v1, v2, v3;
+        mesh_point_cloud.get_triangle(i * 3, v1, v2, v3);
+        set(i, make_triangle_query_data(v1, v2, v3));
+    }
+}
+
+PrecomputedTriangles::PrecomputedTriangles(
+    const MeshPointCloud&               mesh_point_cloud,
+    const std::vector<std::uint32_t>&   triangle_order)
+  : m_degenerate_count(0)
+{
+    CORE_TRACE_SCOPE("PrecomputedTriangles build");
+
+    resize(triangle_order.size());
+
+    for (std::size_t i = 0; i < triangle_order.size(); ++i)
+    {
+        glm::vec3 v1, v2, v3;
+        mesh_point_cloud.get_triangle(std::size_t(triangle_order[i]) * 3, v1, v2, v3);
+        set(i, make_triangle_query_data(v1, v2, v3));
+    }
+}
+
+std::size_t PrecomputedTriangles::get_triangle_count() const
+{
+    return m_degenerate.size();
+}
+
+std::size_t PrecomputedTriangles::get_degenerate_count() const
+{
+    return m_degenerate_count;
+}
+
+MemoryUsage PrecomputedTriangles::get_memory_usage() const
+{
+    const FloatArray* arrays[] = {
+        &m_origin_x, &m_origin_y, &m_origin_z,
+        &m_edge0_x, &m_edge0_y, &m_edge0_z,
+        &m_edge1_x, &m_edge1_y, &m_edge1_z,
+        &m_a00, &m_a01, &m_a11,
+        &m_inv_det, &m_inv_a00, &m_inv_a11, &m_inv_a_12 };
+
+    std::size_t bytes = get_heap_bytes(m_degenerate);
+    for (const FloatArray* array : arrays)
+        bytes += get_heap_bytes(*array);
+
+    MemoryUsage usage;
+    usage.add("precomputed triangles", bytes);
+    return usage;
+}
+
+void PrecomputedTriangles::resize(const std::size_t triangle_count)
+{
+    FloatArray* arrays[] = {
+        &m_origin_x, &m_origin_y, &m_origin_z,
+        &m_edge0_x, &m_edge0_y, &m_edge0_z,
+        &m_edge1_x, &m_edge1_y, &m_edge1_z,
+        &m_a00, &m_a01, &m_a11,
+        &m_inv_det, &m_inv_a00, &m_inv_a11, &m_inv_a_12 };
+
+    for (FloatArray* array : arrays)
+        array->resize(triangle_count);
+
+    m_degenerate.resize(triangle_count);
+}
+
+void PrecomputedTriangles::set(const std::size_t index, const TriangleQueryData& triangle)
+{
+    m_origin_x[index] = triangle.origin.x;
+    m_origin_y[index] = triangle.origin.y;
+    m_origin_z[index] = triangle.origin.z;
+    m_edge0_x[index] = triangle.edge0.x;
+    m_edge0_y[index] = triangle.edge0.y;
+    m_edge0_z[index] = triangle.edge0.z;
+    m_edge1_x[index] = triangle.edge1.x;
+    m_edge1_y[index] = triangle.edge1.y;
+    m_edge1_z[index] = triangle.edge1.z;
+    m_a00[index] = triangle.a00;
+    m_a01[index] = triangle.a01;
+    m_a11[index] = triangle.a11;
+    m_inv_det[index] = triangle.inv_det;
+    m_inv_a00[index] = triangle.inv_a00;
+    m_inv_a11[index] = triangle.inv_a11;
+    m_inv_a_12[index] = triangle.inv_a_12;
+    // 0 for regular triangles, 1 + segment for degenerate ones.
+    m_degenerate[index] = triangle.degenerate ? 1 + triangle.segment : 0;
+
+    if (triangle.degenerate)
+        ++m_degenerate_count;
+}
+
+} // namespace core
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * @brief Per-triangle terms of the closest point computation, stored once.
+ *
+ * `closest_point_in_triangle` computes edges, dot products and reciprocals
+ * that only depend on the triangle, for every candidate of every query.
+ * This stores them (see `TriangleQueryData`), one array per term (SoA):
+ * 16 floats and a flag per triangle, to save that work on each query.
+ *
+ * Degenerate triangles are flagged once here instead of producing NaNs
+ * during queries.
+ */
+class PrecomputedTriangles
+{
+  public:
+    /**
+     * @brief Precompute the terms of every triangle of the point cloud.
+     */
+    explicit PrecomputedTriangles(const MeshPointCloud& mesh_point_cloud);
+
+    /**
+     * @brief Precompute the terms of the given triangles, in the given order.
+     *
+     * Index `i` of this object refers to triangle `triangle_order[i]` of the
+     * point cloud. Acceleration structures use it to store triangles in the
+     * order they are visited.
+     */
+    PrecomputedTriangles(
+        const MeshPointCloud&               mesh_point_cloud,
+        const std::vector<std::uint32_t>&   triangle_order);
+
+    inline TriangleQueryData get(const std::size_t index) const
+    {
+        TriangleQueryData triangle;
+        triangle.origin = glm::vec3(m_origin_x[index], m_origin_y[index], m_origin_z[index]);
+        triangle.edge0 = glm::vec3(m_edge0_x[index], m_edge0_y[index], m_edge0_z[index]);
+        triangle.edge1 = glm::vec3(m_edge1_x[index], m_edge1_y[index], m_edge1_z[index]);
+        triangle.a00 = m_a00[index];
+        triangle.a01 = m_a01[index];
+        triangle.a11 = m_a11[index];
+        triangle.inv_det = m_inv_det[index];
+        triangle.inv_a00 = m_inv_a00[index];
+        triangle.inv_a11 = m_inv_a11[index];
+        triangle.inv_a_12 = m_inv_a_12[index];
+        triangle.degenerate = m_degenerate[index] != 0;
+        triangle.segment = triangle.degenerate ? m_degenerate[index] - 1 : 0;
+        return triangle;
+    }
+
+    std::size_t get_triangle_count() const;
+
+    /**
+     * @brief Number of triangles with a zero area.
+     */
+    std::size_t get_degenerate_count() const;
+
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    typedef TrackedVector<float, MemoryCategory::QueryCache> FloatArray;
+    typedef TrackedVector<std::uint8_t, MemoryCategory::QueryCache> FlagArray;
+
+    FloatArray  m_origin_x, m_origin_y, m_origin_z;
+    FloatArray  m_edge0_x, m_edge0_y, m_edge0_z;
+    FloatArray  m_edge1_x, m_edge1_y, m_edge1_z;
+    FloatArray  m_a00, m_a01, m_a11;
+    FloatArray  m_inv_det, m_inv_a00, m_inv_a11, m_inv_a_12;
+    FlagArray   m_degenerate;
+    std::size_t m_degenerate_count;
+
+    void resize(const std::size_t triangle_count);
+    void set(const std::size_t index, const TriangleQueryData& triangle);
+};
+
+} // namespace core
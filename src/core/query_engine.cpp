@@ -0,0 +1,284 @@
+#include "query_engine.h"
+
+#include "query_engine_impl.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace core
+{
+
+namespace
+{
+    typedef std::unique_ptr<QueryEngine> (*CreateFunction)(const MeshPointCloud&, const bool, const BvhBuildMethod);
+
+    struct EngineConfiguration
+    {
+        QueryEngineSettings settings;
+        CreateFunction      create;
+    };
+
+    template <
+        QueryBackend    Backend,
+        typename        Scalar,
+        typename        Index,
+        std::size_t     LeafSize,
+        std::size_t     CandidateCount>
+    EngineConfiguration make_configuration()
+    {
+        typedef QueryEngineImpl<Backend, Scalar, Index, LeafSize, CandidateCount> Engine;
+
+        EngineConfiguration configuration;
+        configuration.settings = make_query_engine_settings<Scalar, Index, LeafSize, CandidateCount>(
+            Backend, false, BvhBuildMethod::Sah);
+        configuration.create = [](
+            const MeshPointCloud&   mesh_point_cloud,
+            const bool              precompute_triangles,
+            const BvhBuildMethod    bvh_build_method)
+        {
+            return std::unique_ptr<QueryEngine>(new Engine(mesh_point_cloud, precompute_triangles, bvh_build_method));
+        };
+
+        return configuration;
+    }
+
+    /**
+     * @brief Pre-instantiated engines. The first one of each backend is its default.
+     */
+    const std::vector<EngineConfiguration>& get_engine_configurations()
+    {
+        static const std::vector<EngineConfiguration> configurations =
+        {
+            // Original application settings first.
+            make_configuration<QueryBackend::KdTree, float, std::uint64_t, 10, 100>(),
+            make_configuration<QueryBackend::KdTree, float, std::uint32_t, 10, 100>(),
+            make_configuration<QueryBackend::KdTree, float, std::uint32_t, 10, 32>(),
+            make_configuration<QueryBackend::KdTree, float, std::uint32_t, 16, 100>(),
+            make_configuration<QueryBackend::KdTree, double, std::uint64_t, 10, 100>(),
+            make_configuration<QueryBackend::KdTree, double, std::uint32_t, 10, 100>(),
+
+            make_configuration<QueryBackend::Bvh8, float, std::uint32_t, 4, 0>(),
+            make_configuration<QueryBackend::Bvh8, float, std::uint32_t, 2, 0>(),
+            make_configuration<QueryBackend::Bvh8, float, std::uint32_t, 8, 0>(),
+            make_configuration<QueryBackend::Bvh8, double, std::uint32_t, 4, 0>(),
+
+            make_configuration<QueryBackend::Bvh16, float, std::uint32_t, 4, 0>(),
+            make_configuration<QueryBackend::Bvh16, float, std::uint32_t, 2, 0>(),
+            make_configuration<QueryBackend::Bvh16, float, std::uint32_t, 8, 0>(),
+            make_configuration<QueryBackend::Bvh16, double, std::uint32_t, 4, 0>(),
+
+            make_configuration<QueryBackend::WideBvh4, float, std::uint32_t, 4, 0>(),
+            make_configuration<QueryBackend::WideBvh4, float, std::uint32_t, 8, 0>(),
+            make_configuration<QueryBackend::WideBvh4, double, std::uint32_t, 4, 0>(),
+
+            make_configuration<QueryBackend::WideBvh8, float, std::uint32_t, 4, 0>(),
+            make_configuration<QueryBackend::WideBvh8, float, std::uint32_t, 8, 0>(),
+            make_configuration<QueryBackend::WideBvh8, double, std::uint32_t, 4, 0>(),
+
+            make_configuration<QueryBackend::Heightfield, float, std::uint32_t, 2, 0>(),
+            make_configuration<QueryBackend::Heightfield, double, std::uint32_t, 2, 0>(),
+
+            make_configuration<QueryBackend::Convex, float, std::uint32_t, 4, 0>(),
+            make_configuration<QueryBackend::Convex, double, std::uint32_t, 4, 0>(),
+        };
+
+        return configurations;
+    }
+
+    bool match(const QueryEngineSettings& lhs, const QueryEngineSettings& rhs)
+    {
+        // The candidate count only applies to the KDTree.
+        return lhs.backend == rhs.backend
+            && lhs.scalar == rhs.scalar
+            && lhs.index_bits == rhs.index_bits
+            && lhs.leaf_size == rhs.leaf_size
+            && (lhs.backend != QueryBackend::KdTree || lhs.candidate_count == rhs.candidate_count);
+    }
+
+    /**
+     * @brief Default settings of `backend`, with the scalar type, precomputation and build method of `settings`.
+     */
+    QueryEngineSettings get_fallback_settings(const QueryBackend backend, const QueryEngineSettings& settings)
+    {
+        QueryEngineSettings fallback_settings = get_default_query_engine_settings(backend);
+        fallback_settings.scalar = settings.scalar;
+        fallback_settings.precompute_triangles = settings.precompute_triangles;
+        fallback_settings.bvh_build_method = settings.bvh_build_method;
+        return fallback_settings;
+    }
+}
+
+QueryEngineSettings get_default_query_engine_settings(const QueryBackend backend)
+{
+    if (backend == QueryBackend::Auto)
+    {
+        QueryEngineSettings settings = get_default_query_engine_settings(QueryBackend::WideBvh4);
+        settings.backend = QueryBackend::Auto;
+        return settings;
+    }
+
+    for (const EngineConfiguration& configuration : get_engine_configurations())
+    {
+        if (configuration.settings.backend == backend)
+            return configuration.settings;
+    }
+
+    assert(false);
+    return QueryEngineSettings();
+}
+
+std::vector<QueryEngineSettings> get_query_engine_configurations()
+{
+    std::vector<QueryEngineSettings> settings;
+
+    for (const EngineConfiguration& configuration : get_engine_configurations())
+        settings.push_back(configuration.settings);
+
+    return settings;
+}
+
+std::unique_ptr<QueryEngine> create_query_engine(
+    const MeshPointCloud&           mesh_point_cloud,
+    const QueryEngineSettings&      settings)
+{
+    if (settings.backend == QueryBackend::Auto)
+    {
+        QueryBackend backend = QueryBackend::WideBvh4;
+
+        if (is_convex_mesh(mesh_point_cloud))
+            backend = QueryBackend::Convex;
+        else if (is_height_grid(mesh_point_cloud))
+            backend = QueryBackend::Heightfield;
+
+        std::cout << "Using the " << get_backend_name(backend) << " backend.\n";
+
+        return create_query_engine(mesh_point_cloud, get_fallback_settings(backend, settings));
+    }
+
+    if (settings.backend == QueryBackend::Heightfield && !is_height_grid(mesh_point_cloud))
+    {
+        std::cerr << "The mesh is not a height grid. Using the " << get_backend_name(QueryBackend::WideBvh4)
+            << " backend instead of the heightfield.\n";
+
+        return create_query_engine(mesh_point_cloud, get_fallback_settings(QueryBackend::WideBvh4, settings));
+    }
+
+    if (settings.backend == QueryBackend::Convex && !is_convex_mesh(mesh_point_cloud))
+    {
+        std::cerr << "The mesh is not convex. Using the " << get_backend_name(QueryBackend::WideBvh4)
+            << " backend instead of the convex one.\n";
+
+        return create_query_engine(mesh_point_cloud, get_fallback_settings(QueryBackend::WideBvh4, settings));
+    }
+
+    for (const EngineConfiguration& configuration : get_engine_configurations())
+    {
+        if (match(configuration.settings, settings))
+            return configuration.create(mesh_point_cloud, settings.precompute_triangles, settings.bvh_build_method);
+    }
+
+    return nullptr;
+}
+
+namespace
+{
+    const char* backend_names[] = { "kdtree", "bvh8", "bvh16", "wide4", "wide8", "heightfield", "convex", "auto" };
+    const std::size_t backend_count = sizeof(backend_names) / sizeof(backend_names[0]);
+
+    const char* scalar_type_names[] = { "float", "double" };
+    const std::size_t scalar_type_count = sizeof(scalar_type_names) / sizeof(scalar_type_names[0]);
+
+    const char* batch_schedule_names[] = { "sequential", "sorted", "packet", "interleaved" };
+    const std::size_t batch_schedule_count = sizeof(batch_schedule_names) / sizeof(batch_schedule_names[0]);
+
+    const char* bvh_build_method_names[] = { "sah", "lbvh", "lbvh-treelets" };
+    const std::size_t bvh_build_method_count = sizeof(bvh_build_method_names) / sizeof(bvh_build_method_names[0]);
+}
+
+const char* get_backend_name(const QueryBackend backend)
+{
+    const std::size_t index = static_cast<std::size_t>(backend);
+    assert(index < backend_count);
+    return backend_names[index];
+}
+
+bool get_backend_from_name(const char* name, QueryBackend& backend)
+{
+    for (std::size_t i = 0; i < backend_count; ++i)
+    {
+        if (std::strcmp(name, backend_names[i]) == 0)
+        {
+            backend = static_cast<QueryBackend>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* get_scalar_type_name(const ScalarType scalar)
+{
+    const std::size_t index = static_cast<std::size_t>(scalar);
+    assert(index < scalar_type_count);
+    return scalar_type_names[index];
+}
+
+bool get_scalar_type_from_name(const char* name, ScalarType& scalar)
+{
+    for (std::size_t i = 0; i < scalar_type_count; ++i)
+    {
+        if (std::strcmp(name, scalar_type_names[i]) == 0)
+        {
+            scalar = static_cast<ScalarType>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* get_batch_schedule_name(const BatchSchedule schedule)
+{
+    const std::size_t index = static_cast<std::size_t>(schedule);
+    assert(index < batch_schedule_count);
+    return batch_schedule_names[index];
+}
+
+bool get_batch_schedule_from_name(const char* name, BatchSchedule& schedule)
+{
+    for (std::size_t i = 0; i < batch_schedule_count; ++i)
+    {
+        if (std::strcmp(name, batch_schedule_names[i]) == 0)
+        {
+            schedule = static_cast<BatchSchedule>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* get_bvh_build_method_name(const BvhBuildMethod method)
+{
+    const std::size_t index = static_cast<std::size_t>(method);
+    assert(index < bvh_build_method_count);
+    return bvh_build_method_names[index];
+}
+
+bool get_bvh_build_method_from_name(const char* name, BvhBuildMethod& method)
+{
+    for (std::size_t i = 0; i < bvh_build_method_count; ++i)
+    {
+        if (std::strcmp(name, bvh_build_method_names[i]) == 0)
+        {
+            method = static_cast<BvhBuildMethod>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace core
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "bvh_builder.h"
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * @brief Acceleration structure used to find the closest point.
+ */
+enum class QueryBackend
+{
+    KdTree,      // nanoflann KDTree on the point cloud (approximate, see README)
+    Bvh8,        // compact triangle BVH with 8-bit quantized bounds (exact)
+    Bvh16,       // compact triangle BVH with 16-bit quantized bounds (exact)
+    WideBvh4,    // triangle BVH with 4 children per node, SIMD box distances (exact)
+    WideBvh8,    // triangle BVH with 8 children per node, SIMD box distances (exact)
+    Heightfield, // min/max height mipmaps of a grid mesh, WideBvh4 on other meshes (exact)
+    Convex,      // walk on the triangles of a convex mesh, WideBvh4 on other meshes and inside points (exact)
+    Auto         // Convex, Heightfield or WideBvh4, the first one the mesh qualifies for (exact)
+};
+
+/**
+ * @brief Precision of the distance computations.
+ *
+ * Queries and results are always single precision, like the mesh.
+ */
+enum class ScalarType
+{
+    Float,
+    Double
+};
+
+/**
+ * @brief How the queries of a batch are run.
+ */
+enum class BatchSchedule
+{
+    Sequential,     // in the given order, on the calling thread
+    Sorted,         // sorted along a Morton curve, then in parallel chunks with work stealing
+    Packet,         // sorted, and groups of nearby queries traverse the tree together (BVH backends)
+    Interleaved     // sorted, and each thread interleaves traversals to hide memory latency (BVH backends)
+};
+
+/**
+ * @brief Compile-time parameters of a query engine, picked at runtime.
+ *
+ * Only the pre-instantiated combinations exist, see `get_query_engine_configurations`.
+ */
+struct QueryEngineSettings
+{
+    QueryBackend    backend = QueryBackend::KdTree;
+    ScalarType      scalar = ScalarType::Float;
+
+    // Width of the point indices in the tree: 32 or 64.
+    std::size_t     index_bits = 64;
+
+    // Maximum number of points (KDTree) or triangles (BVH) per leaf. Heightfield cells hold 2.
+    std::size_t     leaf_size = 10;
+
+    // KDTree only: how many nearest cloud points are refined into triangle points.
+    // A number that is too low will generate incorrect results when the mesh density is high.
+    std::size_t     candidate_count = 100;
+
+    // Store the triangle terms of the closest point computation once.
+    // Single precision only. It costs 65 bytes per triangle.
+    bool            precompute_triangles = false;
+
+    // BVH backends only: how the hierarchy is built. Linear builds are many
+    // times faster, for meshes rebuilt often; SAH hierarchies answer queries faster.
+    BvhBuildMethod  bvh_build_method = BvhBuildMethod::Sah;
+};
+
+/**
+ * @brief Closest point with everything known about it at the end of the search.
+ */
+struct ClosestPointResult
+{
+    glm::vec3       point;
+    float           distance2;      // squared distance to the query point
+    std::uint32_t   triangle;       // mesh triangle, i.e. indices 3 * triangle to 3 * triangle + 2
+    glm::vec3       barycentric;    // weights of the triangle vertices
+    SurfaceFeature  feature;
+
+    // Interpolated from `Mesh::Vertex::normal` with the barycentric coordinates, normalized.
+    glm::vec3       normal;
+};
+
+/**
+ * @brief Nearest intersection of a ray and the mesh.
+ */
+struct RayHit
+{
+    glm::vec3       point;
+    float           distance;       // along the ray, from its origin
+    std::uint32_t   triangle;       // mesh triangle, i.e. indices 3 * triangle to 3 * triangle + 2
+    glm::vec3       barycentric;    // weights of the triangle vertices
+
+    // Interpolated from `Mesh::Vertex::normal` with the barycentric coordinates, normalized.
+    glm::vec3       normal;
+};
+
+/**
+ * @brief Closest approach between a segment, e.g. a tool move or a swept point, and the mesh.
+ */
+struct SegmentClosestPointResult
+{
+    // Closest point on the mesh. `distance2` is to the segment.
+    ClosestPointResult  mesh;
+
+    // Closest point on the segment: start + segment_t * (end - start).
+    glm::vec3           segment_point;
+    float               segment_t;
+};
+
+/**
+ * @brief Regular 3D grid of query points, e.g. the voxels of a distance volume.
+ *
+ * Voxel (x, y, z) is at `origin + spacing * (x, y, z)` and is stored at
+ * index `x + dimensions[0] * (y + dimensions[1] * z)`.
+ */
+struct RegularGrid
+{
+    glm::vec3       origin;
+    glm::vec3       spacing;
+    std::size_t     dimensions[3];
+
+    // Only the voxels strictly closer than this to the mesh are computed.
+    float           band_width;
+};
+
+/**
+ * @brief Called with each triangle found by a radius query.
+ */
+typedef std::function<void(const ClosestPointResult&)> TriangleCallback;
+
+/**
+ * @brief Closest point query on a mesh point cloud, for one configuration.
+ *
+ * Implementations are templates specialized on the settings
+ * (see query_engine_impl.h); all virtual calls are per query or per batch.
+ */
+class QueryEngine
+{
+  public:
+    virtual ~QueryEngine() {}
+
+    /**
+     * @brief Return the closest point on the mesh within the specified maximum search distance.
+     */
+    virtual bool get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        glm::vec3&          result) const = 0;
+
+    /**
+     * @brief Same as above, with the triangle, barycentric coordinates, feature and normal.
+     */
+    virtual bool get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        ClosestPointResult& result) const = 0;
+
+    /**
+     * @brief Run `count` queries at once. Return the number of points found.
+     *
+     * `found` is optional. `results[i]` is left untouched when no point is found.
+     */
+    virtual std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        glm::vec3*          results,
+        bool*               found) const = 0;
+
+    virtual std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found) const = 0;
+
+    /**
+     * @brief Find the `k` closest distinct triangles strictly within `max_distance`,
+     * sorted by distance. Return how many were found, at most `k`.
+     */
+    virtual std::size_t get_k_closest_points(
+        const glm::vec3&    query_point,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results) const = 0;
+
+    /**
+     * @brief Batch version: `results` holds `k` entries per query.
+     * Return the total number of results. `result_counts` is optional.
+     */
+    virtual std::size_t get_k_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results,
+        std::size_t*        result_counts) const = 0;
+
+    /**
+     * @brief Call `callback` with the closest point of every triangle within
+     * `radius` (inclusive), in no particular order. Return the number of triangles.
+     */
+    virtual std::size_t for_each_triangle_in_radius(
+        const glm::vec3&        query_point,
+        const float             radius,
+        const TriangleCallback& callback) const = 0;
+
+    /**
+     * @brief Return the closest point on the mesh to a segment, within the specified maximum distance.
+     *
+     * Exact, unlike sampling points along the segment. A segment crossing
+     * the mesh is at distance 0, at its first crossing.
+     */
+    virtual bool get_closest_point_to_segment(
+        const glm::vec3&            start,
+        const glm::vec3&            end,
+        const float                 max_distance,
+        SegmentClosestPointResult&  result) const = 0;
+
+    /**
+     * @brief Run `count` segment queries at once. Return the number of points found.
+     *
+     * `found` is optional. `results[i]` is left untouched when no point is found.
+     */
+    virtual std::size_t get_closest_points_to_segments(
+        const glm::vec3*            starts,
+        const glm::vec3*            ends,
+        const std::size_t           count,
+        const float                 max_distance,
+        SegmentClosestPointResult*  results,
+        bool*                       found) const = 0;
+
+    /**
+     * @brief Closest point of every voxel of a grid, e.g. to build a distance volume.
+     *
+     * Much faster than one query per voxel: voxels are processed in tiles,
+     * in parallel, and share the triangles found around their tile.
+     * `distances` (required) gets the distance to the mesh, infinity outside
+     * the band. `closest_points` is optional and left untouched outside the band.
+     * Both hold one entry per voxel. Return the number of voxels in the band.
+     */
+    virtual std::size_t get_closest_points_on_grid(
+        const RegularGrid&  grid,
+        float*              distances,
+        glm::vec3*          closest_points) const = 0;
+
+    /**
+     * @brief Find the nearest triangle hit by the ray within `max_distance` of its origin.
+     *
+     * `direction` doesn't need to be normalized. Triangles are hit from both sides.
+     */
+    virtual bool intersect_ray(
+        const glm::vec3&    origin,
+        const glm::vec3&    direction,
+        const float         max_distance,
+        RayHit&             hit) const = 0;
+
+    /**
+     * @brief Schedule of the closest point batches, `BatchSchedule::Sorted` by default.
+     *
+     * Must not be changed while queries run.
+     */
+    virtual void set_batch_schedule(const BatchSchedule schedule) = 0;
+
+    virtual BatchSchedule get_batch_schedule() const = 0;
+
+    /**
+     * @brief Heap bytes used by the acceleration structure.
+     */
+    virtual MemoryUsage get_memory_usage() const = 0;
+
+    virtual const QueryEngineSettings& get_settings() const = 0;
+};
+
+/**
+ * @brief Default settings of a backend.
+ *
+ * For the KDTree, these are the original settings of the application. The
+ * automatic backend has the `WideBvh4` ones.
+ */
+QueryEngineSettings get_default_query_engine_settings(const QueryBackend backend);
+
+/**
+ * @brief Pre-instantiated configurations, without triangle precomputation.
+ */
+std::vector<QueryEngineSettings> get_query_engine_configurations();
+
+/**
+ * @brief Build the engine matching the settings.
+ *
+ * Return nullptr if the combination is not pre-instantiated. The heightfield
+ * and convex backends fall back to the default `WideBvh4` engine when the
+ * mesh is not a grid (see `is_height_grid`) or not convex (see
+ * `is_convex_mesh`). The automatic backend is resolved to one of them here,
+ * keeping the scalar type, the triangle precomputation and the build method.
+ */
+std::unique_ptr<QueryEngine> create_query_engine(
+    const MeshPointCloud&           mesh_point_cloud,
+    const QueryEngineSettings&      settings);
+
+/**
+ * @brief Backend name, e.g. "kdtree".
+ */
+const char* get_backend_name(const QueryBackend backend);
+
+/**
+ * @brief Find a backend from its name. Return false if the name is unknown.
+ */
+bool get_backend_from_name(const char* name, QueryBackend& backend);
+
+/**
+ * @brief Scalar type name, "float" or "double".
+ */
+const char* get_scalar_type_name(const ScalarType scalar);
+
+/**
+ * @brief Find a scalar type from its name. Return false if the name is unknown.
+ */
+bool get_scalar_type_from_name(const char* name, ScalarType& scalar);
+
+/**
+ * @brief BVH build method name, e.g. "sah".
+ */
+const char* get_bvh_build_method_name(const BvhBuildMethod method);
+
+/**
+ * @brief Find a BVH build method from its name. Return false if the name is unknown.
+ */
+bool get_bvh_build_method_from_name(const char* name, BvhBuildMethod& method);
+
+/**
+ * @brief Batch schedule name, e.g. "sorted".
+ */
+const char* get_batch_schedule_name(const BatchSchedule schedule);
+
+/**
+ * @brief Find a batch schedule from its name. Return false if the name is unknown.
+ */
+bool get_batch_schedule_from_name(const char* name, BatchSchedule& schedule);
+
+} // namespace core
@@ -0,0 +1,2082 @@
+#pragma once
+
+#include "bounded_priority_queue.h"
+#include "bvh.h"
+#include "convex_mesh.h"
+#include "cpu_dispatch.h"
+#include "heightfield.h"
+#include "math.h"
+#include "memory.h"
+#include "morton.h"
+#include "mesh_point_cloud.h"
+#include "parallel.h"
+#include "precomputed_triangles.h"
+#include "query_engine.h"
+#include "trace.h"
+#include "wide_bvh.h"
+
+#include <nanoflann/nanoflann.hpp>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace core
+{
+
+//
+// Query engines specialized at compile time.
+//
+// Each engine is a template on the backend, the scalar type, the index width,
+// the leaf size and the candidate count. Constant bounds let the compiler
+// unroll the refinement loops and size the scratch buffers on the stack.
+// `query_engine.cpp` instantiates the common configurations for the runtime
+// factory; other configurations can be instantiated directly.
+//
+
+template <typename Scalar>
+struct ScalarTraits;
+
+template <>
+struct ScalarTraits<float>
+{
+    typedef glm::vec3 Vec3;
+    static const ScalarType type = ScalarType::Float;
+};
+
+template <>
+struct ScalarTraits<double>
+{
+    typedef glm::dvec3 Vec3;
+    static const ScalarType type = ScalarType::Double;
+};
+
+// Queries traversing the tree together in `BatchSchedule::Packet`.
+const std::size_t query_packet_size = 8;
+
+// Queries in flight on each thread in `BatchSchedule::Interleaved`: about the
+// number of cache misses a core keeps going at once. 16 and 32 are not faster.
+const std::size_t query_interleave_count = 8;
+
+/**
+ * @brief Settings describing an engine instantiation.
+ */
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+QueryEngineSettings make_query_engine_settings(
+    const QueryBackend      backend,
+    const bool              precompute_triangles,
+    const BvhBuildMethod    bvh_build_method)
+{
+    QueryEngineSettings settings;
+    settings.backend = backend;
+    settings.scalar = ScalarTraits<Scalar>::type;
+    settings.index_bits = sizeof(Index) * 8;
+    settings.leaf_size = LeafSize;
+    settings.candidate_count = CandidateCount;
+    settings.precompute_triangles = precompute_triangles;
+    settings.bvh_build_method = bvh_build_method;
+    return settings;
+}
+
+/**
+ * @brief Closest point on a precomputed triangle.
+ *
+ * The precomputed terms are single precision: double precision
+ * engines never build them, this overload only keeps the code generic.
+ */
+inline glm::vec3 closest_point_in_precomputed_triangle(
+    const glm::vec3&            p,
+    const TriangleQueryData&    triangle,
+    glm::vec3&                  barycentric)
+{
+    return closest_point_in_triangle(p, triangle, barycentric);
+}
+
+inline glm::dvec3 closest_point_in_precomputed_triangle(
+    const glm::dvec3&           p,
+    const TriangleQueryData&    triangle,
+    glm::dvec3&                 barycentric)
+{
+    glm::vec3 single_barycentric;
+    const glm::vec3 result = closest_point_in_triangle(glm::vec3(p), triangle, single_barycentric);
+    barycentric = glm::dvec3(single_barycentric);
+    return glm::dvec3(result);
+}
+
+/**
+ * @brief Best triangle point found so far by a search.
+ */
+template <typename Vec3>
+struct ClosestPointCandidate
+{
+    Vec3                        point;
+    Vec3                        barycentric;
+    typename Vec3::value_type   distance2;
+    std::uint32_t               triangle;
+};
+
+template <typename Vec3>
+struct ClosestPointCandidateLess
+{
+    inline bool operator()(
+        const ClosestPointCandidate<Vec3>&  lhs,
+        const ClosestPointCandidate<Vec3>&  rhs) const
+    {
+        return lhs.distance2 < rhs.distance2;
+    }
+};
+
+/**
+ * @brief Best triangle point found so far by a segment search.
+ */
+template <typename Vec3>
+struct SegmentCandidate
+{
+    ClosestPointCandidate<Vec3>     mesh;
+    typename Vec3::value_type       segment_t;  // closest point of the segment, in [0, 1]
+};
+
+inline void store_result(
+    const MeshPointCloud&,
+    const ClosestPointCandidate<glm::vec3>&     candidate,
+    glm::vec3&                                  result)
+{
+    result = candidate.point;
+}
+
+inline void store_result(
+    const MeshPointCloud&,
+    const ClosestPointCandidate<glm::dvec3>&    candidate,
+    glm::vec3&                                  result)
+{
+    result = glm::vec3(candidate.point);
+}
+
+/**
+ * @brief Normal of a point of a mesh triangle, interpolated from the vertex normals.
+ */
+inline glm::vec3 interpolate_vertex_normal(
+    const MeshPointCloud&   mesh_point_cloud,
+    const std::uint32_t     triangle,
+    const glm::vec3&        barycentric)
+{
+    const Mesh::VertexArray& vertices = mesh_point_cloud.get_mesh().get_vertices();
+    const Mesh::IndexArray& triangles = mesh_point_cloud.get_mesh().get_triangles();
+    const std::size_t first_index = std::size_t(triangle) * 3;
+
+    const glm::vec3 normal =
+        barycentric.x * vertices[triangles[first_index]].normal
+        + barycentric.y * vertices[triangles[first_index + 1]].normal
+        + barycentric.z * vertices[triangles[first_index + 2]].normal;
+    const float length2 = glm::dot(normal, normal);
+
+    return length2 > 0.0f ? normal / std::sqrt(length2) : normal;
+}
+
+/**
+ * @brief Fill a rich result. Only the normal is computed here, once per query.
+ */
+template <typename Vec3>
+inline void store_result(
+    const MeshPointCloud&                   mesh_point_cloud,
+    const ClosestPointCandidate<Vec3>&      candidate,
+    ClosestPointResult&                     result)
+{
+    result.point = glm::vec3(candidate.point);
+    result.distance2 = static_cast<float>(candidate.distance2);
+    result.triangle = candidate.triangle;
+    result.barycentric = glm::vec3(candidate.barycentric);
+    result.feature = get_surface_feature(candidate.barycentric);
+    result.normal = interpolate_vertex_normal(mesh_point_cloud, result.triangle, result.barycentric);
+}
+
+/**
+ * @brief Single and batch queries on top of the non-virtual `Derived::find`.
+ */
+template <typename Derived, typename Scalar>
+class QueryEngineBase : public QueryEngine
+{
+  public:
+    QueryEngineBase()
+      : m_batch_schedule(BatchSchedule::Sorted)
+    {
+    }
+
+    bool get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        glm::vec3&          result) const override
+    {
+        return run_query(query_point, max_distance, result);
+    }
+
+    bool get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        ClosestPointResult& result) const override
+    {
+        return run_query(query_point, max_distance, result);
+    }
+
+    std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        glm::vec3*          results,
+        bool*               found) const override
+    {
+        return run_queries(query_points, count, max_distance, results, found);
+    }
+
+    std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found) const override
+    {
+        return run_queries(query_points, count, max_distance, results, found);
+    }
+
+    std::size_t get_k_closest_points(
+        const glm::vec3&    query_point,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results) const override
+    {
+        return run_k_query(query_point, k, max_distance, get_scratch(k), results);
+    }
+
+    std::size_t get_k_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const std::size_t   k,
+        const float         max_distance,
+        ClosestPointResult* results,
+        std::size_t*        result_counts) const override
+    {
+        // Each chunk runs on one thread, with the scratch buffer of that thread.
+        auto run_k_queries = [&](const std::uint32_t* indices, const std::size_t query_count)
+        {
+            Candidate* scratch = get_scratch(k);
+            std::size_t total_count = 0;
+
+            for (std::size_t i = 0; i < query_count; ++i)
+            {
+                const std::size_t index = indices ? indices[i] : i;
+                const std::size_t result_count = run_k_query(query_points[index], k, max_distance, scratch, results + index * k);
+
+                if (result_counts)
+                    result_counts[index] = result_count;
+
+                total_count += result_count;
+            }
+
+            return total_count;
+        };
+
+        if (m_batch_schedule == BatchSchedule::Sequential || count < sorted_batch_min_size)
+            return run_k_queries(nullptr, count);
+
+        CORE_TRACE_SCOPE("sorted k batch");
+
+        return run_sorted_chunks(
+            count,
+            [query_points](const std::size_t i) { return query_points[i]; },
+            run_k_queries);
+    }
+
+    std::size_t for_each_triangle_in_radius(
+        const glm::vec3&        query_point,
+        const float             radius,
+        const TriangleCallback& callback) const override
+    {
+        assert(radius >= 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const MeshPointCloud& mesh_point_cloud = engine->get_mesh_point_cloud();
+
+        ClosestPointResult result;
+        auto visit = [&](const Candidate& candidate)
+        {
+            store_result(mesh_point_cloud, candidate, result);
+            callback(result);
+        };
+
+        return engine->find_in_radius(query_point, Scalar(radius) * Scalar(radius), visit);
+    }
+
+    bool intersect_ray(
+        const glm::vec3&    origin,
+        const glm::vec3&    direction,
+        const float         max_distance,
+        RayHit&             hit) const override
+    {
+        typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar length = std::sqrt(distance2(Vec3(direction), Vec3(0)));
+
+        if (!(length > Scalar(0)))
+            return false;
+
+        const Vec3 ray_origin(origin);
+        const Vec3 ray_direction = Vec3(direction) / length;
+
+        Scalar max_t = Scalar(max_distance);
+        std::uint32_t triangle;
+        Vec3 barycentric;
+
+        if (!engine->find_ray(ray_origin, ray_direction, max_t, triangle, barycentric))
+            return false;
+
+        hit.point = glm::vec3(ray_origin + max_t * ray_direction);
+        hit.distance = static_cast<float>(max_t);
+        hit.triangle = triangle;
+        hit.barycentric = glm::vec3(barycentric);
+        hit.normal = interpolate_vertex_normal(engine->get_mesh_point_cloud(), triangle, hit.barycentric);
+        return true;
+    }
+
+    bool get_closest_point_to_segment(
+        const glm::vec3&            start,
+        const glm::vec3&            end,
+        const float                 max_distance,
+        SegmentClosestPointResult&  result) const override
+    {
+        return run_segment_query(start, end, max_distance, result);
+    }
+
+    std::size_t get_closest_points_to_segments(
+        const glm::vec3*            starts,
+        const glm::vec3*            ends,
+        const std::size_t           count,
+        const float                 max_distance,
+        SegmentClosestPointResult*  results,
+        bool*                       found) const override
+    {
+        auto run_segments = [&](const std::uint32_t* indices, const std::size_t segment_count)
+        {
+            std::size_t found_count = 0;
+
+            for (std::size_t i = 0; i < segment_count; ++i)
+            {
+                const std::size_t index = indices ? indices[i] : i;
+                const bool query_found = run_segment_query(starts[index], ends[index], max_distance, results[index]);
+
+                if (found)
+                    found[index] = query_found;
+
+                found_count += query_found ? 1 : 0;
+            }
+
+            return found_count;
+        };
+
+        if (m_batch_schedule == BatchSchedule::Sequential || count < sorted_batch_min_size)
+            return run_segments(nullptr, count);
+
+        CORE_TRACE_SCOPE("sorted segment batch");
+
+        // Segments are sorted on their midpoints, packets and interleaving don't apply.
+        return run_sorted_chunks(
+            count,
+            [starts, ends](const std::size_t i) { return (starts[i] + ends[i]) * 0.5f; },
+            run_segments);
+    }
+
+    std::size_t get_closest_points_on_grid(
+        const RegularGrid&  grid,
+        float*              distances,
+        glm::vec3*          closest_points) const override
+    {
+        assert(grid.band_width > 0.0f);
+        assert(distances);
+
+        const std::size_t tile_counts[3] = {
+            (grid.dimensions[0] + grid_tile_size - 1) / grid_tile_size,
+            (grid.dimensions[1] + grid_tile_size - 1) / grid_tile_size,
+            (grid.dimensions[2] + grid_tile_size - 1) / grid_tile_size };
+
+        std::atomic<std::size_t> found_count(0);
+
+        parallel_for(
+            tile_counts[0] * tile_counts[1] * tile_counts[2],
+            [&](const std::size_t tile)
+            {
+                const std::size_t tile_x = tile % tile_counts[0];
+                const std::size_t tile_y = (tile / tile_counts[0]) % tile_counts[1];
+                const std::size_t tile_z = tile / (tile_counts[0] * tile_counts[1]);
+
+                found_count += run_grid_tile(
+                    grid,
+                    tile_x * grid_tile_size,
+                    tile_y * grid_tile_size,
+                    tile_z * grid_tile_size,
+                    distances,
+                    closest_points);
+            });
+
+        return found_count;
+    }
+
+    void set_batch_schedule(const BatchSchedule schedule) override
+    {
+        m_batch_schedule = schedule;
+    }
+
+    BatchSchedule get_batch_schedule() const override
+    {
+        return m_batch_schedule;
+    }
+
+    /**
+     * @brief `find` for up to `query_packet_size` nearby queries.
+     *
+     * Engines with a packet traversal hide this one, which runs the queries
+     * one by one. `best` and `found` hold `query_packet_size` entries.
+     */
+    inline void find_packet(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const Scalar        max_distance2,
+        ClosestPointCandidate<typename ScalarTraits<Scalar>::Vec3>* best,
+        bool*               found) const
+    {
+        const Derived* engine = static_cast<const Derived*>(this);
+
+        for (std::size_t i = 0; i < count; ++i)
+            found[i] = engine->find(query_points[i], max_distance2, best[i]);
+    }
+
+    /**
+     * @brief `find` for `count` queries, interleaved on the calling thread.
+     *
+     * `get_point(i)` returns query `i` and `store(i, found, best)` receives
+     * its result. Engines with an interleaved traversal hide this one, which
+     * runs the queries one by one.
+     */
+    template <typename GetPoint, typename Store>
+    inline void find_interleaved(
+        const std::size_t   count,
+        const Scalar        max_distance2,
+        const GetPoint&     get_point,
+        Store&              store) const
+    {
+        const Derived* engine = static_cast<const Derived*>(this);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ClosestPointCandidate<typename ScalarTraits<Scalar>::Vec3> best;
+            const bool found = engine->find(get_point(i), max_distance2, best);
+            store(i, found, best);
+        }
+    }
+
+  private:
+    typedef ClosestPointCandidate<typename ScalarTraits<Scalar>::Vec3> Candidate;
+
+    // Voxels per tile side in grid queries.
+    static const std::size_t grid_tile_size = 4;
+
+    // Smaller batches are not worth sorting, and are often already split by the caller.
+    static const std::size_t sorted_batch_min_size = 4096;
+
+    // Queries per chunk of a sorted batch: consecutive queries of a chunk
+    // are close in space and traverse mostly the same nodes.
+    static const std::size_t sorted_batch_chunk_size = 256;
+
+    BatchSchedule m_batch_schedule;
+
+    /**
+     * @brief Compute the voxels of the tile starting at voxel (x0, y0, z0).
+     *
+     * The distance field d is 1-Lipschitz: for a voxel at `r` from the tile
+     * center `c`, d(c) - r <= d(voxel) <= d(c) + r. One query at the center
+     * skips the tiles entirely out of the band, and the voxels of the others
+     * that are. Each voxel is then searched within the smallest of d(c) + r
+     * and its distance to the closest triangle of the previous voxel, which
+     * neighbours mostly share: the search starts with a tight bound, included.
+     * Return the number of voxels in the band.
+     */
+    std::size_t run_grid_tile(
+        const RegularGrid&  grid,
+        const std::size_t   x0,
+        const std::size_t   y0,
+        const std::size_t   z0,
+        float*              distances,
+        glm::vec3*          closest_points) const
+    {
+        typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+        const Derived* engine = static_cast<const Derived*>(this);
+        const MeshPointCloud& mesh_point_cloud = engine->get_mesh_point_cloud();
+
+        const std::size_t x1 = std::min(x0 + grid_tile_size, grid.dimensions[0]);
+        const std::size_t y1 = std::min(y0 + grid_tile_size, grid.dimensions[1]);
+        const std::size_t z1 = std::min(z0 + grid_tile_size, grid.dimensions[2]);
+
+        const glm::vec3 center = grid.origin + grid.spacing * glm::vec3(
+            float(x0 + x1 - 1) * 0.5f,
+            float(y0 + y1 - 1) * 0.5f,
+            float(z0 + z1 - 1) * 0.5f);
+        const Scalar half_diagonal = std::sqrt(distance2(
+            Vec3(grid.origin + grid.spacing * glm::vec3(float(x0), float(y0), float(z0))),
+            Vec3(center)));
+        const Scalar band_width = Scalar(grid.band_width);
+
+        // Relative margin on the bounds, for rounding.
+        const Scalar margin = Scalar(1.0001);
+
+        Candidate center_closest;
+        const Scalar tile_distance = band_width + half_diagonal;
+        const bool near_mesh = engine->find(center, tile_distance * tile_distance, center_closest);
+        const Scalar center_distance = std::sqrt(center_closest.distance2);
+
+        std::size_t found_count = 0;
+        bool has_previous = false;
+        std::uint32_t previous_triangle = 0;
+
+        for (std::size_t z = z0; z < z1; ++z)
+        for (std::size_t y = y0; y < y1; ++y)
+        for (std::size_t x = x0; x < x1; ++x)
+        {
+            const std::size_t voxel = x + grid.dimensions[0] * (y + grid.dimensions[1] * z);
+            const glm::vec3 point = grid.origin + grid.spacing * glm::vec3(float(x), float(y), float(z));
+            const Scalar radius = std::sqrt(distance2(Vec3(point), Vec3(center)));
+
+            distances[voxel] = std::numeric_limits<float>::infinity();
+
+            if (!near_mesh || center_distance - radius >= band_width)
+                continue;
+
+            const Scalar upper_bound = (center_distance + radius) * margin;
+            Scalar max_distance2 = upper_bound * upper_bound;
+
+            if (has_previous)
+            {
+                glm::vec3 v1, v2, v3;
+                mesh_point_cloud.get_triangle(std::size_t(previous_triangle) * 3, v1, v2, v3);
+
+                const Vec3 previous_point = closest_point_in_triangle(Vec3(point), Vec3(v1), Vec3(v2), Vec3(v3));
+                max_distance2 = std::min(max_distance2, distance2(Vec3(point), previous_point) * margin);
+            }
+
+            // `find` only accepts distances strictly below the bound, but these
+            // bounds are reached, e.g. 0 for a voxel on the surface.
+            max_distance2 = std::min(
+                band_width * band_width,
+                std::nextafter(max_distance2, std::numeric_limits<Scalar>::infinity()));
+
+            Candidate closest;
+            if (!engine->find(point, max_distance2, closest))
+                continue;
+
+            distances[voxel] = static_cast<float>(std::sqrt(closest.distance2));
+            if (closest_points)
+                store_result(mesh_point_cloud, closest, closest_points[voxel]);
+
+            has_previous = true;
+            previous_triangle = closest.triangle;
+            ++found_count;
+        }
+
+        return found_count;
+    }
+
+    inline bool run_segment_query(
+        const glm::vec3&            start,
+        const glm::vec3&            end,
+        const float                 max_distance,
+        SegmentClosestPointResult&  result) const
+    {
+        typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+        assert(max_distance > 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar max_distance2 = Scalar(max_distance) * Scalar(max_distance);
+
+        SegmentCandidate<Vec3> candidate;
+        if (!engine->find_segment(Vec3(start), Vec3(end), max_distance2, candidate))
+            return false;
+
+        store_result(engine->get_mesh_point_cloud(), candidate.mesh, result.mesh);
+        result.segment_t = static_cast<float>(candidate.segment_t);
+        result.segment_point = glm::vec3(Vec3(start) + candidate.segment_t * (Vec3(end) - Vec3(start)));
+        return true;
+    }
+
+    /**
+     * @brief Per-thread candidate buffer of at least `size` entries, reused by all queries.
+     */
+    static Candidate* get_scratch(const std::size_t size)
+    {
+        static thread_local std::vector<Candidate> scratch;
+
+        if (scratch.size() < size)
+            scratch.resize(size);
+
+        return scratch.data();
+    }
+
+    inline std::size_t run_k_query(
+        const glm::vec3&    query_point,
+        const std::size_t   k,
+        const float         max_distance,
+        Candidate*          scratch,
+        ClosestPointResult* results) const
+    {
+        assert(max_distance > 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar max_distance2 = Scalar(max_distance) * Scalar(max_distance);
+
+        if (k == 0)
+            return 0;
+
+        const std::size_t result_count = engine->find_k(query_point, k, max_distance2, scratch);
+
+        for (std::size_t i = 0; i < result_count; ++i)
+            store_result(engine->get_mesh_point_cloud(), scratch[i], results[i]);
+
+        return result_count;
+    }
+
+    template <typename Result>
+    inline bool run_query(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        Result&             result) const
+    {
+        assert(max_distance > 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar max_distance2 = Scalar(max_distance) * Scalar(max_distance);
+
+        Candidate candidate;
+        if (!engine->find(query_point, max_distance2, candidate))
+            return false;
+
+        store_result(engine->get_mesh_point_cloud(), candidate, result);
+        return true;
+    }
+
+    template <typename Result>
+    std::size_t run_queries(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        Result*             results,
+        bool*               found) const
+    {
+        if (m_batch_schedule != BatchSchedule::Sequential && count >= sorted_batch_min_size)
+            return run_sorted_queries(query_points, count, max_distance, results, found);
+
+        std::size_t found_count = 0;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const bool query_found = run_query(query_points[i], max_distance, results[i]);
+
+            if (found)
+                found[i] = query_found;
+
+            found_count += query_found ? 1 : 0;
+        }
+
+        return found_count;
+    }
+
+    /**
+     * @brief Run the queries along a Morton curve, in parallel chunks.
+     *
+     * With `BatchSchedule::Packet`, consecutive queries of a chunk are found
+     * `query_packet_size` at a time by `Derived::find_packet`; with
+     * `BatchSchedule::Interleaved`, the queries of a chunk are interleaved by
+     * `Derived::find_interleaved`. Results are written directly at the
+     * original index of their query.
+     */
+    template <typename Result>
+    std::size_t run_sorted_queries(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        Result*             results,
+        bool*               found) const
+    {
+        CORE_TRACE_SCOPE("sorted batch");
+
+        return run_sorted_chunks(
+            count,
+            [query_points](const std::size_t i) { return query_points[i]; },
+            [&](const std::uint32_t* indices, const std::size_t chunk_count)
+            {
+                if (m_batch_schedule == BatchSchedule::Packet)
+                    return run_query_packets(query_points, indices, chunk_count, max_distance, results, found);
+
+                if (m_batch_schedule == BatchSchedule::Interleaved)
+                    return run_interleaved_queries(query_points, indices, chunk_count, max_distance, results, found);
+
+                std::size_t found_count = 0;
+
+                for (std::size_t i = 0; i < chunk_count; ++i)
+                {
+                    const std::size_t index = indices[i];
+                    const bool query_found = run_query(query_points[index], max_distance, results[index]);
+
+                    if (found)
+                        found[index] = query_found;
+
+                    found_count += query_found ? 1 : 0;
+                }
+
+                return found_count;
+            });
+    }
+
+    /**
+     * @brief Sort `count` queries along a Morton curve of `get_point(i)` and run them in parallel chunks.
+     *
+     * `run_chunk(indices, chunk_count)` runs the queries at `indices`, close
+     * in space, and returns what they found. Return the sum.
+     */
+    template <typename GetPoint, typename RunChunk>
+    std::size_t run_sorted_chunks(
+        const std::size_t   count,
+        const GetPoint&     get_point,
+        const RunChunk&     run_chunk) const
+    {
+        const std::vector<std::uint32_t> order = get_morton_order(count, get_point);
+
+        const std::size_t chunk_count = (count + sorted_batch_chunk_size - 1) / sorted_batch_chunk_size;
+        std::atomic<std::size_t> total_count(0);
+
+        parallel_for_stealing(chunk_count, [&](const std::size_t chunk)
+        {
+            const std::size_t first = chunk * sorted_batch_chunk_size;
+            const std::size_t last = std::min(first + sorted_batch_chunk_size, count);
+
+            total_count += run_chunk(order.data() + first, last - first);
+        });
+
+        return total_count;
+    }
+
+    /**
+     * @brief Run the queries at `indices`, `query_packet_size` at a time.
+     */
+    template <typename Result>
+    std::size_t run_query_packets(
+        const glm::vec3*        query_points,
+        const std::uint32_t*    indices,
+        const std::size_t       count,
+        const float             max_distance,
+        Result*                 results,
+        bool*                   found) const
+    {
+        assert(max_distance > 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar max_distance2 = Scalar(max_distance) * Scalar(max_distance);
+
+        std::size_t found_count = 0;
+
+        for (std::size_t first = 0; first < count; first += query_packet_size)
+        {
+            const std::size_t packet_count = std::min(query_packet_size, count - first);
+
+            glm::vec3 packet_points[query_packet_size];
+            Candidate candidates[query_packet_size];
+            bool packet_found[query_packet_size];
+
+            for (std::size_t lane = 0; lane < packet_count; ++lane)
+                packet_points[lane] = query_points[indices[first + lane]];
+
+            engine->find_packet(packet_points, packet_count, max_distance2, candidates, packet_found);
+
+            for (std::size_t lane = 0; lane < packet_count; ++lane)
+            {
+                const std::size_t index = indices[first + lane];
+
+                if (packet_found[lane])
+                {
+                    store_result(engine->get_mesh_point_cloud(), candidates[lane], results[index]);
+                    ++found_count;
+                }
+
+                if (found)
+                    found[index] = packet_found[lane];
+            }
+        }
+
+        return found_count;
+    }
+
+    /**
+     * @brief Run the queries at `indices`, interleaved.
+     */
+    template <typename Result>
+    std::size_t run_interleaved_queries(
+        const glm::vec3*        query_points,
+        const std::uint32_t*    indices,
+        const std::size_t       count,
+        const float             max_distance,
+        Result*                 results,
+        bool*                   found) const
+    {
+        assert(max_distance > 0.0f);
+        const Derived* engine = static_cast<const Derived*>(this);
+        const Scalar max_distance2 = Scalar(max_distance) * Scalar(max_distance);
+
+        std::size_t found_count = 0;
+
+        const auto get_point = [query_points, indices](const std::size_t i)
+        {
+            return query_points[indices[i]];
+        };
+
+        auto store = [&](const std::size_t i, const bool query_found, const Candidate& candidate)
+        {
+            const std::size_t index = indices[i];
+
+            if (query_found)
+            {
+                store_result(engine->get_mesh_point_cloud(), candidate, results[index]);
+                ++found_count;
+            }
+
+            if (found)
+                found[index] = query_found;
+        };
+
+        engine->find_interleaved(count, max_distance2, get_point, store);
+
+        return found_count;
+    }
+};
+
+/**
+ * @brief Engine instantiation. Specialized per backend below.
+ */
+template <
+    QueryBackend    Backend,
+    typename        Scalar,
+    typename        Index,
+    std::size_t     LeafSize,
+    std::size_t     CandidateCount>
+class QueryEngineImpl;
+
+/**
+ * @brief nanoflann KDTree on the point cloud, refining the nearest
+ * `CandidateCount` points into points on their triangles.
+ */
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::KdTree, Scalar, Index, LeafSize, CandidateCount>
+  : public QueryEngineBase<QueryEngineImpl<QueryBackend::KdTree, Scalar, Index, LeafSize, CandidateCount>, Scalar>
+{
+  public:
+    static_assert(CandidateCount > 0, "the KDTree needs candidates");
+
+    typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+    QueryEngineImpl(
+        const MeshPointCloud&   mesh_point_cloud,
+        const bool              precompute_triangles,
+        const BvhBuildMethod    bvh_build_method)
+      : m_mesh_point_cloud(mesh_point_cloud)
+      , m_settings(make_query_engine_settings<Scalar, Index, LeafSize, CandidateCount>(
+            QueryBackend::KdTree,
+            precompute_triangles && std::is_same<Scalar, float>::value,
+            BvhBuildMethod::Sah))
+      , m_tree_index(
+            3,
+            mesh_point_cloud,
+            nanoflann::KDTreeSingleIndexAdaptorParams(LeafSize))
+    {
+        // Start a timer to know how long it takes to build the query object.
+        auto timer_start = std::chrono::high_resolution_clock::now();
+
+        {
+            CORE_TRACE_SCOPE("ClosestPointQuery tree build");
+            m_tree_index.buildIndex();
+        }
+
+        // nanoflann allocates its nodes from its own memory pool.
+        // Account for what the pool handed out.
+        record_allocation(
+            MemoryCategory::QueryIndex,
+            m_tree_index.pool.usedMemory + m_tree_index.pool.wastedMemory);
+
+        auto timer_stop = std::chrono::high_resolution_clock::now();
+        auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+        std::cout << "Generated mesh query tree in " << process_time << "ms.\n";
+
+        // Any point of a triangle is within its longest edge of each of its vertices.
+        Scalar max_edge_length2 = Scalar(0);
+
+        for (std::size_t i = 0; i < mesh_point_cloud.get_triangle_count(); ++i)
+        {
+            glm::vec3 v1, v2, v3;
+            mesh_point_cloud.get_triangle(i * 3, v1, v2, v3);
+            max_edge_length2 = std::max(max_edge_length2, distance2(Vec3(v1), Vec3(v2)));
+            max_edge_length2 = std::max(max_edge_length2, distance2(Vec3(v2), Vec3(v3)));
+            max_edge_length2 = std::max(max_edge_length2, distance2(Vec3(v3), Vec3(v1)));
+        }
+
+        m_max_edge_length = std::sqrt(max_edge_length2);
+
+        if (m_settings.precompute_triangles)
+            m_precomputed_triangles.reset(new PrecomputedTriangles(mesh_point_cloud));
+        else if (precompute_triangles)
+            std::cerr << "Precomputed triangles are single precision, not used by double precision queries.\n";
+
+        if (bvh_build_method != BvhBuildMethod::Sah)
+            std::cerr << "The BVH build method doesn't apply to the KDTree.\n";
+    }
+
+    ~QueryEngineImpl()
+    {
+        record_deallocation(
+            MemoryCategory::QueryIndex,
+            m_tree_index.pool.usedMemory + m_tree_index.pool.wastedMemory);
+    }
+
+    /**
+     * @brief Find the closest triangle point strictly closer than `sqrt(max_distance2)`.
+     */
+    inline bool find(
+        const glm::vec3&                    query_point,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>&        best) const
+    {
+        const Vec3 point(query_point);
+
+        // Use the KDTree to find the nearest points to the `query_point`.
+        std::array<Index, CandidateCount> indices;
+        std::array<Scalar, CandidateCount> distances2;
+
+        const std::size_t num_results =
+            m_tree_index.knnSearch(
+                &point[0],
+                CandidateCount,
+                indices.data(),
+                distances2.data());
+
+        bool found = false;
+        best.distance2 = max_distance2;
+
+        // Find the closest point on the mesh using all points near to `query_point`.
+        // To do so, we use the triangle on which each point is and compute the closest
+        // point to query_point that is on the triangle.
+        // For all these "triangles points", we keep the closest one to the query point.
+        // FIXME: We analyse the same triangles multiple times.
+        auto refine = [&](const Index point_index)
+        {
+            // Each triangle has 3 points in the cloud.
+            const std::uint32_t triangle = static_cast<std::uint32_t>(point_index / 3);
+            Vec3 barycentric;
+            const Vec3 p = closest_point_on_triangle(point, triangle, barycentric);
+
+            // From all triangles, keep the closest one.
+            const Scalar distance2_to_triangle = distance2(p, point);
+
+            if (distance2_to_triangle < best.distance2)
+            {
+                found = true;
+                best.point = p;
+                best.barycentric = barycentric;
+                best.distance2 = distance2_to_triangle;
+                best.triangle = triangle;
+            }
+        };
+
+        // Constant trip count unless the cloud has fewer points than candidates.
+        if (num_results == CandidateCount)
+        {
+            for (std::size_t i = 0; i < CandidateCount; ++i)
+                refine(indices[i]);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < num_results; ++i)
+                refine(indices[i]);
+        }
+
+        return found;
+    }
+
+    /**
+     * @brief Find the `k` closest distinct triangles among the triangles of the candidate points.
+     *
+     * Like `find`, only triangles near the nearest cloud points are considered.
+     */
+    inline std::size_t find_k(
+        const glm::vec3&                    query_point,
+        const std::size_t                   k,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>*        storage) const
+    {
+        const Vec3 point(query_point);
+
+        std::array<Index, CandidateCount> indices;
+        std::array<Scalar, CandidateCount> distances2;
+
+        const std::size_t num_results =
+            m_tree_index.knnSearch(
+                &point[0],
+                CandidateCount,
+                indices.data(),
+                distances2.data());
+
+        BoundedPriorityQueue<ClosestPointCandidate<Vec3>, ClosestPointCandidateLess<Vec3>> queue(storage, k);
+
+        for (std::size_t i = 0; i < num_results; ++i)
+        {
+            ClosestPointCandidate<Vec3> candidate;
+            candidate.triangle = static_cast<std::uint32_t>(indices[i] / 3);
+
+            // The 3 points of a triangle are often candidates together.
+            bool already_kept = false;
+            for (std::size_t j = 0; j < queue.size() && !already_kept; ++j)
+                already_kept = storage[j].triangle == candidate.triangle;
+
+            if (already_kept)
+                continue;
+
+            candidate.point = closest_point_on_triangle(point, candidate.triangle, candidate.barycentric);
+            candidate.distance2 = distance2(candidate.point, point);
+
+            if (candidate.distance2 < max_distance2)
+                queue.push(candidate);
+        }
+
+        return queue.sort();
+    }
+
+    /**
+     * @brief Call `visit` with every triangle within `sqrt(radius2)`. Exact.
+     *
+     * A triangle within the radius has all its vertices within the radius plus
+     * the longest edge of the mesh: the cloud is searched with that radius.
+     */
+    template <typename Visitor>
+    inline std::size_t find_in_radius(
+        const glm::vec3&    query_point,
+        const Scalar        radius2,
+        Visitor&            visit) const
+    {
+        static thread_local std::vector<std::pair<Index, Scalar>> matches;
+        static thread_local std::vector<std::uint32_t> triangles;
+
+        const Vec3 point(query_point);
+        const Scalar search_radius = std::sqrt(radius2) + m_max_edge_length;
+
+        matches.clear();
+        m_tree_index.radiusSearch(
+            &point[0],
+            search_radius * search_radius,
+            matches,
+            nanoflann::SearchParams(32, 0, false));
+
+        triangles.clear();
+        for (const std::pair<Index, Scalar>& match : matches)
+            triangles.push_back(static_cast<std::uint32_t>(match.first / 3));
+
+        std::sort(triangles.begin(), triangles.end());
+        triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+        std::size_t count = 0;
+
+        for (const std::uint32_t triangle : triangles)
+        {
+            ClosestPointCandidate<Vec3> candidate;
+            candidate.triangle = triangle;
+            candidate.point = closest_point_on_triangle(point, triangle, candidate.barycentric);
+            candidate.distance2 = distance2(candidate.point, point);
+
+            if (candidate.distance2 <= radius2)
+            {
+                visit(candidate);
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief Nearest triangle hit by the ray before `max_t`, which is lowered to the hit.
+     *
+     * The tree cells bound the cloud points only: grown by the longest edge
+     * of the mesh, they bound the triangles of their points. Exact.
+     */
+    inline bool find_ray(
+        const Vec3&         origin,
+        const Vec3&         direction,
+        Scalar&             max_t,
+        std::uint32_t&      triangle,
+        Vec3&               barycentric) const
+    {
+        if (!m_tree_index.root_node)
+            return false;
+
+        const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+        const Vec3 inv_direction(
+            direction.x != Scalar(0) ? Scalar(1) / direction.x : infinity,
+            direction.y != Scalar(0) ? Scalar(1) / direction.y : infinity,
+            direction.z != Scalar(0) ? Scalar(1) / direction.z : infinity);
+
+        Vec3 box_min, box_max;
+        get_root_cell(box_min, box_max);
+
+        Scalar t_entry;
+        if (!intersect_ray_box(origin, inv_direction, box_min, box_max, max_t, t_entry))
+            return false;
+
+        return find_ray_in_node(
+            m_tree_index.root_node,
+            box_min,
+            box_max,
+            origin,
+            direction,
+            inv_direction,
+            max_t,
+            triangle,
+            barycentric);
+    }
+
+    /**
+     * @brief Closest triangle point to a segment strictly within `max_distance2`.
+     *
+     * Cells are pruned by their distance to the segment, grown like in `find_ray`. Exact.
+     */
+    inline bool find_segment(
+        const Vec3&                 start,
+        const Vec3&                 end,
+        const Scalar                max_distance2,
+        SegmentCandidate<Vec3>&     closest) const
+    {
+        if (!m_tree_index.root_node)
+            return false;
+
+        bool found = false;
+        Scalar closest_distance2 = max_distance2;
+
+        const auto cell_distance2 = [&](const Vec3& box_min, const Vec3& box_max)
+        {
+            return distance2_segment_to_box(start, end, box_min, box_max);
+        };
+
+        // Triangles are visited once per vertex in the cells, repeats are not closer.
+        auto visit_point = [&](const Index point_index, Scalar& bound)
+        {
+            glm::vec3 v1, v2, v3;
+            m_mesh_point_cloud.get_triangle(point_index, v1, v2, v3);
+
+            Scalar segment_t;
+            Vec3 point, barycentric;
+            const Scalar distance2 = closest_points_segment_triangle(
+                start, end, Vec3(v1), Vec3(v2), Vec3(v3), segment_t, point, barycentric);
+
+            if (distance2 < bound)
+            {
+                bound = distance2;
+                found = true;
+                closest.mesh = { point, barycentric, distance2, static_cast<std::uint32_t>(point_index / 3) };
+                closest.segment_t = segment_t;
+            }
+        };
+
+        Vec3 box_min, box_max;
+        get_root_cell(box_min, box_max);
+
+        if (cell_distance2(box_min, box_max) < closest_distance2)
+            traverse_closest_cells(m_tree_index.root_node, box_min, box_max, cell_distance2, closest_distance2, visit_point);
+
+        return found;
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_mesh_point_cloud;
+    }
+
+    MemoryUsage get_memory_usage() const override
+    {
+        MemoryUsage usage;
+        usage.add("tree nodes", m_tree_index.pool.usedMemory);
+        usage.add("tree pool slack", m_tree_index.pool.wastedMemory);
+        usage.add("tree point indices", get_heap_bytes(m_tree_index.vind));
+
+        if (m_precomputed_triangles)
+            usage.add("precomputed triangles", m_precomputed_triangles->get_memory_usage().get_total_bytes());
+
+        return usage;
+    }
+
+    const QueryEngineSettings& get_settings() const override
+    {
+        return m_settings;
+    }
+
+  private:
+    typedef nanoflann::KDTreeSingleIndexAdaptor<
+        nanoflann::L2_Simple_Adaptor<Scalar, MeshPointCloud>,
+        MeshPointCloud,
+        3, /* Go 3D! */
+        Index> TreeIndex;
+
+    const MeshPointCloud&   m_mesh_point_cloud;
+    QueryEngineSettings     m_settings;
+    TreeIndex               m_tree_index;
+    Scalar                  m_max_edge_length;
+
+    // Optional, indexed by triangle.
+    std::unique_ptr<PrecomputedTriangles> m_precomputed_triangles;
+
+    inline Vec3 closest_point_on_triangle(
+        const Vec3&         point,
+        const std::uint32_t triangle,
+        Vec3&               barycentric) const
+    {
+        if (m_precomputed_triangles)
+        {
+            return closest_point_in_precomputed_triangle(
+                point,
+                m_precomputed_triangles->get(triangle),
+                barycentric);
+        }
+
+        // Ask to the point cloud where the triangle is.
+        glm::vec3 v1, v2, v3;
+        m_mesh_point_cloud.get_triangle(std::size_t(triangle) * 3, v1, v2, v3);
+
+        // Compute the closest point to `query_point` that is on the triangle.
+        return closest_point_in_triangle(point, Vec3(v1), Vec3(v2), Vec3(v3), barycentric);
+    }
+
+    /**
+     * @brief Bounds of the tree points, grown by the longest edge to bound their triangles.
+     */
+    inline void get_root_cell(Vec3& box_min, Vec3& box_max) const
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            box_min[axis] = m_tree_index.root_bbox[axis].low - m_max_edge_length;
+            box_max[axis] = m_tree_index.root_bbox[axis].high + m_max_edge_length;
+        }
+    }
+
+    /**
+     * @brief Visit the points of the cells closer than `closest_distance2`, nearest cell first.
+     *
+     * `cell_distance2(min, max)` bounds the distance to the triangles of the
+     * cell, grown by the longest edge. `visit_point(index, closest_distance2)`
+     * may lower the bound.
+     */
+    template <typename CellDistance, typename PointVisitor>
+    void traverse_closest_cells(
+        const typename TreeIndex::Node* node,
+        const Vec3&                     box_min,
+        const Vec3&                     box_max,
+        const CellDistance&             cell_distance2,
+        Scalar&                         closest_distance2,
+        PointVisitor&                   visit_point) const
+    {
+        if (!node->child1 && !node->child2)
+        {
+            for (Index i = node->node_type.lr.left; i < node->node_type.lr.right; ++i)
+                visit_point(m_tree_index.vind[i], closest_distance2);
+
+            return;
+        }
+
+        const int axis = node->node_type.sub.divfeat;
+
+        Vec3 child_min[2] = { box_min, box_min };
+        Vec3 child_max[2] = { box_max, box_max };
+        child_max[0][axis] = node->node_type.sub.divlow + m_max_edge_length;
+        child_min[1][axis] = node->node_type.sub.divhigh - m_max_edge_length;
+
+        const typename TreeIndex::Node* children[2] = { node->child1, node->child2 };
+        const Scalar distance2[2] = {
+            cell_distance2(child_min[0], child_max[0]),
+            cell_distance2(child_min[1], child_max[1]) };
+
+        const int nearest = distance2[1] < distance2[0] ? 1 : 0;
+        const int farthest = 1 - nearest;
+
+        if (distance2[nearest] < closest_distance2)
+        {
+            traverse_closest_cells(
+                children[nearest], child_min[nearest], child_max[nearest],
+                cell_distance2, closest_distance2, visit_point);
+        }
+
+        if (distance2[farthest] < closest_distance2)
+        {
+            traverse_closest_cells(
+                children[farthest], child_min[farthest], child_max[farthest],
+                cell_distance2, closest_distance2, visit_point);
+        }
+    }
+
+    bool find_ray_in_node(
+        const typename TreeIndex::Node* node,
+        const Vec3&                     box_min,
+        const Vec3&                     box_max,
+        const Vec3&                     origin,
+        const Vec3&                     direction,
+        const Vec3&                     inv_direction,
+        Scalar&                         max_t,
+        std::uint32_t&                  triangle,
+        Vec3&                           barycentric) const
+    {
+        // Leaf: test the triangles of its points.
+        if (!node->child1 && !node->child2)
+        {
+            bool hit = false;
+
+            for (Index i = node->node_type.lr.left; i < node->node_type.lr.right; ++i)
+            {
+                const Index point_index = m_tree_index.vind[i];
+
+                glm::vec3 v1, v2, v3;
+                m_mesh_point_cloud.get_triangle(point_index, v1, v2, v3);
+
+                Scalar t;
+                Vec3 hit_barycentric;
+
+                if (intersect_ray_triangle(origin, direction, Vec3(v1), Vec3(v2), Vec3(v3), max_t, t, hit_barycentric))
+                {
+                    hit = true;
+                    max_t = t;
+                    triangle = static_cast<std::uint32_t>(point_index / 3);
+                    barycentric = hit_barycentric;
+                }
+            }
+
+            return hit;
+        }
+
+        // Children cells, grown by the longest edge.
+        const int axis = node->node_type.sub.divfeat;
+
+        Vec3 child_min[2] = { box_min, box_min };
+        Vec3 child_max[2] = { box_max, box_max };
+        child_max[0][axis] = node->node_type.sub.divlow + m_max_edge_length;
+        child_min[1][axis] = node->node_type.sub.divhigh - m_max_edge_length;
+
+        const typename TreeIndex::Node* children[2] = { node->child1, node->child2 };
+        Scalar t_entry[2];
+        bool enter[2];
+
+        for (int c = 0; c < 2; ++c)
+            enter[c] = intersect_ray_box(origin, inv_direction, child_min[c], child_max[c], max_t, t_entry[c]);
+
+        // Visit the nearest child first.
+        const int nearest = enter[1] && (!enter[0] || t_entry[1] < t_entry[0]) ? 1 : 0;
+        const int farthest = 1 - nearest;
+
+        bool hit = false;
+
+        if (enter[nearest])
+        {
+            hit = find_ray_in_node(
+                children[nearest], child_min[nearest], child_max[nearest],
+                origin, direction, inv_direction, max_t, triangle, barycentric);
+        }
+
+        // The nearest child may have found a hit before the farthest one.
+        if (enter[farthest] && t_entry[farthest] <= max_t)
+        {
+            hit = find_ray_in_node(
+                children[farthest], child_min[farthest], child_max[farthest],
+                origin, direction, inv_direction, max_t, triangle, barycentric) || hit;
+        }
+
+        return hit;
+    }
+};
+
+/**
+ * @brief BVH on the triangles, `CompactBvh` or `WideBvh`, or `Heightfield` on grid meshes. Exact.
+ *
+ * Leaves are refined with a loop of `LeafSize` iterations, then a
+ * remainder loop for the few leaves made at the maximum build depth.
+ * The candidate count doesn't apply and is 0.
+ */
+template <
+    QueryBackend    Backend,
+    typename        Bvh,
+    typename        Scalar,
+    typename        Index,
+    std::size_t     LeafSize>
+class BvhQueryEngine
+  : public QueryEngineBase<BvhQueryEngine<Backend, Bvh, Scalar, Index, LeafSize>, Scalar>
+{
+  public:
+    static_assert(std::is_same<Index, std::uint32_t>::value, "BVH nodes store 32-bit offsets");
+    static_assert(LeafSize > 0, "leaves hold at least one triangle");
+
+    typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+    BvhQueryEngine(
+        const MeshPointCloud&   mesh_point_cloud,
+        const bool              precompute_triangles,
+        const BvhBuildMethod    bvh_build_method)
+      : m_settings(make_query_engine_settings<Scalar, Index, LeafSize, 0>(
+            Backend,
+            precompute_triangles && std::is_same<Scalar, float>::value,
+            bvh_build_method))
+      , m_bvh(mesh_point_cloud, LeafSize, m_settings.precompute_triangles, bvh_build_method)
+      , m_simd_kernels(get_simd_kernels())
+    {
+        if (precompute_triangles && !m_settings.precompute_triangles)
+            std::cerr << "Precomputed triangles are single precision, not used by double precision queries.\n";
+    }
+
+    /**
+     * @brief Find the closest triangle point strictly closer than `sqrt(max_distance2)`.
+     */
+    inline bool find(
+        const glm::vec3&                    query_point,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>&        best) const
+    {
+        const Vec3 point(query_point);
+
+        bool found = false;
+        Scalar closest_distance2 = max_distance2;
+
+        auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t count, Scalar& max_leaf_distance2)
+        {
+            refine_leaf(point, first, count, max_leaf_distance2, best, found);
+        };
+
+        m_bvh.traverse_nearest(point, closest_distance2, visit_leaf);
+
+        best.distance2 = closest_distance2;
+        return found;
+    }
+
+    /**
+     * @brief `find` for `count` queries, with `query_interleave_count` traversals in flight.
+     *
+     * Each traversal processes one node, prefetches its next one, and hands
+     * over to the next traversal while the node is loaded, so the memory
+     * latency of one query is hidden behind the work of the others. A
+     * finished query is replaced by the next one. Same results as `find`.
+     */
+    template <typename GetPoint, typename Store>
+    inline void find_interleaved(
+        const std::size_t   count,
+        const Scalar        max_distance2,
+        const GetPoint&     get_point,
+        Store&              store) const
+    {
+        struct Query
+        {
+            std::size_t                                                         index;
+            Vec3                                                                point;
+            Scalar                                                              closest_distance2;
+            bool                                                                found;
+            ClosestPointCandidate<Vec3>                                         best;
+            typename Bvh::template NearestTraversal<Scalar>    traversal;
+        };
+
+        Query queries[query_interleave_count];
+        std::size_t active_count = 0;
+        std::size_t next = 0;
+
+        const auto start = [&](Query& query)
+        {
+            query.index = next++;
+            query.point = Vec3(get_point(query.index));
+            query.closest_distance2 = max_distance2;
+            query.found = false;
+            m_bvh.start_nearest(query.point, query.traversal);
+        };
+
+        for (; active_count < query_interleave_count && next < count; ++active_count)
+            start(queries[active_count]);
+
+        while (active_count > 0)
+        {
+            for (std::size_t slot = 0; slot < active_count;)
+            {
+                Query& query = queries[slot];
+
+                auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t primitive_count, Scalar& max_leaf_distance2)
+                {
+                    refine_leaf(query.point, first, primitive_count, max_leaf_distance2, query.best, query.found);
+                };
+
+                if (m_bvh.step_nearest(query.point, query.traversal, query.closest_distance2, visit_leaf))
+                {
+                    ++slot;
+                    continue;
+                }
+
+                query.best.distance2 = query.closest_distance2;
+                store(query.index, query.found, query.best);
+
+                if (next < count)
+                {
+                    start(query);
+                    ++slot;
+                }
+                else
+                    query = queries[--active_count];
+            }
+        }
+    }
+
+    /**
+     * @brief `find` for up to `query_packet_size` nearby queries, in one traversal.
+     *
+     * A node is visited while one of the queries still needs it, so the
+     * packet loads each node once. In single precision, leaves test each
+     * triangle against all the queries with the batched triangle kernel
+     * (`distance2_to_triangle`): results are the same as `find` with
+     * precomputed triangles, and within rounding without them.
+     */
+    inline void find_packet(
+        const glm::vec3*                    query_points,
+        const std::size_t                   count,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>*        best,
+        bool*                               found) const
+    {
+        assert(count > 0 && count <= query_packet_size);
+
+        PointPacket<Scalar, query_packet_size> packet;
+        Scalar closest_distance2[query_packet_size];
+
+        for (std::size_t lane = 0; lane < query_packet_size; ++lane)
+        {
+            // Missing lanes repeat the first query with a bound of 0: they never need a node.
+            const glm::vec3& point = query_points[lane < count ? lane : 0];
+            packet.x[lane] = Scalar(point.x);
+            packet.y[lane] = Scalar(point.y);
+            packet.z[lane] = Scalar(point.z);
+            closest_distance2[lane] = lane < count ? max_distance2 : Scalar(0);
+            found[lane] = false;
+        }
+
+        auto visit_leaf = [&](
+            const std::uint32_t first,
+            const std::uint32_t primitive_count,
+            const Scalar        (&leaf_distance2)[query_packet_size],
+            Scalar              (&bound)[query_packet_size])
+        {
+            refine_packet(packet, first, primitive_count, leaf_distance2, bound, best, found);
+        };
+
+        m_bvh.traverse_packet(packet, closest_distance2, visit_leaf);
+
+        for (std::size_t lane = 0; lane < count; ++lane)
+            best[lane].distance2 = closest_distance2[lane];
+    }
+
+    /**
+     * @brief Find the `k` closest triangles. Exact.
+     *
+     * Once `k` triangles are kept, nodes farther than the k-th one are skipped.
+     */
+    inline std::size_t find_k(
+        const glm::vec3&                    query_point,
+        const std::size_t                   k,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>*        storage) const
+    {
+        const Vec3 point(query_point);
+        BoundedPriorityQueue<ClosestPointCandidate<Vec3>, ClosestPointCandidateLess<Vec3>> queue(storage, k);
+        Scalar bound2 = max_distance2;
+
+        auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t count, Scalar& max_leaf_distance2)
+        {
+            for (std::uint32_t i = first; i < first + count; ++i)
+            {
+                ClosestPointCandidate<Vec3> candidate;
+                candidate.triangle = m_bvh.get_primitive(i);
+                candidate.point = closest_point_on_primitive(point, i, candidate.barycentric);
+                candidate.distance2 = distance2(candidate.point, point);
+
+                if (candidate.distance2 < max_leaf_distance2
+                    && queue.push(candidate)
+                    && queue.is_full())
+                {
+                    max_leaf_distance2 = queue.top().distance2;
+                }
+            }
+        };
+
+        m_bvh.traverse_nearest(point, bound2, visit_leaf);
+
+        return queue.sort();
+    }
+
+    /**
+     * @brief Call `visit` with every triangle within `sqrt(radius2)`, nearest leaves first. Exact.
+     */
+    template <typename Visitor>
+    inline std::size_t find_in_radius(
+        const glm::vec3&    query_point,
+        const Scalar        radius2,
+        Visitor&            visit) const
+    {
+        const Vec3 point(query_point);
+        std::size_t count = 0;
+
+        // Traversal skips nodes at `bound2` or farther: nodes exactly at the radius are kept.
+        Scalar bound2 = std::nextafter(radius2, std::numeric_limits<Scalar>::max());
+
+        auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t primitive_count, Scalar&)
+        {
+            for (std::uint32_t i = first; i < first + primitive_count; ++i)
+            {
+                ClosestPointCandidate<Vec3> candidate;
+                candidate.triangle = m_bvh.get_primitive(i);
+                candidate.point = closest_point_on_primitive(point, i, candidate.barycentric);
+                candidate.distance2 = distance2(candidate.point, point);
+
+                if (candidate.distance2 <= radius2)
+                {
+                    visit(candidate);
+                    ++count;
+                }
+            }
+        };
+
+        m_bvh.traverse_nearest(point, bound2, visit_leaf);
+
+        return count;
+    }
+
+    /**
+     * @brief Nearest triangle hit by the ray before `max_t`, which is lowered to the hit.
+     */
+    inline bool find_ray(
+        const Vec3&         origin,
+        const Vec3&         direction,
+        Scalar&             max_t,
+        std::uint32_t&      triangle,
+        Vec3&               barycentric) const
+    {
+        const MeshPointCloud& mesh_point_cloud = m_bvh.get_mesh_point_cloud();
+        bool hit = false;
+
+        auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t count, Scalar& max_leaf_t)
+        {
+            for (std::uint32_t i = first; i < first + count; ++i)
+            {
+                const std::uint32_t primitive_triangle = m_bvh.get_primitive(i);
+
+                glm::vec3 v1, v2, v3;
+                mesh_point_cloud.get_triangle(std::size_t(primitive_triangle) * 3, v1, v2, v3);
+
+                Scalar t;
+                Vec3 hit_barycentric;
+
+                if (intersect_ray_triangle(origin, direction, Vec3(v1), Vec3(v2), Vec3(v3), max_leaf_t, t, hit_barycentric))
+                {
+                    hit = true;
+                    max_leaf_t = t;
+                    triangle = primitive_triangle;
+                    barycentric = hit_barycentric;
+                }
+            }
+        };
+
+        m_bvh.traverse_ray(origin, direction, max_t, visit_leaf);
+
+        return hit;
+    }
+
+    /**
+     * @brief Closest triangle point to a segment strictly within `max_distance2`.
+     *
+     * Nodes are pruned by their exact distance to the segment.
+     */
+    inline bool find_segment(
+        const Vec3&                 start,
+        const Vec3&                 end,
+        const Scalar                max_distance2,
+        SegmentCandidate<Vec3>&     closest) const
+    {
+        const MeshPointCloud& mesh_point_cloud = m_bvh.get_mesh_point_cloud();
+        bool found = false;
+        Scalar closest_distance2 = max_distance2;
+
+        const auto box_distance2 = [&](const glm::vec3& box_min, const glm::vec3& box_max)
+        {
+            return distance2_segment_to_box(start, end, Vec3(box_min), Vec3(box_max));
+        };
+
+        auto visit_leaf = [&](const std::uint32_t first, const std::uint32_t count, Scalar& bound)
+        {
+            for (std::uint32_t i = first; i < first + count; ++i)
+            {
+                const std::uint32_t triangle = m_bvh.get_primitive(i);
+
+                glm::vec3 v1, v2, v3;
+                mesh_point_cloud.get_triangle(std::size_t(triangle) * 3, v1, v2, v3);
+
+                Scalar segment_t;
+                Vec3 point, barycentric;
+                const Scalar distance2 = closest_points_segment_triangle(
+                    start, end, Vec3(v1), Vec3(v2), Vec3(v3), segment_t, point, barycentric);
+
+                if (distance2 < bound)
+                {
+                    bound = distance2;
+                    found = true;
+                    closest.mesh = { point, barycentric, distance2, triangle };
+                    closest.segment_t = segment_t;
+                }
+            }
+        };
+
+        m_bvh.traverse_closest(box_distance2, closest_distance2, visit_leaf);
+
+        return found;
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_bvh.get_mesh_point_cloud();
+    }
+
+    MemoryUsage get_memory_usage() const override
+    {
+        return m_bvh.get_memory_usage();
+    }
+
+    const QueryEngineSettings& get_settings() const override
+    {
+        return m_settings;
+    }
+
+  private:
+    QueryEngineSettings     m_settings;
+    Bvh                     m_bvh;
+    const SimdKernels*      m_simd_kernels;     // nullptr for the math.h kernels
+
+    /**
+     * @brief Closest point on the triangle of the primitive at `primitive` in leaf order.
+     */
+    inline Vec3 closest_point_on_primitive(
+        const Vec3&         point,
+        const std::uint32_t primitive,
+        Vec3&               barycentric) const
+    {
+        const PrecomputedTriangles* precomputed_triangles = m_bvh.get_precomputed_triangles();
+
+        if (precomputed_triangles)
+            return closest_point_in_precomputed_triangle(point, precomputed_triangles->get(primitive), barycentric);
+
+        glm::vec3 v1, v2, v3;
+        m_bvh.get_mesh_point_cloud().get_triangle(std::size_t(m_bvh.get_primitive(primitive)) * 3, v1, v2, v3);
+        return closest_point_in_triangle(point, Vec3(v1), Vec3(v2), Vec3(v3), barycentric);
+    }
+
+    /**
+     * @brief Refine the primitives of a leaf into `best` for `find`, lowering `closest_distance2`.
+     *
+     * A loop of `LeafSize` iterations the compiler can unroll, then the
+     * remainder for the few leaves made at the maximum build depth.
+     */
+    inline void refine_leaf(
+        const Vec3&                         point,
+        const std::uint32_t                 first,
+        const std::uint32_t                 count,
+        Scalar&                             closest_distance2,
+        ClosestPointCandidate<Vec3>&        best,
+        bool&                               found) const
+    {
+        auto refine = [&](const std::uint32_t primitive)
+        {
+            const std::uint32_t triangle = m_bvh.get_primitive(primitive);
+            Vec3 barycentric;
+            const Vec3 p = closest_point_on_primitive(point, primitive, barycentric);
+
+            const Scalar distance2_to_triangle = distance2(p, point);
+
+            if (distance2_to_triangle < closest_distance2)
+            {
+                found = true;
+                best.point = p;
+                best.barycentric = barycentric;
+                best.triangle = triangle;
+                closest_distance2 = distance2_to_triangle;
+            }
+        };
+
+        for (std::uint32_t i = 0; i < LeafSize; ++i)
+        {
+            if (i < count)
+                refine(first + i);
+        }
+
+        for (std::uint32_t i = LeafSize; i < count; ++i)
+            refine(first + i);
+    }
+
+    /**
+     * @brief Refine the primitives of a leaf for all the lanes of a packet, single precision.
+     *
+     * Each triangle is tested against every lane at once; the closest point
+     * itself is only computed for the lanes it improves.
+     */
+    inline void refine_packet(
+        const PointPacket<float, query_packet_size>&    packet,
+        const std::uint32_t                             first,
+        const std::uint32_t                             count,
+        const float                                     (&)[query_packet_size],
+        float                                           (&closest_distance2)[query_packet_size],
+        ClosestPointCandidate<Vec3>*                    best,
+        bool*                                           found) const
+    {
+        const PrecomputedTriangles* precomputed_triangles = m_bvh.get_precomputed_triangles();
+
+        for (std::uint32_t i = first; i < first + count; ++i)
+        {
+            TriangleQueryData triangle;
+
+            if (precomputed_triangles)
+                triangle = precomputed_triangles->get(i);
+            else
+            {
+                glm::vec3 v1, v2, v3;
+                m_bvh.get_mesh_point_cloud().get_triangle(std::size_t(m_bvh.get_primitive(i)) * 3, v1, v2, v3);
+                triangle = make_triangle_query_data(v1, v2, v3);
+            }
+
+            static_assert(query_packet_size == 8, "the SIMD kernel takes packets of 8 queries");
+
+            float distance2[query_packet_size];
+
+            if (m_simd_kernels)
+                m_simd_kernels->distance2_to_triangle8(packet, triangle, distance2);
+            else
+                distance2_to_triangle(packet, triangle, distance2);
+
+            for (std::size_t lane = 0; lane < query_packet_size; ++lane)
+            {
+                if (distance2[lane] < closest_distance2[lane])
+                {
+                    const glm::vec3 point(packet.x[lane], packet.y[lane], packet.z[lane]);
+                    closest_distance2[lane] = distance2[lane];
+                    found[lane] = true;
+                    best[lane].point = closest_point_in_triangle(point, triangle, best[lane].barycentric);
+                    best[lane].triangle = m_bvh.get_primitive(i);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Same as above in double precision, lane by lane, skipping the lanes that don't need the leaf.
+     */
+    inline void refine_packet(
+        const PointPacket<double, query_packet_size>&   packet,
+        const std::uint32_t                             first,
+        const std::uint32_t                             count,
+        const double                                    (&leaf_distance2)[query_packet_size],
+        double                                          (&closest_distance2)[query_packet_size],
+        ClosestPointCandidate<Vec3>*                    best,
+        bool*                                           found) const
+    {
+        for (std::uint32_t i = first; i < first + count; ++i)
+        {
+            for (std::size_t lane = 0; lane < query_packet_size; ++lane)
+            {
+                if (!(leaf_distance2[lane] < closest_distance2[lane]))
+                    continue;
+
+                const Vec3 point(packet.x[lane], packet.y[lane], packet.z[lane]);
+                Vec3 barycentric;
+                const Vec3 p = closest_point_on_primitive(point, i, barycentric);
+                const Scalar distance2_to_triangle = distance2(p, point);
+
+                if (distance2_to_triangle < closest_distance2[lane])
+                {
+                    closest_distance2[lane] = distance2_to_triangle;
+                    found[lane] = true;
+                    best[lane].point = p;
+                    best[lane].barycentric = barycentric;
+                    best[lane].triangle = m_bvh.get_primitive(i);
+                }
+            }
+        }
+    }
+};
+
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::Bvh8, Scalar, Index, LeafSize, CandidateCount>
+  : public BvhQueryEngine<QueryBackend::Bvh8, CompactBvh8, Scalar, Index, LeafSize>
+{
+  public:
+    using BvhQueryEngine<QueryBackend::Bvh8, CompactBvh8, Scalar, Index, LeafSize>::BvhQueryEngine;
+};
+
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::Bvh16, Scalar, Index, LeafSize, CandidateCount>
+  : public BvhQueryEngine<QueryBackend::Bvh16, CompactBvh16, Scalar, Index, LeafSize>
+{
+  public:
+    using BvhQueryEngine<QueryBackend::Bvh16, CompactBvh16, Scalar, Index, LeafSize>::BvhQueryEngine;
+};
+
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::WideBvh4, Scalar, Index, LeafSize, CandidateCount>
+  : public BvhQueryEngine<QueryBackend::WideBvh4, WideBvh4, Scalar, Index, LeafSize>
+{
+  public:
+    using BvhQueryEngine<QueryBackend::WideBvh4, WideBvh4, Scalar, Index, LeafSize>::BvhQueryEngine;
+};
+
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::WideBvh8, Scalar, Index, LeafSize, CandidateCount>
+  : public BvhQueryEngine<QueryBackend::WideBvh8, WideBvh8, Scalar, Index, LeafSize>
+{
+  public:
+    using BvhQueryEngine<QueryBackend::WideBvh8, WideBvh8, Scalar, Index, LeafSize>::BvhQueryEngine;
+};
+
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::Heightfield, Scalar, Index, LeafSize, CandidateCount>
+  : public BvhQueryEngine<QueryBackend::Heightfield, Heightfield, Scalar, Index, LeafSize>
+{
+  public:
+    using BvhQueryEngine<QueryBackend::Heightfield, Heightfield, Scalar, Index, LeafSize>::BvhQueryEngine;
+};
+
+/**
+ * @brief Walk on a convex mesh (see `ConvexMesh`), `WideBvh4` for everything else. Exact.
+ *
+ * Closest point queries from outside the solid walk a few triangles from
+ * the support vertex towards the point. Queries the walk can't answer,
+ * from inside the solid, and the other query types go to the BVH.
+ */
+template <typename Scalar, typename Index, std::size_t LeafSize, std::size_t CandidateCount>
+class QueryEngineImpl<QueryBackend::Convex, Scalar, Index, LeafSize, CandidateCount>
+  : public QueryEngineBase<QueryEngineImpl<QueryBackend::Convex, Scalar, Index, LeafSize, CandidateCount>, Scalar>
+{
+  public:
+    typedef typename ScalarTraits<Scalar>::Vec3 Vec3;
+
+    QueryEngineImpl(
+        const MeshPointCloud&   mesh_point_cloud,
+        const bool              precompute_triangles,
+        const BvhBuildMethod    bvh_build_method)
+      : m_convex_mesh(mesh_point_cloud)
+      , m_bvh_engine(mesh_point_cloud, precompute_triangles, bvh_build_method)
+    {
+    }
+
+    /**
+     * @brief Find the closest triangle point strictly closer than `sqrt(max_distance2)`.
+     */
+    inline bool find(
+        const glm::vec3&                    query_point,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>&        best) const
+    {
+        ClosestPointCandidate<Vec3> candidate;
+
+        if (!m_convex_mesh.find_closest(
+                Vec3(query_point),
+                candidate.triangle,
+                candidate.point,
+                candidate.barycentric,
+                candidate.distance2))
+        {
+            return m_bvh_engine.find(query_point, max_distance2, best);
+        }
+
+        // The walk found the closest point: nothing else is closer.
+        if (!(candidate.distance2 < max_distance2))
+        {
+            best.distance2 = max_distance2;
+            return false;
+        }
+
+        best = candidate;
+        return true;
+    }
+
+    inline std::size_t find_k(
+        const glm::vec3&                    query_point,
+        const std::size_t                   k,
+        const Scalar                        max_distance2,
+        ClosestPointCandidate<Vec3>*        storage) const
+    {
+        return m_bvh_engine.find_k(query_point, k, max_distance2, storage);
+    }
+
+    template <typename Visitor>
+    inline std::size_t find_in_radius(
+        const glm::vec3&    query_point,
+        const Scalar        radius2,
+        Visitor&            visit) const
+    {
+        return m_bvh_engine.find_in_radius(query_point, radius2, visit);
+    }
+
+    inline bool find_ray(
+        const Vec3&         origin,
+        const Vec3&         direction,
+        Scalar&             max_t,
+        std::uint32_t&      triangle,
+        Vec3&               barycentric) const
+    {
+        return m_bvh_engine.find_ray(origin, direction, max_t, triangle, barycentric);
+    }
+
+    inline bool find_segment(
+        const Vec3&                 start,
+        const Vec3&                 end,
+        const Scalar                max_distance2,
+        SegmentCandidate<Vec3>&     closest) const
+    {
+        return m_bvh_engine.find_segment(start, end, max_distance2, closest);
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_bvh_engine.get_mesh_point_cloud();
+    }
+
+    MemoryUsage get_memory_usage() const override
+    {
+        MemoryUsage usage = m_convex_mesh.get_memory_usage();
+        const MemoryUsage bvh_usage = m_bvh_engine.get_memory_usage();
+
+        for (const MemoryUsage::Component& component : bvh_usage.get_components())
+            usage.add(component.name, component.bytes);
+
+        return usage;
+    }
+
+    const QueryEngineSettings& get_settings() const override
+    {
+        return m_bvh_engine.get_settings();
+    }
+
+  private:
+    ConvexMesh                                                                          m_convex_mesh;
+    BvhQueryEngine<QueryBackend::Convex, WideBvh4, Scalar, Index, LeafSize>             m_bvh_engine;
+};
+
+} // namespace core
@@ -0,0 +1,117 @@
+#include "radix_sort.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    const std::size_t digit_bits = 8;
+    const std::size_t digit_count = std::size_t(1) << digit_bits;
+
+    // Smaller blocks cost more in counts than they gain in parallelism.
+    const std::size_t min_block_size = 16384;
+}
+
+void parallel_radix_sort(
+    std::uint64_t*      keys,
+    std::uint32_t*      values,
+    const std::size_t   count,
+    const std::size_t   key_bits)
+{
+    assert(key_bits <= 64);
+
+    if (count < 2)
+        return;
+
+    const std::size_t block_count = std::min(
+        (count + min_block_size - 1) / min_block_size,
+        4 * get_thread_count());
+    const std::size_t block_size = (count + block_count - 1) / block_count;
+
+    std::vector<std::uint64_t> key_buffer(count);
+    std::vector<std::uint32_t> value_buffer(count);
+
+    std::uint64_t* source_keys = keys;
+    std::uint32_t* source_values = values;
+    std::uint64_t* target_keys = key_buffer.data();
+    std::uint32_t* target_values = value_buffer.data();
+
+    // Digit counts of every block, then where each block writes each digit.
+    std::vector<std::size_t> offsets(block_count * digit_count);
+
+    for (std::size_t shift = 0; shift < key_bits; shift += digit_bits)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        parallel_for(block_count, [&](const std::size_t block)
+        {
+            std::size_t* block_counts = &offsets[block * digit_count];
+            const std::size_t last = std::min(count, (block + 1) * block_size);
+
+            for (std::size_t i = block * block_size; i < last; ++i)
+                ++block_counts[(source_keys[i] >> shift) & (digit_count - 1)];
+        });
+
+        // All the keys have the same digit: the pass wouldn't move anything.
+        std::size_t digit_total = 0;
+        std::size_t used_digits = 0;
+
+        for (std::size_t digit = 0; digit < digit_count; ++digit)
+        {
+            std::size_t total = 0;
+
+            for (std::size_t block = 0; block < block_count; ++block)
+                total += offsets[block * digit_count + digit];
+
+            used_digits += total > 0 ? 1 : 0;
+        }
+
+        if (used_digits == 1)
+            continue;
+
+        // Digits in order, and blocks in order within a digit, for a stable sort.
+        for (std::size_t digit = 0; digit < digit_count; ++digit)
+        {
+            for (std::size_t block = 0; block < block_count; ++block)
+            {
+                const std::size_t block_digit_count = offsets[block * digit_count + digit];
+                offsets[block * digit_count + digit] = digit_total;
+                digit_total += block_digit_count;
+            }
+        }
+
+        assert(digit_total == count);
+
+        parallel_for(block_count, [&](const std::size_t block)
+        {
+            std::size_t* block_offsets = &offsets[block * digit_count];
+            const std::size_t last = std::min(count, (block + 1) * block_size);
+
+            for (std::size_t i = block * block_size; i < last; ++i)
+            {
+                const std::size_t target = block_offsets[(source_keys[i] >> shift) & (digit_count - 1)]++;
+                target_keys[target] = source_keys[i];
+                target_values[target] = source_values[i];
+            }
+        });
+
+        std::swap(source_keys, target_keys);
+        std::swap(source_values, target_values);
+    }
+
+    // An odd number of passes left the result in the buffers.
+    if (source_keys != keys)
+    {
+        std::memcpy(keys, source_keys, count * sizeof(std::uint64_t));
+        std::memcpy(values, source_values, count * sizeof(std::uint32_t));
+    }
+}
+
+} // namespace core
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace core
+{
+
+/**
+ * @brief Sort `count` key and value pairs by key, on all threads.
+ *
+ * Least significant digit radix sort, 8 bits per pass, on the `key_bits`
+ * lowest bits of the keys (higher bits must be 0). Each pass splits the
+ * array in blocks: the blocks count their digits in parallel, then scatter
+ * their pairs in parallel at offsets computed from all the counts. Passes
+ * where all keys share the same digit are skipped. The sort is stable, so
+ * the result doesn't depend on the number of threads.
+ */
+void parallel_radix_sort(
+    std::uint64_t*      keys,
+    std::uint32_t*      values,
+    const std::size_t   count,
+    const std::size_t   key_bits = 64);
+
+} // namespace core
@@ -20,8 +20,8 @@ void RasterizedMesh::prepare()
     glGenVertexArrays(1, &m_vao_id);
     glBindVertexArray(m_vao_id);
 
-    const std::vector<Mesh::Vertex>& vertices = m_mesh.get_vertices();
-    const std::vector<unsigned int>& triangles = m_mesh.get_triangles();
+    const Mesh::VertexArray& vertices = m_mesh.get_vertices();
+    const Mesh::IndexArray& triangles = m_mesh.get_triangles();
 
     m_vertex_count = vertices.size();
     m_triangle_count = triangles.size();
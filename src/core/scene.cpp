@@ -2,6 +2,7 @@
 
 #include "mesh.h"
 #include "rasterized_mesh.h"
+#include "trace.h"
 
 #include <cstddef>
 
@@ -11,6 +12,8 @@ namespace core
 Scene::Scene(const std::vector<Mesh>& meshes)
   : m_meshes(meshes)
 {
+    CORE_TRACE_SCOPE("Scene GPU upload");
+
     // Prepare to render meshes.
     m_drawing_meshes.reserve(m_meshes.size());
 
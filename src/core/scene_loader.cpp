@@ -1,7 +1,9 @@
 #include "scene_loader.h"
 
 #include "mesh.h"
+#include "mesh_reorder.h"
 #include "scene.h"
+#include "trace.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -20,8 +22,10 @@ namespace core
 
 namespace
 {
-    Mesh process_mesh_node(aiMesh* mesh, const aiScene* scene)
+    Mesh process_mesh_node(aiMesh* mesh, const aiScene* scene, const bool reorder_spatially)
     {
+        CORE_TRACE_SCOPE("process_mesh_node");
+
         std::vector<Mesh::Vertex> vertices;
         std::vector<GLuint> triangles;
 
@@ -58,62 +62,77 @@ namespace
             }
         }
 
+        if (reorder_spatially)
+            reorder_mesh_spatially(vertices, triangles);
+
         return Mesh(vertices, triangles);
     }
+}
 
-    std::vector<Mesh> load_meshes_from_file(const std::string& file_path)
-    {
-        Assimp::Importer importer;
+std::vector<Mesh> load_meshes_from_file(
+    const std::string&  file_path,
+    const bool          reorder_spatially)
+{
+    Assimp::Importer importer;
+
+    // Normalize the scene in [-1, 1]
+    importer.SetPropertyInteger("PP_PTV_NORMALIZE", 1);
 
-        // Normalize the scene in [-1, 1]
-        importer.SetPropertyInteger("PP_PTV_NORMALIZE", 1);
+    const aiScene* scene = nullptr;
 
-        const aiScene* scene = importer.ReadFile(
+    {
+        CORE_TRACE_SCOPE("assimp import");
+
+        scene = importer.ReadFile(
             file_path, 
             aiProcess_Triangulate 
             | aiProcess_FlipUVs
             | aiProcess_GenNormals
             | aiProcess_ForceGenNormals
             | aiProcess_PreTransformVertices);
+    }
 
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-        {
-            std::cerr << "Unable to import file: " << importer.GetErrorString() << "\n";
-            return {};
-        }
-
-        std::list<aiNode*> process_stack;
-        process_stack.push_back(scene->mRootNode);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cerr << "Unable to import file: " << importer.GetErrorString() << "\n";
+        return {};
+    }
 
-        std::vector<Mesh> meshes;
+    std::list<aiNode*> process_stack;
+    process_stack.push_back(scene->mRootNode);
 
-        // Process scene tree.
-        while (process_stack.size())
-        {
-            aiNode* node = process_stack.front();
-            process_stack.pop_front();
+    std::vector<Mesh> meshes;
 
-            // Process current node meshes
-            for (std::size_t i = 0; i < node->mNumMeshes; ++i)
-            {
-                aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-                meshes.push_back(process_mesh_node(mesh, scene));
-            }
+    // Process scene tree.
+    while (process_stack.size())
+    {
+        aiNode* node = process_stack.front();
+        process_stack.pop_front();
 
-            // Find childrens and add them to the stack
-            for (std::size_t i = 0; i < node->mNumChildren; ++i)
-            {
-                process_stack.push_back(node->mChildren[i]);
-            }
+        // Process current node meshes
+        for (std::size_t i = 0; i < node->mNumMeshes; ++i)
+        {
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            meshes.push_back(process_mesh_node(mesh, scene, reorder_spatially));
         }
 
-        return meshes;
+        // Find childrens and add them to the stack
+        for (std::size_t i = 0; i < node->mNumChildren; ++i)
+        {
+            process_stack.push_back(node->mChildren[i]);
+        }
     }
+
+    return meshes;
 }
 
-Scene* load_scene_from_file(const std::string& file_path)
+Scene* load_scene_from_file(
+    const std::string&  file_path,
+    const bool          reorder_spatially)
 {
-    std::vector<Mesh> scene_meshes = load_meshes_from_file(file_path);
+    CORE_TRACE_SCOPE("load_scene_from_file");
+
+    std::vector<Mesh> scene_meshes = load_meshes_from_file(file_path, reorder_spatially);
     return new Scene(scene_meshes);
 }
 
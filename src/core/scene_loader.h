@@ -1,6 +1,9 @@
 #pragma once
 
+#include "mesh.h"
+
 #include <string>
+#include <vector>
 
 // Forward declarations.
 namespace core { class Scene; }
@@ -8,9 +11,22 @@ namespace core { class Scene; }
 namespace core
 {
 
+/**
+ * @brief Load meshes from a file using Assimp.
+ *
+ * Unlike `load_scene_from_file`, this doesn't require an OpenGL context.
+ * When `reorder_spatially` is true, triangles and vertices are sorted along
+ * a Morton curve (see `reorder_mesh_spatially`).
+ */
+std::vector<Mesh> load_meshes_from_file(
+    const std::string&  file_path,
+    const bool          reorder_spatially = false);
+
 /**
  * @brief Load meshes from a file using Assimp and prepare them for render.
  */
-Scene* load_scene_from_file(const std::string& file_path);
+Scene* load_scene_from_file(
+    const std::string&  file_path,
+    const bool          reorder_spatially = false);
 
 } // namespace core
\ No newline at end of file
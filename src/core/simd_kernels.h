@@ -0,0 +1,207 @@
+#pragma once
+
+//
+// Kernels of `SimdKernels`, compiled once per instruction set.
+//
+// Each simd_kernels_<isa>.cpp defines CORE_SIMD_NAMESPACE and includes this
+// file with its own compiler flags, so that the loops below are vectorized
+// for that instruction set. Each copy lives in its own namespace: the
+// linker never mixes code of two instruction sets. For the same reason,
+// these kernels only call the functions defined here, no inline function
+// of another header.
+//
+// The operations and their order are the ones of math.h and morton.h.
+//
+
+#include "cpu_dispatch.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(CORE_SIMD_NAMESPACE)
+#error "Define CORE_SIMD_NAMESPACE before including simd_kernels.h"
+#endif
+
+namespace core
+{
+namespace CORE_SIMD_NAMESPACE
+{
+
+template <std::size_t Width>
+void distance2_to_boxes(
+    const glm::vec3&    point,
+    const float*        bounds,
+    float*              distance2)
+{
+    const float* min_x = bounds;
+    const float* min_y = bounds + Width;
+    const float* min_z = bounds + 2 * Width;
+    const float* max_x = bounds + 3 * Width;
+    const float* max_y = bounds + 4 * Width;
+    const float* max_z = bounds + 5 * Width;
+    const float px = point.x, py = point.y, pz = point.z;
+
+    for (std::size_t i = 0; i < Width; ++i)
+    {
+        const float x = px < min_x[i] ? min_x[i] : px;
+        const float y = py < min_y[i] ? min_y[i] : py;
+        const float z = pz < min_z[i] ? min_z[i] : pz;
+        const float dx = px - (max_x[i] < x ? max_x[i] : x);
+        const float dy = py - (max_y[i] < y ? max_y[i] : y);
+        const float dz = pz - (max_z[i] < z ? max_z[i] : z);
+        distance2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+inline void distance2_to_triangle8(
+    const PointPacket<float, 8>&    packet,
+    const TriangleQueryData&        triangle,
+    float*                          distance2)
+{
+    const std::size_t width = 8;
+    const float ox = triangle.origin.x, oy = triangle.origin.y, oz = triangle.origin.z;
+    const float e0x = triangle.edge0.x, e0y = triangle.edge0.y, e0z = triangle.edge0.z;
+
+    if (triangle.degenerate)
+    {
+        for (std::size_t i = 0; i < width; ++i)
+        {
+            const float vx = packet.x[i] - ox, vy = packet.y[i] - oy, vz = packet.z[i] - oz;
+            const float projection = (vx * e0x + vy * e0y + vz * e0z) * triangle.inv_a00;
+            const float clamped = projection < 0.0f ? 0.0f : projection;
+            const float t = 1.0f < clamped ? 1.0f : clamped;
+
+            const float dx = ox + t * e0x - packet.x[i];
+            const float dy = oy + t * e0y - packet.y[i];
+            const float dz = oz + t * e0z - packet.z[i];
+            distance2[i] = dx * dx + dy * dy + dz * dz;
+        }
+
+        return;
+    }
+
+    const float e1x = triangle.edge1.x, e1y = triangle.edge1.y, e1z = triangle.edge1.z;
+    const float a00 = triangle.a00;
+    const float a01 = triangle.a01;
+    const float a11 = triangle.a11;
+    const float det = a00 * a11 - a01 * a01;
+
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        const float vx = packet.x[i] - ox, vy = packet.y[i] - oy, vz = packet.z[i] - oz;
+        const float b0 = -(vx * e0x + vy * e0y + vz * e0z);
+        const float b1 = -(vx * e1x + vy * e1y + vz * e1z);
+        const float t0 = a01 * b1 - a11 * b0;
+        const float t1 = a01 * b0 - a00 * b1;
+
+        const float e01 = -b0 * triangle.inv_a00;
+        const float e20 = -b1 * triangle.inv_a11;
+        const float e01_or_v1 = -b0 >= a00 ? 1.0f : e01;
+        const float e20_or_v2 = -b1 >= a11 ? 1.0f : e20;
+
+        const float on_e01 = b0 >= 0.0f ? 0.0f : e01_or_v1;
+        const float on_e20 = b1 >= 0.0f ? 0.0f : e20_or_v2;
+
+        const float interior_s0 = t0 * triangle.inv_det;
+        const float interior_s1 = t1 * triangle.inv_det;
+
+        const float r2_tmp0 = a01 + b0;
+        const float r2_tmp1 = a11 + b1;
+        const float r2_numer = (r2_tmp1 - r2_tmp0) * triangle.inv_a_12;
+        const float r2_t0 = 1.0f < r2_numer ? 1.0f : r2_numer;
+        const float r2_1_t0 = 1.0f - r2_t0;
+        const float r2_e20 = r2_tmp1 <= 0.0f ? 1.0f : (b1 >= 0.0f ? 0.0f : e20);
+        const bool r2_on_e12 = r2_tmp1 > r2_tmp0;
+
+        const float r6_tmp0 = a01 + b1;
+        const float r6_tmp1 = a00 + b0;
+        const float r6_numer = (r6_tmp1 - r6_tmp0) * triangle.inv_a_12;
+        const float r6_t1 = 1.0f < r6_numer ? 1.0f : r6_numer;
+        const float r6_1_t1 = 1.0f - r6_t1;
+        const float r6_e01 = r6_tmp1 <= 0.0f ? 1.0f : (b0 >= 0.0f ? 0.0f : e01);
+        const bool r6_on_e12 = r6_tmp1 > r6_tmp0;
+
+        const float r1_numer = a11 + b1 - a01 - b0;
+        const float r1_scaled = r1_numer * triangle.inv_a_12;
+        const float r1_t0 = r1_numer <= 0.0f ? 0.0f : (1.0f < r1_scaled ? 1.0f : r1_scaled);
+        const float r1_1_t0 = 1.0f - r1_t0;
+        const float r1_t1 = r1_numer <= 0.0f ? 1.0f : r1_1_t0;
+
+        const bool region_e20 = (t0 < 0.0f) & !((t1 < 0.0f) & (b0 < 0.0f));
+        const bool region_e01 = !region_e20 & (t1 < 0.0f);
+        const float inside_s0 = region_e20 ? 0.0f : (region_e01 ? on_e01 : interior_s0);
+        const float inside_s1 = region_e20 ? on_e20 : (region_e01 ? 0.0f : interior_s1);
+
+        const float r2_s0 = r2_on_e12 ? r2_t0 : 0.0f;
+        const float r2_s1 = r2_on_e12 ? r2_1_t0 : r2_e20;
+        const float r6_s0 = r6_on_e12 ? r6_1_t1 : r6_e01;
+        const float r6_s1 = r6_on_e12 ? r6_t1 : 0.0f;
+        const float outside_s0 = t0 < 0.0f ? r2_s0 : (t1 < 0.0f ? r6_s0 : r1_t0);
+        const float outside_s1 = t0 < 0.0f ? r2_s1 : (t1 < 0.0f ? r6_s1 : r1_t1);
+
+        const bool inside = t0 + t1 <= det;
+        const float s0 = inside ? inside_s0 : outside_s0;
+        const float s1 = inside ? inside_s1 : outside_s1;
+
+        const float dx = ox + s0 * e0x + s1 * e1x - packet.x[i];
+        const float dy = oy + s0 * e0y + s1 * e1y - packet.y[i];
+        const float dz = oz + s0 * e0z + s1 * e1z - packet.z[i];
+        distance2[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+inline std::uint64_t expand_bits_21(const std::uint32_t value)
+{
+    std::uint64_t x = value & 0x1FFFFF;
+    x = (x | x << 32) & 0x001F00000000FFFFull;
+    x = (x | x << 16) & 0x001F0000FF0000FFull;
+    x = (x | x << 8)  & 0x100F00F00F00F00Full;
+    x = (x | x << 4)  & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+inline void morton_codes(
+    const glm::vec3*    points,
+    const std::size_t   count,
+    const glm::vec3&    box_min,
+    const glm::vec3&    inv_extent,
+    std::uint64_t*      codes)
+{
+    const float max_value = static_cast<float>((1 << 21) - 1);
+    const float min_x = box_min.x, min_y = box_min.y, min_z = box_min.z;
+    const float inv_x = inv_extent.x, inv_y = inv_extent.y, inv_z = inv_extent.z;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        // `glm::clamp` to [0, 1], with the same compares.
+        float x = (points[i].x - min_x) * inv_x;
+        float y = (points[i].y - min_y) * inv_y;
+        float z = (points[i].z - min_z) * inv_z;
+        x = x < 0.0f ? 0.0f : x;
+        y = y < 0.0f ? 0.0f : y;
+        z = z < 0.0f ? 0.0f : z;
+        x = 1.0f < x ? 1.0f : x;
+        y = 1.0f < y ? 1.0f : y;
+        z = 1.0f < z ? 1.0f : z;
+
+        // Signed conversions vectorize without AVX-512, and the values fit.
+        codes[i] = expand_bits_21(static_cast<std::uint32_t>(static_cast<std::int32_t>(x * max_value))) << 2
+            | expand_bits_21(static_cast<std::uint32_t>(static_cast<std::int32_t>(y * max_value))) << 1
+            | expand_bits_21(static_cast<std::uint32_t>(static_cast<std::int32_t>(z * max_value)));
+    }
+}
+
+inline SimdKernels make_simd_kernels(const CpuIsa isa)
+{
+    SimdKernels kernels;
+    kernels.isa = isa;
+    kernels.distance2_to_boxes4 = &distance2_to_boxes<4>;
+    kernels.distance2_to_boxes8 = &distance2_to_boxes<8>;
+    kernels.distance2_to_triangle8 = &distance2_to_triangle8;
+    kernels.morton_codes = &morton_codes;
+    return kernels;
+}
+
+} // namespace CORE_SIMD_NAMESPACE
+} // namespace core
@@ -0,0 +1,14 @@
+// Compiled for AVX2, see CMakeLists.txt.
+#define CORE_SIMD_NAMESPACE avx2
+#include "simd_kernels.h"
+
+namespace core
+{
+
+const SimdKernels& get_avx2_simd_kernels()
+{
+    static const SimdKernels kernels = avx2::make_simd_kernels(CpuIsa::Avx2);
+    return kernels;
+}
+
+} // namespace core
@@ -0,0 +1,14 @@
+// Compiled for AVX-512 F, DQ, BW and VL, see CMakeLists.txt.
+#define CORE_SIMD_NAMESPACE avx512
+#include "simd_kernels.h"
+
+namespace core
+{
+
+const SimdKernels& get_avx512_simd_kernels()
+{
+    static const SimdKernels kernels = avx512::make_simd_kernels(CpuIsa::Avx512);
+    return kernels;
+}
+
+} // namespace core
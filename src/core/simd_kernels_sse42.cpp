@@ -0,0 +1,14 @@
+// Compiled for SSE4.2, see CMakeLists.txt.
+#define CORE_SIMD_NAMESPACE sse42
+#include "simd_kernels.h"
+
+namespace core
+{
+
+const SimdKernels& get_sse42_simd_kernels()
+{
+    static const SimdKernels kernels = sse42::make_simd_kernels(CpuIsa::Sse42);
+    return kernels;
+}
+
+} // namespace core
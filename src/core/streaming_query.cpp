@@ -0,0 +1,932 @@
+#include "streaming_query.h"
+
+#include "bvh_builder.h"
+#include "math.h"
+#include "morton.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace core
+{
+
+namespace
+{
+    // File layout: the header, the cluster table, then the clusters. Each
+    // cluster holds its nodes, vertices, triangles and mesh triangles.
+    // Values are in the byte order of the machine that wrote the file.
+    const char cluster_file_magic[4] = { 'C', 'L', 'S', '1' };
+
+    struct ClusterFileHeader
+    {
+        char            magic[4];
+        std::uint32_t   cluster_count;
+        std::uint64_t   triangle_count;
+    };
+
+    static_assert(sizeof(ClusterFileHeader) == 16, "Cluster file header layout");
+    static_assert(sizeof(ClusterNode) == 32, "Cluster node layout");
+    static_assert(sizeof(ClusterRecord) == 48, "Cluster record layout");
+    static_assert(sizeof(Mesh::Vertex) == 6 * sizeof(float), "Cluster vertex layout");
+
+    // Maximum number of triangles per leaf of the cluster BVHs.
+    const std::size_t cluster_leaf_size = 8;
+
+    // Clusters built in parallel per thread before they are written.
+    const std::size_t clusters_per_thread = 4;
+
+    // Consecutive queries of a batch run by the same thread.
+    const std::size_t batch_chunk_size = 256;
+
+    // In 64 bits: the counts of a corrupt record must not wrap.
+    std::uint64_t get_cluster_bytes(const ClusterRecord& record)
+    {
+        return std::uint64_t(record.node_count) * sizeof(ClusterNode)
+            + std::uint64_t(record.vertex_count) * sizeof(Mesh::Vertex)
+            + std::uint64_t(record.triangle_count) * 4 * sizeof(std::uint32_t);
+    }
+
+    std::size_t get_cluster_heap_bytes(const MeshCluster& cluster)
+    {
+        return get_heap_bytes(cluster.nodes)
+            + get_heap_bytes(cluster.vertices)
+            + get_heap_bytes(cluster.triangles)
+            + get_heap_bytes(cluster.mesh_triangles);
+    }
+
+    /**
+     * @brief Whether the data of a cluster read from a file can be traversed without reading out of bounds.
+     *
+     * Nodes must have their children after them, in a tree no deeper than
+     * the traversal stack allows, and leaves and triangles must index
+     * existing triangles and vertices.
+     */
+    bool is_valid_cluster(const MeshCluster& cluster)
+    {
+        const std::size_t node_count = cluster.nodes.size();
+        const std::size_t triangle_count = cluster.mesh_triangles.size();
+        std::vector<std::uint8_t> depths(node_count, 0);
+
+        for (std::size_t i = 0; i < node_count; ++i)
+        {
+            const ClusterNode& node = cluster.nodes[i];
+
+            if (node.count > 0)
+            {
+                if (std::size_t(node.first) + node.count > triangle_count)
+                    return false;
+                continue;
+            }
+
+            if (node.first <= i || std::size_t(node.first) + 1 >= node_count || depths[i] >= bvh_max_build_depth)
+                return false;
+
+            depths[node.first] = std::max<std::uint8_t>(depths[node.first], depths[i] + 1);
+            depths[node.first + 1] = std::max<std::uint8_t>(depths[node.first + 1], depths[i] + 1);
+        }
+
+        for (const std::uint32_t vertex : cluster.triangles)
+        {
+            if (vertex >= cluster.vertices.size())
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Nodes of a `BvhBuilder` hierarchy, the root first and the children of each inner node next to each other.
+     */
+    template <typename NodeArray>
+    void flatten_nodes(const BvhBuilder& builder, NodeArray& nodes)
+    {
+        const std::vector<BuildNode>& build_nodes = builder.get_nodes();
+
+        nodes.clear();
+
+        if (build_nodes.empty())
+            return;
+
+        nodes.reserve(build_nodes.size());
+        nodes.resize(1);
+
+        // Build node and node of each node to fill, in breadth-first order.
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending(1, std::make_pair(0u, 0u));
+
+        for (std::size_t i = 0; i < pending.size(); ++i)
+        {
+            const BuildNode& build_node = build_nodes[pending[i].first];
+
+            ClusterNode node;
+            node.min = build_node.bounds.min;
+            node.max = build_node.bounds.max;
+
+            if (build_node.is_leaf)
+            {
+                assert(build_node.primitive_count > 0);
+                node.first = build_node.first_primitive;
+                node.count = build_node.primitive_count;
+            }
+            else
+            {
+                node.first = static_cast<std::uint32_t>(nodes.size());
+                node.count = 0;
+                nodes.resize(nodes.size() + 2);
+                pending.push_back(std::make_pair(build_node.children[0], node.first));
+                pending.push_back(std::make_pair(build_node.children[1], node.first + 1));
+            }
+
+            nodes[pending[i].second] = node;
+        }
+    }
+
+    /**
+     * @brief Call `visit_leaf(first, count)` on the leaves nearer than `closest_distance2`, nearest first.
+     *
+     * `visit_leaf` may lower `closest_distance2`, which prunes the rest.
+     */
+    template <typename VisitLeaf>
+    void traverse_nearest(
+        const ClusterNode*  nodes,
+        const glm::vec3&    point,
+        const float&        closest_distance2,
+        const VisitLeaf&    visit_leaf)
+    {
+        struct StackEntry
+        {
+            std::uint32_t   node;
+            float           distance2;
+        };
+
+        // Each inner node replaces itself with its two children.
+        StackEntry stack[bvh_max_build_depth + 2];
+        std::size_t stack_size = 0;
+
+        stack[stack_size++] = { 0, distance2_to_box(point, nodes[0].min, nodes[0].max) };
+
+        while (stack_size > 0)
+        {
+            const StackEntry entry = stack[--stack_size];
+
+            if (entry.distance2 >= closest_distance2)
+                continue;
+
+            const ClusterNode& node = nodes[entry.node];
+
+            if (node.count > 0)
+            {
+                visit_leaf(node.first, node.count);
+                continue;
+            }
+
+            const ClusterNode& left = nodes[node.first];
+            const ClusterNode& right = nodes[node.first + 1];
+            const float left_distance2 = distance2_to_box(point, left.min, left.max);
+            const float right_distance2 = distance2_to_box(point, right.min, right.max);
+
+            // The nearest child is pushed last, to be visited first.
+            if (left_distance2 < right_distance2)
+            {
+                stack[stack_size++] = { node.first + 1, right_distance2 };
+                stack[stack_size++] = { node.first, left_distance2 };
+            }
+            else
+            {
+                stack[stack_size++] = { node.first, left_distance2 };
+                stack[stack_size++] = { node.first + 1, right_distance2 };
+            }
+        }
+    }
+
+    /**
+     * @brief Build the cluster of the sorted triangles [first, last) and its file data.
+     */
+    void build_cluster(
+        const Mesh&                         mesh,
+        const std::vector<std::uint32_t>&   order,
+        const std::size_t                   first,
+        const std::size_t                   last,
+        ClusterRecord&                      record,
+        std::vector<char>&                  data)
+    {
+        const Mesh::VertexArray& mesh_vertices = mesh.get_vertices();
+        const Mesh::IndexArray& mesh_triangles = mesh.get_triangles();
+        const std::size_t triangle_count = last - first;
+
+        // Mesh vertices of the cluster, sorted, so that a binary search gives their cluster index.
+        std::vector<std::uint32_t> vertices;
+        vertices.reserve(triangle_count * 3);
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            for (std::size_t corner = 0; corner < 3; ++corner)
+                vertices.push_back(mesh_triangles[std::size_t(order[i]) * 3 + corner]);
+        }
+
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        std::vector<std::uint32_t> triangles(triangle_count * 3);
+        std::vector<BuildBounds> triangle_bounds(triangle_count);
+
+        for (std::size_t i = 0; i < triangle_count; ++i)
+        {
+            for (std::size_t corner = 0; corner < 3; ++corner)
+            {
+                const std::uint32_t vertex = mesh_triangles[std::size_t(order[first + i]) * 3 + corner];
+
+                triangles[i * 3 + corner] = static_cast<std::uint32_t>(
+                    std::lower_bound(vertices.begin(), vertices.end(), vertex) - vertices.begin());
+                triangle_bounds[i].extend(mesh_vertices[vertex].pos);
+            }
+        }
+
+        const BvhBuilder builder(triangle_bounds, cluster_leaf_size);
+        const std::vector<std::uint32_t>& primitives = builder.get_primitives();
+
+        std::vector<ClusterNode> nodes;
+        flatten_nodes(builder, nodes);
+
+        record.min = nodes[0].min;
+        record.max = nodes[0].max;
+        record.triangle_count = static_cast<std::uint32_t>(triangle_count);
+        record.vertex_count = static_cast<std::uint32_t>(vertices.size());
+        record.node_count = static_cast<std::uint32_t>(nodes.size());
+        record.padding = 0;
+
+        data.resize(get_cluster_bytes(record));
+        char* out = data.data();
+
+        std::memcpy(out, nodes.data(), nodes.size() * sizeof(ClusterNode));
+        out += nodes.size() * sizeof(ClusterNode);
+
+        for (const std::uint32_t vertex : vertices)
+        {
+            std::memcpy(out, &mesh_vertices[vertex], sizeof(Mesh::Vertex));
+            out += sizeof(Mesh::Vertex);
+        }
+
+        // Triangles in the leaf order, then their mesh triangle.
+        for (const std::uint32_t primitive : primitives)
+        {
+            std::memcpy(out, &triangles[std::size_t(primitive) * 3], 3 * sizeof(std::uint32_t));
+            out += 3 * sizeof(std::uint32_t);
+        }
+
+        for (const std::uint32_t primitive : primitives)
+        {
+            std::memcpy(out, &order[first + primitive], sizeof(std::uint32_t));
+            out += sizeof(std::uint32_t);
+        }
+
+        assert(out == data.data() + data.size());
+    }
+}
+
+bool write_cluster_file(
+    const Mesh&         mesh,
+    const std::string&  file_path,
+    const std::size_t   cluster_size)
+{
+    CORE_TRACE_SCOPE("cluster file write");
+
+    assert(cluster_size > 0);
+
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    const Mesh::VertexArray& vertices = mesh.get_vertices();
+    const Mesh::IndexArray& triangles = mesh.get_triangles();
+    const std::size_t triangle_count = triangles.size() / 3;
+    const std::size_t cluster_count = (triangle_count + cluster_size - 1) / cluster_size;
+
+    assert(cluster_count <= std::numeric_limits<std::uint32_t>::max());
+
+    std::ofstream out(file_path, std::ios::binary);
+
+    if (!out)
+    {
+        std::cerr << "Unable to write cluster file " << file_path << "\n";
+        return false;
+    }
+
+    const std::vector<std::uint32_t> order = get_morton_order(
+        triangle_count,
+        [&](const std::size_t i)
+        {
+            return (vertices[triangles[i * 3]].pos + vertices[triangles[i * 3 + 1]].pos + vertices[triangles[i * 3 + 2]].pos) / 3.0f;
+        });
+
+    ClusterFileHeader header;
+    std::memcpy(header.magic, cluster_file_magic, sizeof(header.magic));
+    header.cluster_count = static_cast<std::uint32_t>(cluster_count);
+    header.triangle_count = triangle_count;
+
+    // The table is written last, once the cluster offsets are known.
+    std::vector<ClusterRecord> records(cluster_count);
+    const std::vector<char> empty_table(cluster_count * sizeof(ClusterRecord), 0);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(empty_table.data(), empty_table.size());
+
+    const std::size_t group_size = get_thread_count() * clusters_per_thread;
+    std::vector<std::vector<char>> group_data(group_size);
+
+    for (std::size_t group_first = 0; group_first < cluster_count && out; group_first += group_size)
+    {
+        const std::size_t group_count = std::min(group_size, cluster_count - group_first);
+
+        parallel_for(group_count, [&](const std::size_t i)
+        {
+            const std::size_t cluster = group_first + i;
+            const std::size_t first = cluster * cluster_size;
+
+            build_cluster(mesh, order, first, std::min(first + cluster_size, triangle_count), records[cluster], group_data[i]);
+        });
+
+        for (std::size_t i = 0; i < group_count; ++i)
+        {
+            records[group_first + i].offset = static_cast<std::uint64_t>(out.tellp());
+            out.write(group_data[i].data(), group_data[i].size());
+        }
+    }
+
+    out.seekp(sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ClusterRecord));
+
+    if (!out)
+    {
+        std::cerr << "Unable to write cluster file " << file_path << "\n";
+        return false;
+    }
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Wrote " << cluster_count << " clusters (" << triangle_count << " triangles) in "
+        << process_time << "ms.\n";
+    std::cout << "\tFile size: " << format_memory_size(static_cast<std::size_t>(out.tellp())) << "\n";
+
+    return true;
+}
+
+ClusterCache::ClusterCache(
+    const std::string&              file_path,
+    const ClusterTable&             records,
+    const StreamingQuerySettings&   settings)
+  : m_records(records)
+  , m_capacity(settings.cache_size)
+  , m_prefetch_queue_size(settings.prefetch_queue_size)
+  , m_file(file_path, std::ios::binary)
+  , m_entries(records.size())
+  , m_size(0)
+  , m_heap_size(0)
+  , m_prefetch_size(0)
+  , m_stopping(false)
+{
+    m_prefetch_thread = std::thread(&ClusterCache::run_prefetcher, this);
+}
+
+ClusterCache::~ClusterCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_prefetch_available.notify_all();
+    m_prefetch_thread.join();
+}
+
+std::shared_ptr<const MeshCluster> ClusterCache::get_cluster(const std::uint32_t cluster)
+{
+    assert(cluster < m_entries.size());
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[cluster];
+
+    while (entry.state == EntryState::Loading)
+        m_cluster_loaded.wait(lock);
+
+    if (entry.state == EntryState::Loaded)
+    {
+        ++m_statistics.hits;
+
+        if (entry.prefetched)
+        {
+            ++m_statistics.prefetch_hits;
+            entry.prefetched = false;
+            m_prefetch_size -= get_cluster_bytes(m_records[cluster]);
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, entry.lru_position);
+        return entry.cluster;
+    }
+
+    // Absent, or queued: the prefetcher skips clusters that are not queued anymore.
+    ++m_statistics.misses;
+    entry.state = EntryState::Loading;
+    lock.unlock();
+
+    const std::shared_ptr<const MeshCluster> data = read_cluster(cluster);
+
+    lock.lock();
+    insert_cluster(cluster, data, false);
+
+    return data;
+}
+
+void ClusterCache::prefetch_clusters(const std::uint32_t* clusters, const std::size_t count)
+{
+    std::size_t queued_count = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            assert(clusters[i] < m_entries.size());
+
+            Entry& entry = m_entries[clusters[i]];
+            const std::size_t bytes = get_cluster_bytes(m_records[clusters[i]]);
+
+            if (entry.state != EntryState::Absent)
+                continue;
+
+            if (m_prefetch_queue.size() >= m_prefetch_queue_size || m_prefetch_size + bytes > m_capacity / 4)
+                break;
+
+            entry.state = EntryState::Queued;
+            m_prefetch_queue.push_back(clusters[i]);
+            m_prefetch_size += bytes;
+            ++queued_count;
+        }
+    }
+
+    // Most batches queue nothing: don't wake the prefetcher for nothing.
+    if (queued_count > 0)
+        m_prefetch_available.notify_one();
+}
+
+ClusterCacheStatistics ClusterCache::get_statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+MemoryUsage ClusterCache::get_memory_usage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MemoryUsage usage;
+    usage.add("cache entries", get_heap_bytes(m_entries));
+    usage.add("cached clusters", m_heap_size);
+    return usage;
+}
+
+std::shared_ptr<const MeshCluster> ClusterCache::read_cluster(const std::uint32_t cluster)
+{
+    CORE_TRACE_SCOPE("cluster read");
+
+    const ClusterRecord& record = m_records[cluster];
+    std::shared_ptr<MeshCluster> data = std::make_shared<MeshCluster>();
+
+    data->nodes.resize(record.node_count);
+    data->vertices.resize(record.vertex_count);
+    data->triangles.resize(std::size_t(record.triangle_count) * 3);
+    data->mesh_triangles.resize(record.triangle_count);
+
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(record.offset));
+    m_file.read(reinterpret_cast<char*>(data->nodes.data()), data->nodes.size() * sizeof(ClusterNode));
+    m_file.read(reinterpret_cast<char*>(data->vertices.data()), data->vertices.size() * sizeof(Mesh::Vertex));
+    m_file.read(reinterpret_cast<char*>(data->triangles.data()), data->triangles.size() * sizeof(std::uint32_t));
+    m_file.read(reinterpret_cast<char*>(data->mesh_triangles.data()), data->mesh_triangles.size() * sizeof(std::uint32_t));
+
+    if (!m_file)
+    {
+        std::cerr << "Unable to read cluster " << cluster << " of the cluster file.\n";
+        return nullptr;
+    }
+
+    if (!is_valid_cluster(*data))
+    {
+        std::cerr << "Invalid cluster " << cluster << " in the cluster file.\n";
+        return nullptr;
+    }
+
+    return data;
+}
+
+void ClusterCache::insert_cluster(
+    const std::uint32_t                         cluster,
+    const std::shared_ptr<const MeshCluster>&   data,
+    const bool                                  prefetched)
+{
+    Entry& entry = m_entries[cluster];
+    const std::size_t bytes = get_cluster_bytes(m_records[cluster]);
+
+    // Waiting threads read it again themselves.
+    if (!data)
+    {
+        if (prefetched)
+            m_prefetch_size -= bytes;
+
+        entry.state = EntryState::Absent;
+        ++m_statistics.read_failures;
+        m_cluster_loaded.notify_all();
+        return;
+    }
+
+    m_statistics.loaded_bytes += bytes;
+
+    // The cache filled up during the read: drop the prefetch rather than evict a cluster in use.
+    if (prefetched && m_size + bytes > m_capacity)
+    {
+        m_prefetch_size -= bytes;
+        entry.state = EntryState::Absent;
+        m_cluster_loaded.notify_all();
+        return;
+    }
+
+    entry.cluster = data;
+    entry.state = EntryState::Loaded;
+    entry.prefetched = prefetched;
+    m_lru.push_front(cluster);
+    entry.lru_position = m_lru.begin();
+
+    m_size += bytes;
+    m_heap_size += get_cluster_heap_bytes(*data);
+
+    while (m_size > m_capacity && m_lru.size() > 1)
+    {
+        const std::uint32_t evicted = m_lru.back();
+        Entry& evicted_entry = m_entries[evicted];
+
+        const std::size_t evicted_bytes = get_cluster_bytes(m_records[evicted]);
+
+        if (evicted_entry.prefetched)
+            m_prefetch_size -= evicted_bytes;
+
+        m_lru.pop_back();
+        m_heap_size -= get_cluster_heap_bytes(*evicted_entry.cluster);
+        evicted_entry.cluster.reset();
+        evicted_entry.state = EntryState::Absent;
+        evicted_entry.prefetched = false;
+        m_size -= evicted_bytes;
+        ++m_statistics.evictions;
+    }
+
+    m_cluster_loaded.notify_all();
+}
+
+void ClusterCache::run_prefetcher()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_prefetch_available.wait(lock, [this]() { return m_stopping || !m_prefetch_queue.empty(); });
+
+        if (m_stopping)
+            return;
+
+        const std::uint32_t cluster = m_prefetch_queue.front();
+        m_prefetch_queue.pop_front();
+
+        // Requested in the meantime, or no room left: prefetches never evict.
+        if (m_entries[cluster].state != EntryState::Queued
+            || m_size + get_cluster_bytes(m_records[cluster]) > m_capacity)
+        {
+            if (m_entries[cluster].state == EntryState::Queued)
+                m_entries[cluster].state = EntryState::Absent;
+
+            m_prefetch_size -= get_cluster_bytes(m_records[cluster]);
+            continue;
+        }
+
+        m_entries[cluster].state = EntryState::Loading;
+        lock.unlock();
+
+        const std::shared_ptr<const MeshCluster> data = read_cluster(cluster);
+
+        lock.lock();
+        insert_cluster(cluster, data, true);
+
+        if (m_entries[cluster].state == EntryState::Loaded)
+            ++m_statistics.prefetches;
+    }
+}
+
+StreamingClosestPointQuery::StreamingClosestPointQuery(
+    const std::string&              file_path,
+    const StreamingQuerySettings&   settings)
+  : m_settings(settings)
+  , m_triangle_count(0)
+{
+    CORE_TRACE_SCOPE("cluster file open");
+
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    const std::uint64_t file_size = file ? static_cast<std::uint64_t>(file.tellg()) : 0;
+    ClusterFileHeader header;
+
+    if (!file.seekg(0)
+        || !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, cluster_file_magic, sizeof(header.magic)) != 0)
+    {
+        std::cerr << "Not a cluster file: " << file_path << "\n";
+        return;
+    }
+
+    // Every size and offset is checked against the file size, so that a
+    // truncated or corrupt file is rejected here instead of read out of bounds.
+    const std::uint64_t table_end = sizeof(header) + std::uint64_t(header.cluster_count) * sizeof(ClusterRecord);
+
+    if (table_end > file_size)
+    {
+        std::cerr << "Truncated cluster table in " << file_path << "\n";
+        return;
+    }
+
+    m_records.resize(header.cluster_count);
+
+    if (!file.read(reinterpret_cast<char*>(m_records.data()), m_records.size() * sizeof(ClusterRecord)))
+    {
+        std::cerr << "Unable to read the cluster table of " << file_path << "\n";
+        m_records.clear();
+        return;
+    }
+
+    // The counts of each cluster must fit in its byte range, before its arrays are allocated.
+    for (std::size_t i = 0; i < m_records.size(); ++i)
+    {
+        const ClusterRecord& record = m_records[i];
+
+        if (record.node_count == 0
+            || record.triangle_count == 0
+            || record.offset < table_end
+            || record.offset > file_size
+            || get_cluster_bytes(record) > file_size - record.offset)
+        {
+            std::cerr << "Invalid cluster " << i << " in the cluster table of " << file_path << "\n";
+            m_records.clear();
+            return;
+        }
+    }
+
+    m_triangle_count = header.triangle_count;
+
+    std::vector<BuildBounds> cluster_bounds(m_records.size());
+
+    for (std::size_t i = 0; i < m_records.size(); ++i)
+    {
+        cluster_bounds[i].min = m_records[i].min;
+        cluster_bounds[i].max = m_records[i].max;
+    }
+
+    const BvhBuilder builder(cluster_bounds, 1);
+    flatten_nodes(builder, m_nodes);
+    m_cluster_order.assign(builder.get_primitives().begin(), builder.get_primitives().end());
+
+    m_cache.reset(new ClusterCache(file_path, m_records, settings));
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Opened " << m_records.size() << " clusters (" << m_triangle_count << " triangles) in "
+        << process_time << "ms.\n";
+}
+
+bool StreamingClosestPointQuery::get_closest_point(
+    const glm::vec3&    query_point,
+    const float         max_distance,
+    ClosestPointResult& result) const
+{
+    assert(max_distance > 0.0f);
+
+    if (empty() || m_nodes.empty())
+        return false;
+
+    float closest_distance2 = max_distance * max_distance;
+    std::shared_ptr<const MeshCluster> closest_cluster;
+    std::uint32_t closest_triangle = 0;
+    glm::vec3 closest_point;
+    glm::vec3 closest_barycentric;
+    bool read_failed = false;
+
+    traverse_nearest(m_nodes.data(), query_point, closest_distance2, [&](const std::uint32_t first, const std::uint32_t count)
+    {
+        for (std::uint32_t i = first; i < first + count; ++i)
+        {
+            const std::uint32_t cluster_index = m_cluster_order[i];
+            const ClusterRecord& record = m_records[cluster_index];
+
+            if (distance2_to_box(query_point, record.min, record.max) >= closest_distance2)
+                continue;
+
+            const std::shared_ptr<const MeshCluster> cluster = m_cache->get_cluster(cluster_index);
+
+            // The closest point may be in the missing cluster: fail the query, pruning the rest.
+            if (!cluster)
+            {
+                read_failed = true;
+                closest_distance2 = 0.0f;
+                return;
+            }
+
+            const MeshCluster& data = *cluster;
+
+            traverse_nearest(data.nodes.data(), query_point, closest_distance2, [&](const std::uint32_t first_triangle, const std::uint32_t triangle_count)
+            {
+                for (std::uint32_t triangle = first_triangle; triangle < first_triangle + triangle_count; ++triangle)
+                {
+                    const std::size_t first_index = std::size_t(triangle) * 3;
+
+                    glm::vec3 barycentric;
+                    const glm::vec3 p = closest_point_in_triangle(
+                        query_point,
+                        data.vertices[data.triangles[first_index]].pos,
+                        data.vertices[data.triangles[first_index + 1]].pos,
+                        data.vertices[data.triangles[first_index + 2]].pos,
+                        barycentric);
+                    const float distance2_to_triangle = distance2(p, query_point);
+
+                    if (distance2_to_triangle < closest_distance2)
+                    {
+                        if (closest_cluster != cluster)
+                            closest_cluster = cluster;
+
+                        closest_distance2 = distance2_to_triangle;
+                        closest_triangle = triangle;
+                        closest_point = p;
+                        closest_barycentric = barycentric;
+                    }
+                }
+            });
+        }
+    });
+
+    if (read_failed || !closest_cluster)
+        return false;
+
+    const MeshCluster& data = *closest_cluster;
+    const std::size_t first_index = std::size_t(closest_triangle) * 3;
+    const glm::vec3 normal =
+        closest_barycentric.x * data.vertices[data.triangles[first_index]].normal
+        + closest_barycentric.y * data.vertices[data.triangles[first_index + 1]].normal
+        + closest_barycentric.z * data.vertices[data.triangles[first_index + 2]].normal;
+    const float length2 = glm::dot(normal, normal);
+
+    result.point = closest_point;
+    result.distance2 = closest_distance2;
+    result.triangle = data.mesh_triangles[closest_triangle];
+    result.barycentric = closest_barycentric;
+    result.feature = get_surface_feature(closest_barycentric);
+    result.normal = length2 > 0.0f ? normal / std::sqrt(length2) : normal;
+
+    return true;
+}
+
+std::size_t StreamingClosestPointQuery::get_closest_points(
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance,
+    ClosestPointResult* results,
+    bool*               found) const
+{
+    CORE_TRACE_SCOPE("streaming batch");
+
+    const std::vector<std::uint32_t> order = get_morton_order(
+        count,
+        [query_points](const std::size_t i) { return query_points[i]; });
+
+    const std::size_t chunk_count = (count + batch_chunk_size - 1) / batch_chunk_size;
+    const std::size_t prefetch_distance = m_nodes.empty() ? 0 : m_settings.prefetch_distance;
+    std::unique_ptr<bool[]> found_flags;
+
+    // Whether the previous query found a point, for the prefetches.
+    if (!found && prefetch_distance > 0)
+    {
+        found_flags.reset(new bool[count]);
+        found = found_flags.get();
+    }
+
+    std::atomic<std::size_t> found_count(0);
+
+    parallel_for_stealing(chunk_count, [&](const std::size_t chunk)
+    {
+        const std::size_t first = chunk * batch_chunk_size;
+        const std::size_t last = std::min(first + batch_chunk_size, count);
+        std::size_t chunk_found_count = 0;
+        std::vector<std::uint32_t> clusters;
+        std::vector<std::uint32_t> prefetched_clusters;    // sorted
+
+        for (std::size_t i = first; i < last; ++i)
+        {
+            // The distance to the mesh is 1-Lipschitz: the query ahead is at most
+            // as far as the previous one, plus the distance between them. Only
+            // the queries of this chunk are looked ahead, other threads run the others.
+            if (prefetch_distance > 0 && i > first && i + prefetch_distance < last && found[order[i - 1]])
+            {
+                const glm::vec3& previous_point = query_points[order[i - 1]];
+                const glm::vec3& next_point = query_points[order[i + prefetch_distance]];
+                const float bound = std::sqrt(results[order[i - 1]].distance2) + glm::length(next_point - previous_point);
+
+                if (bound < max_distance)
+                    prefetch_clusters(next_point, bound, prefetched_clusters, clusters);
+            }
+
+            const std::size_t index = order[i];
+            const bool query_found = get_closest_point(query_points[index], max_distance, results[index]);
+
+            if (found)
+                found[index] = query_found;
+
+            chunk_found_count += query_found ? 1 : 0;
+        }
+
+        found_count += chunk_found_count;
+    });
+
+    return found_count;
+}
+
+std::size_t StreamingClosestPointQuery::get_cluster_count() const
+{
+    return m_records.size();
+}
+
+std::uint64_t StreamingClosestPointQuery::get_triangle_count() const
+{
+    return m_triangle_count;
+}
+
+ClusterCacheStatistics StreamingClosestPointQuery::get_cache_statistics() const
+{
+    return m_cache ? m_cache->get_statistics() : ClusterCacheStatistics();
+}
+
+MemoryUsage StreamingClosestPointQuery::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("cluster table", get_heap_bytes(m_records));
+    usage.add("cluster bvh", get_heap_bytes(m_nodes) + get_heap_bytes(m_cluster_order));
+
+    if (m_cache)
+    {
+        const MemoryUsage cache_usage = m_cache->get_memory_usage();
+
+        for (const MemoryUsage::Component& component : cache_usage.get_components())
+            usage.add(component.name, component.bytes);
+    }
+
+    return usage;
+}
+
+void StreamingClosestPointQuery::prefetch_clusters(
+    const glm::vec3&            point,
+    const float                 max_distance,
+    std::vector<std::uint32_t>& prefetched_clusters,
+    std::vector<std::uint32_t>& clusters) const
+{
+    const float max_distance2 = max_distance * max_distance;
+
+    clusters.clear();
+
+    traverse_nearest(m_nodes.data(), point, max_distance2, [&](const std::uint32_t first, const std::uint32_t count)
+    {
+        for (std::uint32_t i = first; i < first + count; ++i)
+        {
+            const std::uint32_t cluster = m_cluster_order[i];
+            const ClusterRecord& record = m_records[cluster];
+
+            if (distance2_to_box(point, record.min, record.max) >= max_distance2)
+                continue;
+
+            // Neighbouring queries mostly need the same clusters: each is only prefetched once.
+            const auto position = std::lower_bound(prefetched_clusters.begin(), prefetched_clusters.end(), cluster);
+
+            if (position != prefetched_clusters.end() && *position == cluster)
+                continue;
+
+            prefetched_clusters.insert(position, cluster);
+            clusters.push_back(cluster);
+        }
+    });
+
+    if (!clusters.empty())
+        m_cache->prefetch_clusters(clusters.data(), clusters.size());
+}
+
+} // namespace core
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "memory.h"
+#include "mesh.h"
+#include "query_engine.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+
+//
+// Out-of-core closest point queries.
+//
+// Meshes larger than the memory are split once into a cluster file: the
+// triangles are sorted along a Morton curve of their centroids and cut
+// into clusters of nearby triangles, each with its own vertices, triangles
+// and binary BVH. Queries only keep the cluster table and a hierarchy of
+// the cluster bounds in memory, and page the clusters in through a cache
+// bounded in bytes.
+//
+
+// Default number of triangles per cluster.
+const std::size_t default_cluster_size = 4096;
+
+/**
+ * @brief Split a mesh into a cluster file, see `StreamingClosestPointQuery`. Return false on failure.
+ *
+ * The mesh must fit in memory, but the queries on the file don't need it.
+ * Clusters are built in parallel, a group at a time, and written in the
+ * Morton order of their triangles.
+ */
+bool write_cluster_file(
+    const Mesh&         mesh,
+    const std::string&  file_path,
+    const std::size_t   cluster_size = default_cluster_size);
+
+/**
+ * @brief Node of the binary BVH of a cluster, or of the cluster hierarchy. Same layout in the file.
+ *
+ * Inner nodes have no primitive and their two children at `first` and
+ * `first + 1`. Leaves hold primitives [first, first + count).
+ */
+struct ClusterNode
+{
+    glm::vec3       min;
+    std::uint32_t   first;
+    glm::vec3       max;
+    std::uint32_t   count;
+};
+
+/**
+ * @brief Entry of the cluster table: bounds and location of a cluster. Same layout in the file.
+ */
+struct ClusterRecord
+{
+    glm::vec3       min;
+    std::uint32_t   triangle_count;
+    glm::vec3       max;
+    std::uint32_t   vertex_count;
+    std::uint64_t   offset;         // from the start of the file
+    std::uint32_t   node_count;
+    std::uint32_t   padding;
+};
+
+typedef TrackedVector<ClusterRecord, MemoryCategory::QueryIndex> ClusterTable;
+
+/**
+ * @brief Triangles of a cluster, in the leaf order of its BVH.
+ */
+struct MeshCluster
+{
+    typedef TrackedVector<ClusterNode, MemoryCategory::QueryCache> NodeArray;
+    typedef TrackedVector<Mesh::Vertex, MemoryCategory::QueryCache> VertexArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryCache> IndexArray;
+
+    NodeArray   nodes;
+    VertexArray vertices;
+    IndexArray  triangles;      // 3 indices of `vertices` per triangle
+    IndexArray  mesh_triangles; // triangle of the original mesh
+};
+
+/**
+ * @brief Counters of a `ClusterCache`, since it was opened.
+ */
+struct ClusterCacheStatistics
+{
+    std::size_t hits = 0;           // requested clusters already in memory, or being loaded
+    std::size_t misses = 0;         // requested clusters loaded by the requesting thread
+    std::size_t prefetches = 0;     // clusters loaded ahead of their queries
+    std::size_t prefetch_hits = 0;  // prefetched clusters requested before their eviction
+    std::size_t evictions = 0;
+    std::size_t loaded_bytes = 0;
+    std::size_t read_failures = 0;  // clusters that couldn't be read or were invalid, failing their queries
+};
+
+/**
+ * @brief Settings of `StreamingClosestPointQuery`.
+ */
+struct StreamingQuerySettings
+{
+    // Bytes of cluster data kept in memory. Clusters still used by queries
+    // are freed once the queries are done with them.
+    std::size_t cache_size = std::size_t(256) << 20;
+
+    // Queries ahead of the current one of a batch whose clusters are prefetched, 0 to disable.
+    // Off by default: it only pays off when the reads are slow and the cache has room to spare.
+    std::size_t prefetch_distance = 0;
+
+    // Pending prefetches. Further ones are dropped until the queue drains.
+    std::size_t prefetch_queue_size = 64;
+};
+
+/**
+ * @brief Clusters of a cluster file in memory, least recently used first out.
+ *
+ * Any thread can request a cluster: it is read on demand unless it is in
+ * memory, and threads requesting a cluster being read wait for it instead
+ * of reading it again. A background thread reads the prefetched clusters.
+ * Reads of the file are serialized.
+ */
+class ClusterCache
+{
+  public:
+    ClusterCache(
+        const std::string&                  file_path,
+        const ClusterTable&                 records,
+        const StreamingQuerySettings&       settings);
+
+    ~ClusterCache();
+
+    ClusterCache(const ClusterCache&) = delete;
+    ClusterCache& operator=(const ClusterCache&) = delete;
+
+    /**
+     * @brief Return the cluster, loading it if needed. Null if it can't be read or is invalid.
+     */
+    std::shared_ptr<const MeshCluster> get_cluster(const std::uint32_t cluster);
+
+    /**
+     * @brief Queue clusters to be loaded in the background, unless they are in memory. Don't block.
+     *
+     * Clusters are dropped once the queue is full, once the prefetched
+     * clusters not requested yet would take more than a quarter of the
+     * cache, or once they don't fit in the cache: prefetches never evict.
+     */
+    void prefetch_clusters(const std::uint32_t* clusters, const std::size_t count);
+
+    ClusterCacheStatistics get_statistics() const;
+
+    /**
+     * @brief Heap bytes used by the cache entries and the clusters in memory.
+     */
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    enum class EntryState
+    {
+        Absent,
+        Queued,     // in the prefetch queue
+        Loading,
+        Loaded
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<const MeshCluster>      cluster;
+        std::list<std::uint32_t>::iterator      lru_position;
+        EntryState                              state = EntryState::Absent;
+        bool                                    prefetched = false;    // and not requested yet
+    };
+
+    const ClusterTable&                 m_records;
+    const std::size_t                   m_capacity;
+    const std::size_t                   m_prefetch_queue_size;
+
+    std::ifstream                       m_file;
+    std::mutex                          m_file_mutex;
+
+    // Entries, LRU list, queue and statistics are guarded by `m_mutex`.
+    mutable std::mutex                  m_mutex;
+    std::condition_variable             m_cluster_loaded;
+    std::condition_variable             m_prefetch_available;
+    std::vector<Entry>                  m_entries;
+    std::list<std::uint32_t>            m_lru;          // loaded clusters, most recently used first
+    std::deque<std::uint32_t>           m_prefetch_queue;
+    std::size_t                         m_size;         // file bytes of the loaded clusters, against the capacity
+    std::size_t                         m_heap_size;    // tracked heap bytes of the loaded clusters
+    std::size_t                         m_prefetch_size;    // queued, or prefetched and not requested yet
+    ClusterCacheStatistics              m_statistics;
+    bool                                m_stopping;
+
+    std::thread                         m_prefetch_thread;
+
+    std::shared_ptr<const MeshCluster> read_cluster(const std::uint32_t cluster);
+
+    /**
+     * @brief Store a cluster read by this thread, then evict clusters down to the capacity.
+     *
+     * `m_mutex` must be locked. The new cluster is never evicted. A
+     * prefetched cluster that doesn't fit anymore is dropped instead.
+     */
+    void insert_cluster(
+        const std::uint32_t                         cluster,
+        const std::shared_ptr<const MeshCluster>&   data,
+        const bool                                  prefetched);
+
+    void run_prefetcher();
+};
+
+/**
+ * @brief Closest point queries on a cluster file (see `write_cluster_file`), for meshes larger than the memory.
+ *
+ * The cluster table and a BVH of the cluster bounds stay in memory: about
+ * 120 bytes per cluster. Queries visit the clusters nearest first and prune
+ * them by their bounds, so they only page in the clusters around their
+ * closest point. Results are exact and the same as in memory.
+ *
+ * Batches run along a Morton curve of the query points, in parallel, so
+ * consecutive queries share their clusters. With a `prefetch_distance`,
+ * each query also prefetches the clusters of the query that far ahead of
+ * it in its chunk, so the reads overlap the queries: the distance to the
+ * mesh is 1-Lipschitz, so that query is within the distance of the
+ * previous one plus the distance between them.
+ */
+class StreamingClosestPointQuery
+{
+  public:
+    /**
+     * @brief Open a cluster file. Empty if it can't be read, or if its table doesn't fit in the file.
+     */
+    explicit StreamingClosestPointQuery(
+        const std::string&              file_path,
+        const StreamingQuerySettings&   settings = StreamingQuerySettings());
+
+    StreamingClosestPointQuery(const StreamingClosestPointQuery&) = delete;
+    StreamingClosestPointQuery& operator=(const StreamingClosestPointQuery&) = delete;
+
+    inline bool empty() const
+    {
+        return !m_cache;
+    }
+
+    /**
+     * @brief Same as `ClosestPointQuery::get_closest_point`. `triangle` is a triangle of the original mesh.
+     *
+     * Also false if a cluster it visits can't be read: the point found may
+     * not be the closest. See `ClusterCacheStatistics::read_failures`.
+     */
+    bool get_closest_point(
+        const glm::vec3&    query_point,
+        const float         max_distance,
+        ClosestPointResult& result) const;
+
+    /**
+     * @brief Run `count` queries at once. Return the number of points found.
+     *
+     * `found` is optional. `results[i]` is left untouched when no point is found.
+     */
+    std::size_t get_closest_points(
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance,
+        ClosestPointResult* results,
+        bool*               found = nullptr) const;
+
+    std::size_t get_cluster_count() const;
+
+    std::uint64_t get_triangle_count() const;
+
+    ClusterCacheStatistics get_cache_statistics() const;
+
+    /**
+     * @brief Heap bytes used by the cluster table, the cluster BVH and the cached clusters.
+     */
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    typedef TrackedVector<ClusterNode, MemoryCategory::QueryIndex> NodeArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryIndex> IndexArray;
+
+    const StreamingQuerySettings    m_settings;
+    std::uint64_t                   m_triangle_count;
+    ClusterTable                    m_records;
+
+    // BVH of the cluster bounds. Leaves hold clusters [first, first + count) of `m_cluster_order`.
+    NodeArray                       m_nodes;
+    IndexArray                      m_cluster_order;
+
+    std::unique_ptr<ClusterCache>   m_cache;
+
+    /**
+     * @brief Prefetch the clusters within `max_distance` of the point, nearest first.
+     *
+     * Clusters in `prefetched_clusters` (sorted) are skipped, the others
+     * are added to it. `clusters` is a buffer for their indices.
+     */
+    void prefetch_clusters(
+        const glm::vec3&            point,
+        const float                 max_distance,
+        std::vector<std::uint32_t>& prefetched_clusters,
+        std::vector<std::uint32_t>& clusters) const;
+};
+
+} // namespace core
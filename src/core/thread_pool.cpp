@@ -0,0 +1,81 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace core
+{
+
+ThreadPool::ThreadPool(const std::size_t thread_count)
+  : m_running_count(0)
+  , m_stopping(false)
+{
+    const std::size_t count = std::max<std::size_t>(thread_count, 1);
+
+    m_threads.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+        m_threads.emplace_back(&ThreadPool::run_worker, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_task_available.notify_all();
+
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+
+    m_task_available.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return m_tasks.empty() && m_running_count == 0; });
+}
+
+std::size_t ThreadPool::get_thread_count() const
+{
+    return m_threads.size();
+}
+
+void ThreadPool::run_worker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_task_available.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+        // Queued tasks still run when stopping.
+        if (m_tasks.empty())
+            return;
+
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        ++m_running_count;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        --m_running_count;
+
+        if (m_tasks.empty() && m_running_count == 0)
+            m_idle.notify_all();
+    }
+}
+
+} // namespace core
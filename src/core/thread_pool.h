@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core
+{
+
+/**
+ * @brief Persistent worker threads running submitted tasks in submission order.
+ *
+ * Tasks must not throw. The destructor runs the tasks still queued, then
+ * joins the workers.
+ */
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(const std::size_t thread_count);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queue a task. Any thread can submit, including a worker.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Wait until the queue is empty and no task is running.
+     *
+     * Must not be called from a worker.
+     */
+    void wait_idle();
+
+    std::size_t get_thread_count() const;
+
+  private:
+    std::vector<std::thread>            m_threads;
+    std::deque<std::function<void()>>   m_tasks;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_task_available;
+    std::condition_variable             m_idle;
+    std::size_t                         m_running_count;
+    bool                                m_stopping;
+
+    void run_worker();
+};
+
+} // namespace core
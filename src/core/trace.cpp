@@ -0,0 +1,203 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char*     name;
+        std::int64_t    timestamp_ns;   // since the trace epoch
+        char            phase;          // 'B' or 'E'
+    };
+
+    /**
+     * @brief Events of one thread.
+     *
+     * The owning thread appends events and publishes them by incrementing
+     * `size` (release). Readers only look at the first `size` events.
+     */
+    struct ThreadTraceBuffer
+    {
+        // Roughly 1.5MB per thread. When full, new events are dropped.
+        static const std::size_t capacity = 1 << 16;
+
+        explicit ThreadTraceBuffer(const std::uint32_t id)
+          : thread_id(id)
+          , events(capacity)
+          , size(0)
+          , dropped_count(0)
+        {}
+
+        const std::uint32_t         thread_id;
+        std::vector<TraceEvent>     events;
+        std::atomic<std::size_t>    size;
+        std::atomic<std::size_t>    dropped_count;
+    };
+
+    /**
+     * @brief Owns the buffers of every thread that ever recorded an event.
+     *
+     * Buffers outlive their thread so that events of finished worker threads
+     * can still be saved. The mutex is only taken when a thread records its
+     * first event, and when saving or clearing.
+     */
+    struct TraceRegistry
+    {
+        std::mutex                                          mutex;
+        std::vector<std::unique_ptr<ThreadTraceBuffer>>     buffers;
+    };
+
+    std::atomic<bool> g_tracing_enabled(false);
+
+    const std::chrono::steady_clock::time_point g_trace_epoch = std::chrono::steady_clock::now();
+
+    TraceRegistry& get_registry()
+    {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    ThreadTraceBuffer& get_thread_buffer()
+    {
+        thread_local ThreadTraceBuffer* buffer = nullptr;
+
+        if (!buffer)
+        {
+            TraceRegistry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            const std::uint32_t thread_id = static_cast<std::uint32_t>(registry.buffers.size());
+            registry.buffers.emplace_back(new ThreadTraceBuffer(thread_id));
+            buffer = registry.buffers.back().get();
+        }
+
+        return *buffer;
+    }
+
+    void record_event(const char* name, const char phase)
+    {
+        const std::int64_t timestamp_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - g_trace_epoch).count();
+
+        ThreadTraceBuffer& buffer = get_thread_buffer();
+        const std::size_t index = buffer.size.load(std::memory_order_relaxed);
+
+        if (index >= ThreadTraceBuffer::capacity)
+        {
+            buffer.dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.events[index] = { name, timestamp_ns, phase };
+        buffer.size.store(index + 1, std::memory_order_release);
+    }
+
+    void write_json_string(std::ostream& out, const char* str)
+    {
+        out << '"';
+        for (; *str; ++str)
+        {
+            if (*str == '"' || *str == '\\')
+                out << '\\';
+            out << *str;
+        }
+        out << '"';
+    }
+}
+
+void set_tracing_enabled(const bool enabled)
+{
+    g_tracing_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool is_tracing_enabled()
+{
+    return g_tracing_enabled.load(std::memory_order_relaxed);
+}
+
+void trace_begin(const char* name)
+{
+    record_event(name, 'B');
+}
+
+void trace_end(const char* name)
+{
+    record_event(name, 'E');
+}
+
+void clear_trace()
+{
+    TraceRegistry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for (const std::unique_ptr<ThreadTraceBuffer>& buffer : registry.buffers)
+    {
+        buffer->size.store(0, std::memory_order_release);
+        buffer->dropped_count.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool write_chrome_trace(const std::string& file_path)
+{
+    std::ofstream out(file_path);
+
+    if (!out)
+    {
+        std::cerr << "Unable to write trace file " << file_path << "\n";
+        return false;
+    }
+
+    TraceRegistry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    std::size_t event_count = 0;
+    std::size_t dropped_count = 0;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    for (const std::unique_ptr<ThreadTraceBuffer>& buffer : registry.buffers)
+    {
+        const std::size_t size = buffer->size.load(std::memory_order_acquire);
+        dropped_count += buffer->dropped_count.load(std::memory_order_relaxed);
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            const TraceEvent& event = buffer->events[i];
+
+            if (event_count++ > 0)
+                out << ",\n";
+
+            // Chrome expects timestamps in microseconds.
+            out << "{\"name\":";
+            write_json_string(out, event.name);
+            out << ",\"ph\":\"" << event.phase << "\""
+                << ",\"ts\":" << (event.timestamp_ns / 1000) << '.'
+                << static_cast<char>('0' + (event.timestamp_ns / 100) % 10)
+                << ",\"pid\":1,\"tid\":" << buffer->thread_id << "}";
+        }
+    }
+
+    out << "\n]}\n";
+
+    std::cout << "Saved " << event_count << " trace events in " << file_path << ".\n";
+
+    if (dropped_count > 0)
+        std::cout << "\t" << dropped_count << " events were dropped (trace buffer full).\n";
+
+    return static_cast<bool>(out);
+}
+
+} // namespace core
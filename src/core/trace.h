@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+
+namespace core
+{
+
+//
+// Scoped tracing.
+//
+// Begin and end events are recorded in a per-thread buffer. Only the owning
+// thread writes into its buffer, so recording an event never takes a lock.
+// The recorded events can be saved in the Chrome trace-event format and
+// opened in chrome://tracing or https://ui.perfetto.dev.
+//
+// Event names must be string literals (or outlive the trace): only the
+// pointer is stored.
+//
+
+/**
+ * @brief Start or stop recording trace events. Disabled by default.
+ */
+void set_tracing_enabled(const bool enabled);
+
+bool is_tracing_enabled();
+
+/**
+ * @brief Record the beginning of a named event on the calling thread.
+ */
+void trace_begin(const char* name);
+
+/**
+ * @brief Record the end of a named event on the calling thread.
+ */
+void trace_end(const char* name);
+
+/**
+ * @brief Forget all recorded events.
+ *
+ * Must not be called while other threads are recording events.
+ */
+void clear_trace();
+
+/**
+ * @brief Write all recorded events in a Chrome trace-event JSON file.
+ *
+ * Must not be called while other threads are recording events.
+ */
+bool write_chrome_trace(const std::string& file_path);
+
+/**
+ * @brief Record a begin event on construction and an end event on destruction.
+ */
+class TraceScope
+{
+  public:
+    explicit TraceScope(const char* name)
+      : m_name(name)
+      , m_recording(is_tracing_enabled())
+    {
+        if (m_recording)
+            trace_begin(m_name);
+    }
+
+    ~TraceScope()
+    {
+        if (m_recording)
+            trace_end(m_name);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+  private:
+    const char* m_name;
+    const bool  m_recording;
+};
+
+} // namespace core
+
+#define CORE_TRACE_CONCAT_IMPL(a, b) a##b
+#define CORE_TRACE_CONCAT(a, b) CORE_TRACE_CONCAT_IMPL(a, b)
+
+/**
+ * @brief Trace the enclosing scope under the given name.
+ */
+#define CORE_TRACE_SCOPE(name) \
+    core::TraceScope CORE_TRACE_CONCAT(trace_scope_, __LINE__)(name)
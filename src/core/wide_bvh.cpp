@@ -0,0 +1,188 @@
+#include "wide_bvh.h"
+
+#include "trace.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace core
+{
+
+namespace
+{
+    /**
+     * @brief Collapse the binary node `build_index` and its descendants into `nodes[node_index]`.
+     *
+     * The inner child with the largest surface is opened until the node is
+     * full or only has leaves. Inner children are allocated side by side,
+     * then encoded depth first.
+     */
+    template <std::size_t Width, typename NodeArray>
+    void collapse_node(
+        const std::vector<BuildNode>&   build_nodes,
+        const std::uint32_t             build_index,
+        const std::uint32_t             node_index,
+        NodeArray&                      nodes)
+    {
+        std::uint32_t children[Width];
+        std::size_t child_count = 0;
+
+        if (build_nodes[build_index].is_leaf)
+            children[child_count++] = build_index;
+        else
+        {
+            children[child_count++] = build_nodes[build_index].children[0];
+            children[child_count++] = build_nodes[build_index].children[1];
+        }
+
+        while (child_count < Width)
+        {
+            std::size_t largest = Width;
+            float largest_area = -1.0f;
+
+            for (std::size_t c = 0; c < child_count; ++c)
+            {
+                const BuildNode& child = build_nodes[children[c]];
+
+                if (!child.is_leaf && child.bounds.half_area() > largest_area)
+                {
+                    largest = c;
+                    largest_area = child.bounds.half_area();
+                }
+            }
+
+            if (largest == Width)
+                break;
+
+            const BuildNode& opened = build_nodes[children[largest]];
+            children[largest] = opened.children[0];
+            children[child_count++] = opened.children[1];
+        }
+
+        const float infinity = std::numeric_limits<float>::infinity();
+        std::uint32_t child_nodes[Width];
+
+        for (std::size_t c = 0; c < Width; ++c)
+        {
+            auto& node = nodes[node_index];
+
+            if (c >= child_count)
+            {
+                node.min_x[c] = node.min_y[c] = node.min_z[c] = infinity;
+                node.max_x[c] = node.max_y[c] = node.max_z[c] = -infinity;
+                node.child[c] = 0;
+                node.primitive_count[c] = 0;
+                continue;
+            }
+
+            const BuildNode& child = build_nodes[children[c]];
+
+            node.min_x[c] = child.bounds.min.x;
+            node.min_y[c] = child.bounds.min.y;
+            node.min_z[c] = child.bounds.min.z;
+            node.max_x[c] = child.bounds.max.x;
+            node.max_y[c] = child.bounds.max.y;
+            node.max_z[c] = child.bounds.max.z;
+
+            if (child.is_leaf)
+            {
+                node.child[c] = child.first_primitive;
+                node.primitive_count[c] = child.primitive_count;
+            }
+            else
+            {
+                child_nodes[c] = static_cast<std::uint32_t>(nodes.size());
+                nodes.resize(nodes.size() + 1);
+
+                // `resize` may have moved the nodes.
+                nodes[node_index].child[c] = child_nodes[c];
+                nodes[node_index].primitive_count[c] = 0;
+            }
+        }
+
+        for (std::size_t c = 0; c < child_count; ++c)
+        {
+            if (!build_nodes[children[c]].is_leaf)
+                collapse_node<Width>(build_nodes, children[c], child_nodes[c], nodes);
+        }
+    }
+}
+
+template <std::size_t Width>
+WideBvh<Width>::WideBvh(
+    const MeshPointCloud&   mesh_point_cloud,
+    const std::size_t       leaf_max_size,
+    const bool              precompute_triangles,
+    const BvhBuildMethod    build_method)
+  : m_mesh_point_cloud(mesh_point_cloud)
+  , m_distance2_to_boxes(nullptr)
+{
+    CORE_TRACE_SCOPE("WideBvh build");
+
+    // Start a timer to know how long it takes to build the hierarchy.
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    if (m_mesh_point_cloud.get_triangle_count() > 0)
+    {
+        const BvhBuilder builder(m_mesh_point_cloud, leaf_max_size, build_method);
+        const std::vector<BuildNode>& build_nodes = builder.get_nodes();
+
+        m_primitives.assign(builder.get_primitives().begin(), builder.get_primitives().end());
+
+        m_root_min = build_nodes[0].bounds.min;
+        m_root_max = build_nodes[0].bounds.max;
+
+        // The node count depends on how full the nodes get: grow, then release the slack.
+        m_nodes.resize(1);
+        collapse_node<Width>(build_nodes, 0, 0, m_nodes);
+        m_nodes.shrink_to_fit();
+
+        if (precompute_triangles)
+            m_precomputed_triangles.reset(new PrecomputedTriangles(mesh_point_cloud, builder.get_primitives()));
+    }
+
+    // The kernels read the bounds as one array of 6 * Width floats.
+    static_assert(offsetof(Node, max_z) == 5 * Width * sizeof(float), "unexpected node layout");
+
+    if (const SimdKernels* kernels = get_simd_kernels())
+    {
+        if (Width == 4)
+            m_distance2_to_boxes = kernels->distance2_to_boxes4;
+        else if (Width == 8)
+            m_distance2_to_boxes = kernels->distance2_to_boxes8;
+    }
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    auto process_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+    std::cout << "Generated mesh BVH (" << Width << "-wide nodes) in " << process_time << "ms.\n";
+    std::cout << "\tNode count: " << m_nodes.size() << "\n";
+}
+
+template <std::size_t Width>
+std::size_t WideBvh<Width>::get_node_count() const
+{
+    return m_nodes.size();
+}
+
+template <std::size_t Width>
+MemoryUsage WideBvh<Width>::get_memory_usage() const
+{
+    MemoryUsage usage;
+    usage.add("bvh nodes", get_heap_bytes(m_nodes));
+    usage.add("bvh triangle indices", get_heap_bytes(m_primitives));
+
+    if (m_precomputed_triangles)
+        usage.add("precomputed triangles", m_precomputed_triangles->get_memory_usage().get_total_bytes());
+
+    return usage;
+}
+
+// Supported widths.
+template class WideBvh<4>;
+template class WideBvh<8>;
+
+} // namespace core
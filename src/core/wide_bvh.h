@@ -0,0 +1,605 @@
+#pragma once
+
+#include "bvh_builder.h"
+#include "cpu_dispatch.h"
+#include "math.h"
+#include "memory.h"
+#include "mesh_point_cloud.h"
+#include "precomputed_triangles.h"
+
+#include <glm/glm.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace core
+{
+
+/**
+ * @brief Bounding volume hierarchy of the mesh triangles with `Width` children per node.
+ *
+ * Built by collapsing the binary SAH hierarchy of `BvhBuilder`: the inner
+ * child with the largest surface is replaced by its two children until a
+ * node has `Width` of them. The tree is about log2(Width) times shallower,
+ * so a query chases that many fewer nodes.
+ *
+ * Each node stores the bounds of its children in SoA layout, in single
+ * precision, so the distances of a point to all of them are computed in one
+ * vectorized loop (`distance2_to_boxes`, or its `SimdKernels` version for
+ * the CPU in single precision). The children closer than the closest point
+ * so far are then visited nearest first. Results are exact.
+ *
+ * Reference:
+ *  - Shallow Bounding Volume Hierarchies for Fast SIMD Ray Tracing of Incoherent Rays
+ *    Holger Dammertz, Johannes Hanika, Alexander Keller, EGSR 2008
+ */
+template <std::size_t Width>
+class WideBvh
+{
+  public:
+    static_assert(Width >= 2 && Width <= 16, "unsupported node width");
+
+    /**
+     * @brief Hierarchy node.
+     *
+     * A child with a non-zero `primitive_count` is a leaf and `child` is its
+     * first primitive, otherwise `child` is the node index. Unused children
+     * have empty bounds, so they are never visited.
+     */
+    struct alignas(64) Node
+    {
+        float           min_x[Width];
+        float           min_y[Width];
+        float           min_z[Width];
+        float           max_x[Width];
+        float           max_y[Width];
+        float           max_z[Width];
+        std::uint32_t   child[Width];
+        std::uint32_t   primitive_count[Width];
+    };
+
+    // Along a path, each node leaves at most `Width - 1` children on the stack.
+    static const std::size_t max_stack_size = bvh_max_build_depth * (Width - 1) + Width;
+
+    /**
+     * @brief Build the hierarchy.
+     *
+     * With `precompute_triangles`, the terms of the closest point computation
+     * are stored for every triangle, in leaf order (see `PrecomputedTriangles`).
+     * `build_method` trades build time for query time, see `BvhBuilder`.
+     */
+    WideBvh(
+        const MeshPointCloud&   mesh_point_cloud,
+        const std::size_t       leaf_max_size = 4,
+        const bool              precompute_triangles = false,
+        const BvhBuildMethod    build_method = BvhBuildMethod::Sah);
+
+    /**
+     * @brief Visit the leaves closer than `closest_distance2`, nearest first.
+     *
+     * Same as `CompactBvh::traverse_nearest`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_nearest(
+        const Vec3&                     query_point,
+        typename Vec3::value_type&      closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Same as above, for any query shape. See `CompactBvh::traverse_closest`.
+     */
+    template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+    void traverse_closest(
+        const BoxDistance&              box_distance2,
+        Scalar&                         closest_distance2,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Visit the leaves needed by a packet of nearby queries, in one traversal.
+     *
+     * Same as `CompactBvh::traverse_packet`.
+     */
+    template <typename Scalar, std::size_t PacketWidth, typename LeafVisitor>
+    void traverse_packet(
+        const PointPacket<Scalar, PacketWidth>& packet,
+        Scalar                                  (&closest_distance2)[PacketWidth],
+        LeafVisitor&                            visit_leaf) const;
+
+    /**
+     * @brief Suspended `traverse_nearest`, for traversals interleaved on one thread.
+     */
+    template <typename Scalar>
+    struct NearestTraversal
+    {
+        struct StackEntry
+        {
+            std::uint32_t   child;
+            std::uint32_t   primitive_count;    // non-zero for leaves
+            Scalar          distance2;          // to the child bounds
+        };
+
+        StackEntry      stack[max_stack_size];
+        std::size_t     stack_size;
+    };
+
+    /**
+     * @brief Start a `traverse_nearest` that runs one node per `step_nearest` call.
+     */
+    template <typename Vec3>
+    void start_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal) const;
+
+    /**
+     * @brief Process the next node or leaf of the traversal, then prefetch the following node.
+     *
+     * Same as `CompactBvh::step_nearest`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    bool step_nearest(
+        const Vec3&                                                 query_point,
+        NearestTraversal<typename Vec3::value_type>&                traversal,
+        typename Vec3::value_type&                                  closest_distance2,
+        LeafVisitor&                                                visit_leaf) const;
+
+    /**
+     * @brief Visit the leaves a ray enters before `max_t`, nearest entry first.
+     *
+     * Same as `CompactBvh::traverse_ray`.
+     */
+    template <typename Vec3, typename LeafVisitor>
+    void traverse_ray(
+        const Vec3&                     origin,
+        const Vec3&                     direction,
+        typename Vec3::value_type&      max_t,
+        LeafVisitor&                    visit_leaf) const;
+
+    /**
+     * @brief Triangle index of the primitive at `index`, in leaf order.
+     */
+    inline std::uint32_t get_primitive(const std::size_t index) const
+    {
+        return m_primitives[index];
+    }
+
+    /**
+     * @brief Precomputed triangles in leaf order, or nullptr.
+     */
+    inline const PrecomputedTriangles* get_precomputed_triangles() const
+    {
+        return m_precomputed_triangles.get();
+    }
+
+    inline const MeshPointCloud& get_mesh_point_cloud() const
+    {
+        return m_mesh_point_cloud;
+    }
+
+    std::size_t get_node_count() const;
+
+    MemoryUsage get_memory_usage() const;
+
+  private:
+    typedef TrackedVector<Node, MemoryCategory::QueryIndex> NodeArray;
+    typedef TrackedVector<std::uint32_t, MemoryCategory::QueryIndex> PrimitiveArray;
+
+    const MeshPointCloud&   m_mesh_point_cloud;
+    glm::vec3               m_root_min;
+    glm::vec3               m_root_max;
+
+    // The root is node 0. A mesh small enough for one leaf still gets a root node.
+    NodeArray               m_nodes;
+
+    // Triangle indices, in leaf order.
+    PrimitiveArray          m_primitives;
+
+    // Optional, in leaf order too.
+    std::unique_ptr<PrecomputedTriangles> m_precomputed_triangles;
+
+    // `SimdKernels` version of `distance2_to_boxes` for `Width`, or nullptr for math.h.
+    void (*m_distance2_to_boxes)(const glm::vec3& point, const float* bounds, float* distance2);
+
+    inline glm::vec3 get_child_min(const Node& node, const std::size_t c) const
+    {
+        return glm::vec3(node.min_x[c], node.min_y[c], node.min_z[c]);
+    }
+
+    inline glm::vec3 get_child_max(const Node& node, const std::size_t c) const
+    {
+        return glm::vec3(node.max_x[c], node.max_y[c], node.max_z[c]);
+    }
+
+    /**
+     * @brief Squared distances between a point and the children bounds of `node`.
+     */
+    template <typename Vec3>
+    inline void get_children_distance2(
+        const Node&                     node,
+        const Vec3&                     point,
+        typename Vec3::value_type       (&distance2)[Width]) const
+    {
+        distance2_to_boxes(point, node.min_x, node.min_y, node.min_z, node.max_x, node.max_y, node.max_z, distance2);
+    }
+
+    inline void get_children_distance2(
+        const Node&                     node,
+        const glm::vec3&                point,
+        float                           (&distance2)[Width]) const
+    {
+        if (m_distance2_to_boxes)
+            m_distance2_to_boxes(point, node.min_x, distance2);
+        else
+            distance2_to_boxes(point, node.min_x, node.min_y, node.min_z, node.max_x, node.max_y, node.max_z, distance2);
+    }
+
+    inline void prefetch_node(const std::uint32_t index) const
+    {
+        const char* node = reinterpret_cast<const char*>(&m_nodes[index]);
+
+        for (std::size_t offset = 0; offset < sizeof(Node); offset += 64)
+            prefetch(node + offset);
+    }
+
+    /**
+     * @brief Push the children of `node` closer than `closest_distance2`, nearest last.
+     */
+    template <typename StackEntry, typename Scalar>
+    inline static void push_children(
+        const Node&                     node,
+        const Scalar                    (&distance2)[Width],
+        const Scalar                    closest_distance2,
+        StackEntry*                     stack,
+        std::size_t&                    stack_size);
+};
+
+typedef WideBvh<4> WideBvh4;
+typedef WideBvh<8> WideBvh8;
+
+
+//
+// Implementation.
+//
+
+template <std::size_t Width>
+template <typename StackEntry, typename Scalar>
+void WideBvh<Width>::push_children(
+    const Node&                     node,
+    const Scalar                    (&distance2)[Width],
+    const Scalar                    closest_distance2,
+    StackEntry*                     stack,
+    std::size_t&                    stack_size)
+{
+    assert(stack_size + Width <= max_stack_size);
+
+    // Insertion sort of the visited children on the stack, farthest first.
+    const std::size_t first = stack_size;
+
+    for (std::size_t c = 0; c < Width; ++c)
+    {
+        if (!(distance2[c] < closest_distance2))
+            continue;
+
+        std::size_t i = stack_size++;
+
+        while (i > first && stack[i - 1].distance2 < distance2[c])
+        {
+            stack[i] = stack[i - 1];
+            --i;
+        }
+
+        stack[i].child = node.child[c];
+        stack[i].primitive_count = node.primitive_count[c];
+        stack[i].distance2 = distance2[c];
+    }
+}
+
+template <std::size_t Width>
+template <typename Vec3, typename LeafVisitor>
+void WideBvh<Width>::traverse_nearest(
+    const Vec3&                     query_point,
+    typename Vec3::value_type&      closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    NearestTraversal<typename Vec3::value_type> traversal;
+    start_nearest(query_point, traversal);
+
+    while (traversal.stack_size > 0)
+    {
+        const auto entry = traversal.stack[--traversal.stack_size];
+
+        // A closer point was found since this child was pushed.
+        if (entry.distance2 >= closest_distance2)
+            continue;
+
+        if (entry.primitive_count > 0)
+        {
+            visit_leaf(entry.child, entry.primitive_count, closest_distance2);
+            continue;
+        }
+
+        const Node& node = m_nodes[entry.child];
+
+        typename Vec3::value_type distance2[Width];
+        get_children_distance2(node, query_point, distance2);
+
+        push_children(node, distance2, closest_distance2, traversal.stack, traversal.stack_size);
+    }
+}
+
+template <std::size_t Width>
+template <typename Scalar, typename BoxDistance, typename LeafVisitor>
+void WideBvh<Width>::traverse_closest(
+    const BoxDistance&              box_distance2,
+    Scalar&                         closest_distance2,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename NearestTraversal<Scalar>::StackEntry StackEntry;
+
+    if (m_nodes.empty())
+        return;
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    stack[stack_size++] = { 0, 0, box_distance2(m_root_min, m_root_max) };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer point was found since this child was pushed.
+        if (entry.distance2 >= closest_distance2)
+            continue;
+
+        if (entry.primitive_count > 0)
+        {
+            visit_leaf(entry.child, entry.primitive_count, closest_distance2);
+            continue;
+        }
+
+        const Node& node = m_nodes[entry.child];
+        const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+
+        Scalar distance2[Width];
+
+        for (std::size_t c = 0; c < Width; ++c)
+        {
+            // Unused children have empty bounds: skip them rather than relying on `box_distance2`.
+            distance2[c] = node.min_x[c] <= node.max_x[c]
+                ? box_distance2(get_child_min(node, c), get_child_max(node, c))
+                : infinity;
+        }
+
+        push_children(node, distance2, closest_distance2, stack, stack_size);
+    }
+}
+
+template <std::size_t Width>
+template <typename Scalar, std::size_t PacketWidth, typename LeafVisitor>
+void WideBvh<Width>::traverse_packet(
+    const PointPacket<Scalar, PacketWidth>& packet,
+    Scalar                                  (&closest_distance2)[PacketWidth],
+    LeafVisitor&                            visit_leaf) const
+{
+    struct StackEntry
+    {
+        std::uint32_t   child;
+        std::uint32_t   primitive_count;        // non-zero for leaves
+        Scalar          distance2[PacketWidth]; // of every lane to the child bounds
+        Scalar          nearest_distance2;      // of the lanes that need the child
+    };
+
+    if (m_nodes.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    StackEntry& root = stack[stack_size++];
+    root.child = 0;
+    root.primitive_count = 0;
+    distance2_to_box(packet, m_root_min, m_root_max, root.distance2);
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // Closer points were found for every lane since this child was pushed.
+        if (get_min_distance2_below(entry.distance2, closest_distance2) == infinity)
+            continue;
+
+        if (entry.primitive_count > 0)
+        {
+            visit_leaf(entry.child, entry.primitive_count, entry.distance2, closest_distance2);
+            continue;
+        }
+
+        const Node& node = m_nodes[entry.child];
+
+        assert(stack_size + Width <= max_stack_size);
+
+        // Insertion sort of the needed children on the stack, farthest first.
+        const std::size_t first = stack_size;
+
+        for (std::size_t c = 0; c < Width; ++c)
+        {
+            if (node.min_x[c] > node.max_x[c])
+                continue;
+
+            StackEntry child;
+            child.child = node.child[c];
+            child.primitive_count = node.primitive_count[c];
+            distance2_to_box(packet, get_child_min(node, c), get_child_max(node, c), child.distance2);
+            child.nearest_distance2 = get_min_distance2_below(child.distance2, closest_distance2);
+
+            if (child.nearest_distance2 == infinity)
+                continue;
+
+            std::size_t i = stack_size++;
+
+            while (i > first && stack[i - 1].nearest_distance2 < child.nearest_distance2)
+            {
+                stack[i] = stack[i - 1];
+                --i;
+            }
+
+            stack[i] = child;
+        }
+    }
+}
+
+template <std::size_t Width>
+template <typename Vec3>
+void WideBvh<Width>::start_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal) const
+{
+    traversal.stack_size = 0;
+
+    if (m_nodes.empty())
+        return;
+
+    traversal.stack[traversal.stack_size++] = {
+        0,
+        0,
+        distance2_to_box(query_point, Vec3(m_root_min), Vec3(m_root_max)) };
+
+    prefetch_node(0);
+}
+
+template <std::size_t Width>
+template <typename Vec3, typename LeafVisitor>
+bool WideBvh<Width>::step_nearest(
+    const Vec3&                                                 query_point,
+    NearestTraversal<typename Vec3::value_type>&                traversal,
+    typename Vec3::value_type&                                  closest_distance2,
+    LeafVisitor&                                                visit_leaf) const
+{
+    typedef typename NearestTraversal<typename Vec3::value_type>::StackEntry StackEntry;
+
+    StackEntry* stack = traversal.stack;
+    std::size_t& stack_size = traversal.stack_size;
+
+    // Entries pruned since they were pushed: skipped without loading their node.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    const StackEntry entry = stack[--stack_size];
+
+    if (entry.primitive_count > 0)
+        visit_leaf(entry.child, entry.primitive_count, closest_distance2);
+    else
+    {
+        const Node& node = m_nodes[entry.child];
+
+        typename Vec3::value_type distance2[Width];
+        get_children_distance2(node, query_point, distance2);
+
+        push_children(node, distance2, closest_distance2, stack, stack_size);
+    }
+
+    // A leaf may have pruned the next entries.
+    while (stack_size > 0 && stack[stack_size - 1].distance2 >= closest_distance2)
+        --stack_size;
+
+    if (stack_size == 0)
+        return false;
+
+    if (stack[stack_size - 1].primitive_count == 0)
+        prefetch_node(stack[stack_size - 1].child);
+
+    return true;
+}
+
+template <std::size_t Width>
+template <typename Vec3, typename LeafVisitor>
+void WideBvh<Width>::traverse_ray(
+    const Vec3&                     origin,
+    const Vec3&                     direction,
+    typename Vec3::value_type&      max_t,
+    LeafVisitor&                    visit_leaf) const
+{
+    typedef typename Vec3::value_type Scalar;
+
+    struct StackEntry
+    {
+        std::uint32_t   child;
+        std::uint32_t   primitive_count;    // non-zero for leaves
+        Scalar          t_entry;
+    };
+
+    if (m_nodes.empty())
+        return;
+
+    const Scalar infinity = std::numeric_limits<Scalar>::infinity();
+    const Vec3 inv_direction(
+        direction.x != Scalar(0) ? Scalar(1) / direction.x : infinity,
+        direction.y != Scalar(0) ? Scalar(1) / direction.y : infinity,
+        direction.z != Scalar(0) ? Scalar(1) / direction.z : infinity);
+
+    StackEntry stack[max_stack_size];
+    std::size_t stack_size = 0;
+
+    Scalar root_t_entry;
+    if (!intersect_ray_box(origin, inv_direction, Vec3(m_root_min), Vec3(m_root_max), max_t, root_t_entry))
+        return;
+
+    stack[stack_size++] = { 0, 0, root_t_entry };
+
+    while (stack_size > 0)
+    {
+        const StackEntry entry = stack[--stack_size];
+
+        // A closer hit was found since this child was pushed.
+        if (entry.t_entry > max_t)
+            continue;
+
+        if (entry.primitive_count > 0)
+        {
+            visit_leaf(entry.child, entry.primitive_count, max_t);
+            continue;
+        }
+
+        const Node& node = m_nodes[entry.child];
+
+        assert(stack_size + Width <= max_stack_size);
+
+        // Insertion sort of the hit children on the stack, farthest entry first.
+        const std::size_t first = stack_size;
+
+        for (std::size_t c = 0; c < Width; ++c)
+        {
+            Scalar t_entry;
+
+            if (node.min_x[c] > node.max_x[c]
+                || !intersect_ray_box(
+                    origin,
+                    inv_direction,
+                    Vec3(get_child_min(node, c)),
+                    Vec3(get_child_max(node, c)),
+                    max_t,
+                    t_entry))
+                continue;
+
+            std::size_t i = stack_size++;
+
+            while (i > first && stack[i - 1].t_entry < t_entry)
+            {
+                stack[i] = stack[i - 1];
+                --i;
+            }
+
+            stack[i] = { node.child[c], node.primitive_count[c], t_entry };
+        }
+    }
+}
+
+} // namespace core
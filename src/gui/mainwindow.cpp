@@ -4,10 +4,13 @@
 #include "file_system.h"
 
 // core includes.
+#include "core/async_query.h"
 #include "core/closest_point_query.h"
+#include "core/memory.h"
 #include "core/mesh_point_cloud.h"
 #include "core/scene.h"
 #include "core/scene_loader.h"
+#include "core/trace.h"
 
 // imgui, gl3w and glfw includes.
 #include <imgui.h>
@@ -19,8 +22,10 @@
 #include <glm/gtx/rotate_vector.hpp>
 
 // Standard includes.
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <inttypes.h>
 #include <iostream>
 #include <string>
@@ -48,6 +53,17 @@ namespace
     {
         std::cerr << "GLFW Error " << error << ": " << description << "\n";
     }
+
+    /**
+     * @brief Display the memory used by an object, component by component.
+     */
+    void imgui_draw_memory_usage(const char* title, const core::MemoryUsage& usage)
+    {
+        ImGui::Text("%s: %s", title, core::format_memory_size(usage.get_total_bytes()).c_str());
+
+        for (const core::MemoryUsage::Component& component : usage.get_components())
+            ImGui::BulletText("%s: %s", component.name, core::format_memory_size(component.bytes).c_str());
+    }
 }
 
 void MainWindow::init(const int window_width, const int window_height)
@@ -157,6 +173,9 @@ void MainWindow::run()
 
 void MainWindow::release()
 {
+    // Wait for the running queries before anything they use is destroyed.
+    m_async_closest_point_query.reset(nullptr);
+
     ImGui_ImplGlfwGL3_Shutdown();
     glfwTerminate();
 }
@@ -167,11 +186,12 @@ void MainWindow::load_scene(const std::string& path)
     m_animate_query_point = false;
 
     // Load the scene.
-    m_scene.reset(core::load_scene_from_file(path));
+    m_scene.reset(core::load_scene_from_file(path, m_reorder_mesh_on_load));
 
     if (m_scene->get_mesh_count() == 0)
     {
         std::cerr << "No mesh in the scene.\n";
+        m_async_closest_point_query.reset(nullptr);
         m_mesh_point_cloud.reset(nullptr);
         m_closest_point_query.reset(nullptr);
         return;
@@ -181,7 +201,24 @@ void MainWindow::load_scene(const std::string& path)
     m_mesh_point_cloud.reset(new core::MeshPointCloud(m_scene->get_mesh(0)));
 
     // Prepare closest point queries.
-    m_closest_point_query.reset(new core::ClosestPointQuery(*m_mesh_point_cloud));
+    build_closest_point_query();
+}
+
+void MainWindow::build_closest_point_query()
+{
+    // Release the previous acceleration structure first,
+    // once the queries running on it are done.
+    m_async_closest_point_query.reset(nullptr);
+    m_closest_point_query.reset(nullptr);
+
+    core::QueryEngineSettings settings = core::get_default_query_engine_settings(
+        static_cast<core::ClosestPointQuery::Backend>(m_query_backend));
+    settings.precompute_triangles = m_precompute_triangles;
+    settings.bvh_build_method = static_cast<core::BvhBuildMethod>(m_bvh_build_method);
+
+    m_closest_point_query.reset(new core::ClosestPointQuery(*m_mesh_point_cloud, settings));
+
+    m_async_closest_point_query.reset(new core::AsyncClosestPointQuery(*m_closest_point_query));
 }
 
 // Constructor.
@@ -189,7 +226,16 @@ MainWindow::MainWindow()
   : m_query_point_max_serach_radius(10.0f)
   , m_query_point_pos(1.0f, 1.0f, 1.0f)
   , m_animate_query_point(false)
+  , m_reorder_mesh_on_load(false)
   , m_query_count(1)
+  , m_closest_point_answer_version(0)
+  , m_query_in_flight(false)
+  , m_query_backend(static_cast<int>(core::ClosestPointQuery::Backend::KdTree))
+  , m_precompute_triangles(false)
+  , m_bvh_build_method(static_cast<int>(core::BvhBuildMethod::Sah))
+  , m_pick_offset(0.1f)
+  , m_pick_found(false)
+  , m_pick_time(0)
 {}
 
 // Singleton instance.
@@ -234,6 +280,32 @@ void MainWindow::imgui_draw()
 
             ImGui::DragInt("Query count", &m_query_count, 1, 1, 1000);
 
+            const char* backends[] = { "KDTree (points)", "BVH 8-bit (triangles)", "BVH 16-bit (triangles)", "BVH 4-wide (triangles)", "BVH 8-wide (triangles)", "Heightfield (grid meshes)", "Convex (convex meshes)", "Automatic" };
+            if (ImGui::Combo("Backend", &m_query_backend, backends, IM_ARRAYSIZE(backends))
+                && m_mesh_point_cloud)
+            {
+                build_closest_point_query();
+            }
+
+            if (ImGui::Checkbox("Precompute triangles", &m_precompute_triangles)
+                && m_mesh_point_cloud)
+            {
+                build_closest_point_query();
+            }
+
+            const char* build_methods[] = { "SAH (fastest queries)", "LBVH (fastest build)", "LBVH + treelets" };
+            if (ImGui::Combo("BVH build", &m_bvh_build_method, build_methods, IM_ARRAYSIZE(build_methods))
+                && m_mesh_point_cloud
+                && m_query_backend != static_cast<int>(core::ClosestPointQuery::Backend::KdTree))
+            {
+                build_closest_point_query();
+            }
+
+            ImGui::DragFloat("Pick offset", &m_pick_offset, 0.01f, 0.0f, 10.0f);
+            ImGui::TextDisabled("Right click on the mesh to move the query point");
+            if (m_pick_time > 0)
+                ImGui::Text("Last pick %s, %" PRId64 "us", m_pick_found ? "hit" : "missed", m_pick_time);
+
             if (!m_animate_query_point && ImGui::Button("Animate query point"))
             {
                 m_animate_query_point = true;
@@ -251,10 +323,48 @@ void MainWindow::imgui_draw()
         {
             glm::vec3 readonly_pos = m_closest_point_pos;
             ImGui::DragFloat3("Position", glm::value_ptr(readonly_pos));
+
+            if (m_closest_point_found)
+            {
+                static const char* feature_names[] = { "vertex", "edge", "face" };
+                const core::ClosestPointResult& result = m_closest_point_result;
+
+                ImGui::Text("Distance %f", std::sqrt(result.distance2));
+                ImGui::Text("Triangle %u (%s)", result.triangle, feature_names[static_cast<int>(result.feature)]);
+                ImGui::Text("Barycentric %.3f %.3f %.3f", result.barycentric.x, result.barycentric.y, result.barycentric.z);
+                ImGui::Text("Normal %.3f %.3f %.3f", result.normal.x, result.normal.y, result.normal.z);
+            }
+
             ImGui::Text("Last query time %" PRId64 "ms", m_closest_point_query_time);
             ImGui::TreePop();
         }
 
+        if (ImGui::TreeNode("Memory"))
+        {
+            if (m_scene && m_scene->get_mesh_count() > 0)
+                imgui_draw_memory_usage("Mesh", m_scene->get_mesh(0).get_memory_usage());
+
+            if (m_mesh_point_cloud)
+                imgui_draw_memory_usage("Point cloud", m_mesh_point_cloud->get_memory_usage());
+
+            if (m_closest_point_query)
+                imgui_draw_memory_usage("Query index", m_closest_point_query->get_memory_usage());
+
+            ImGui::Separator();
+            ImGui::Text("Allocated (all objects):");
+
+            for (std::size_t i = 0; i < static_cast<std::size_t>(core::MemoryCategory::Count); ++i)
+            {
+                const core::MemoryCategory category = static_cast<core::MemoryCategory>(i);
+                ImGui::BulletText(
+                    "%s: %s",
+                    core::get_memory_category_name(category),
+                    core::format_memory_size(core::get_allocated_bytes(category)).c_str());
+            }
+
+            ImGui::TreePop();
+        }
+
         if (first_display) ImGui::SetNextTreeNodeOpen(true);
         if (ImGui::TreeNode("Camera"))
         {
@@ -280,6 +390,30 @@ void MainWindow::imgui_draw()
                 (long)(1000.0 / m_framerate));
 
             ImGui::Text("Mouse Position: (%.1f,%.1f)", ImGui::GetIO().MousePos.x, ImGui::GetIO().MousePos.y);
+
+            // Record a trace of load, build and query phases.
+            // Open the saved file in chrome://tracing.
+            bool record_trace = core::is_tracing_enabled();
+            ImGui::Checkbox("Record trace", &record_trace);
+            if (record_trace != core::is_tracing_enabled())
+                core::set_tracing_enabled(record_trace);
+
+            // The query workers record events too: wait for them.
+            if (ImGui::Button("Save trace"))
+            {
+                if (m_async_closest_point_query)
+                    m_async_closest_point_query->wait();
+                core::write_chrome_trace("trace.json");
+            }
+
+            ImGui::SameLine();
+            if (ImGui::Button("Clear trace"))
+            {
+                if (m_async_closest_point_query)
+                    m_async_closest_point_query->wait();
+                core::clear_trace();
+            }
+
             ImGui::TreePop();
         }
 
@@ -309,6 +443,7 @@ void MainWindow::imgui_draw_main_menu_bar()
             if (!file_path.empty())
                 load_scene(file_path);
         }
+        ImGui::MenuItem("Reorder triangles on load", "", &m_reorder_mesh_on_load);
         ImGui::EndMenu();
     }
 
@@ -360,22 +495,30 @@ void MainWindow::opengl_draw()
 void MainWindow::find_closest_point()
 {
     // Invalid search radius, don't run.
-    bool run = m_query_point_max_serach_radius > 0.0f;
-
-    // Start a timer to know how long it takes.
-    auto timer_start = std::chrono::high_resolution_clock::now();
-
-    // Run the query (multiple times if you want to see it's speed).
-    for (int i = 0; i < m_query_count; ++i)
+    const bool run = m_query_point_max_serach_radius > 0.0f;
+
+    // Start new queries once the previous ones are done:
+    // frames never wait for them and never queue them up.
+    if (run && !m_query_in_flight)
+        submit_closest_point_queries();
+
+    // Render the latest completed answer.
+    ClosestPointAnswer answer;
+    std::uint64_t answer_version;
+    if (m_closest_point_answer.read(answer, answer_version)
+        && answer_version != m_closest_point_answer_version)
     {
-        m_closest_point_found = run && m_closest_point_query->get_closest_point(
-            m_query_point_pos,
-            m_query_point_max_serach_radius,
-            m_closest_point_pos);
+        m_closest_point_answer_version = answer_version;
+        m_closest_point_found = answer.found;
+        m_closest_point_result = answer.result;
+        m_closest_point_query_time = answer.time;
+
+        if (m_closest_point_found)
+            m_closest_point_pos = m_closest_point_result.point;
     }
 
-    auto timer_stop = std::chrono::high_resolution_clock::now();
-    m_closest_point_query_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+    if (!run)
+        m_closest_point_found = false;
 
     // Push the points in a buffer ready to be rendered.
     std::vector<RasterizedPoints::Point> points;
@@ -394,6 +537,47 @@ void MainWindow::find_closest_point()
     m_scene_points.set_points(points);
 }
 
+void MainWindow::submit_closest_point_queries()
+{
+    // Run the query multiple times if you want to see it's speed.
+    const std::size_t count = static_cast<std::size_t>(std::max(m_query_count, 1));
+
+    // The buffers are not used by any query at this point.
+    if (m_async_query_points.size() != count)
+    {
+        m_async_query_points.resize(count);
+        m_async_results.resize(count);
+        m_async_found.reset(new bool[count]);
+    }
+
+    std::fill(m_async_query_points.begin(), m_async_query_points.end(), m_query_point_pos);
+
+    m_query_in_flight = true;
+
+    // Start a timer to know how long it takes.
+    const auto timer_start = std::chrono::high_resolution_clock::now();
+
+    // Called on a worker thread once the whole batch is done.
+    m_async_closest_point_query->get_closest_points(
+        m_async_query_points.data(),
+        count,
+        m_query_point_max_serach_radius,
+        m_async_results.data(),
+        m_async_found.get(),
+        [this, timer_start](const std::size_t)
+        {
+            const auto timer_stop = std::chrono::high_resolution_clock::now();
+
+            ClosestPointAnswer answer;
+            answer.found = m_async_found[0];
+            answer.result = m_async_results[0];
+            answer.time = std::chrono::duration_cast<std::chrono::milliseconds>(timer_stop - timer_start).count();
+
+            m_closest_point_answer.write(answer);
+            m_query_in_flight = false;
+        });
+}
+
 void MainWindow::animate_query_point()
 {
     // Rotate the query point arround the model.
@@ -409,6 +593,34 @@ void MainWindow::animate_query_point()
     m_query_point_pos += m_closest_point_pos;
 }
 
+void MainWindow::pick_query_point()
+{
+    if (!m_closest_point_query)
+        return;
+
+    double mouse_x, mouse_y;
+    int window_width, window_height;
+    glfwGetCursorPos(m_glfw_window, &mouse_x, &mouse_y);
+    glfwGetWindowSize(m_glfw_window, &window_width, &window_height);
+
+    if (window_width <= 0 || window_height <= 0)
+        return;
+
+    glm::vec3 origin, direction;
+    m_camera.get_ray(mouse_x, mouse_y, window_width, window_height, origin, direction);
+
+    auto timer_start = std::chrono::high_resolution_clock::now();
+
+    core::RayHit hit;
+    m_pick_found = m_closest_point_query->intersect_ray(origin, direction, 1000.0f, hit);
+
+    auto timer_stop = std::chrono::high_resolution_clock::now();
+    m_pick_time = std::chrono::duration_cast<std::chrono::microseconds>(timer_stop - timer_start).count();
+
+    if (m_pick_found)
+        m_query_point_pos = hit.point + hit.normal * m_pick_offset;
+}
+
 // GLFW Window callbacks.
 void MainWindow::glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -451,25 +663,7 @@ void MainWindow::glfw_char_callback(GLFWwindow* window, unsigned int c)
 
 void MainWindow::glfw_mouse_callback(GLFWwindow* window, double x, double y)
 {
-    // When true, the mouse interaction is disabled on the GLFW window.
-    // We do this to not interact with GLFW when we use imgui.
-    static bool ignore_glfw_mouse_events = false;
-
     MainWindow &gui = MainWindow::get_instance();
-
-    bool is_mouse_on_imgui = ImGui::IsAnyWindowHovered();
-
-    if (is_mouse_on_imgui && ignore_glfw_mouse_events)
-    {
-        glfwSetInputMode(gui.m_glfw_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-        ignore_glfw_mouse_events = false;
-    }
-    else if (!is_mouse_on_imgui && !ignore_glfw_mouse_events)
-    {
-        glfwSetInputMode(gui.m_glfw_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-        ignore_glfw_mouse_events = true;
-    }
-
     gui.m_camera.glfw_process_mouse_move(x, y, gui.m_frame_delta_time);
 }
 
@@ -478,9 +672,25 @@ void MainWindow::glfw_mouse_button_callback(GLFWwindow* window, int button, int
     MainWindow &gui = MainWindow::get_instance();
 
     ImGui_ImplGlfwGL3_MouseButtonCallback(gui.m_glfw_window, button, action, mods);
+
+    // The cursor is hidden only while the camera rotates,
+    // the rest of the time it is needed to pick the mesh.
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE)
+    {
+        glfwSetInputMode(gui.m_glfw_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        gui.m_camera.glfw_process_mouse_action(button, action, mods, gui.m_frame_delta_time);
+        return;
+    }
+
     if (ImGui::IsAnyWindowHovered())
         return;
 
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        glfwSetInputMode(gui.m_glfw_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
+        gui.pick_query_point();
+
     gui.m_camera.glfw_process_mouse_action(button, action, mods, gui.m_frame_delta_time);
 }
 
@@ -4,13 +4,20 @@
 #include "shader.h"
 #include "rasterized_points.h"
 
+// core includes.
+#include "core/double_buffer.h"
+#include "core/query_engine.h"
+
+#include <atomic>
 #include <cstdlib>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 // Forward declarations.
 class GLFWwindow;
+namespace core { class AsyncClosestPointQuery; }
 namespace core { class ClosestPointQuery; }
 namespace core { class MeshPointCloud; }
 namespace core { class Scene; }
@@ -57,6 +64,7 @@ class MainWindow
     int                                       m_screen_width;
     int                                       m_screen_height;
     bool                                      m_draw_wireframe;
+    bool                                      m_reorder_mesh_on_load; // sort triangles along a Morton curve
 
     // Time data.
     float                                     m_time_since_startup;
@@ -90,13 +98,42 @@ class MainWindow
     // - process time
     std::unique_ptr<core::MeshPointCloud>     m_mesh_point_cloud;     
     std::unique_ptr<core::ClosestPointQuery>  m_closest_point_query;  
+    int                                       m_query_backend; // core::ClosestPointQuery::Backend
+    bool                                      m_precompute_triangles;
+    int                                       m_bvh_build_method; // core::BvhBuildMethod
     glm::vec3                                 m_query_point_pos;      
     float                                     m_query_point_max_serach_radius; 
     glm::vec3                                 m_closest_point_pos; 
+    core::ClosestPointResult                  m_closest_point_result;
     std::int64_t                              m_closest_point_query_time; // milliseconds
     bool                                      m_closest_point_found;
     int                                       m_query_count; // call the algorithm multiple times to see its speed
 
+    // Queries run on worker threads, one batch of `m_query_count` at a time.
+    // Each frame renders the latest completed answer instead of waiting.
+    struct ClosestPointAnswer
+    {
+        bool                        found;
+        core::ClosestPointResult    result;
+        std::int64_t                time; // milliseconds, from submission to completion
+    };
+
+    core::DoubleBuffer<ClosestPointAnswer>          m_closest_point_answer;
+    std::uint64_t                                   m_closest_point_answer_version;
+    std::atomic<bool>                               m_query_in_flight;
+    std::vector<glm::vec3>                          m_async_query_points;  // owned by the running batch
+    std::vector<core::ClosestPointResult>           m_async_results;       // owned by the running batch
+    std::unique_ptr<bool[]>                         m_async_found;         // owned by the running batch
+
+    // Declared after the members the running batch uses (`m_closest_point_answer`,
+    // `m_query_in_flight`, `m_async_*`): it is destroyed before them, waiting for the batch.
+    std::unique_ptr<core::AsyncClosestPointQuery>   m_async_closest_point_query;
+
+    // Right click on the mesh moves the query point there, `m_pick_offset` along the normal.
+    float                                     m_pick_offset;
+    bool                                      m_pick_found;
+    std::int64_t                              m_pick_time; // microseconds
+
     // The application is able to move the query point.
     // I made this to quickly detect any incorrect behavior from the implementation.
     bool                                      m_animate_query_point;
@@ -110,8 +147,11 @@ class MainWindow
 
     void opengl_draw();
 
+    void build_closest_point_query();
     void find_closest_point();
+    void submit_closest_point_queries();
     void animate_query_point();
+    void pick_query_point();
 
     // GLFW Window callbacks.
     static void glfw_framebuffer_size_callback(GLFWwindow* window, int width, int height);
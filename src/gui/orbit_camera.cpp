@@ -71,6 +71,28 @@ glm::vec3 OrbitCamera::up() const
     return glm::cross(direction, right);
 }
 
+void OrbitCamera::get_ray(
+    const double    mouse_x,
+    const double    mouse_y,
+    const int       window_width,
+    const int       window_height,
+    glm::vec3&      origin,
+    glm::vec3&      direction) const
+{
+    // Pixel center in normalized device coordinates, y up.
+    const float ndc_x = 2.0f * (static_cast<float>(mouse_x) + 0.5f) / window_width - 1.0f;
+    const float ndc_y = 1.0f - 2.0f * (static_cast<float>(mouse_y) + 0.5f) / window_height;
+
+    // Unproject it on the near and far planes.
+    const glm::mat4 inverse_view_projection =
+        glm::inverse(projection(window_width, window_height) * view());
+    const glm::vec4 near_point = inverse_view_projection * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+    const glm::vec4 far_point = inverse_view_projection * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+
+    origin = glm::vec3(near_point) / near_point.w;
+    direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+}
+
 void OrbitCamera::glfw_process_mouse_move(double xpos, double ypos, float delta_time)
 {
     if (m_rotate_when_mouse_move)
@@ -30,6 +30,20 @@ class OrbitCamera
     glm::mat4 view() const;
     glm::vec3 up() const;
 
+    /**
+     * @brief World space ray going through a pixel of the window.
+     *
+     * The mouse position is in window coordinates, origin at the top left.
+     * The ray starts on the near plane, `direction` is normalized.
+     */
+    void get_ray(
+        const double    mouse_x,
+        const double    mouse_y,
+        const int       window_width,
+        const int       window_height,
+        glm::vec3&      origin,
+        glm::vec3&      direction) const;
+
     void glfw_process_mouse_move(double xpos, double ypos, float delta_time);
     void glfw_process_mouse_action(int button, int action, int mods, float delta_time);
     void glfw_process_scroll(double xoffset, double yoffset, float delta_time);
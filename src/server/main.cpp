@@ -0,0 +1,402 @@
+// server includes.
+#include "query_client.h"
+#include "query_server.h"
+#include "shared_memory_client.h"
+#include "shared_memory_server.h"
+
+// core includes.
+#include "core/closest_point_query.h"
+#include "core/cpu_dispatch.h"
+#include "core/mesh.h"
+#include "core/mesh_point_cloud.h"
+#include "core/query_engine.h"
+#include "core/scene_loader.h"
+
+#include <glm/glm.hpp>
+
+// Standard includes.
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Query server.
+//
+// Load a mesh once, build its closest point query object and serve
+// queries to local processes over a Unix domain socket, and optionally
+// through shared memory. With `--bench`, connect to a running server
+// instead and measure its throughput.
+//
+
+namespace
+{
+    struct Options
+    {
+        std::string         mesh_path = "resources/models/teapot.obj";
+        core::QueryBackend  backend = core::QueryBackend::Auto;
+        bool                reorder_spatially = false;
+        bool                precompute_triangles = false;
+        core::CpuIsa        isa = core::CpuIsa::Baseline;
+        bool                force_isa = false;  // use `isa` instead of the detected instruction set
+        server::QueryServerSettings settings;
+        server::SharedMemoryServerSettings shared_memory_settings;
+        bool                use_shared_memory = false;
+
+        // Benchmark client.
+        std::size_t         bench_query_count = 0;  // per client, 0 to serve
+        std::size_t         client_count = 1;
+        std::size_t         request_size = 64;
+        std::size_t         pipeline_depth = 4;
+        float               max_distance = 10.0f;
+    };
+
+    void print_usage()
+    {
+        std::cout
+            << "Usage: app.server [options] [mesh file]\n"
+            << "Options:\n"
+            << "  --socket PATH       Unix domain socket (default /tmp/closest_point.sock)\n"
+            << "  --backend NAME      Acceleration structure: kdtree, bvh8, bvh16, wide4, wide8, heightfield, convex or auto (default auto)\n"
+            << "  --reorder           Sort triangles and vertices along a Morton curve on load\n"
+            << "  --precompute        Store per-triangle terms of the closest point computation\n"
+            << "  --isa NAME          Force the kernels: baseline, sse4.2, avx2 or avx512 (default detected)\n"
+            << "  --batch N           Maximum number of queries run at once (default 4096)\n"
+            << "  --report S          Seconds between metrics reports, 0 to disable (default 5)\n"
+            << "  --shm NAME          Also serve one client through the shared memory NAME, e.g. /queries\n"
+            << "  --shm-capacity N    Query slots of the shared memory ring (default 131072)\n"
+            << "Benchmark a running server:\n"
+            << "  --bench N           Send N random queries per client, then print statistics\n"
+            << "  --clients N         Number of concurrent clients (default 1)\n"
+            << "  --request-size N    Queries per request (default 64)\n"
+            << "  --pipeline N        Requests in flight per client (default 4)\n"
+            << "  --shm NAME          Go through the shared memory NAME instead of the socket, 1 client\n"
+            << "  --radius R          Maximum search distance (default 10)\n"
+            << "  --help              Show this message\n";
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const bool has_value = i + 1 < argc;
+
+            if (std::strcmp(argv[i], "--socket") == 0 && has_value)
+                options.settings.socket_path = argv[++i];
+            else if (std::strcmp(argv[i], "--backend") == 0 && has_value)
+            {
+                if (!core::get_backend_from_name(argv[++i], options.backend))
+                    return false;
+            }
+            else if (std::strcmp(argv[i], "--reorder") == 0)
+                options.reorder_spatially = true;
+            else if (std::strcmp(argv[i], "--precompute") == 0)
+                options.precompute_triangles = true;
+            else if (std::strcmp(argv[i], "--isa") == 0 && has_value)
+            {
+                if (!core::get_cpu_isa_from_name(argv[++i], options.isa))
+                    return false;
+
+                options.force_isa = true;
+            }
+            else if (std::strcmp(argv[i], "--batch") == 0 && has_value)
+                options.settings.max_batch_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--report") == 0 && has_value)
+            {
+                options.settings.report_interval = std::strtod(argv[++i], nullptr);
+                options.shared_memory_settings.report_interval = options.settings.report_interval;
+            }
+            else if (std::strcmp(argv[i], "--shm") == 0 && has_value)
+            {
+                options.shared_memory_settings.name = argv[++i];
+                options.use_shared_memory = true;
+            }
+            else if (std::strcmp(argv[i], "--shm-capacity") == 0 && has_value)
+                options.shared_memory_settings.capacity = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--bench") == 0 && has_value)
+                options.bench_query_count = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--clients") == 0 && has_value)
+                options.client_count = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--request-size") == 0 && has_value)
+                options.request_size = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--pipeline") == 0 && has_value)
+                options.pipeline_depth = std::strtoul(argv[++i], nullptr, 10);
+            else if (std::strcmp(argv[i], "--radius") == 0 && has_value)
+                options.max_distance = std::strtof(argv[++i], nullptr);
+            else if (argv[i][0] != '-')
+                options.mesh_path = argv[i];
+            else
+                return false;
+        }
+
+        return options.settings.max_batch_size > 0
+            && options.client_count > 0
+            && options.request_size > 0
+            && options.request_size <= server::max_request_query_count
+            && options.pipeline_depth > 0
+            && options.max_distance > 0.0f
+            && options.shared_memory_settings.capacity > 0
+            && !(options.use_shared_memory && options.bench_query_count > 0 && options.client_count > 1);
+    }
+
+    server::QueryServer* running_server = nullptr;
+    server::SharedMemoryQueryServer* running_shared_memory_server = nullptr;
+
+    void stop_server(int)
+    {
+        if (running_server)
+            running_server->stop();
+
+        if (running_shared_memory_server)
+            running_shared_memory_server->stop();
+    }
+
+    int run_server(const Options& options)
+    {
+        if (options.force_isa)
+            core::force_cpu_isa(options.isa);
+
+        std::cout << "Kernels: " << core::get_cpu_isa_name(core::get_cpu_isa()) << "\n";
+
+        const std::vector<core::Mesh> meshes = core::load_meshes_from_file(options.mesh_path, options.reorder_spatially);
+
+        if (meshes.empty())
+        {
+            std::cerr << "No mesh in " << options.mesh_path << ".\n";
+            return 2;
+        }
+
+        const core::MeshPointCloud mesh_point_cloud(meshes[0]);
+        const core::ClosestPointQuery closest_point_query(
+            mesh_point_cloud,
+            options.backend,
+            options.precompute_triangles);
+
+        server::QueryServer query_server(closest_point_query, options.settings);
+
+        if (!query_server.listen())
+            return 3;
+
+        std::unique_ptr<server::SharedMemoryQueryServer> shared_memory_server;
+
+        if (options.use_shared_memory)
+        {
+            shared_memory_server.reset(new server::SharedMemoryQueryServer(closest_point_query, options.shared_memory_settings));
+
+            if (!shared_memory_server->create())
+                return 3;
+        }
+
+        running_server = &query_server;
+        running_shared_memory_server = shared_memory_server.get();
+        std::signal(SIGINT, stop_server);
+        std::signal(SIGTERM, stop_server);
+
+        // The shared memory channel is polled by its own thread.
+        std::thread shared_memory_thread;
+        if (shared_memory_server)
+            shared_memory_thread = std::thread(&server::SharedMemoryQueryServer::run, shared_memory_server.get());
+
+        query_server.run();
+
+        if (shared_memory_thread.joinable())
+        {
+            shared_memory_server->stop();
+            shared_memory_thread.join();
+        }
+
+        running_server = nullptr;
+        running_shared_memory_server = nullptr;
+        std::cout << "Server stopped.\n";
+        return 0;
+    }
+
+    struct BenchResult
+    {
+        bool                connected = false;
+        std::size_t         found_count = 0;
+        std::vector<double> latencies;      // per request, in seconds
+    };
+
+    /**
+     * @brief Send random queries, keeping `pipeline_depth` requests in flight.
+     */
+    void run_bench_client(const Options& options, const std::size_t client_index, BenchResult& result)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        server::QueryClient client;
+
+        if (!client.connect(options.settings.socket_path))
+            return;
+
+        result.connected = true;
+
+        // Random positions around the mesh (normalized in [-1, 1]).
+        std::mt19937 random_engine(static_cast<std::uint32_t>(42 + client_index));
+        std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+
+        std::vector<glm::vec3> query_points(options.request_size);
+        std::vector<server::QueryResult> results(options.request_size);
+        std::vector<Clock::time_point> send_times;
+
+        const std::size_t request_count = (options.bench_query_count + options.request_size - 1) / options.request_size;
+        std::size_t sent_count = 0;
+        std::size_t received_count = 0;
+
+        send_times.reserve(request_count);
+        result.latencies.reserve(request_count);
+
+        while (received_count < request_count)
+        {
+            while (sent_count < request_count && sent_count - received_count < options.pipeline_depth)
+            {
+                for (glm::vec3& query_point : query_points)
+                    query_point = glm::vec3(distribution(random_engine), distribution(random_engine), distribution(random_engine));
+
+                send_times.push_back(Clock::now());
+
+                if (!client.send_request(static_cast<std::uint32_t>(sent_count), query_points.data(), query_points.size(), options.max_distance))
+                    return;
+
+                ++sent_count;
+            }
+
+            server::ResponseHeader header;
+
+            if (!client.receive_response(header, results.data(), results.size())
+                || header.request_id != received_count)
+            {
+                std::cerr << "Client " << client_index << ": unexpected response.\n";
+                return;
+            }
+
+            result.latencies.push_back(std::chrono::duration<double>(Clock::now() - send_times[received_count]).count());
+            result.found_count += header.found_count;
+            ++received_count;
+        }
+    }
+
+    /**
+     * @brief Send random queries through shared memory, `request_size` per tick.
+     */
+    void run_shared_memory_bench_client(const Options& options, BenchResult& result)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        server::SharedMemoryClient client;
+
+        if (!client.connect(options.shared_memory_settings.name))
+            return;
+
+        result.connected = true;
+
+        std::mt19937 random_engine(42);
+        std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+
+        std::vector<glm::vec3> query_points(options.request_size);
+        std::vector<core::ClosestPointResult> results(options.request_size);
+        std::unique_ptr<bool[]> found(new bool[options.request_size]);
+
+        const std::size_t tick_count = (options.bench_query_count + options.request_size - 1) / options.request_size;
+        result.latencies.reserve(tick_count);
+
+        for (std::size_t tick = 0; tick < tick_count; ++tick)
+        {
+            for (glm::vec3& query_point : query_points)
+                query_point = glm::vec3(distribution(random_engine), distribution(random_engine), distribution(random_engine));
+
+            const Clock::time_point start = Clock::now();
+
+            if (!client.get_closest_points(query_points.data(), query_points.size(), options.max_distance, results.data(), found.get()))
+            {
+                std::cerr << "The server stopped.\n";
+                return;
+            }
+
+            result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            result.found_count += std::count(found.get(), found.get() + options.request_size, true);
+        }
+    }
+
+    int run_bench(const Options& options)
+    {
+        std::vector<BenchResult> results(options.client_count);
+        std::vector<std::thread> threads;
+
+        auto timer_start = std::chrono::high_resolution_clock::now();
+
+        if (options.use_shared_memory)
+            threads.emplace_back(run_shared_memory_bench_client, std::cref(options), std::ref(results[0]));
+        else
+        {
+            for (std::size_t i = 0; i < options.client_count; ++i)
+                threads.emplace_back(run_bench_client, std::cref(options), i, std::ref(results[i]));
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        auto timer_stop = std::chrono::high_resolution_clock::now();
+        const double duration = std::chrono::duration<double>(timer_stop - timer_start).count();
+
+        std::vector<double> latencies;
+        std::size_t query_count = 0;
+        std::size_t found_count = 0;
+
+        for (const BenchResult& result : results)
+        {
+            if (!result.connected)
+                return 3;
+
+            latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+            query_count += result.latencies.size() * options.request_size;
+            found_count += result.found_count;
+        }
+
+        if (latencies.empty())
+            return 4;
+
+        std::sort(latencies.begin(), latencies.end());
+
+        double latency_sum = 0.0;
+        for (const double latency : latencies)
+            latency_sum += latency;
+
+        std::cout << "Ran " << query_count << " queries from " << options.client_count << " clients in " << (duration * 1000.0) << "ms.\n";
+        std::cout << "\tThroughput: " << (query_count / duration) << " queries/s\n";
+        std::cout << "\tFound: " << found_count << "/" << query_count << "\n";
+        std::cout << "\tRequest latency: " << (latency_sum / latencies.size() * 1000.0) << "ms average, "
+            << (latencies[latencies.size() / 2] * 1000.0) << "ms median, "
+            << (latencies[latencies.size() * 99 / 100] * 1000.0) << "ms 99th percentile\n";
+
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage();
+        return 1;
+    }
+
+    // A closed connection must not kill the process.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (options.bench_query_count > 0)
+        return run_bench(options);
+
+    return run_server(options);
+}
@@ -0,0 +1,153 @@
+#include "query_client.h"
+
+// POSIX includes.
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Standard includes.
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace server
+{
+
+QueryClient::QueryClient()
+  : m_socket(-1)
+{
+}
+
+QueryClient::~QueryClient()
+{
+    disconnect();
+}
+
+bool QueryClient::connect(const std::string& socket_path)
+{
+    disconnect();
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << socket_path << "\n";
+        return false;
+    }
+
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (m_socket == -1
+        || ::connect(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        std::cerr << "Unable to connect to " << socket_path << ": " << std::strerror(errno) << "\n";
+        disconnect();
+        return false;
+    }
+
+    return true;
+}
+
+void QueryClient::disconnect()
+{
+    if (m_socket != -1)
+    {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+bool QueryClient::is_connected() const
+{
+    return m_socket != -1;
+}
+
+bool QueryClient::send_request(
+    const std::uint32_t request_id,
+    const glm::vec3*    query_points,
+    const std::size_t   count,
+    const float         max_distance)
+{
+    if (count > max_request_query_count)
+        return false;
+
+    RequestHeader header;
+    header.magic = request_magic;
+    header.request_id = request_id;
+    header.count = static_cast<std::uint32_t>(count);
+    header.max_distance = max_distance;
+
+    // One write per request.
+    m_send_buffer.resize(sizeof(RequestHeader) + count * sizeof(QueryPoint));
+    std::memcpy(m_send_buffer.data(), &header, sizeof(header));
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const QueryPoint point = { { query_points[i].x, query_points[i].y, query_points[i].z } };
+        std::memcpy(m_send_buffer.data() + sizeof(RequestHeader) + i * sizeof(QueryPoint), &point, sizeof(point));
+    }
+
+    return send_all(m_send_buffer.data(), m_send_buffer.size());
+}
+
+bool QueryClient::receive_response(
+    ResponseHeader&     header,
+    QueryResult*        results,
+    const std::size_t   capacity)
+{
+    if (!receive_all(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    if (header.magic != response_magic || header.count > capacity)
+    {
+        std::cerr << "Invalid response from the server.\n";
+        disconnect();
+        return false;
+    }
+
+    return receive_all(reinterpret_cast<char*>(results), header.count * sizeof(QueryResult));
+}
+
+bool QueryClient::send_all(const char* data, const std::size_t size)
+{
+    std::size_t sent = 0;
+
+    while (m_socket != -1 && sent < size)
+    {
+        const ssize_t result = send(m_socket, data + sent, size - sent, 0);
+
+        if (result > 0)
+            sent += static_cast<std::size_t>(result);
+        else if (result == -1 && errno == EINTR)
+            continue;
+        else
+            disconnect();
+    }
+
+    return sent == size;
+}
+
+bool QueryClient::receive_all(char* data, const std::size_t size)
+{
+    std::size_t received = 0;
+
+    while (m_socket != -1 && received < size)
+    {
+        const ssize_t result = recv(m_socket, data + received, size - received, 0);
+
+        if (result > 0)
+            received += static_cast<std::size_t>(result);
+        else if (result == -1 && errno == EINTR)
+            continue;
+        else
+            disconnect();
+    }
+
+    return received == size;
+}
+
+} // namespace server
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "query_protocol.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace server
+{
+
+/**
+ * @brief Blocking connection to a query server.
+ *
+ * Requests can be pipelined: send several before receiving their
+ * responses, which come back in the same order. Keep the number of
+ * requests in flight bounded, the server stops reading a client whose
+ * responses are not read.
+ */
+class QueryClient
+{
+  public:
+    QueryClient();
+
+    ~QueryClient();
+
+    QueryClient(const QueryClient&) = delete;
+    QueryClient& operator=(const QueryClient&) = delete;
+
+    /**
+     * @brief Connect to the server. Return false if it failed, with the reason on stderr.
+     */
+    bool connect(const std::string& socket_path);
+
+    void disconnect();
+
+    bool is_connected() const;
+
+    /**
+     * @brief Send a request without waiting for its response. Return false if the connection failed.
+     */
+    bool send_request(
+        const std::uint32_t request_id,
+        const glm::vec3*    query_points,
+        const std::size_t   count,
+        const float         max_distance);
+
+    /**
+     * @brief Wait for the next response. `results` must hold the count of its request.
+     *
+     * Return false if the connection failed or the response is invalid.
+     */
+    bool receive_response(
+        ResponseHeader&     header,
+        QueryResult*        results,
+        const std::size_t   capacity);
+
+  private:
+    int                 m_socket;
+    std::vector<char>   m_send_buffer;
+
+    bool send_all(const char* data, const std::size_t size);
+    bool receive_all(char* data, const std::size_t size);
+};
+
+} // namespace server
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+namespace server
+{
+
+//
+// Binary protocol of the query server.
+//
+// Clients and server run on the same machine: values are sent in the
+// native byte order and layout, without any encoding. A client can send
+// any number of requests without waiting for their responses (pipelining);
+// the responses of a connection come back in request order. A client can
+// shut down its sending side once done: its complete requests are still
+// answered before the connection is closed.
+//
+// Request:  RequestHeader, then `count` QueryPoint.
+// Response: ResponseHeader, then `count` QueryResult.
+//
+
+const std::uint32_t request_magic = 0x31515043;     // "CPQ1"
+const std::uint32_t response_magic = 0x31525043;    // "CPR1"
+
+// Larger requests are rejected and their connection is closed.
+const std::uint32_t max_request_query_count = 1 << 16;
+
+struct RequestHeader
+{
+    std::uint32_t   magic;
+    std::uint32_t   request_id;     // chosen by the client, sent back in the response
+    std::uint32_t   count;          // number of query points
+    float           max_distance;   // positive, else the request is rejected
+};
+
+struct QueryPoint
+{
+    float           position[3];
+};
+
+struct ResponseHeader
+{
+    std::uint32_t   magic;
+    std::uint32_t   request_id;
+    std::uint32_t   count;
+    std::uint32_t   found_count;
+};
+
+struct QueryResult
+{
+    float           point[3];
+    float           distance2;      // squared distance to the query point
+    std::uint32_t   triangle;
+    std::uint32_t   found;          // 0 or 1, the other fields are undefined when 0
+};
+
+static_assert(sizeof(RequestHeader) == 16, "Unexpected request header padding");
+static_assert(sizeof(QueryPoint) == 12, "Unexpected query point padding");
+static_assert(sizeof(ResponseHeader) == 16, "Unexpected response header padding");
+static_assert(sizeof(QueryResult) == 24, "Unexpected query result padding");
+
+} // namespace server
@@ -0,0 +1,546 @@
+#include "query_server.h"
+
+// core includes.
+#include "core/closest_point_query.h"
+#include "core/memory.h"
+#include "core/trace.h"
+
+// POSIX includes.
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Standard includes.
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <iostream>
+
+namespace server
+{
+
+namespace
+{
+
+// Clients are not read anymore while this much is waiting to be parsed or sent.
+const std::size_t max_buffered_bytes = 16 * 1024 * 1024;
+
+const int poll_timeout_ms = 100;
+
+bool set_non_blocking(const int socket)
+{
+    const int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+double get_seconds(const std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+} // namespace
+
+QueryServer::QueryServer(
+    const core::ClosestPointQuery&  query,
+    const QueryServerSettings&      settings)
+  : m_settings(settings)
+  , m_async_query(query)
+  , m_listen_socket(-1)
+  , m_stopping(false)
+  , m_next_client_id(1)
+  , m_batch_capacity(0)
+{
+}
+
+QueryServer::~QueryServer()
+{
+    for (const std::unique_ptr<Client>& client : m_clients)
+        close(client->socket);
+
+    if (m_listen_socket != -1)
+    {
+        close(m_listen_socket);
+        unlink(m_settings.socket_path.c_str());
+    }
+}
+
+bool QueryServer::listen()
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (m_settings.socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << m_settings.socket_path << "\n";
+        return false;
+    }
+
+    std::strcpy(address.sun_path, m_settings.socket_path.c_str());
+
+    m_listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (m_listen_socket == -1)
+    {
+        std::cerr << "Unable to create a socket: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    // Remove the socket file left by a previous server.
+    unlink(m_settings.socket_path.c_str());
+
+    if (bind(m_listen_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1
+        || ::listen(m_listen_socket, SOMAXCONN) == -1
+        || !set_non_blocking(m_listen_socket))
+    {
+        std::cerr << "Unable to listen on " << m_settings.socket_path << ": " << std::strerror(errno) << "\n";
+        close(m_listen_socket);
+        m_listen_socket = -1;
+        return false;
+    }
+
+    std::cout << "Listening on " << m_settings.socket_path << ".\n";
+    return true;
+}
+
+void QueryServer::run()
+{
+    std::vector<pollfd> poll_fds;
+    m_last_report_time = Clock::now();
+
+    while (!m_stopping)
+    {
+        // Poll the listening socket first, then one entry per client.
+        poll_fds.clear();
+        poll_fds.push_back({ m_listen_socket, POLLIN, 0 });
+
+        bool has_pending_requests = false;
+
+        for (const std::unique_ptr<Client>& client : m_clients)
+        {
+            const std::size_t buffered_bytes =
+                (client->input.size() - client->input_offset) + (client->output.size() - client->output_offset);
+
+            short events = 0;
+
+            // Stop reading clients that send faster than they read, or that won't send anymore.
+            if (buffered_bytes < max_buffered_bytes && !client->end_of_input)
+                events |= POLLIN;
+
+            if (client->output_offset < client->output.size())
+                events |= POLLOUT;
+
+            poll_fds.push_back({ client->socket, events, 0 });
+
+            has_pending_requests = has_pending_requests || has_complete_request(*client);
+        }
+
+        // Don't wait when requests are already received.
+        const int ready_count = poll(
+            poll_fds.data(),
+            static_cast<nfds_t>(poll_fds.size()),
+            has_pending_requests ? 0 : poll_timeout_ms);
+
+        if (ready_count == -1 && errno != EINTR)
+        {
+            std::cerr << "Unable to poll the sockets: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        if (ready_count > 0)
+        {
+            // New clients are polled from the next iteration.
+            const std::size_t client_count = m_clients.size();
+
+            for (std::size_t i = 0; i < client_count; ++i)
+            {
+                Client& client = *m_clients[i];
+                const short events = poll_fds[i + 1].revents;
+
+                if (events & POLLERR)
+                {
+                    client.closed = true;
+                    continue;
+                }
+
+                if (events & POLLOUT)
+                    write_client(client);
+
+                // Half-closed clients are kept until their requests are answered.
+                if ((events & (POLLIN | POLLHUP)) && !client.end_of_input)
+                    read_client(client);
+            }
+
+            if (poll_fds[0].revents & POLLIN)
+                accept_clients();
+        }
+
+        run_batch();
+
+        // Send the responses right away, most fit in the socket buffer.
+        for (const std::unique_ptr<Client>& client : m_clients)
+            write_client(*client);
+
+        remove_closed_clients();
+
+        // Periodic report of the active clients.
+        const Clock::time_point now = Clock::now();
+
+        if (m_settings.report_interval > 0.0
+            && get_seconds(now - m_last_report_time) >= m_settings.report_interval)
+        {
+            m_last_report_time = now;
+
+            for (const std::unique_ptr<Client>& client : m_clients)
+            {
+                if (client->metrics.request_count == client->reported_request_count)
+                    continue;
+
+                client->reported_request_count = client->metrics.request_count;
+                report_metrics(*client, "active");
+            }
+        }
+    }
+}
+
+void QueryServer::stop()
+{
+    m_stopping = true;
+}
+
+void QueryServer::accept_clients()
+{
+    while (true)
+    {
+        const int socket = accept(m_listen_socket, nullptr, nullptr);
+
+        if (socket == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                std::cerr << "Unable to accept a client: " << std::strerror(errno) << "\n";
+            return;
+        }
+
+        if (!set_non_blocking(socket))
+        {
+            std::cerr << "Unable to configure a client socket: " << std::strerror(errno) << "\n";
+            close(socket);
+            continue;
+        }
+
+        std::unique_ptr<Client> client(new Client());
+        client->socket = socket;
+        client->id = m_next_client_id++;
+        client->connection_time = Clock::now();
+
+        std::cout << "Client " << client->id << " connected.\n";
+        m_clients.push_back(std::move(client));
+    }
+}
+
+void QueryServer::read_client(Client& client)
+{
+    // Drop the parsed bytes once they are the larger part of the buffer.
+    if (client.input_offset > 0 && client.input_offset * 2 >= client.input.size())
+    {
+        client.input.erase(client.input.begin(), client.input.begin() + client.input_offset);
+        client.complete_offset -= client.input_offset;
+        client.input_offset = 0;
+    }
+
+    char buffer[64 * 1024];
+
+    while (!client.closed)
+    {
+        const ssize_t size = recv(client.socket, buffer, sizeof(buffer), 0);
+
+        if (size > 0)
+        {
+            client.input.insert(client.input.end(), buffer, buffer + size);
+            client.metrics.bytes_received += static_cast<std::size_t>(size);
+            find_complete_requests(client, Clock::now());
+
+            if (client.input.size() - client.input_offset >= max_buffered_bytes)
+                return;
+        }
+        else if (size == 0)
+        {
+            client.end_of_input = true;
+            return;
+        }
+        else if (errno == EINTR)
+            continue;
+        else
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                client.closed = true;
+            return;
+        }
+    }
+}
+
+void QueryServer::find_complete_requests(Client& client, const Clock::time_point receive_time) const
+{
+    while (!client.closed && client.input.size() - client.complete_offset >= sizeof(RequestHeader))
+    {
+        RequestHeader header;
+        std::memcpy(&header, client.input.data() + client.complete_offset, sizeof(header));
+
+        // NaN fails the comparison too.
+        if (header.magic != request_magic
+            || header.count > max_request_query_count
+            || !(header.max_distance > 0.0f))
+        {
+            std::cerr << "Invalid request from client " << client.id << ", closing the connection.\n";
+            client.closed = true;
+            return;
+        }
+
+        const std::size_t request_size = sizeof(RequestHeader) + header.count * sizeof(QueryPoint);
+
+        if (client.input.size() - client.complete_offset < request_size)
+            return;
+
+        client.complete_offset += request_size;
+        client.request_times.push_back(receive_time);
+    }
+}
+
+void QueryServer::write_client(Client& client)
+{
+    while (!client.closed && client.output_offset < client.output.size())
+    {
+        const ssize_t size = send(
+            client.socket,
+            client.output.data() + client.output_offset,
+            client.output.size() - client.output_offset,
+            0);
+
+        if (size >= 0)
+        {
+            client.output_offset += static_cast<std::size_t>(size);
+            client.metrics.bytes_sent += static_cast<std::size_t>(size);
+        }
+        else if (errno == EINTR)
+            continue;
+        else
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                client.closed = true;
+            break;
+        }
+    }
+
+    // Latency of the fully sent responses.
+    const Clock::time_point now = Clock::now();
+
+    while (!client.pending_responses.empty()
+        && client.pending_responses.front().end_offset <= client.output_offset)
+    {
+        const double latency = get_seconds(now - client.pending_responses.front().received_time);
+        client.metrics.total_latency += latency;
+        client.metrics.max_latency = std::max(client.metrics.max_latency, latency);
+        client.pending_responses.pop_front();
+    }
+
+    // Offsets of the pending responses stay valid: the buffer is only reset once all is sent.
+    if (client.output_offset == client.output.size())
+    {
+        client.output.clear();
+        client.output_offset = 0;
+    }
+}
+
+bool QueryServer::has_complete_request(const Client& client) const
+{
+    return !client.closed && !client.request_times.empty();
+}
+
+bool QueryServer::is_finished(const Client& client) const
+{
+    return client.end_of_input
+        && !has_complete_request(client)
+        && client.output_offset == client.output.size();
+}
+
+void QueryServer::run_batch()
+{
+    CORE_TRACE_SCOPE("server batch");
+
+    m_batch_requests.clear();
+    m_batch_points.clear();
+
+    // Take the requests of all the clients in turn, so that none is starved.
+    bool parsed_request = true;
+
+    while (parsed_request && m_batch_points.size() < m_settings.max_batch_size)
+    {
+        parsed_request = false;
+
+        for (const std::unique_ptr<Client>& client_ptr : m_clients)
+        {
+            Client& client = *client_ptr;
+
+            if (!has_complete_request(client))
+                continue;
+
+            // Complete requests are valid.
+            RequestHeader header;
+            std::memcpy(&header, client.input.data() + client.input_offset, sizeof(header));
+
+            // A request is never split, a batch can get larger than the maximum by one request.
+            if (!m_batch_requests.empty() && m_batch_points.size() + header.count > m_settings.max_batch_size)
+                continue;
+
+            const char* points = client.input.data() + client.input_offset + sizeof(RequestHeader);
+
+            BatchRequest request;
+            request.client = &client;
+            request.request_id = header.request_id;
+            request.max_distance = header.max_distance;
+            request.first = m_batch_points.size();
+            request.count = header.count;
+            request.received_time = client.request_times.front();
+            m_batch_requests.push_back(request);
+            client.request_times.pop_front();
+
+            for (std::uint32_t i = 0; i < header.count; ++i)
+            {
+                QueryPoint point;
+                std::memcpy(&point, points + i * sizeof(QueryPoint), sizeof(point));
+                m_batch_points.emplace_back(point.position[0], point.position[1], point.position[2]);
+            }
+
+            client.input_offset += sizeof(RequestHeader) + header.count * sizeof(QueryPoint);
+            client.metrics.request_count += 1;
+            client.metrics.query_count += header.count;
+            parsed_request = true;
+        }
+    }
+
+    if (m_batch_requests.empty())
+        return;
+
+    const std::size_t batch_size = m_batch_points.size();
+
+    if (batch_size > m_batch_capacity)
+    {
+        m_batch_capacity = batch_size;
+        m_batch_results.resize(batch_size);
+        m_batch_found.reset(new bool[batch_size]);
+    }
+
+    // Consecutive requests with the same search distance run as one batch on the workers.
+    std::vector<std::future<std::size_t>> futures;
+
+    for (std::size_t first = 0; first < m_batch_requests.size();)
+    {
+        std::size_t last = first + 1;
+
+        while (last < m_batch_requests.size()
+            && m_batch_requests[last].max_distance == m_batch_requests[first].max_distance)
+        {
+            ++last;
+        }
+
+        const std::size_t point_first = m_batch_requests[first].first;
+        const std::size_t point_count =
+            m_batch_requests[last - 1].first + m_batch_requests[last - 1].count - point_first;
+
+        futures.push_back(m_async_query.get_closest_points(
+            m_batch_points.data() + point_first,
+            point_count,
+            m_batch_requests[first].max_distance,
+            m_batch_results.data() + point_first,
+            m_batch_found.get() + point_first));
+
+        first = last;
+    }
+
+    for (std::future<std::size_t>& future : futures)
+        future.wait();
+
+    // Queue the responses, in request order for each client.
+    for (const BatchRequest& request : m_batch_requests)
+    {
+        Client& client = *request.client;
+
+        ResponseHeader header;
+        header.magic = response_magic;
+        header.request_id = request.request_id;
+        header.count = static_cast<std::uint32_t>(request.count);
+        header.found_count = 0;
+
+        const std::size_t header_offset = client.output.size();
+        client.output.resize(header_offset + sizeof(ResponseHeader) + request.count * sizeof(QueryResult));
+
+        char* results = client.output.data() + header_offset + sizeof(ResponseHeader);
+
+        for (std::size_t i = 0; i < request.count; ++i)
+        {
+            const std::size_t index = request.first + i;
+            const core::ClosestPointResult& closest_point = m_batch_results[index];
+
+            QueryResult result;
+            std::memset(&result, 0, sizeof(result));
+
+            if (m_batch_found[index])
+            {
+                result.point[0] = closest_point.point.x;
+                result.point[1] = closest_point.point.y;
+                result.point[2] = closest_point.point.z;
+                result.distance2 = closest_point.distance2;
+                result.triangle = closest_point.triangle;
+                result.found = 1;
+                ++header.found_count;
+            }
+
+            std::memcpy(results + i * sizeof(QueryResult), &result, sizeof(result));
+        }
+
+        std::memcpy(client.output.data() + header_offset, &header, sizeof(header));
+        client.pending_responses.push_back({ client.output.size(), request.received_time });
+    }
+}
+
+void QueryServer::remove_closed_clients()
+{
+    for (std::unique_ptr<Client>& client : m_clients)
+    {
+        // An incomplete request left by a half-closed client is dropped.
+        if (!client->closed && !is_finished(*client))
+            continue;
+
+        report_metrics(*client, "disconnected");
+        close(client->socket);
+        client.reset();
+    }
+
+    m_clients.erase(
+        std::remove(m_clients.begin(), m_clients.end(), nullptr),
+        m_clients.end());
+}
+
+void QueryServer::report_metrics(const Client& client, const char* event) const
+{
+    const ClientMetrics& metrics = client.metrics;
+    const double duration = get_seconds(Clock::now() - client.connection_time);
+
+    // Only the responses fully sent have a latency.
+    const std::size_t answered_count = metrics.request_count - client.pending_responses.size();
+
+    std::cout << "Client " << client.id << " " << event << " after " << duration << "s.\n";
+    std::cout << "\tRequests: " << metrics.request_count
+        << ", queries: " << metrics.query_count
+        << " (" << (duration > 0.0 ? metrics.query_count / duration : 0.0) << " queries/s)\n";
+    std::cout << "\tLatency: "
+        << (answered_count > 0 ? metrics.total_latency / answered_count * 1000.0 : 0.0) << "ms average, "
+        << metrics.max_latency * 1000.0 << "ms maximum\n";
+    std::cout << "\tReceived: " << core::format_memory_size(metrics.bytes_received)
+        << ", sent: " << core::format_memory_size(metrics.bytes_sent) << "\n";
+}
+
+} // namespace server
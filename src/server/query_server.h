@@ -0,0 +1,168 @@
+#pragma once
+
+#include "query_protocol.h"
+
+// core includes.
+#include "core/async_query.h"
+#include "core/query_engine.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace core { class ClosestPointQuery; }
+
+namespace server
+{
+
+struct QueryServerSettings
+{
+    std::string     socket_path = "/tmp/closest_point.sock";
+
+    // Queries of all the clients run together, up to this many at once.
+    std::size_t     max_batch_size = 4096;
+
+    // Seconds between two metrics reports, 0 to only report on disconnection.
+    double          report_interval = 5.0;
+};
+
+/**
+ * @brief Traffic of one client since it connected.
+ */
+struct ClientMetrics
+{
+    std::size_t     request_count = 0;
+    std::size_t     query_count = 0;
+    std::size_t     bytes_received = 0;
+    std::size_t     bytes_sent = 0;
+
+    // From the end of a request reception to the end of its response sending, in seconds.
+    double          total_latency = 0.0;
+    double          max_latency = 0.0;
+};
+
+/**
+ * @brief Serve closest point queries over a Unix domain socket.
+ *
+ * One thread runs the event loop: it reads the requests of all the
+ * clients, coalesces them into batches that run on the worker pool of an
+ * `AsyncClosestPointQuery`, and streams the responses back. Clients don't
+ * need to wait for a response before sending the next request.
+ */
+class QueryServer
+{
+  public:
+    QueryServer(
+        const core::ClosestPointQuery&  query,
+        const QueryServerSettings&      settings);
+
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    /**
+     * @brief Create the socket. Return false if it failed, with the reason on stderr.
+     */
+    bool listen();
+
+    /**
+     * @brief Serve the clients until `stop` is called.
+     */
+    void run();
+
+    /**
+     * @brief Make `run` return. Can be called from any thread, or a signal handler.
+     */
+    void stop();
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct PendingResponse
+    {
+        std::size_t         end_offset;     // in the output buffer
+        Clock::time_point   received_time;
+    };
+
+    struct Client
+    {
+        int                             socket;
+        std::size_t                     id;
+        Clock::time_point               connection_time;
+        bool                            closed = false;        // to be discarded
+        bool                            end_of_input = false;  // the client shut down its sending side
+
+        std::vector<char>               input;
+        std::size_t                     input_offset = 0;      // parsed bytes
+        std::size_t                     complete_offset = 0;   // end of the received complete requests
+        std::deque<Clock::time_point>   request_times;         // reception of the complete requests not parsed yet
+
+        std::vector<char>               output;
+        std::size_t                     output_offset = 0; // sent bytes
+        std::deque<PendingResponse>     pending_responses;
+
+        ClientMetrics                   metrics;
+        std::size_t                     reported_request_count = 0;
+    };
+
+    // A request of the current batch.
+    struct BatchRequest
+    {
+        Client*             client;
+        std::uint32_t       request_id;
+        float               max_distance;
+        std::size_t         first;          // in the batch arrays
+        std::size_t         count;
+        Clock::time_point   received_time;
+    };
+
+    const QueryServerSettings               m_settings;
+    core::AsyncClosestPointQuery            m_async_query;
+    int                                     m_listen_socket;
+    std::atomic<bool>                       m_stopping;
+    std::size_t                             m_next_client_id;
+    std::vector<std::unique_ptr<Client>>    m_clients;
+    Clock::time_point                       m_last_report_time;
+
+    std::vector<BatchRequest>               m_batch_requests;
+    std::vector<glm::vec3>                  m_batch_points;
+    std::vector<core::ClosestPointResult>   m_batch_results;
+    std::unique_ptr<bool[]>                 m_batch_found;
+    std::size_t                             m_batch_capacity;
+
+    void accept_clients();
+    void read_client(Client& client);
+
+    /**
+     * @brief Record the reception time of the requests completed by the last received bytes.
+     *
+     * Invalid requests close the connection.
+     */
+    void find_complete_requests(Client& client, const Clock::time_point receive_time) const;
+
+    void write_client(Client& client);
+    bool has_complete_request(const Client& client) const;
+
+    /**
+     * @brief True once the client stopped sending and all its complete requests are answered and sent.
+     */
+    bool is_finished(const Client& client) const;
+
+    /**
+     * @brief Gather the received requests of all the clients, run them and queue the responses.
+     */
+    void run_batch();
+
+    void remove_closed_clients();
+    void report_metrics(const Client& client, const char* event) const;
+};
+
+} // namespace server
@@ -0,0 +1,238 @@
+#include "shared_memory_channel.h"
+
+// POSIX includes.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Standard includes.
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+namespace server
+{
+
+namespace
+{
+
+std::size_t align_to_cache_line(const std::size_t size)
+{
+    return (size + 63) & ~std::size_t(63);
+}
+
+// Offsets of the slot arrays in the region.
+struct ChannelLayout
+{
+    std::size_t     query_points;
+    std::size_t     max_distances;
+    std::size_t     results;
+    std::size_t     found;
+    std::size_t     size;
+};
+
+ChannelLayout get_channel_layout(const std::size_t capacity)
+{
+    ChannelLayout layout;
+    layout.query_points = align_to_cache_line(sizeof(SharedMemoryHeader));
+    layout.max_distances = layout.query_points + align_to_cache_line(capacity * sizeof(glm::vec3));
+    layout.results = layout.max_distances + align_to_cache_line(capacity * sizeof(float));
+    layout.found = layout.results + align_to_cache_line(capacity * sizeof(core::ClosestPointResult));
+    layout.size = layout.found + align_to_cache_line(capacity * sizeof(bool));
+    return layout;
+}
+
+} // namespace
+
+SharedMemoryChannel::SharedMemoryChannel()
+  : m_owner(false)
+  , m_data(nullptr)
+  , m_size(0)
+  , m_capacity(0)
+{
+}
+
+SharedMemoryChannel::~SharedMemoryChannel()
+{
+    close();
+}
+
+bool SharedMemoryChannel::create(const std::string& name, const std::size_t capacity)
+{
+    close();
+
+    std::size_t rounded_capacity = 1;
+    while (rounded_capacity < capacity)
+        rounded_capacity *= 2;
+
+    const ChannelLayout layout = get_channel_layout(rounded_capacity);
+
+    // Remove the region left by a previous server.
+    shm_unlink(name.c_str());
+
+    const int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    if (file == -1 || ftruncate(file, static_cast<off_t>(layout.size)) == -1)
+    {
+        std::cerr << "Unable to create the shared memory " << name << ": " << std::strerror(errno) << "\n";
+
+        if (file != -1)
+        {
+            ::close(file);
+            shm_unlink(name.c_str());
+        }
+
+        return false;
+    }
+
+    void* data = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    ::close(file);
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Unable to map the shared memory " << name << ": " << std::strerror(errno) << "\n";
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    m_name = name;
+    m_owner = true;
+    m_data = static_cast<char*>(data);
+    m_size = layout.size;
+    m_capacity = rounded_capacity;
+
+    // The region is zero-filled.
+    SharedMemoryHeader* header = new (m_data) SharedMemoryHeader();
+    header->capacity = static_cast<std::uint32_t>(rounded_capacity);
+    header->query_size = sizeof(glm::vec3);
+    header->result_size = sizeof(core::ClosestPointResult);
+    header->submitted = 0;
+    header->completed = 0;
+    header->consumed = 0;
+    header->client_attached = 0;
+    header->server_running = 0;
+    header->magic.store(shared_memory_magic, std::memory_order_release);
+
+    return true;
+}
+
+bool SharedMemoryChannel::open(const std::string& name)
+{
+    close();
+
+    const int file = shm_open(name.c_str(), O_RDWR, 0600);
+
+    if (file == -1)
+    {
+        std::cerr << "Unable to open the shared memory " << name << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    // Map the header first to get the capacity.
+    void* data = mmap(nullptr, sizeof(SharedMemoryHeader), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Unable to map the shared memory " << name << ": " << std::strerror(errno) << "\n";
+        ::close(file);
+        return false;
+    }
+
+    const SharedMemoryHeader* header = static_cast<const SharedMemoryHeader*>(data);
+    const bool valid =
+        header->magic.load(std::memory_order_acquire) == shared_memory_magic
+        && header->query_size == sizeof(glm::vec3)
+        && header->result_size == sizeof(core::ClosestPointResult);
+    const std::size_t capacity = header->capacity;
+
+    munmap(data, sizeof(SharedMemoryHeader));
+
+    if (!valid)
+    {
+        std::cerr << "The shared memory " << name << " is not a query channel of this version.\n";
+        ::close(file);
+        return false;
+    }
+
+    const ChannelLayout layout = get_channel_layout(capacity);
+    data = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    ::close(file);
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Unable to map the shared memory " << name << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    m_name = name;
+    m_owner = false;
+    m_data = static_cast<char*>(data);
+    m_size = layout.size;
+    m_capacity = capacity;
+
+    return true;
+}
+
+void SharedMemoryChannel::close()
+{
+    if (!m_data)
+        return;
+
+    munmap(m_data, m_size);
+
+    if (m_owner)
+        shm_unlink(m_name.c_str());
+
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_owner = false;
+}
+
+bool SharedMemoryChannel::is_open() const
+{
+    return m_data != nullptr;
+}
+
+SharedMemoryHeader& SharedMemoryChannel::get_header() const
+{
+    return *reinterpret_cast<SharedMemoryHeader*>(m_data);
+}
+
+std::size_t SharedMemoryChannel::get_capacity() const
+{
+    return m_capacity;
+}
+
+glm::vec3* SharedMemoryChannel::get_query_points() const
+{
+    return reinterpret_cast<glm::vec3*>(m_data + get_channel_layout(m_capacity).query_points);
+}
+
+float* SharedMemoryChannel::get_max_distances() const
+{
+    return reinterpret_cast<float*>(m_data + get_channel_layout(m_capacity).max_distances);
+}
+
+core::ClosestPointResult* SharedMemoryChannel::get_results() const
+{
+    return reinterpret_cast<core::ClosestPointResult*>(m_data + get_channel_layout(m_capacity).results);
+}
+
+bool* SharedMemoryChannel::get_found() const
+{
+    return reinterpret_cast<bool*>(m_data + get_channel_layout(m_capacity).found);
+}
+
+void wait_for_channel(const std::size_t idle_count)
+{
+    if (idle_count < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+} // namespace server
@@ -0,0 +1,104 @@
+#pragma once
+
+// core includes.
+#include "core/query_engine.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace server
+{
+
+//
+// Shared memory transport of the query server.
+//
+// A POSIX shared memory region holds a ring of query slots: the query
+// point and search distance written by the client, and the result written
+// in place by the query engine. Three cursors split the ring in two
+// single-producer single-consumer rings:
+// - queries in [completed, submitted) are written by the client, waiting for the server;
+// - results in [consumed, completed) are written by the server, waiting for the client.
+// Each side polls the cursors of the other one, nothing goes through the kernel.
+// Both processes must be built from the same sources: records are shared
+// with their in-memory layout.
+//
+
+const std::uint32_t shared_memory_magic = 0x314D5350;  // "PSM1"
+
+struct SharedMemoryHeader
+{
+    std::atomic<std::uint32_t>  magic;          // set last by the server, once the region is ready
+    std::uint32_t               capacity;       // number of slots, a power of 2
+    std::uint32_t               query_size;     // sizeof(glm::vec3)
+    std::uint32_t               result_size;    // sizeof(core::ClosestPointResult)
+
+    // On separate cache lines: each is written by one side only.
+    alignas(64) std::atomic<std::uint64_t>  submitted;          // written by the client
+    alignas(64) std::atomic<std::uint64_t>  completed;          // written by the server
+    alignas(64) std::atomic<std::uint64_t>  consumed;           // written by the client
+
+    alignas(64) std::atomic<std::uint32_t>  client_attached;    // one client at a time
+    std::atomic<std::uint32_t>              server_running;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory cursors must be lock-free");
+
+/**
+ * @brief Mapping of the shared memory region of a channel.
+ */
+class SharedMemoryChannel
+{
+  public:
+    SharedMemoryChannel();
+
+    ~SharedMemoryChannel();
+
+    SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+    SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+    /**
+     * @brief Create the region, replacing a stale one. The server owns it and removes it when closed.
+     *
+     * `capacity` is rounded up to a power of 2. Return false if it failed, with the reason on stderr.
+     */
+    bool create(const std::string& name, const std::size_t capacity);
+
+    /**
+     * @brief Map the region created by the server. Return false if it failed, with the reason on stderr.
+     */
+    bool open(const std::string& name);
+
+    void close();
+
+    bool is_open() const;
+
+    SharedMemoryHeader& get_header() const;
+
+    std::size_t get_capacity() const;
+
+    // Slot arrays, `capacity` entries each.
+    glm::vec3*                  get_query_points() const;
+    float*                      get_max_distances() const;
+    core::ClosestPointResult*   get_results() const;
+    bool*                       get_found() const;
+
+  private:
+    std::string     m_name;
+    bool            m_owner;
+    char*           m_data;
+    std::size_t     m_size;
+    std::size_t     m_capacity;
+};
+
+/**
+ * @brief Wait a little longer each time the other side has nothing new.
+ *
+ * Yield first, then sleep: polling stays cheap when the channel is idle.
+ */
+void wait_for_channel(const std::size_t idle_count);
+
+} // namespace server
@@ -0,0 +1,184 @@
+#include "shared_memory_client.h"
+
+// Standard includes.
+#include <algorithm>
+#include <iostream>
+
+namespace server
+{
+
+SharedMemoryClient::SharedMemoryClient()
+  : m_submitted(0)
+  , m_consumed(0)
+{
+}
+
+SharedMemoryClient::~SharedMemoryClient()
+{
+    disconnect();
+}
+
+bool SharedMemoryClient::connect(const std::string& name)
+{
+    disconnect();
+
+    if (!m_channel.open(name))
+        return false;
+
+    SharedMemoryHeader& header = m_channel.get_header();
+
+    std::uint32_t attached = 0;
+    if (!header.client_attached.compare_exchange_strong(attached, 1))
+    {
+        std::cerr << "The shared memory " << name << " is already used by another client.\n";
+        m_channel.close();
+        return false;
+    }
+
+    // The previous client left no pending query.
+    m_submitted = header.submitted.load(std::memory_order_relaxed);
+    m_consumed = header.consumed.load(std::memory_order_relaxed);
+
+    return true;
+}
+
+void SharedMemoryClient::disconnect()
+{
+    if (!m_channel.is_open())
+        return;
+
+    // Drop the pending results, so that the next client starts with an empty ring.
+    SharedMemoryHeader& header = m_channel.get_header();
+    std::size_t idle_count = 0;
+
+    while (m_consumed != m_submitted && is_server_running())
+    {
+        const core::ClosestPointResult* results;
+        const bool* found;
+        const std::size_t count = get_completed_results(results, found);
+
+        if (count > 0)
+            release_results(count);
+        else
+            wait_for_channel(idle_count++);
+    }
+
+    header.client_attached.store(0, std::memory_order_release);
+    m_channel.close();
+}
+
+bool SharedMemoryClient::is_connected() const
+{
+    return m_channel.is_open();
+}
+
+bool SharedMemoryClient::is_server_running() const
+{
+    return m_channel.get_header().server_running.load(std::memory_order_acquire) != 0;
+}
+
+std::size_t SharedMemoryClient::get_capacity() const
+{
+    return m_channel.get_capacity();
+}
+
+std::size_t SharedMemoryClient::acquire_query_slots(glm::vec3*& query_points, float*& max_distances)
+{
+    const std::size_t capacity = m_channel.get_capacity();
+    const std::size_t first = static_cast<std::size_t>(m_submitted & (capacity - 1));
+    const std::size_t free_count = capacity - static_cast<std::size_t>(m_submitted - m_consumed);
+
+    query_points = m_channel.get_query_points() + first;
+    max_distances = m_channel.get_max_distances() + first;
+
+    return std::min(free_count, capacity - first);
+}
+
+void SharedMemoryClient::submit_queries(const std::size_t count)
+{
+    m_submitted += count;
+    m_channel.get_header().submitted.store(m_submitted, std::memory_order_release);
+}
+
+std::size_t SharedMemoryClient::get_completed_results(const core::ClosestPointResult*& results, const bool*& found)
+{
+    const std::size_t capacity = m_channel.get_capacity();
+    const std::size_t first = static_cast<std::size_t>(m_consumed & (capacity - 1));
+    const std::uint64_t completed = m_channel.get_header().completed.load(std::memory_order_acquire);
+
+    results = m_channel.get_results() + first;
+    found = m_channel.get_found() + first;
+
+    return std::min(static_cast<std::size_t>(completed - m_consumed), capacity - first);
+}
+
+void SharedMemoryClient::release_results(const std::size_t count)
+{
+    m_consumed += count;
+    m_channel.get_header().consumed.store(m_consumed, std::memory_order_release);
+}
+
+bool SharedMemoryClient::get_closest_points(
+    const glm::vec3*            query_points,
+    const std::size_t           count,
+    const float                 max_distance,
+    core::ClosestPointResult*   results,
+    bool*                       found)
+{
+    std::size_t submitted_count = 0;
+    std::size_t received_count = 0;
+    std::size_t idle_count = 0;
+
+    while (received_count < count)
+    {
+        bool progress = false;
+
+        // Fill the free slots.
+        glm::vec3* slot_points;
+        float* slot_max_distances;
+        const std::size_t slot_count = std::min(
+            acquire_query_slots(slot_points, slot_max_distances),
+            count - submitted_count);
+
+        if (slot_count > 0)
+        {
+            std::copy(query_points + submitted_count, query_points + submitted_count + slot_count, slot_points);
+            std::fill(slot_max_distances, slot_max_distances + slot_count, max_distance);
+            submit_queries(slot_count);
+            submitted_count += slot_count;
+            progress = true;
+        }
+
+        // Read the completed results.
+        const core::ClosestPointResult* slot_results;
+        const bool* slot_found;
+        const std::size_t result_count = get_completed_results(slot_results, slot_found);
+
+        if (result_count > 0)
+        {
+            for (std::size_t i = 0; i < result_count; ++i)
+            {
+                if (slot_found[i])
+                    results[received_count + i] = slot_results[i];
+
+                if (found)
+                    found[received_count + i] = slot_found[i];
+            }
+
+            release_results(result_count);
+            received_count += result_count;
+            progress = true;
+        }
+
+        if (progress)
+            idle_count = 0;
+        else if (!is_server_running())
+            return false;
+        else
+            wait_for_channel(idle_count++);
+    }
+
+    return true;
+}
+
+} // namespace server
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "shared_memory_channel.h"
+
+// core includes.
+#include "core/query_engine.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace server
+{
+
+/**
+ * @brief Client side of a shared memory channel.
+ *
+ * Queries can be written directly in the shared slots
+ * (`acquire_query_slots` then `submit_queries`) and results read in place
+ * (`get_completed_results` then `release_results`), or copied with
+ * `get_closest_points`. Results come back in submission order.
+ * Not thread-safe: a single thread submits and receives.
+ */
+class SharedMemoryClient
+{
+  public:
+    SharedMemoryClient();
+
+    ~SharedMemoryClient();
+
+    SharedMemoryClient(const SharedMemoryClient&) = delete;
+    SharedMemoryClient& operator=(const SharedMemoryClient&) = delete;
+
+    /**
+     * @brief Attach to the channel of a server. Return false if it failed, with the reason on stderr.
+     */
+    bool connect(const std::string& name);
+
+    /**
+     * @brief Wait for the pending results, then detach.
+     */
+    void disconnect();
+
+    bool is_connected() const;
+
+    /**
+     * @brief Return false once the server stopped, pending queries won't complete.
+     */
+    bool is_server_running() const;
+
+    std::size_t get_capacity() const;
+
+    /**
+     * @brief Free contiguous slots to write queries in. Return their number, possibly 0.
+     *
+     * Slots with a search distance that isn't positive find nothing.
+     */
+    std::size_t acquire_query_slots(glm::vec3*& query_points, float*& max_distances);
+
+    /**
+     * @brief Hand the first `count` acquired slots to the server.
+     */
+    void submit_queries(const std::size_t count);
+
+    /**
+     * @brief Contiguous completed results, in submission order. Return their number, possibly 0.
+     *
+     * `found` tells which results are valid.
+     */
+    std::size_t get_completed_results(const core::ClosestPointResult*& results, const bool*& found);
+
+    /**
+     * @brief Give the first `count` completed slots back, they can be reused for new queries.
+     */
+    void release_results(const std::size_t count);
+
+    /**
+     * @brief Run `count` queries of any size, streaming them through the ring.
+     *
+     * Same as `ClosestPointQuery::get_closest_points`. Return false if the
+     * server stopped before all the results came back. No query submitted
+     * through the slots must be pending.
+     */
+    bool get_closest_points(
+        const glm::vec3*            query_points,
+        const std::size_t           count,
+        const float                 max_distance,
+        core::ClosestPointResult*   results,
+        bool*                       found);
+
+  private:
+    SharedMemoryChannel     m_channel;
+    std::uint64_t           m_submitted;    // local copies of the cursors owned by the client
+    std::uint64_t           m_consumed;
+};
+
+} // namespace server
@@ -0,0 +1,144 @@
+#include "shared_memory_server.h"
+
+// core includes.
+#include "core/closest_point_query.h"
+#include "core/trace.h"
+
+// Standard includes.
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <vector>
+
+namespace server
+{
+
+SharedMemoryQueryServer::SharedMemoryQueryServer(
+    const core::ClosestPointQuery&      query,
+    const SharedMemoryServerSettings&   settings)
+  : m_settings(settings)
+  , m_async_query(query)
+  , m_stopping(false)
+{
+}
+
+bool SharedMemoryQueryServer::create()
+{
+    if (!m_channel.create(m_settings.name, m_settings.capacity))
+        return false;
+
+    // Clients can submit queries right away, they are served once `run` starts.
+    m_channel.get_header().server_running.store(1, std::memory_order_release);
+
+    std::cout << "Serving shared memory " << m_settings.name
+        << " (" << m_channel.get_capacity() << " query slots).\n";
+    return true;
+}
+
+void SharedMemoryQueryServer::run()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    SharedMemoryHeader& header = m_channel.get_header();
+    const std::size_t capacity = m_channel.get_capacity();
+
+    glm::vec3* query_points = m_channel.get_query_points();
+    const float* max_distances = m_channel.get_max_distances();
+    core::ClosestPointResult* results = m_channel.get_results();
+    bool* found = m_channel.get_found();
+
+    std::vector<std::future<std::size_t>> futures;
+    std::size_t idle_count = 0;
+
+    // Metrics since the last report.
+    Clock::time_point report_time = Clock::now();
+    std::size_t query_count = 0;
+    std::size_t batch_count = 0;
+
+    while (!m_stopping)
+    {
+        const std::uint64_t completed = header.completed.load(std::memory_order_relaxed);
+        const std::uint64_t submitted = header.submitted.load(std::memory_order_acquire);
+
+        if (submitted == completed)
+        {
+            wait_for_channel(idle_count++);
+        }
+        else
+        {
+            CORE_TRACE_SCOPE("shared memory batch");
+
+            idle_count = 0;
+
+            // Contiguous slots only: the end of the ring is run first.
+            const std::size_t first = static_cast<std::size_t>(completed & (capacity - 1));
+            const std::size_t count = std::min(
+                std::min(static_cast<std::size_t>(submitted - completed), capacity - first),
+                m_settings.max_batch_size);
+
+            // Slots with the same search distance run together on the workers.
+            futures.clear();
+
+            for (std::size_t run_first = first; run_first < first + count;)
+            {
+                // Read once: the client process can write the slots at any time.
+                const float max_distance = max_distances[run_first];
+                std::size_t run_last = run_first + 1;
+
+                while (run_last < first + count && max_distances[run_last] == max_distance)
+                    ++run_last;
+
+                // Slots with a distance the engine can't run (0, negative or NaN) find nothing.
+                if (!(max_distance > 0.0f))
+                {
+                    std::fill(found + run_first, found + run_last, false);
+                    run_first = run_last;
+                    continue;
+                }
+
+                futures.push_back(m_async_query.get_closest_points(
+                    query_points + run_first,
+                    run_last - run_first,
+                    max_distance,
+                    results + run_first,
+                    found + run_first));
+
+                run_first = run_last;
+            }
+
+            for (std::future<std::size_t>& future : futures)
+                future.wait();
+
+            header.completed.store(completed + count, std::memory_order_release);
+
+            query_count += count;
+            batch_count += 1;
+        }
+
+        const Clock::time_point now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - report_time).count();
+
+        if (m_settings.report_interval > 0.0 && elapsed >= m_settings.report_interval)
+        {
+            if (query_count > 0)
+            {
+                std::cout << "Shared memory: " << query_count << " queries in " << batch_count << " batches"
+                    << " (" << (query_count / elapsed) << " queries/s).\n";
+            }
+
+            report_time = now;
+            query_count = 0;
+            batch_count = 0;
+        }
+    }
+
+    header.server_running.store(0, std::memory_order_release);
+}
+
+void SharedMemoryQueryServer::stop()
+{
+    m_stopping = true;
+}
+
+} // namespace server
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "shared_memory_channel.h"
+
+// core includes.
+#include "core/async_query.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace core { class ClosestPointQuery; }
+
+namespace server
+{
+
+struct SharedMemoryServerSettings
+{
+    std::string     name = "/closest_point_queries";
+
+    // Query slots of the ring, rounded up to a power of 2.
+    std::size_t     capacity = 1 << 17;
+
+    // Results are published every this many queries, so the client can read them early.
+    std::size_t     max_batch_size = 4096;
+
+    // Seconds between two metrics reports, 0 to disable.
+    double          report_interval = 5.0;
+};
+
+/**
+ * @brief Serve closest point queries to one client through shared memory.
+ *
+ * The server polls the ring for submitted queries and runs them on the
+ * worker pool of an `AsyncClosestPointQuery`, reading the query points
+ * and writing the results directly in the shared memory slots.
+ */
+class SharedMemoryQueryServer
+{
+  public:
+    SharedMemoryQueryServer(
+        const core::ClosestPointQuery&      query,
+        const SharedMemoryServerSettings&   settings);
+
+    SharedMemoryQueryServer(const SharedMemoryQueryServer&) = delete;
+    SharedMemoryQueryServer& operator=(const SharedMemoryQueryServer&) = delete;
+
+    /**
+     * @brief Create the shared memory region. Return false if it failed, with the reason on stderr.
+     */
+    bool create();
+
+    /**
+     * @brief Serve queries until `stop` is called.
+     */
+    void run();
+
+    /**
+     * @brief Make `run` return. Can be called from any thread, or a signal handler.
+     */
+    void stop();
+
+  private:
+    const SharedMemoryServerSettings    m_settings;
+    core::AsyncClosestPointQuery        m_async_query;
+    SharedMemoryChannel                 m_channel;
+    std::atomic<bool>                   m_stopping;
+};
+
+} // namespace server